@@ -0,0 +1,148 @@
+#pragma once
+
+#include "fsm_state_index.hpp"
+
+#include <stddef.h>
+
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+//状态机确定性分析
+//同一状态下同一触发器可能关联多个转换, Fsm按优先级从高到低(同优先级按添加顺序)尝试
+//AnalyzeDeterminism 把每个(状态, 触发器)组合归为以下几类:
+//- 无条件: 第一个候选没有任何guard, 总是由它执行, 其余候选永远不会被执行
+//- guard互斥: 只有一个带guard的候选, 或者候选只有位掩码guard且两两互斥, 任意时刻至多一个通过, 与尝试顺序无关
+//- 优先级确定: 候选可能同时通过, 但优先级各不相同, 结果由显式优先级决定
+//- 有歧义: 候选可能同时通过且存在相同的优先级, 结果依赖添加顺序
+//冻结布局(FrozenFsm)使用同样的分类为每个状态自动选择最快的合法分派方式;
+//Fsm::Execute 不做这一分类, 总是按尝试顺序逐个比较触发器, 需要直接分派时应冻结为 FrozenFsm
+
+namespace fsm
+{
+    //(状态, 触发器)组合的分类
+    enum TriggerGroupKind
+    {
+        FSM_GROUP_UNCONDITIONAL = 0,
+        FSM_GROUP_GUARDED_EXCLUSIVE,
+        FSM_GROUP_PRIORITIZED,
+        FSM_GROUP_AMBIGUOUS
+    };
+
+    //确定性分析的结果, 每个(状态, 触发器)组合一项
+    template <typename State, typename Trigger>
+    struct TriggerGroupReport
+    {
+        State state;
+        Trigger trigger;
+        TriggerGroupKind kind;
+        size_t candidates;//候选转换个数
+    };
+
+    //转换是否没有任何guard
+    template <typename Trans>
+    bool IsUnguarded(const Trans& transition)
+    {
+        return !transition.guardfn && transition.maskguard.Empty();
+    }
+
+    //两个位掩码guard是否不可能同时通过; 自身矛盾的掩码永远不会通过, 与任何掩码互斥
+    inline bool MaskGuardsExclusive(const MaskGuard& a, const MaskGuard& b)
+    {
+        return ((a.required & b.forbidden) | (a.forbidden & b.required)
+            | (a.required & a.forbidden) | (b.required & b.forbidden)) != 0;
+    }
+
+    //对同一(状态, 触发器)按尝试顺序排列的候选转换分类, *it为指向转换的指针
+    template <typename It>
+    TriggerGroupKind ClassifyTriggerGroup(It first, It last)
+    {
+        if (first == last || IsUnguarded(**first))
+        {
+            return FSM_GROUP_UNCONDITIONAL;
+        }
+
+        if (std::next(first) == last)
+        {
+            return FSM_GROUP_GUARDED_EXCLUSIVE;//只有一个带guard的候选
+        }
+
+        bool exclusive = true;
+        bool distinct_priority = true;
+        for (It a = first; a != last; ++a)
+        {
+            if ((*a)->guardfn)
+            {
+                exclusive = false;//guard函数不透明, 无法证明互斥
+            }
+
+            for (It b = first; b != a; ++b)
+            {
+                if (!MaskGuardsExclusive((*a)->maskguard, (*b)->maskguard))
+                {
+                    exclusive = false;
+                }
+                if ((*a)->priority == (*b)->priority)
+                {
+                    distinct_priority = false;
+                }
+            }
+        }
+
+        if (exclusive)
+        {
+            return FSM_GROUP_GUARDED_EXCLUSIVE;
+        }
+        return distinct_priority ? FSM_GROUP_PRIORITIZED : FSM_GROUP_AMBIGUOUS;
+    }
+
+    //分类是否说明该组合的执行结果与同优先级的添加顺序无关
+    inline bool IsDeterministic(TriggerGroupKind kind)
+    {
+        return kind != FSM_GROUP_AMBIGUOUS;
+    }
+
+    //分析状态机定义中的每个(状态, 触发器)组合, 按状态和触发器在状态内首次出现的顺序给出
+    //definition可以是Fsm, 也可以是按传入状态分组好的FsmBuilder; 触发器需要可以作为哈希表的键
+    template <typename Definition>
+    auto AnalyzeDeterminism(const Definition& definition)
+        -> std::vector<TriggerGroupReport<
+            typename std::decay<decltype(definition.GetTransitions().begin()->first)>::type,
+            typename std::decay<decltype(definition.GetTransitions().begin()->second.begin()->trigger)>::type>>
+    {
+        using State = typename std::decay<decltype(definition.GetTransitions().begin()->first)>::type;
+        using Trans = typename std::decay<decltype(*definition.GetTransitions().begin()->second.begin())>::type;
+        using Trigger = decltype(Trans::trigger);
+
+        std::vector<TriggerGroupReport<State, Trigger>> reports;
+        StateIndexer<Trigger> triggers;//所有状态共用的触发器编号
+        std::vector<std::vector<const Trans*>> groups;//按触发器编号收集当前状态的候选, 保持尝试顺序
+        std::vector<StateIndex> order;//当前状态中各触发器首次出现的顺序
+        for (const auto& state_transitions : definition.GetTransitions())
+        {
+            order.clear();
+            for (const auto& transition : state_transitions.second)
+            {
+                StateIndex idx = triggers.Add(transition.trigger);
+                if (idx == groups.size())
+                {
+                    groups.emplace_back();
+                }
+                if (groups[idx].empty())
+                {
+                    order.push_back(idx);
+                }
+                groups[idx].push_back(&transition);
+            }
+
+            for (StateIndex idx : order)
+            {
+                std::vector<const Trans*>& group = groups[idx];
+                reports.push_back({ state_transitions.first, triggers.At(idx),
+                    ClassifyTriggerGroup(group.begin(), group.end()), group.size() });
+                group.clear();
+            }
+        }
+        return reports;
+    }
+}
@@ -0,0 +1,431 @@
+#pragma once
+
+#include "fsm_state_index.hpp"
+
+#include <stdint.h>
+
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+//位并行NFA执行
+//同一状态下同一触发器有多个无guard转换时, Fsm只会选取第一个; 有些场景需要的是NFA语义: 同时跟踪所有可达的状态
+//BitNfa 把活动状态集合表示为位掩码, 最多64 x Words个状态(Words为1或2时即64或128个状态), 每个触发器一步推进整个集合:
+//  next = ((active << 1) & shift[t]) | (active & loop[t]) | 例外转换的后继
+//状态按从初始状态出发的深度优先顺序编号, 使尽可能多的转换成为 i -> i+1 的链式转换, 由移位一次完成(shift-and);
+//自环由loop一次完成; 其余的例外转换按活动的源状态逐个合并预先计算的后继掩码
+//多模式匹配时各模式的链式状态互不干扰, 每个字节只需要几条指令, 而且不会出现DFA的状态爆炸
+//语义为标准NFA: 活动状态在触发器上没有转换时离开活动集合; 需要在输入的任意位置开始匹配时,
+//为初始状态添加所有触发器上的自环即可
+//定义必须无guard, 触发器为整数或枚举类型; 转换上的action函数不会被调用
+
+namespace fsm
+{
+    //Words个64位字组成的状态集合
+    template <size_t Words>
+    struct StateMask
+    {
+        uint64_t words[Words];
+
+        static StateMask None()
+        {
+            StateMask mask;
+            for (size_t w = 0; w < Words; ++w)
+            {
+                mask.words[w] = 0;
+            }
+            return mask;
+        }
+
+        static StateMask Single(StateIndex idx)
+        {
+            StateMask mask = None();
+            mask.Set(idx);
+            return mask;
+        }
+
+        void Set(StateIndex idx)
+        {
+            words[idx >> 6] |= uint64_t(1) << (idx & 63);
+        }
+
+        bool Test(StateIndex idx) const
+        {
+            return ((words[idx >> 6] >> (idx & 63)) & 1) != 0;
+        }
+
+        bool Any() const
+        {
+            uint64_t bits = 0;
+            for (size_t w = 0; w < Words; ++w)
+            {
+                bits |= words[w];
+            }
+            return bits != 0;
+        }
+
+        size_t Count() const
+        {
+            size_t count = 0;
+            for (size_t w = 0; w < Words; ++w)
+            {
+                count += static_cast<size_t>(__builtin_popcountll(words[w]));
+            }
+            return count;
+        }
+
+        //左移一位, 低位字的最高位进入高位字
+        StateMask ShiftLeft() const
+        {
+            StateMask mask;
+            uint64_t carry = 0;
+            for (size_t w = 0; w < Words; ++w)
+            {
+                mask.words[w] = (words[w] << 1) | carry;
+                carry = words[w] >> 63;
+            }
+            return mask;
+        }
+
+        StateMask operator&(const StateMask& other) const
+        {
+            StateMask mask;
+            for (size_t w = 0; w < Words; ++w)
+            {
+                mask.words[w] = words[w] & other.words[w];
+            }
+            return mask;
+        }
+
+        StateMask operator|(const StateMask& other) const
+        {
+            StateMask mask;
+            for (size_t w = 0; w < Words; ++w)
+            {
+                mask.words[w] = words[w] | other.words[w];
+            }
+            return mask;
+        }
+
+        StateMask& operator|=(const StateMask& other)
+        {
+            for (size_t w = 0; w < Words; ++w)
+            {
+                words[w] |= other.words[w];
+            }
+            return *this;
+        }
+
+        bool operator==(const StateMask& other) const
+        {
+            for (size_t w = 0; w < Words; ++w)
+            {
+                if (words[w] != other.words[w])
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool operator!=(const StateMask& other) const
+        {
+            return !(*this == other);
+        }
+    };
+
+    template <typename State, State Initial, typename Trigger, size_t Words = 1>
+    class BitNfa
+    {
+    public:
+        using SourceFsm = Fsm<State, Initial, Trigger>;
+        using Mask = StateMask<Words>;
+
+        //支持的最大状态数
+        static const size_t kMaxStates = 64 * Words;
+        //支持的最大触发器序号
+        static const uint64_t kMaxOrdinal = 0xFFFF;
+
+        BitNfa()
+            : indexer_()
+            , symbols_()
+            , steps_(1, StepMasks{ Mask::None(), Mask::None(), Mask::None(), 0 })
+            , exceptions_()
+            , active_(Mask::Single(0))
+        {
+        }
+
+        //由状态机定义构建, 含有guard时返回FSM_GUARDED_TRANSITION, 状态数超过kMaxStates时返回FSM_STATE_LIMIT_EXCEEDED
+        //definition可以是SourceFsm, 也可以是按传入状态分组好的FsmBuilder
+        template <typename Definition>
+        FsmErrors Build(const Definition& definition)
+        {
+            StateIndexer<State> found = IndexDefinitionStates<State, Initial>(definition);
+            if (found.Size() > kMaxStates)
+            {
+                return FSM_STATE_LIMIT_EXCEEDED;
+            }
+
+            //触发器序号映射为连续的符号编号, 符号0保留给没有任何转换的触发器
+            std::vector<uint32_t> symbols;
+            uint32_t symbol_count = 1;
+            std::vector<std::vector<std::pair<StateIndex, uint32_t>>> edges(found.Size());//源状态 -> (目标状态, 符号)
+            for (const auto& state_transitions : definition.GetTransitions())
+            {
+                StateIndex from = found.Find(state_transitions.first);
+                for (const auto& transition : state_transitions.second)
+                {
+                    if (transition.guardfn || !transition.maskguard.Empty())
+                    {
+                        return FSM_GUARDED_TRANSITION;
+                    }
+
+                    uint64_t ordinal = TriggerOrdinal(transition.trigger);
+                    if (ordinal > kMaxOrdinal)
+                    {
+                        return FSM_TRIGGER_OUT_OF_RANGE;
+                    }
+                    if (ordinal >= symbols.size())
+                    {
+                        symbols.resize(ordinal + 1, 0);
+                    }
+                    if (symbols[ordinal] == 0)
+                    {
+                        symbols[ordinal] = symbol_count++;
+                    }
+                    edges[from].emplace_back(found.Find(transition.to_state), symbols[ordinal]);
+                }
+            }
+
+            //深度优先的先序编号: 每个状态第一个未编号的后继紧接着它编号, 形成尽可能长的链
+            StateIndexer<State> indexer;
+            std::vector<StateIndex> number(found.Size(), kInvalidStateIndex);
+            for (StateIndex root = 0; root < found.Size(); ++root)
+            {
+                std::vector<StateIndex> stack(1, root);
+                while (!stack.empty())
+                {
+                    StateIndex s = stack.back();
+                    stack.pop_back();
+                    if (number[s] != kInvalidStateIndex)
+                    {
+                        continue;
+                    }
+                    number[s] = indexer.Add(found.At(s));
+                    for (auto it = edges[s].rbegin(); it != edges[s].rend(); ++it)
+                    {
+                        if (number[it->first] == kInvalidStateIndex)
+                        {
+                            stack.push_back(it->first);
+                        }
+                    }
+                }
+            }
+
+            //把每条转换归入链式移位, 自环或例外
+            std::vector<StepMasks> steps(symbol_count, StepMasks{ Mask::None(), Mask::None(), Mask::None(), 0 });
+            std::vector<Mask> targets(symbol_count * found.Size(), Mask::None());
+            for (StateIndex s = 0; s < found.Size(); ++s)
+            {
+                StateIndex from = number[s];
+                for (const auto& edge : edges[s])
+                {
+                    StateIndex to = number[edge.first];
+                    StepMasks& step = steps[edge.second];
+                    if (to == from + 1)
+                    {
+                        step.shift.Set(to);
+                    }
+                    else if (to == from)
+                    {
+                        step.loop.Set(to);
+                    }
+                    else
+                    {
+                        step.except.Set(from);
+                        targets[edge.second * found.Size() + from].Set(to);
+                    }
+                }
+            }
+
+            //例外后继按符号、源状态编号顺序连续存放, 通过例外掩码中的排名定位
+            std::vector<Mask> exceptions;
+            for (uint32_t symbol = 0; symbol < symbol_count; ++symbol)
+            {
+                StepMasks& step = steps[symbol];
+                step.offset = static_cast<uint32_t>(exceptions.size());
+                for (StateIndex from = 0; from < found.Size(); ++from)
+                {
+                    if (step.except.Test(from))
+                    {
+                        exceptions.push_back(targets[symbol * found.Size() + from]);
+                    }
+                }
+            }
+
+            indexer_ = std::move(indexer);
+            symbols_.swap(symbols);
+            steps_.swap(steps);
+            exceptions_.swap(exceptions);
+            active_ = Mask::Single(0);
+            return FSM_SUCCESS;
+        }
+
+        size_t StateCount() const
+        {
+            return indexer_.Size();
+        }
+
+        //返回状态对应的位序号, 初始状态为0
+        StateIndex FindState(State s) const
+        {
+            return indexer_.Find(s);
+        }
+
+        State StateAt(StateIndex idx) const
+        {
+            return indexer_.At(idx);
+        }
+
+        //由一组状态构造掩码, 未知的状态被忽略
+        Mask MaskOf(std::initializer_list<State> states) const
+        {
+            Mask mask = Mask::None();
+            for (State s : states)
+            {
+                StateIndex idx = indexer_.Find(s);
+                if (idx != kInvalidStateIndex)
+                {
+                    mask.Set(idx);
+                }
+            }
+            return mask;
+        }
+
+        //重置为只有初始状态活动
+        void Reset()
+        {
+            active_ = Mask::Single(0);
+        }
+
+        const Mask& Active() const
+        {
+            return active_;
+        }
+
+        void SetActive(const Mask& active)
+        {
+            active_ = active;
+        }
+
+        bool IsActive(State s) const
+        {
+            StateIndex idx = indexer_.Find(s);
+            return idx != kInvalidStateIndex && active_.Test(idx);
+        }
+
+        //活动集合中没有任何状态时, 后续的触发器都不会再有效果
+        bool Empty() const
+        {
+            return !active_.Any();
+        }
+
+        //计算active在trigger上的后继集合
+        Mask Step(const Mask& active, Trigger trigger) const
+        {
+            uint64_t ordinal = TriggerOrdinal(trigger);
+            const StepMasks& step = steps_[ordinal < symbols_.size() ? symbols_[ordinal] : 0];
+
+            Mask next = (active.ShiftLeft() & step.shift) | (active & step.loop);
+            uint32_t rank = step.offset;
+            for (size_t w = 0; w < Words; ++w)
+            {
+                uint64_t except = step.except.words[w];
+                for (uint64_t bits = active.words[w] & except; bits != 0; bits &= bits - 1)
+                {
+                    uint64_t below = except & ((bits & (~bits + 1)) - 1);
+                    next |= exceptions_[rank + static_cast<uint32_t>(__builtin_popcountll(below))];
+                }
+                rank += static_cast<uint32_t>(__builtin_popcountll(except));
+            }
+            return next;
+        }
+
+        //推进活动集合, 没有任何活动状态有转换时返回FSM_NO_MATCHING_TRIGGER, 此时活动集合变为空
+        FsmErrors Execute(Trigger trigger)
+        {
+            active_ = Step(active_, trigger);
+            return active_.Any() ? FSM_SUCCESS : FSM_NO_MATCHING_TRIGGER;
+        }
+
+        //从start出发处理整段输入, 返回结束时的活动集合
+        Mask Run(const Trigger* data, size_t len, const Mask& start) const
+        {
+            Mask active = start;
+            for (size_t i = 0; i < len; ++i)
+            {
+                active = Step(active, data[i]);
+            }
+            return active;
+        }
+
+        Mask Run(const Trigger* data, size_t len) const
+        {
+            return Run(data, len, Mask::Single(0));
+        }
+
+        //多模式匹配: 从当前活动集合出发处理输入, 每当活动集合与accept相交时调用fn(位置, 相交的状态集合),
+        //位置为匹配结束处的下标; 返回调用次数, 处理完后更新活动集合
+        template <typename Fn>
+        size_t Scan(const Trigger* data, size_t len, const Mask& accept, Fn&& fn)
+        {
+            size_t hits = 0;
+            Mask active = active_;
+            for (size_t i = 0; i < len; ++i)
+            {
+                active = Step(active, data[i]);
+                Mask matched = active & accept;
+                if (matched.Any())
+                {
+                    fn(i, matched);
+                    ++hits;
+                }
+            }
+            active_ = active;
+            return hits;
+        }
+
+        //按组件估算的内存占用; instance_bytes 为每个实例保存的活动状态掩码
+        MemoryReport MemoryUsage() const
+        {
+            MemoryReport report;
+            report.Add("object", sizeof(*this));
+            report.Add("state_index", indexer_.MemoryBytes());
+            report.Add("symbols", detail::VectorBytes(symbols_));
+            report.Add("steps", detail::VectorBytes(steps_) + detail::VectorBytes(exceptions_));
+            report.instance_bytes = sizeof(Mask);
+            return report;
+        }
+
+    private:
+        //一个符号的推进掩码
+        struct StepMasks
+        {
+            Mask shift;//链式转换 i -> i+1 的目标状态
+            Mask loop;//自环状态
+            Mask except;//有例外转换的源状态
+            uint32_t offset;//例外后继在exceptions_中的起始位置
+        };
+
+        StateIndexer<State> indexer_;
+        std::vector<uint32_t> symbols_;//触发器序号 -> 符号编号
+        std::vector<StepMasks> steps_;
+        std::vector<Mask> exceptions_;
+        Mask active_;
+    };
+
+    template <typename State, State Initial, typename Trigger, size_t Words>
+    const size_t BitNfa<State, Initial, Trigger, Words>::kMaxStates;
+    template <typename State, State Initial, typename Trigger, size_t Words>
+    const uint64_t BitNfa<State, Initial, Trigger, Words>::kMaxOrdinal;
+}
@@ -0,0 +1,233 @@
+#pragma once
+
+#include "fsm_state_index.hpp"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+//大规模转换定义的批量构建器
+//Fsm::AddTransitions 从initializer_list逐个复制转换(包括其中的std::function), 并逐个追加到各状态的vector中
+//FsmBuilder 以移动方式接收转换, 先统计每个状态的转换数, 再用一次计数排序把同一传入状态的转换
+//排列为连续区间(同一状态内按优先级从高到低, 同优先级保持添加顺序), 最后一次性移动到 Fsm 中, 或者直接从连续区间构建冻结表示:
+//  FsmBuilder<S, I, T> builder;
+//  builder.Reserve(n);
+//  builder.Add({ from, to, trigger, nullptr, nullptr });
+//  builder.Emit(byte_dfa);//ByteDfa, TriggerBitsets 等
+//  builder.Build(fsm);
+
+namespace fsm
+{
+    template <typename State, State Initial, typename Trigger>
+    class FsmBuilder
+    {
+    public:
+        using Machine = Fsm<State, Initial, Trigger>;
+        using Trans = typename Machine::Trans;
+
+        //同一传入状态的连续转换区间
+        class TransRange
+        {
+        public:
+            TransRange(Trans* first, Trans* last)
+                : first_(first)
+                , last_(last)
+            {
+            }
+
+            Trans* begin() const
+            {
+                return first_;
+            }
+
+            Trans* end() const
+            {
+                return last_;
+            }
+
+            size_t size() const
+            {
+                return static_cast<size_t>(last_ - first_);
+            }
+
+        private:
+            Trans* first_;
+            Trans* last_;
+        };
+
+        using StateRange = std::pair<State, TransRange>;
+
+        FsmBuilder()
+            : transitions_()
+            , groups_()
+            , grouped_(true)
+        {
+        }
+
+        //预留count个转换的空间
+        void Reserve(size_t count)
+        {
+            transitions_.reserve(count);
+        }
+
+        void Add(Trans&& transition)
+        {
+            transitions_.push_back(std::move(transition));
+            grouped_ = false;
+        }
+
+        void Add(const Trans& transition)
+        {
+            transitions_.push_back(transition);
+            grouped_ = false;
+        }
+
+        //添加一组转换, 传入move_iterator时转换会被移动
+        template <typename InputIt>
+        void AddTransitions(InputIt start, InputIt end)
+        {
+            transitions_.insert(transitions_.end(), start, end);
+            grouped_ = false;
+        }
+
+        //移动整个vector中的转换, 构建器为空时直接接管其存储
+        void AddTransitions(std::vector<Trans>&& transitions)
+        {
+            if (transitions_.empty())
+            {
+                transitions_.swap(transitions);
+            }
+            else
+            {
+                AddTransitions(std::make_move_iterator(transitions.begin()), std::make_move_iterator(transitions.end()));
+            }
+            grouped_ = false;
+            transitions.clear();
+        }
+
+        //已添加的转换数
+        size_t Size() const
+        {
+            return transitions_.size();
+        }
+
+        //把转换按传入状态排列为连续区间, 重复调用时只在有新转换后重新排列
+        void Group()
+        {
+            if (grouped_)
+            {
+                return;
+            }
+
+            //统计各传入状态的转换数, 状态按首次出现的顺序编号
+            StateIndexer<State> indexer;
+            std::vector<StateIndex> slots(transitions_.size());
+            std::vector<size_t> offsets;
+            for (size_t i = 0; i < transitions_.size(); ++i)
+            {
+                StateIndex idx = indexer.Add(transitions_[i].from_state);
+                if (idx == offsets.size())
+                {
+                    offsets.push_back(0);
+                }
+                slots[i] = idx;
+                ++offsets[idx];
+            }
+
+            //计数转换为各区间的起始位置
+            size_t position = 0;
+            for (auto& offset : offsets)
+            {
+                size_t count = offset;
+                offset = position;
+                position += count;
+            }
+
+            //稳定的计数排序, 同一状态内保持添加顺序
+            std::vector<size_t> order(transitions_.size());
+            std::vector<size_t> cursor(offsets);
+            for (size_t i = 0; i < transitions_.size(); ++i)
+            {
+                order[cursor[slots[i]]++] = i;
+            }
+
+            std::vector<Trans> sorted;
+            sorted.reserve(transitions_.size());
+            for (size_t i : order)
+            {
+                sorted.push_back(std::move(transitions_[i]));
+            }
+            transitions_.swap(sorted);
+
+            groups_.clear();
+            groups_.reserve(offsets.size());
+            Trans* base = transitions_.data();
+            for (StateIndex idx = 0; idx < offsets.size(); ++idx)
+            {
+                size_t last = (idx + 1 < offsets.size()) ? offsets[idx + 1] : transitions_.size();
+                //与 Fsm 的尝试顺序一致
+                if (!std::is_sorted(base + offsets[idx], base + last, Machine::HigherPriority))
+                {
+                    std::stable_sort(base + offsets[idx], base + last, Machine::HigherPriority);
+                }
+                groups_.emplace_back(indexer.At(idx), TransRange(base + offsets[idx], base + last));
+            }
+            grouped_ = true;
+        }
+
+        //返回按传入状态分组的转换, 形式与 Fsm::GetTransitions 一致
+        //调用前需要先调用Group; 之后再添加转换会使区间失效, 需要重新Group
+        const std::vector<StateRange>& GetTransitions() const
+        {
+            assert(grouped_ && "FsmBuilder::GetTransitions before Group");
+            return groups_;
+        }
+
+        //从连续区间直接构建冻结表示, 例如 ByteDfa, TriggerBitsets
+        template <typename Frozen>
+        FsmErrors Emit(Frozen& frozen)
+        {
+            Group();
+            return frozen.Build(*this);
+        }
+
+        //把所有转换移动到状态机中, 每个状态只查找一次并一次性预留空间; 完成后构建器被清空
+        void Build(Machine& machine)
+        {
+            Group();
+            machine.ReserveStates(machine.GetTransitions().size() + groups_.size());
+            for (const auto& group : groups_)
+            {
+                machine.AddTransitions(group.first,
+                    std::make_move_iterator(group.second.begin()), std::make_move_iterator(group.second.end()));
+            }
+            Clear();
+        }
+
+        void Clear()
+        {
+            transitions_.clear();
+            groups_.clear();
+            grouped_ = true;
+        }
+
+        //按组件估算的内存占用, 不含std::function捕获的对象
+        MemoryReport MemoryUsage() const
+        {
+            MemoryReport report;
+            report.Add("object", sizeof(*this));
+            report.Add("transitions", detail::VectorBytes(transitions_));
+            report.Add("groups", detail::VectorBytes(groups_));
+            return report;
+        }
+
+    private:
+        std::vector<Trans> transitions_;//Group之后同一传入状态的转换连续存放
+        std::vector<StateRange> groups_;
+        bool grouped_;
+    };
+}
@@ -0,0 +1,274 @@
+#pragma once
+
+#include "fsm_state_index.hpp"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <bitset>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+//字节流DFA
+//把无guard(包括位掩码guard)的 Fsm<State, Initial, char> 冻结为 状态数 x 256 的稠密转换表, 每个字节只需一次查表
+//语义与逐字节调用 Fsm::Execute 相同: 没有匹配的转换时状态保持不变,
+//同一状态下同一触发器有多个转换时取最先添加的一个
+//冻结表只描述状态的变化, 转换上的action函数不会被调用
+//
+//并行模式(RunParallel)把输入切分为若干块, 除第一块外, 每一块都从所有可能的起始状态出发推测执行,
+//得到 起始状态 -> 结束状态 的映射, 最后按顺序复合各块映射得到结束状态
+//推测执行中不同起始状态一旦汇合到同一状态就合并为一条, 多数DFA很快收敛, 推测代价接近单次运行
+
+namespace fsm
+{
+    template <typename State, State Initial>
+    class ByteDfa
+    {
+    public:
+        using SourceFsm = Fsm<State, Initial, char>;
+
+        ByteDfa()
+            : indexer_()
+            , table_()
+        {
+        }
+
+        //由状态机定义构建转换表, 定义中含有guard函数时返回FSM_GUARDED_TRANSITION
+        //definition可以是SourceFsm, 也可以是按传入状态分组好的FsmBuilder
+        template <typename Definition>
+        FsmErrors Build(const Definition& definition)
+        {
+            StateIndexer<State> indexer = IndexDefinitionStates<State, Initial>(definition);
+            size_t state_count = indexer.Size();
+
+            //表项存储的是目标状态的行偏移(编号 * 256), 查表时省去一次乘法
+            std::vector<uint32_t> table(state_count * kAlphabetSize);
+            for (size_t s = 0; s < state_count; ++s)
+            {
+                std::fill_n(table.begin() + static_cast<std::ptrdiff_t>(s * kAlphabetSize),
+                    kAlphabetSize, static_cast<uint32_t>(s * kAlphabetSize));
+            }
+
+            for (const auto& state_transitions : definition.GetTransitions())
+            {
+                size_t row = indexer.Find(state_transitions.first) * kAlphabetSize;
+                std::bitset<kAlphabetSize> assigned;
+                for (const auto& transition : state_transitions.second)
+                {
+                    if (transition.guardfn || !transition.maskguard.Empty())
+                    {
+                        return FSM_GUARDED_TRANSITION;
+                    }
+
+                    unsigned char byte = static_cast<unsigned char>(transition.trigger);
+                    if (assigned[byte])
+                    {
+                        continue;//保持与Execute一致, 先添加的转换优先
+                    }
+                    assigned[byte] = true;
+                    table[row + byte] = static_cast<uint32_t>(indexer.Find(transition.to_state) * kAlphabetSize);
+                }
+            }
+
+            indexer_ = std::move(indexer);
+            table_.swap(table);
+            return FSM_SUCCESS;
+        }
+
+        //状态数
+        size_t StateCount() const
+        {
+            return indexer_.Size();
+        }
+
+        //返回状态对应的编号, 初始状态编号为0
+        StateIndex FindState(State s) const
+        {
+            return indexer_.Find(s);
+        }
+
+        //返回编号对应的状态
+        State StateAt(StateIndex idx) const
+        {
+            return indexer_.At(idx);
+        }
+
+        //单步转换
+        StateIndex Step(StateIndex from, char byte) const
+        {
+            return table_[from * kAlphabetSize + static_cast<unsigned char>(byte)] / kAlphabetSize;
+        }
+
+        //从start出发顺序处理data, 返回结束状态编号
+        StateIndex Run(const char* data, size_t len, StateIndex start = 0) const
+        {
+            const uint32_t* table = table_.data();
+            uint32_t offset = start * kAlphabetSize;
+            for (size_t i = 0; i < len; ++i)
+            {
+                offset = table[offset + static_cast<unsigned char>(data[i])];
+            }
+            return offset / kAlphabetSize;
+        }
+
+        //从每个状态出发处理data, 返回以起始状态编号为下标的结束状态编号
+        std::vector<StateIndex> RunFromAllStates(const char* data, size_t len) const
+        {
+            size_t state_count = StateCount();
+            const uint32_t* table = table_.data();
+
+            //lanes保存去重后仍在推进的各条执行路径的当前偏移, lane_of记录每个起始状态所在的路径
+            std::vector<uint32_t> lanes(state_count);
+            std::vector<uint32_t> lane_of(state_count);
+            for (size_t s = 0; s < state_count; ++s)
+            {
+                lanes[s] = static_cast<uint32_t>(s * kAlphabetSize);
+                lane_of[s] = static_cast<uint32_t>(s);
+            }
+
+            std::vector<uint32_t> owner(state_count, kNoLane);
+            std::vector<uint32_t> remap;
+            for (size_t pos = 0; pos < len; pos += kMergeInterval)
+            {
+                size_t end = std::min(len, pos + kMergeInterval);
+                for (auto& lane : lanes)
+                {
+                    uint32_t offset = lane;
+                    for (size_t i = pos; i < end; ++i)
+                    {
+                        offset = table[offset + static_cast<unsigned char>(data[i])];
+                    }
+                    lane = offset;
+                }
+
+                if (lanes.size() == 1)
+                {
+                    continue;
+                }
+
+                //合并到达同一状态的路径
+                remap.resize(lanes.size());
+                size_t unique = 0;
+                for (size_t l = 0; l < lanes.size(); ++l)
+                {
+                    uint32_t state = lanes[l] / kAlphabetSize;
+                    if (owner[state] == kNoLane)
+                    {
+                        owner[state] = static_cast<uint32_t>(unique);
+                        lanes[unique++] = lanes[l];
+                    }
+                    remap[l] = owner[state];
+                }
+
+                for (size_t l = 0; l < unique; ++l)
+                {
+                    owner[lanes[l] / kAlphabetSize] = kNoLane;
+                }
+
+                if (unique != lanes.size())
+                {
+                    lanes.resize(unique);
+                    for (auto& lane : lane_of)
+                    {
+                        lane = remap[lane];
+                    }
+                }
+            }
+
+            std::vector<StateIndex> result(state_count);
+            for (size_t s = 0; s < state_count; ++s)
+            {
+                result[s] = lanes[lane_of[s]] / kAlphabetSize;
+            }
+            return result;
+        }
+
+        //多线程处理data, 结果与Run相同
+        //threads为0时使用硬件线程数; 输入过短时退化为顺序执行
+        StateIndex RunParallel(const char* data, size_t len, StateIndex start = 0, size_t threads = 0) const
+        {
+            if (threads == 0)
+            {
+                threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+            }
+
+            size_t chunk_count = std::min(threads, len / kMinChunkSize);
+            if (chunk_count <= 1)
+            {
+                return Run(data, len, start);
+            }
+
+            size_t chunk_size = len / chunk_count;
+            std::vector<std::vector<StateIndex>> mappings(chunk_count);
+            std::vector<std::thread> workers;
+            workers.reserve(chunk_count - 1);
+            bool spawn = true;
+            for (size_t c = 1; c < chunk_count; ++c)
+            {
+                size_t begin = c * chunk_size;
+                size_t size = (c + 1 == chunk_count) ? len - begin : chunk_size;
+                auto work = [this, &mappings, data, begin, size, c] {
+                    mappings[c] = RunFromAllStates(data + begin, size);
+                };
+                if (spawn)
+                {
+                    try
+                    {
+                        workers.emplace_back(work);
+                        continue;
+                    }
+                    catch (const std::system_error&)
+                    {
+                        spawn = false;//无法再创建线程, 剩余的块由当前线程执行, 已启动的线程照常汇合
+                    }
+                }
+                work();
+            }
+
+            //第一块的起始状态已知, 由当前线程直接执行
+            StateIndex state = Run(data, chunk_size, start);
+            for (auto& worker : workers)
+            {
+                worker.join();
+            }
+
+            for (size_t c = 1; c < chunk_count; ++c)
+            {
+                state = mappings[c][state];
+            }
+            return state;
+        }
+
+        //按组件估算的内存占用; instance_bytes 为每个实例保存的状态编号
+        MemoryReport MemoryUsage() const
+        {
+            MemoryReport report;
+            report.Add("object", sizeof(*this));
+            report.Add("state_index", indexer_.MemoryBytes());
+            report.Add("table", detail::VectorBytes(table_));
+            report.instance_bytes = sizeof(StateIndex);
+            return report;
+        }
+
+    private:
+        static const uint32_t kAlphabetSize = 256;
+        //推测执行时每处理这么多字节尝试合并一次路径
+        static const size_t kMergeInterval = 256;
+        //每个线程至少处理的字节数
+        static const size_t kMinChunkSize = 16 * 1024;
+        static const uint32_t kNoLane = 0xFFFFFFFFu;
+
+        StateIndexer<State> indexer_;
+        std::vector<uint32_t> table_;//状态数 x 256, 表项为目标状态的行偏移
+    };
+
+    template <typename State, State Initial>
+    const uint32_t ByteDfa<State, Initial>::kAlphabetSize;
+    template <typename State, State Initial>
+    const size_t ByteDfa<State, Initial>::kMergeInterval;
+    template <typename State, State Initial>
+    const size_t ByteDfa<State, Initial>::kMinChunkSize;
+    template <typename State, State Initial>
+    const uint32_t ByteDfa<State, Initial>::kNoLane;
+}
@@ -0,0 +1,411 @@
+#pragma once
+
+#include "fsmcpp.hpp"
+
+#include <stdint.h>
+
+#include <cassert>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#if !defined(__cpp_impl_coroutine) || !defined(__has_include)
+#error "fsm_coro.hpp requires C++20 coroutines, configure with -DFSM_ENABLE_COROUTINES=ON"
+#elif !__has_include(<coroutine>)
+#error "fsm_coro.hpp requires the <coroutine> header"
+#endif
+
+#include <coroutine>
+
+//可挂起的异步状态机(C++20, 可选)
+//转换的action可以是协程, 在其中 co_await 异步操作(I/O完成、定时器等)而不阻塞执行线程:
+//  machine.AddTransitions({
+//      { IDLE, CONNECTED, CONNECT, nullptr, [&]() -> fsm::FsmTask { co_await socket.Connect(); } },
+//  });
+//执行过程:
+//- 触发器匹配且guard通过后调用action; action在第一个co_await处挂起时, 状态机进入挂起状态:
+//  IsSuspended()为true, GetState()仍为传入状态, GetTarget()为转换后的状态
+//- action完成(协程结束)时提交转换: 状态改为传出状态, 调用调试函数, 再依次执行挂起期间排队的触发器
+//- 挂起期间(以及在action内部)发送的触发器排队, Execute返回FSM_TRIGGER_QUEUED;
+//  排队的触发器执行结果不是FSM_SUCCESS时调用SetRejectFn设置的函数
+//- action没有挂起就结束时与同步action相同, 转换立即提交
+//AsyncFsm不是线程安全的: 被等待的异步操作需要在拥有状态机的线程上恢复协程(例如投递到该线程的事件循环),
+//提交转换和执行排队的触发器都在恢复协程的调用中进行
+//状态机析构时销毁尚未完成的action协程, 此后被等待的操作不能再恢复它
+//协程中不能抛出异常, 未处理的异常直接终止程序
+//核心的 Fsm 仍然只需要C++14, 本文件只在 FSM_ENABLE_COROUTINES 打开时编译
+
+namespace fsm
+{
+    //异步action的返回类型; 协程创建后先挂起, 由AsyncFsm启动
+    class FsmTask
+    {
+    public:
+        struct promise_type
+        {
+            void (*on_done)(void*) = nullptr;//协程结束时的通知, 由AsyncFsm设置
+            void* context = nullptr;
+
+            FsmTask get_return_object()
+            {
+                return FsmTask(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+
+            std::suspend_always initial_suspend() noexcept
+            {
+                return {};
+            }
+
+            //协程已经挂起在最终挂起点, 通知中可以销毁协程
+            struct FinalAwaiter
+            {
+                bool await_ready() noexcept
+                {
+                    return false;
+                }
+
+                void await_suspend(std::coroutine_handle<promise_type> h) noexcept
+                {
+                    promise_type& promise = h.promise();
+                    if (promise.on_done != nullptr)
+                    {
+                        promise.on_done(promise.context);
+                    }
+                }
+
+                void await_resume() noexcept
+                {
+                }
+            };
+
+            FinalAwaiter final_suspend() noexcept
+            {
+                return {};
+            }
+
+            void return_void()
+            {
+            }
+
+            void unhandled_exception()
+            {
+                std::terminate();
+            }
+        };
+
+        using Handle = std::coroutine_handle<promise_type>;
+
+        FsmTask()
+            : handle_(nullptr)
+        {
+        }
+
+        explicit FsmTask(Handle handle)
+            : handle_(handle)
+        {
+        }
+
+        FsmTask(FsmTask&& other) noexcept
+            : handle_(std::exchange(other.handle_, nullptr))
+        {
+        }
+
+        FsmTask& operator=(FsmTask&& other) noexcept
+        {
+            if (this != &other)
+            {
+                Reset();
+                handle_ = std::exchange(other.handle_, nullptr);
+            }
+            return *this;
+        }
+
+        FsmTask(const FsmTask&) = delete;
+        FsmTask& operator=(const FsmTask&) = delete;
+
+        ~FsmTask()
+        {
+            Reset();
+        }
+
+        bool Valid() const
+        {
+            return static_cast<bool>(handle_);
+        }
+
+        //交出协程的所有权
+        Handle Release()
+        {
+            return std::exchange(handle_, nullptr);
+        }
+
+    private:
+        void Reset()
+        {
+            if (handle_)
+            {
+                handle_.destroy();
+                handle_ = nullptr;
+            }
+        }
+
+        Handle handle_;
+    };
+
+    template <typename State, State Initial, typename Trigger>
+    class AsyncFsm
+    {
+    public:
+        using Definition = Fsm<State, Initial, Trigger>;
+        using GuardFn = typename Definition::GuardFn;
+        using AsyncActionFn = std::function<FsmTask()>;//异步操作函数类型, 返回协程
+        using DebugFn = typename Definition::DebugFn;
+        //排队的触发器执行结果不是FSM_SUCCESS时调用, 参数为触发器和返回值
+        using RejectFn = std::function<void(Trigger, FsmErrors)>;
+
+        //与 Fsm::Trans 相同, 只是action为协程
+        struct Trans
+        {
+            State from_state;//传入(初始)状态
+            State to_state;//传出(转换后)状态
+            Trigger trigger;//触发器
+            GuardFn guardfn;//保护函数
+            AsyncActionFn actionfn;//异步操作函数
+            MaskGuard maskguard = MaskGuard{ 0, 0 };//位掩码保护
+            int32_t priority = 0;//优先级
+        };
+
+        AsyncFsm()
+            : definition_()
+            , actions_()
+            , state_(Initial)
+            , target_(Initial)
+            , trigger_()
+            , fired_(kNoAction)
+            , task_(nullptr)
+            , running_(false)
+            , queued_()
+            , head_(0)
+            , debug_fn_(nullptr)
+            , reject_fn_(nullptr)
+            , flags_(nullptr)
+        {
+        }
+
+        //action中捕获了this, 不能复制或移动
+        AsyncFsm(const AsyncFsm&) = delete;
+        AsyncFsm& operator=(const AsyncFsm&) = delete;
+
+        ~AsyncFsm()
+        {
+            if (task_)
+            {
+                task_.destroy();
+            }
+        }
+
+        //向状态机添加一组转换定义; 挂起时也可以添加, actions_中已有的action地址不变, 挂起的协程仍能访问它的捕获
+        template <typename InputIt>
+        void AddTransitions(InputIt start, InputIt end)
+        {
+            std::vector<typename Definition::Trans> wrapped;
+            for (InputIt it = start; it != end; ++it)
+            {
+                //同步部分只记录命中的转换, 异步action在Dispatch中启动
+                size_t index = actions_.size();
+                actions_.push_back((*it).actionfn);
+                wrapped.push_back(typename Definition::Trans{ (*it).from_state, (*it).to_state, (*it).trigger,
+                    (*it).guardfn, [this, index] { fired_ = index; }, (*it).maskguard, (*it).priority });
+            }
+            definition_.AddTransitions(wrapped);
+        }
+
+        template <typename Coll>
+        void AddTransitions(Coll&& c)
+        {
+            AddTransitions(std::begin(c), std::end(c));
+        }
+
+        void AddTransitions(std::initializer_list<Trans>&& i)
+        {
+            AddTransitions(std::begin(i), std::end(i));
+        }
+
+        //转换提交(action完成)时调用, 参数为 from_state, to_state, trigger
+        void AddDebugFn(DebugFn fn)
+        {
+            debug_fn_ = std::move(fn);
+        }
+
+        void SetRejectFn(RejectFn fn)
+        {
+            reject_fn_ = std::move(fn);
+        }
+
+        //绑定位掩码guard使用的标志字, 见 Fsm::BindFlags
+        void BindFlags(const GuardFlags* flags)
+        {
+            flags_ = flags;
+        }
+
+        //执行触发器; 状态机挂起或正在执行action时排队并返回FSM_TRIGGER_QUEUED
+        FsmErrors Execute(Trigger trigger)
+        {
+            if (running_ || task_)
+            {
+                queued_.push_back(trigger);
+                return FSM_TRIGGER_QUEUED;
+            }
+            FsmErrors err_code = Dispatch(trigger);
+            Drain();
+            return err_code;
+        }
+
+        //重置当前状态; 挂起时不能调用(调试构建中断言, 发布构建中忽略)
+        void Reset(State s = Initial)
+        {
+            assert(!task_ && "AsyncFsm::Reset while suspended");
+            if (task_)
+            {
+                return;
+            }
+            state_ = s;
+        }
+
+        //返回当前状态, 挂起时为转换的传入状态
+        State GetState() const
+        {
+            return state_;
+        }
+
+        //挂起时返回转换后将进入的状态, 否则与GetState()相同
+        State GetTarget() const
+        {
+            return task_ ? target_ : state_;
+        }
+
+        //是否在等待异步action完成
+        bool IsSuspended() const
+        {
+            return static_cast<bool>(task_);
+        }
+
+        //排队等待执行的触发器数
+        size_t Pending() const
+        {
+            return queued_.size() - head_;
+        }
+
+        const Definition& GetDefinition() const
+        {
+            return definition_;
+        }
+
+    private:
+        static constexpr size_t kNoAction = ~size_t(0);
+
+        //离开Dispatch时清除running_, guard、action工厂或调试函数抛出异常时状态机仍然可用
+        struct RunningScope
+        {
+            bool& running;
+
+            explicit RunningScope(bool& flag)
+                : running(flag)
+            {
+                running = true;
+            }
+
+            ~RunningScope()
+            {
+                running = false;
+            }
+        };
+
+        //执行一个触发器, 不处理队列
+        FsmErrors Dispatch(Trigger trigger)
+        {
+            RunningScope scope(running_);
+            fired_ = kNoAction;
+            State next = state_;
+            FsmErrors err_code = definition_.Execute(next, trigger, flags_ ? *flags_ : 0);
+            if (fired_ == kNoAction)
+            {
+                return err_code;//没有匹配的触发器或guard不通过
+            }
+
+            target_ = next;
+            trigger_ = trigger;
+            FsmTask task = actions_[fired_] ? actions_[fired_]() : FsmTask();
+            if (!task.Valid())
+            {
+                Commit();
+            }
+            else
+            {
+                task_ = task.Release();
+                task_.promise().on_done = &AsyncFsm::OnDone;
+                task_.promise().context = this;
+                task_.resume();//没有挂起就结束时已经在OnDone中提交
+            }
+            return err_code;
+        }
+
+        //action协程结束
+        static void OnDone(void* context)
+        {
+            AsyncFsm* self = static_cast<AsyncFsm*>(context);
+            self->task_.destroy();
+            self->task_ = nullptr;
+            self->Commit();
+            if (!self->running_)
+            {
+                self->Drain();
+            }
+        }
+
+        void Commit()
+        {
+            State from = state_;
+            state_ = target_;
+            if (debug_fn_)
+            {
+                debug_fn_(from, target_, trigger_);
+            }
+        }
+
+        //依次执行排队的触发器, 直到队列为空或再次挂起
+        void Drain()
+        {
+            while (!task_ && head_ < queued_.size())
+            {
+                Trigger trigger = queued_[head_++];
+                if (head_ == queued_.size())
+                {
+                    queued_.clear();
+                    head_ = 0;
+                }
+                FsmErrors err_code = Dispatch(trigger);
+                if (err_code != FSM_SUCCESS && reject_fn_)
+                {
+                    reject_fn_(trigger, err_code);
+                }
+            }
+        }
+
+        Definition definition_;
+        std::deque<AsyncActionFn> actions_;//按添加顺序保存的异步action; 协程lambda的捕获在其中, 添加时不能移动已有元素
+        State state_;//当前状态
+        State target_;//挂起的转换的传出状态
+        Trigger trigger_;//挂起的转换的触发器
+        size_t fired_;//本次执行命中的转换, kNoAction表示没有转换
+        FsmTask::Handle task_;//正在等待的action协程
+        bool running_;//正在Dispatch中
+        std::vector<Trigger> queued_;//排队的触发器, head_之前的已经执行
+        size_t head_;
+        DebugFn debug_fn_;
+        RejectFn reject_fn_;
+        const GuardFlags* flags_;
+    };
+}
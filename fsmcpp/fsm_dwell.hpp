@@ -0,0 +1,406 @@
+#pragma once
+
+#include "fsm_state_index.hpp"
+
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+//按状态统计停留时间
+//容量规划需要知道实例在每个状态(例如HANDSHAKE)中停留了多久
+//- TscClock 读取CPU时间戳计数器, 一次读取只需要几纳秒; 非x86平台退化为steady_clock的纳秒数
+//- DwellHistogram 是HDR风格的对数-线性直方图: 值按最高位分组, 每组再均分为32格, 相对误差不超过1/32,
+//  记录是O(1)的位运算, 直方图之间可以直接按格相加
+//- DwellTracker 按定义统计, 所有实例汇总到同一组直方图; 每个实例只需额外保存一个进入当前状态的时间戳(Stamp)
+//  每个线程通过自己的 Recorder 句柄记录, 写入句柄独占的计数器, 不加锁也没有原子读改写;
+//  Snapshot 在任意时刻合并所有句柄(包括已经析构的)的计数
+//只有状态发生变化时才记录离开的状态的停留时间; 自转换和被guard阻止的触发器不算离开
+
+namespace fsm
+{
+    class TscClock
+    {
+    public:
+        static uint64_t Now()
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            return __rdtsc();
+#else
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+        }
+
+        //每纳秒的计数, 第一次调用时对照steady_clock校准(约10毫秒)
+        static double TicksPerNanosecond()
+        {
+            static const double rate = Calibrate();
+            return rate;
+        }
+
+        static double ToNanoseconds(uint64_t ticks)
+        {
+            return static_cast<double>(ticks) / TicksPerNanosecond();
+        }
+
+    private:
+        static double Calibrate()
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            using Clock = std::chrono::steady_clock;
+            Clock::time_point start = Clock::now();
+            uint64_t begin = Now();
+            Clock::time_point end = start;
+            while (end - start < std::chrono::milliseconds(10))
+            {
+                end = Clock::now();
+            }
+            uint64_t ticks = Now() - begin;
+            double ns = std::chrono::duration<double, std::nano>(end - start).count();
+            return ticks > 0 ? static_cast<double>(ticks) / ns : 1.0;
+#else
+            return 1.0;
+#endif
+        }
+    };
+
+    namespace detail
+    {
+        //直方图每组的格数为2^kDwellSubBits
+        const uint32_t kDwellSubBits = 5;
+        const uint32_t kDwellBuckets = (64 - kDwellSubBits + 1) << kDwellSubBits;
+    }
+
+    class DwellHistogram
+    {
+    public:
+        DwellHistogram()
+            : counts_(detail::kDwellBuckets, 0)
+            , count_(0)
+            , sum_(0)
+            , min_(UINT64_MAX)
+            , max_(0)
+        {
+        }
+
+        //格数
+        static uint32_t BucketCount()
+        {
+            return detail::kDwellBuckets;
+        }
+
+        //值所在的格
+        static uint32_t BucketOf(uint64_t value)
+        {
+            if (value < (uint64_t(1) << detail::kDwellSubBits))
+            {
+                return static_cast<uint32_t>(value);
+            }
+            uint32_t shift = static_cast<uint32_t>(63 - __builtin_clzll(value)) - detail::kDwellSubBits;
+            return ((shift + 1) << detail::kDwellSubBits) + static_cast<uint32_t>((value >> shift) - (uint64_t(1) << detail::kDwellSubBits));
+        }
+
+        //格的下界(含)
+        static uint64_t LowerBound(uint32_t bucket)
+        {
+            uint32_t group = bucket >> detail::kDwellSubBits;
+            uint64_t sub = bucket & ((1u << detail::kDwellSubBits) - 1);
+            if (group == 0)
+            {
+                return sub;
+            }
+            return (sub + (uint64_t(1) << detail::kDwellSubBits)) << (group - 1);
+        }
+
+        //格的上界(含)
+        static uint64_t UpperBound(uint32_t bucket)
+        {
+            return bucket + 1 < detail::kDwellBuckets ? LowerBound(bucket + 1) - 1 : UINT64_MAX;
+        }
+
+        void Record(uint64_t value, uint64_t times = 1)
+        {
+            counts_[BucketOf(value)] += times;
+            count_ += times;
+            sum_ += value * times;
+            min_ = std::min(min_, value);
+            max_ = std::max(max_, value);
+        }
+
+        //按格累加另一个直方图
+        void Merge(const DwellHistogram& other)
+        {
+            for (uint32_t i = 0; i < detail::kDwellBuckets; ++i)
+            {
+                counts_[i] += other.counts_[i];
+            }
+            count_ += other.count_;
+            sum_ += other.sum_;
+            min_ = std::min(min_, other.min_);
+            max_ = std::max(max_, other.max_);
+        }
+
+        uint64_t Count() const
+        {
+            return count_;
+        }
+
+        //没有记录时为0
+        uint64_t Min() const
+        {
+            return count_ == 0 ? 0 : min_;
+        }
+
+        uint64_t Max() const
+        {
+            return max_;
+        }
+
+        double Mean() const
+        {
+            return count_ == 0 ? 0 : static_cast<double>(sum_) / static_cast<double>(count_);
+        }
+
+        //分位数q(0~1)所在格的上界, 不超过最大值
+        uint64_t ValueAtQuantile(double q) const
+        {
+            if (count_ == 0)
+            {
+                return 0;
+            }
+            uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(count_));
+            rank = std::min(std::max<uint64_t>(rank, 1), count_);
+            uint64_t seen = 0;
+            for (uint32_t i = 0; i < detail::kDwellBuckets; ++i)
+            {
+                seen += counts_[i];
+                if (seen >= rank)
+                {
+                    return std::min(UpperBound(i), max_);
+                }
+            }
+            return max_;
+        }
+
+        //按值从小到大遍历非空的格: fn(下界, 上界, 计数), 用于导出
+        template <typename Fn>
+        void ForEach(Fn&& fn) const
+        {
+            for (uint32_t i = 0; i < detail::kDwellBuckets; ++i)
+            {
+                if (counts_[i] != 0)
+                {
+                    fn(LowerBound(i), UpperBound(i), counts_[i]);
+                }
+            }
+        }
+
+    private:
+        template <typename State, State Initial, typename Trigger>
+        friend class DwellTracker;
+
+        std::vector<uint64_t> counts_;
+        uint64_t count_;
+        uint64_t sum_;
+        uint64_t min_;
+        uint64_t max_;
+    };
+
+    template <typename State, State Initial, typename Trigger>
+    class DwellTracker
+    {
+    public:
+        using Definition = Fsm<State, Initial, Trigger>;
+        //实例进入当前状态的时间, TscClock的计数
+        using Stamp = uint64_t;
+
+        class Recorder;
+
+        explicit DwellTracker(const Definition& definition)
+            : definition_(definition)
+            , indexer_(IndexStates(definition))
+            , mutex_()
+            , recorders_()
+            , retired_(indexer_.Size())
+        {
+        }
+
+        DwellTracker(const DwellTracker&) = delete;
+        DwellTracker& operator=(const DwellTracker&) = delete;
+
+        const Definition& GetDefinition() const
+        {
+            return definition_;
+        }
+
+        //合并所有线程记录的状态s的停留时间(TscClock的计数); s不在定义中时返回空直方图
+        DwellHistogram Snapshot(State s) const
+        {
+            DwellHistogram histogram;
+            StateIndex idx = indexer_.Find(s);
+            if (idx == kInvalidStateIndex)
+            {
+                return histogram;
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            histogram.Merge(retired_[idx]);
+            for (const Recorder* recorder : recorders_)
+            {
+                recorder->CollectInto(idx, histogram);
+            }
+            return histogram;
+        }
+
+        //按组件估算的内存占用, 统计用的定义副本计入"definition";
+        //每个句柄为每个状态保留一组计数器; instance_bytes 为每个实例保存的时间戳
+        MemoryReport MemoryUsage() const
+        {
+            const size_t histogram_bytes = detail::kDwellBuckets * sizeof(uint64_t);
+            std::lock_guard<std::mutex> lock(mutex_);
+            MemoryReport report;
+            report.Add("object", sizeof(*this) - sizeof(Definition));
+            report.Add("definition", definition_.MemoryUsage().Total());
+            report.Add("state_index", indexer_.MemoryBytes());
+            report.Add("retired", retired_.size() * (sizeof(DwellHistogram) + histogram_bytes));
+            report.Add("recorders", detail::VectorBytes(recorders_)
+                + recorders_.size() * indexer_.Size() * (sizeof(Counters) + histogram_bytes));
+            report.instance_bytes = sizeof(Stamp);
+            return report;
+        }
+
+        //所有状态的停留时间, 包括没有记录的状态
+        std::vector<std::pair<State, DwellHistogram>> SnapshotAll() const
+        {
+            std::vector<std::pair<State, DwellHistogram>> all;
+            all.reserve(indexer_.Size());
+            for (StateIndex idx = 0; idx < indexer_.Size(); ++idx)
+            {
+                all.emplace_back(indexer_.At(idx), Snapshot(indexer_.At(idx)));
+            }
+            return all;
+        }
+
+    private:
+        //每个格一个计数器, 只由所属线程写入, 其他线程在Snapshot时读取
+        struct Counters
+        {
+            std::unique_ptr<std::atomic<uint64_t>[]> buckets{ new std::atomic<uint64_t>[detail::kDwellBuckets]() };
+            std::atomic<uint64_t> count{ 0 };
+            std::atomic<uint64_t> sum{ 0 };
+            std::atomic<uint64_t> min{ UINT64_MAX };
+            std::atomic<uint64_t> max{ 0 };
+        };
+
+        const Definition definition_;
+        const StateIndexer<State> indexer_;
+        mutable std::mutex mutex_;
+        std::vector<const Recorder*> recorders_;
+        std::vector<DwellHistogram> retired_;//已经析构的句柄的计数, 以状态编号为下标
+    };
+
+    //每个线程一个记录句柄, 不能跨线程使用; 句柄析构时计数并入DwellTracker
+    template <typename State, State Initial, typename Trigger>
+    class DwellTracker<State, Initial, Trigger>::Recorder
+    {
+    public:
+        explicit Recorder(DwellTracker& tracker)
+            : tracker_(tracker)
+            , counters_(tracker.indexer_.Size())
+        {
+            std::lock_guard<std::mutex> lock(tracker_.mutex_);
+            tracker_.recorders_.push_back(this);
+        }
+
+        Recorder(const Recorder&) = delete;
+        Recorder& operator=(const Recorder&) = delete;
+
+        ~Recorder()
+        {
+            std::lock_guard<std::mutex> lock(tracker_.mutex_);
+            for (StateIndex idx = 0; idx < counters_.size(); ++idx)
+            {
+                CollectInto(idx, tracker_.retired_[idx]);
+            }
+            tracker_.recorders_.erase(std::find(tracker_.recorders_.begin(), tracker_.recorders_.end(), this));
+        }
+
+        //实例进入初始状态(或被Reset)时取得时间戳
+        Stamp Enter() const
+        {
+            return TscClock::Now();
+        }
+
+        //以外部保存的状态执行触发器; 状态变化时记录离开的状态的停留时间并更新stamp
+        FsmErrors Execute(State& state, Stamp& stamp, Trigger trigger)
+        {
+            const State from = state;
+            FsmErrors err_code = tracker_.definition_.Execute(state, trigger);
+            if (!(state == from))
+            {
+                Leave(from, stamp);
+            }
+            return err_code;
+        }
+
+        //实例离开状态from, 由其他方式驱动状态变化时调用
+        void Leave(State from, Stamp& stamp)
+        {
+            Stamp now = TscClock::Now();
+            Record(from, now - stamp);
+            stamp = now;
+        }
+
+        //直接记录一次停留时间
+        void Record(State s, uint64_t ticks)
+        {
+            StateIndex idx = tracker_.indexer_.Find(s);
+            if (idx == kInvalidStateIndex)
+            {
+                return;
+            }
+            //只有本线程写入, 用load+store代替读改写
+            Counters& c = counters_[idx];
+            std::atomic<uint64_t>& bucket = c.buckets[DwellHistogram::BucketOf(ticks)];
+            bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            c.count.store(c.count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            c.sum.store(c.sum.load(std::memory_order_relaxed) + ticks, std::memory_order_relaxed);
+            if (ticks < c.min.load(std::memory_order_relaxed))
+            {
+                c.min.store(ticks, std::memory_order_relaxed);
+            }
+            if (ticks > c.max.load(std::memory_order_relaxed))
+            {
+                c.max.store(ticks, std::memory_order_relaxed);
+            }
+        }
+
+    private:
+        friend class DwellTracker;
+
+        //与写入并发时读到的是某个时刻附近的近似值, 各字段之间可能相差正在进行的几次记录
+        void CollectInto(StateIndex idx, DwellHistogram& histogram) const
+        {
+            const Counters& c = counters_[idx];
+            for (uint32_t i = 0; i < detail::kDwellBuckets; ++i)
+            {
+                histogram.counts_[i] += c.buckets[i].load(std::memory_order_relaxed);
+            }
+            histogram.count_ += c.count.load(std::memory_order_relaxed);
+            histogram.sum_ += c.sum.load(std::memory_order_relaxed);
+            histogram.min_ = std::min(histogram.min_, c.min.load(std::memory_order_relaxed));
+            histogram.max_ = std::max(histogram.max_, c.max.load(std::memory_order_relaxed));
+        }
+
+        DwellTracker& tracker_;
+        std::vector<Counters> counters_;//以状态编号为下标
+    };
+}
@@ -0,0 +1,456 @@
+#pragma once
+
+#include "fsm_builder.hpp"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+//可达性分析与状态空间探索
+//ReachabilityExplorer 在编号为[0, N)的隐式状态空间上做多线程的逐层广度优先搜索:
+//- 访问标记是一个原子位集, 每个状态1位, 用fetch_or无锁地认领新状态, 10^8个状态只需约12MB
+//- 每层的前沿按线程分开收集, 下一层再按块分给各线程, 线程之间不共享写入的容器
+//- 设置spill_threshold后, 线程收集的前沿超过阈值时追加到该线程本层的临时文件, 避免前沿占满内存;
+//  每个线程每层最多一个临时文件, 下一层按偏移区间分块并行读回
+//后继函数以 successors(state, emit) 的形式给出, 对每个后继调用 emit(next), 因此同样适用于乘积状态机等不显式存储的状态空间
+//
+//对 Fsm 定义, AnalyzeReachability 给出从初始状态出发的可达状态、不可达状态、陷阱状态和不可达转换数;
+//PruneUnreachable 把可达状态的转换复制到 FsmBuilder 中, 冻结之前剔除不可达的部分以缩小运行时的表
+//guard被视为可能通过, 因此报告的不可达状态一定不可达, 可达状态则是保守的上界
+
+namespace fsm
+{
+    //探索参数
+    struct ExploreOptions
+    {
+        size_t threads = 1;//线程数, 0表示硬件线程数
+        size_t spill_threshold = 0;//每个线程在内存中保留的前沿状态数上限, 0表示不写入临时文件
+    };
+
+    class ReachabilityExplorer
+    {
+    public:
+        explicit ReachabilityExplorer(const ExploreOptions& options = ExploreOptions())
+            : options_(options)
+            , state_count_(0)
+            , visited_()
+            , reachable_(0)
+            , level_sizes_()
+            , spilled_(0)
+        {
+        }
+
+        //从roots出发探索[0, state_count)中的状态, successors(uint64_t state, emit)对每个后继调用emit(uint64_t next)
+        //根或后继超出范围时返回FSM_STATE_LIMIT_EXCEEDED, 临时文件读写失败时返回FSM_IO_ERROR
+        template <typename SuccessorFn>
+        FsmErrors Explore(uint64_t state_count, const std::vector<uint64_t>& roots, SuccessorFn&& successors)
+        {
+            size_t word_count = static_cast<size_t>((state_count + 63) / 64);
+            visited_.reset(new std::atomic<uint64_t>[word_count]);
+            for (size_t w = 0; w < word_count; ++w)
+            {
+                visited_[w].store(0, std::memory_order_relaxed);
+            }
+            state_count_ = state_count;
+            reachable_ = 0;
+            level_sizes_.clear();
+            spilled_ = 0;
+
+            size_t threads = options_.threads;
+            if (threads == 0)
+            {
+                threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+            }
+
+            std::vector<Segment> current(1);
+            for (uint64_t root : roots)
+            {
+                if (root >= state_count)
+                {
+                    return FSM_STATE_LIMIT_EXCEEDED;
+                }
+                if (TryVisit(root))
+                {
+                    current[0].states.push_back(root);
+                }
+            }
+            current[0].count = current[0].states.size();
+
+            std::atomic<bool> out_of_range(false);
+            std::atomic<bool> io_error(false);
+            for (;;)
+            {
+                uint64_t level_size = 0;
+                for (const auto& segment : current)
+                {
+                    level_size += segment.count;
+                }
+                if (level_size == 0)
+                {
+                    break;
+                }
+                level_sizes_.push_back(level_size);
+                reachable_ += level_size;
+
+                //前沿按块切分: 内存中的按下标, 临时文件中的按偏移区间, 线程通过原子游标领取
+                std::vector<WorkItem> items;
+                for (size_t seg = 0; seg < current.size(); ++seg)
+                {
+                    size_t count = static_cast<size_t>(current[seg].count);
+                    size_t chunk = current[seg].file ? kSpillChunkSize : kChunkSize;
+                    for (size_t begin = 0; begin < count; begin += chunk)
+                    {
+                        items.push_back(WorkItem{ seg, begin, std::min(count, begin + chunk) });
+                    }
+                }
+
+                size_t worker_count = std::max<size_t>(1, std::min(threads, items.size()));
+                std::vector<Frontier> next(worker_count);
+                std::atomic<size_t> cursor(0);
+                auto work = [&](size_t t) {
+                    Frontier& frontier = next[t];
+                    auto emit = [&](uint64_t state) {
+                        if (state >= state_count_)
+                        {
+                            out_of_range.store(true, std::memory_order_relaxed);
+                            return;
+                        }
+                        if (TryVisit(state))
+                        {
+                            frontier.states.push_back(state);
+                            if (options_.spill_threshold != 0 && frontier.states.size() >= options_.spill_threshold
+                                && !Spill(frontier))
+                            {
+                                io_error.store(true, std::memory_order_relaxed);
+                            }
+                        }
+                    };
+
+                    std::vector<uint64_t> buffer;
+                    for (size_t i = cursor++; i < items.size(); i = cursor++)
+                    {
+                        const WorkItem& item = items[i];
+                        const Segment& segment = current[item.segment];
+                        if (!segment.file)
+                        {
+                            for (size_t k = item.begin; k < item.end; ++k)
+                            {
+                                successors(segment.states[k], emit);
+                            }
+                            continue;
+                        }
+
+                        //临时文件中的区间分批读回, 定位和读取在文件锁内完成, 展开后继时不持锁
+                        for (size_t begin = item.begin; begin < item.end; begin += buffer.size())
+                        {
+                            buffer.resize(item.end - begin < kChunkSize ? item.end - begin : kChunkSize);
+                            flockfile(segment.file.get());
+                            bool ok = fseek(segment.file.get(), static_cast<long>(begin * sizeof(uint64_t)), SEEK_SET) == 0
+                                && fread(buffer.data(), sizeof(uint64_t), buffer.size(), segment.file.get()) == buffer.size();
+                            funlockfile(segment.file.get());
+                            if (!ok)
+                            {
+                                io_error.store(true, std::memory_order_relaxed);
+                                break;
+                            }
+                            for (uint64_t state : buffer)
+                            {
+                                successors(state, emit);
+                            }
+                        }
+                    }
+                };
+
+                std::vector<std::thread> workers;
+                workers.reserve(worker_count - 1);
+                bool spawn = true;
+                for (size_t t = 1; t < worker_count; ++t)
+                {
+                    if (spawn)
+                    {
+                        try
+                        {
+                            workers.emplace_back(work, t);
+                            continue;
+                        }
+                        catch (const std::system_error&)
+                        {
+                            spawn = false;//无法再创建线程, 没有启动的工作由当前线程执行, 已启动的线程照常汇合
+                        }
+                    }
+                    work(t);
+                }
+                work(0);
+                for (auto& worker : workers)
+                {
+                    worker.join();
+                }
+
+                if (out_of_range.load())
+                {
+                    return FSM_STATE_LIMIT_EXCEEDED;
+                }
+                if (io_error.load())
+                {
+                    return FSM_IO_ERROR;
+                }
+
+                //各线程的前沿(包括写入临时文件的部分)组成下一层, 上一层的临时文件随之关闭
+                std::vector<Segment> level;
+                for (auto& frontier : next)
+                {
+                    if (frontier.spilled.file)
+                    {
+                        level.push_back(std::move(frontier.spilled));
+                    }
+                    level.push_back(Segment());
+                    level.back().count = frontier.states.size();
+                    level.back().states.swap(frontier.states);
+                }
+                current.swap(level);
+            }
+            return FSM_SUCCESS;
+        }
+
+        //状态是否可达
+        bool IsReachable(uint64_t state) const
+        {
+            return state < state_count_ && ((visited_[state / 64].load(std::memory_order_relaxed) >> (state % 64)) & 1) != 0;
+        }
+
+        //可达的状态数
+        uint64_t ReachableCount() const
+        {
+            return reachable_;
+        }
+
+        //广度优先每一层新发现的状态数, 第0层为根
+        const std::vector<uint64_t>& LevelSizes() const
+        {
+            return level_sizes_;
+        }
+
+        //写入过临时文件的前沿状态数
+        uint64_t SpilledStates() const
+        {
+            return spilled_.load();
+        }
+
+    private:
+        struct FileCloser
+        {
+            void operator()(FILE* file) const
+            {
+                fclose(file);
+            }
+        };
+
+        using FilePtr = std::unique_ptr<FILE, FileCloser>;
+
+        //一层前沿的一段, 在内存中或者在临时文件中
+        struct Segment
+        {
+            std::vector<uint64_t> states;
+            FilePtr file;
+            uint64_t count = 0;
+        };
+
+        //一个线程收集的下一层前沿
+        struct Frontier
+        {
+            std::vector<uint64_t> states;
+            Segment spilled;//本层写入临时文件的部分, 第一次超过阈值时才创建文件
+        };
+
+        struct WorkItem
+        {
+            size_t segment;
+            size_t begin;
+            size_t end;
+        };
+
+        //每次领取的前沿状态数
+        static const size_t kChunkSize = 4096;
+        //每次领取的临时文件中的前沿状态数
+        static const size_t kSpillChunkSize = kChunkSize * 16;
+
+        //认领状态, 返回是否是第一次访问
+        bool TryVisit(uint64_t state)
+        {
+            uint64_t bit = uint64_t(1) << (state % 64);
+            if ((visited_[state / 64].load(std::memory_order_relaxed) & bit) != 0)
+            {
+                return false;
+            }
+            return (visited_[state / 64].fetch_or(bit, std::memory_order_relaxed) & bit) == 0;
+        }
+
+        //把线程的前沿追加到它本层的临时文件
+        bool Spill(Frontier& frontier)
+        {
+            Segment& segment = frontier.spilled;
+            if (!segment.file)
+            {
+                segment.file.reset(tmpfile());
+            }
+            if (!segment.file
+                || fwrite(frontier.states.data(), sizeof(uint64_t), frontier.states.size(), segment.file.get()) != frontier.states.size())
+            {
+                frontier.states.clear();
+                return false;
+            }
+            segment.count += frontier.states.size();
+            spilled_ += frontier.states.size();
+            frontier.states.clear();
+            return true;
+        }
+
+        ExploreOptions options_;
+        uint64_t state_count_;
+        std::unique_ptr<std::atomic<uint64_t>[]> visited_;
+        uint64_t reachable_;
+        std::vector<uint64_t> level_sizes_;
+        std::atomic<uint64_t> spilled_;
+    };
+
+    //Fsm定义的可达性报告
+    template <typename State>
+    struct ReachabilityReport
+    {
+        std::vector<State> reachable;//从初始状态可达的状态, 初始状态在最前
+        std::vector<State> unreachable;//不可达的状态
+        std::vector<State> traps;//可达但无法离开的状态: 没有传出转换, 或者所有传出转换都指向自身
+        size_t unreachable_transitions;//从不可达状态出发的转换数
+        FsmErrors error = FSM_SUCCESS;//探索失败(例如临时文件读写失败)时为错误码, 此时各列表为空
+    };
+
+    namespace detail
+    {
+        //把定义转换为以状态编号表示的邻接表, 并从初始状态出发探索
+        template <typename State, State Initial, typename Definition>
+        FsmErrors ExploreDefinition(const Definition& definition, StateIndexer<State>& indexer,
+            ReachabilityExplorer& explorer)
+        {
+            indexer = IndexDefinitionStates<State, Initial>(definition);
+            std::vector<uint32_t> offsets(indexer.Size() + 1, 0);
+            for (const auto& state_transitions : definition.GetTransitions())
+            {
+                offsets[indexer.Find(state_transitions.first) + 1] += static_cast<uint32_t>(state_transitions.second.size());
+            }
+            for (size_t s = 0; s < indexer.Size(); ++s)
+            {
+                offsets[s + 1] += offsets[s];
+            }
+
+            std::vector<uint32_t> targets(offsets.back());
+            for (const auto& state_transitions : definition.GetTransitions())
+            {
+                uint32_t position = offsets[indexer.Find(state_transitions.first)];
+                for (const auto& transition : state_transitions.second)
+                {
+                    targets[position++] = indexer.Find(transition.to_state);
+                }
+            }
+
+            return explorer.Explore(indexer.Size(), std::vector<uint64_t>(1, 0),
+                [&offsets, &targets](uint64_t state, auto&& emit) {
+                    for (uint32_t i = offsets[state]; i < offsets[state + 1]; ++i)
+                    {
+                        emit(targets[i]);
+                    }
+                });
+        }
+    }
+
+    //分析定义中从初始状态出发的可达性
+    //definition可以是Fsm, 也可以是按传入状态分组好的FsmBuilder
+    template <typename State, State Initial, typename Definition>
+    ReachabilityReport<State> AnalyzeDefinitionReachability(const Definition& definition,
+        const ExploreOptions& options = ExploreOptions())
+    {
+        StateIndexer<State> indexer;
+        ReachabilityExplorer explorer(options);
+        ReachabilityReport<State> report;
+        report.unreachable_transitions = 0;
+        report.error = detail::ExploreDefinition<State, Initial>(definition, indexer, explorer);
+        if (report.error != FSM_SUCCESS)
+        {
+            return report;//探索不完整, 不能据此判断不可达
+        }
+
+        std::vector<bool> leaves(indexer.Size(), false);
+        for (const auto& state_transitions : definition.GetTransitions())
+        {
+            StateIndex from = indexer.Find(state_transitions.first);
+            for (const auto& transition : state_transitions.second)
+            {
+                if (!explorer.IsReachable(from))
+                {
+                    ++report.unreachable_transitions;
+                }
+                else if (!(transition.to_state == state_transitions.first))
+                {
+                    leaves[from] = true;
+                }
+            }
+        }
+
+        for (StateIndex s = 0; s < indexer.Size(); ++s)
+        {
+            if (!explorer.IsReachable(s))
+            {
+                report.unreachable.push_back(indexer.At(s));
+                continue;
+            }
+            report.reachable.push_back(indexer.At(s));
+            if (!leaves[s])
+            {
+                report.traps.push_back(indexer.At(s));
+            }
+        }
+        return report;
+    }
+
+    template <typename State, State Initial, typename Trigger>
+    ReachabilityReport<State> AnalyzeReachability(const Fsm<State, Initial, Trigger>& fsm,
+        const ExploreOptions& options = ExploreOptions())
+    {
+        return AnalyzeDefinitionReachability<State, Initial>(fsm, options);
+    }
+
+    //把从初始状态可达的状态的转换复制到builder中, pruned为剔除的转换数
+    //之后可以用 builder.Emit 构建冻结表示, 或者 builder.Build 构建新的 Fsm
+    //探索失败时返回其错误码(例如FSM_IO_ERROR), builder和pruned不变
+    template <typename State, State Initial, typename Trigger, typename Definition>
+    FsmErrors PruneUnreachable(const Definition& definition, FsmBuilder<State, Initial, Trigger>& builder,
+        size_t& pruned, const ExploreOptions& options = ExploreOptions())
+    {
+        StateIndexer<State> indexer;
+        ReachabilityExplorer explorer(options);
+        FsmErrors err_code = detail::ExploreDefinition<State, Initial>(definition, indexer, explorer);
+        if (err_code != FSM_SUCCESS)
+        {
+            return err_code;
+        }
+
+        pruned = 0;
+        for (const auto& state_transitions : definition.GetTransitions())
+        {
+            if (!explorer.IsReachable(indexer.Find(state_transitions.first)))
+            {
+                pruned += static_cast<size_t>(std::distance(state_transitions.second.begin(), state_transitions.second.end()));
+                continue;
+            }
+            builder.AddTransitions(state_transitions.second.begin(), state_transitions.second.end());
+        }
+        return FSM_SUCCESS;
+    }
+}
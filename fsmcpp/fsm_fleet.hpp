@@ -0,0 +1,257 @@
+#pragma once
+
+#include "fsm_state_index.hpp"
+
+#include <stdint.h>
+
+#include <utility>
+#include <vector>
+
+//按状态分桶的状态机实例容器
+//容器内的所有实例共享同一份状态机定义, 每个实例只保存自己的状态编号和两个链表指针
+//每个状态维护一个侵入式双向链表和实例计数, 在Execute中状态发生变化时增量更新
+//因此 "向状态S中的所有实例广播触发器T" 以及 "各状态的实例数" 的代价只与涉及的实例数成正比
+
+namespace fsm
+{
+    //实例编号类型
+    using InstanceId = uint32_t;
+    //无效的实例编号
+    const InstanceId kInvalidInstanceId = std::numeric_limits<InstanceId>::max();
+
+    template <typename State, State Initial, typename Trigger>
+    class FsmFleet
+    {
+    public:
+        using Definition = Fsm<State, Initial, Trigger>;
+
+        explicit FsmFleet(const Definition& definition)
+            : definition_(definition)
+            , indexer_(IndexStates(definition))
+            , instances_()
+            , buckets_(indexer_.Size())
+            , free_head_(kInvalidInstanceId)
+            , size_(0)
+            , scratch_()
+        {
+        }
+
+        //返回共享的状态机定义
+        const Definition& GetDefinition() const
+        {
+            return definition_;
+        }
+
+        //添加一个处于状态s的实例, 返回实例编号; 已删除实例的编号会被复用
+        InstanceId Add(State s = Initial)
+        {
+            InstanceId id = free_head_;
+            if (id == kInvalidInstanceId)
+            {
+                id = static_cast<InstanceId>(instances_.size());
+                instances_.push_back(Instance{ kInvalidStateIndex, kInvalidInstanceId, kInvalidInstanceId });
+            }
+            else
+            {
+                free_head_ = instances_[id].next;
+            }
+
+            Link(id, IndexOf(s));
+            ++size_;
+            return id;
+        }
+
+        //删除实例
+        void Remove(InstanceId id)
+        {
+            Unlink(id);
+            instances_[id].state = kInvalidStateIndex;
+            instances_[id].next = free_head_;
+            free_head_ = id;
+            --size_;
+        }
+
+        //实例总数
+        size_t Size() const
+        {
+            return size_;
+        }
+
+        //返回实例的当前状态
+        State GetState(InstanceId id) const
+        {
+            return indexer_.At(instances_[id].state);
+        }
+
+        //重置实例的状态, 默认为初始态
+        void Reset(InstanceId id, State s = Initial)
+        {
+            StateIndex idx = IndexOf(s);
+            if (idx != instances_[id].state)
+            {
+                Unlink(id);
+                Link(id, idx);
+            }
+        }
+
+        //对单个实例执行触发器, 状态改变时把实例移动到新状态的桶中
+        FsmErrors Execute(InstanceId id, Trigger trigger)
+        {
+            const State from = indexer_.At(instances_[id].state);
+            State state = from;
+            FsmErrors err_code = definition_.Execute(state, trigger);
+
+            //自转换不需要移动, 只有状态变化时才查找新状态的编号
+            if (!(state == from))
+            {
+                Unlink(id);
+                Link(id, IndexOf(state));
+            }
+            return err_code;
+        }
+
+        //向所有处于状态s的实例执行触发器, 返回执行结果为FSM_SUCCESS的实例数
+        //执行前先复制一份成员列表, 执行过程中实例在桶之间移动不影响遍历
+        size_t Broadcast(State s, Trigger trigger)
+        {
+            StateIndex idx = indexer_.Find(s);
+            if (idx == kInvalidStateIndex)
+            {
+                return 0;
+            }
+
+            scratch_.clear();
+            for (InstanceId id = buckets_[idx].head; id != kInvalidInstanceId; id = instances_[id].next)
+            {
+                scratch_.push_back(id);
+            }
+
+            size_t succeeded = 0;
+            for (InstanceId id : scratch_)
+            {
+                if (Execute(id, trigger) == FSM_SUCCESS)
+                {
+                    ++succeeded;
+                }
+            }
+            return succeeded;
+        }
+
+        //对所有处于状态s的实例调用fn(InstanceId), fn中不能修改实例状态
+        template <typename Fn>
+        void ForEachIn(State s, Fn&& fn) const
+        {
+            StateIndex idx = indexer_.Find(s);
+            if (idx == kInvalidStateIndex)
+            {
+                return;
+            }
+
+            for (InstanceId id = buckets_[idx].head; id != kInvalidInstanceId; id = instances_[id].next)
+            {
+                fn(id);
+            }
+        }
+
+        //返回处于状态s的实例数
+        size_t Count(State s) const
+        {
+            StateIndex idx = indexer_.Find(s);
+            return idx == kInvalidStateIndex ? 0 : buckets_[idx].count;
+        }
+
+        //返回各状态的实例数, 包括实例数为0的已知状态
+        std::vector<std::pair<State, size_t>> Histogram() const
+        {
+            std::vector<std::pair<State, size_t>> histogram;
+            histogram.reserve(buckets_.size());
+            for (StateIndex idx = 0; idx < buckets_.size(); ++idx)
+            {
+                histogram.emplace_back(indexer_.At(idx), buckets_[idx].count);
+            }
+            return histogram;
+        }
+
+        //按组件估算的内存占用, 共享的定义计入"definition"; instance_bytes 为每个实例的链表节点
+        MemoryReport MemoryUsage() const
+        {
+            MemoryReport report;
+            report.Add("object", sizeof(*this) - sizeof(Definition));
+            report.Add("definition", definition_.MemoryUsage().Total());
+            report.Add("state_index", indexer_.MemoryBytes());
+            report.Add("instances", detail::VectorBytes(instances_));
+            report.Add("buckets", detail::VectorBytes(buckets_));
+            report.Add("scratch", detail::VectorBytes(scratch_));
+            report.instance_bytes = sizeof(Instance);
+            return report;
+        }
+
+    private:
+        struct Instance
+        {
+            StateIndex state;//kInvalidStateIndex表示实例已删除
+            InstanceId prev;
+            InstanceId next;//已删除的实例用next串成空闲链表
+        };
+
+        struct Bucket
+        {
+            InstanceId head = kInvalidInstanceId;
+            size_t count = 0;
+        };
+
+        //返回状态编号, 定义中没有出现过的状态(例如Reset到的状态)在此时编号
+        StateIndex IndexOf(State s)
+        {
+            StateIndex idx = indexer_.Add(s);
+            if (idx >= buckets_.size())
+            {
+                buckets_.resize(idx + 1);
+            }
+            return idx;
+        }
+
+        void Link(InstanceId id, StateIndex idx)
+        {
+            Instance& instance = instances_[id];
+            Bucket& bucket = buckets_[idx];
+            instance.state = idx;
+            instance.prev = kInvalidInstanceId;
+            instance.next = bucket.head;
+            if (bucket.head != kInvalidInstanceId)
+            {
+                instances_[bucket.head].prev = id;
+            }
+            bucket.head = id;
+            ++bucket.count;
+        }
+
+        void Unlink(InstanceId id)
+        {
+            Instance& instance = instances_[id];
+            Bucket& bucket = buckets_[instance.state];
+            if (instance.prev != kInvalidInstanceId)
+            {
+                instances_[instance.prev].next = instance.next;
+            }
+            else
+            {
+                bucket.head = instance.next;
+            }
+
+            if (instance.next != kInvalidInstanceId)
+            {
+                instances_[instance.next].prev = instance.prev;
+            }
+            --bucket.count;
+        }
+
+        Definition definition_;
+        StateIndexer<State> indexer_;
+        std::vector<Instance> instances_;
+        std::vector<Bucket> buckets_;//以状态编号为下标
+        InstanceId free_head_;//空闲实例链表
+        size_t size_;
+        std::vector<InstanceId> scratch_;//Broadcast时复制的成员列表
+    };
+}
@@ -0,0 +1,505 @@
+#pragma once
+
+#include "fsm_analysis.hpp"
+#include "fsm_state_index.hpp"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+//冷热分离的冻结状态机
+//Fsm::Trans 把热字段(from_state, to_state, trigger)和两个32字节以上的std::function放在一起,
+//Execute扫描候选转换时大部分读入缓存的都是冷数据
+//FrozenFsm 把每个状态的候选转换排列为连续区间, 触发器键和目标状态编号分别存放在紧凑的数组中,
+//guard和action存放在单独的冷数组里, 只有触发器匹配时才会访问
+//触发器键数组支持用SIMD一次比较一个状态的多个候选触发器
+//位掩码guard与触发器键并列存放, 对一组候选转换无分支地一次求值, 只有通过的候选才会调用guard函数
+//构建时对每个状态做确定性分析(见fsm_analysis.hpp), 所有(状态, 触发器)组合都确定且触发器键足够稠密的状态
+//使用直接分派: 以触发器键为下标一次查表找到候选组, 无条件组直接执行; 其余状态使用SIMD扫描
+//语义与 Fsm::Execute 相同, 只适用于整数或枚举类型的触发器
+
+namespace fsm
+{
+    namespace detail
+    {
+        //在连续的触发器键中比较key, 返回匹配位掩码, 第i位对应keys[i]
+        //kKeys为一次比较的键个数, 读取可能越过区间末尾, 调用方需保证有足够的填充并屏蔽多余的位
+        template <size_t Width>
+        struct KeyBlock
+        {
+            enum { kKeys = 1 };
+
+            template <typename Key>
+            static uint32_t Match(const Key* keys, Key key)
+            {
+                return keys[0] == key ? 1u : 0u;
+            }
+        };
+
+#if defined(__SSE2__)
+        template <>
+        struct KeyBlock<1>
+        {
+            enum { kKeys = 16 };
+
+            template <typename Key>
+            static uint32_t Match(const Key* keys, Key key)
+            {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys));
+                __m128i eq = _mm_cmpeq_epi8(block, _mm_set1_epi8(static_cast<char>(key)));
+                return static_cast<uint32_t>(_mm_movemask_epi8(eq));
+            }
+        };
+
+        template <>
+        struct KeyBlock<2>
+        {
+            enum { kKeys = 8 };
+
+            template <typename Key>
+            static uint32_t Match(const Key* keys, Key key)
+            {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys));
+                __m128i eq = _mm_cmpeq_epi16(block, _mm_set1_epi16(static_cast<short>(key)));
+                //每个16位比较结果压缩为一个字节, 使每个键对应掩码中的一位
+                return static_cast<uint32_t>(_mm_movemask_epi8(_mm_packs_epi16(eq, _mm_setzero_si128())));
+            }
+        };
+
+        template <>
+        struct KeyBlock<4>
+        {
+            enum { kKeys = 4 };
+
+            template <typename Key>
+            static uint32_t Match(const Key* keys, Key key)
+            {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys));
+                __m128i eq = _mm_cmpeq_epi32(block, _mm_set1_epi32(static_cast<int>(key)));
+                return static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(eq)));
+            }
+        };
+#endif
+    }
+
+    template <typename State, State Initial, typename Trigger>
+    class FrozenFsm
+    {
+    public:
+        using SourceFsm = Fsm<State, Initial, Trigger>;
+        using GuardFn = typename SourceFsm::GuardFn;
+        using ActionFn = typename SourceFsm::ActionFn;
+        using DebugFn = typename SourceFsm::DebugFn;
+        //触发器键, 为触发器底层类型对应的无符号类型
+        using Key = typename std::make_unsigned<typename UnderlyingInteger<Trigger>::type>::type;
+
+        //未构建时只有一个没有转换的初始状态
+        FrozenFsm()
+            : indexer_()
+            , offsets_(1, 0)
+            , keys_(kKeyPadding, 0)
+            , targets_()
+            , masks_(kKeyPadding, MaskGuard{ 0, 0 })
+            , cold_()
+            , dispatch_()
+            , direct_()
+            , current_state_(0)
+            , debug_fn_(nullptr)
+            , flags_(nullptr)
+        {
+            current_state_ = IndexOf(Initial);
+        }
+
+        //由状态机定义构建冻结布局, 同一状态内候选转换按触发器键稳定排序, 同一触发器的候选保持定义中的尝试顺序
+        //definition可以是SourceFsm, 也可以是按传入状态分组好的FsmBuilder
+        template <typename Definition>
+        FsmErrors Build(const Definition& definition)
+        {
+            StateIndexer<State> indexer = IndexDefinitionStates<State, Initial>(definition);
+
+            //按状态编号找到每个状态的转换列表
+            using TransList = typename std::decay<decltype(definition.GetTransitions().begin()->second)>::type;
+            std::vector<const TransList*> lists(indexer.Size(), nullptr);
+            size_t total = 0;
+            for (const auto& state_transitions : definition.GetTransitions())
+            {
+                lists[indexer.Find(state_transitions.first)] = &state_transitions.second;
+                total += state_transitions.second.size();
+            }
+
+            std::vector<uint32_t> offsets;
+            std::vector<Key> keys;
+            std::vector<StateIndex> targets;
+            std::vector<MaskGuard> masks;
+            std::vector<ColdTrans> cold;
+            std::vector<StateDispatch> dispatch;
+            std::vector<DirectEntry> direct;
+            offsets.reserve(indexer.Size() + 1);
+            keys.reserve(total + kKeyPadding);
+            targets.reserve(total);
+            masks.reserve(total + kKeyPadding);
+            cold.reserve(total);
+            dispatch.reserve(indexer.Size());
+
+            offsets.push_back(0);
+            using Trans = typename std::decay<decltype(*lists[0]->begin())>::type;
+            std::vector<const Trans*> candidates;
+            for (const TransList* list : lists)
+            {
+                candidates.clear();
+                if (list != nullptr)
+                {
+                    for (const auto& transition : *list)
+                    {
+                        candidates.push_back(&transition);
+                    }
+                }
+
+                //同一触发器的候选排列在一起, 各自的尝试顺序不变
+                std::stable_sort(candidates.begin(), candidates.end(), [](const Trans* a, const Trans* b) {
+                    return ToKey(a->trigger) < ToKey(b->trigger);
+                });
+
+                uint32_t base = static_cast<uint32_t>(keys.size());
+                for (const Trans* transition : candidates)
+                {
+                    keys.push_back(ToKey(transition->trigger));
+                    targets.push_back(indexer.Find(transition->to_state));
+                    masks.push_back(transition->maskguard);
+                    cold.push_back(ColdTrans{ transition->guardfn, transition->actionfn });
+                }
+                offsets.push_back(static_cast<uint32_t>(keys.size()));
+                dispatch.push_back(BuildDispatch(candidates, base, direct));
+            }
+            //SIMD比较可能读取到区间末尾之后, 补齐填充
+            keys.resize(keys.size() + kKeyPadding, 0);
+            masks.resize(masks.size() + kKeyPadding, MaskGuard{ 0, 0 });
+
+            indexer_ = std::move(indexer);
+            offsets_.swap(offsets);
+            keys_.swap(keys);
+            targets_.swap(targets);
+            masks_.swap(masks);
+            cold_.swap(cold);
+            dispatch_.swap(dispatch);
+            direct_.swap(direct);
+            current_state_ = 0;
+            return FSM_SUCCESS;
+        }
+
+        //重置当前状态, 默认为初始态
+        void Reset(State s = Initial)
+        {
+            current_state_ = IndexOf(s);
+        }
+
+        void AddDebugFn(DebugFn fn)
+        {
+            debug_fn_ = fn;
+        }
+
+        //绑定位掩码guard使用的标志字, 传入nullptr时标志字视为0
+        void BindFlags(const GuardFlags* flags)
+        {
+            flags_ = flags;
+        }
+
+        //根据冻结的定义执行给定的触发器, 返回执行操作的状态
+        FsmErrors Execute(Trigger trigger)
+        {
+            return Execute(current_state_, trigger, CurrentFlags());
+        }
+
+        //以外部保存的状态编号执行触发器, 转换成功时修改state
+        FsmErrors Execute(StateIndex& state, Trigger trigger) const
+        {
+            return Execute(state, trigger, CurrentFlags());
+        }
+
+        //以外部保存的状态编号和标志字执行触发器
+        FsmErrors Execute(StateIndex& state, Trigger trigger, GuardFlags flags) const
+        {
+            using Block = detail::KeyBlock<sizeof(Key)>;
+            FsmErrors err_code = FSM_NO_MATCHING_TRIGGER;
+            const Key key = ToKey(trigger);
+
+            const StateDispatch& dispatch = dispatch_[state];
+            if (dispatch.span != 0)
+            {
+                //直接分派: 一次查表找到该触发器的候选组
+                uint64_t slot = static_cast<Key>(key - dispatch.min_key);
+                if (slot >= dispatch.span)
+                {
+                    return err_code;
+                }
+
+                const DirectEntry& entry = direct_[dispatch.offset + slot];
+                if (entry.count == 0)
+                {
+                    return err_code;
+                }
+
+                if (entry.count & kUnconditional)
+                {
+                    Fire(state, entry.first, trigger);
+                    return FSM_SUCCESS;
+                }
+
+                for (uint32_t i = entry.first; i < entry.first + entry.count; ++i)
+                {
+                    if (masks_[i].Pass(flags) && (!cold_[i].guardfn || cold_[i].guardfn()))
+                    {
+                        Fire(state, i, trigger);
+                        break;
+                    }
+                }
+                return FSM_SUCCESS;
+            }
+
+            const uint32_t end = offsets_[state + 1];
+
+            for (uint32_t base = offsets_[state]; base < end; base += Block::kKeys)
+            {
+                uint32_t mask = Block::Match(&keys_[base], key);
+                if (end - base < Block::kKeys)
+                {
+                    mask &= (1u << (end - base)) - 1;//屏蔽区间之外的键
+                }
+
+                if (mask == 0)
+                {
+                    continue;
+                }
+                //有触发器匹配即视为成功, 即使guard都没有通过
+                err_code = FSM_SUCCESS;
+
+                for (mask &= PassMask(&masks_[base], flags); mask != 0; mask &= mask - 1)
+                {
+                    uint32_t i = base + static_cast<uint32_t>(__builtin_ctz(mask));
+
+                    //只有触发器匹配且位掩码guard通过时才访问冷数据
+                    const ColdTrans& cold = cold_[i];
+                    if (cold.guardfn && !cold.guardfn())
+                    {
+                        continue;
+                    }
+
+                    Fire(state, i, trigger);
+                    return err_code;
+                }
+            }
+
+            return err_code;
+        }
+
+        //返回当前状态
+        State GetState() const
+        {
+            return indexer_.At(current_state_);
+        }
+
+        //返回当前状态编号
+        StateIndex GetStateIndex() const
+        {
+            return current_state_;
+        }
+
+        bool IsInitial() const
+        {
+            return current_state_ == 0;
+        }
+
+        size_t StateCount() const
+        {
+            return indexer_.Size();
+        }
+
+        StateIndex FindState(State s) const
+        {
+            return indexer_.Find(s);
+        }
+
+        State StateAt(StateIndex idx) const
+        {
+            return indexer_.At(idx);
+        }
+
+        //状态是否使用直接分派
+        bool IsDirectDispatch(State s) const
+        {
+            StateIndex idx = indexer_.Find(s);
+            return idx != kInvalidStateIndex && dispatch_[idx].span != 0;
+        }
+
+        //按组件估算的内存占用, 不含std::function捕获的对象;
+        //instance_bytes 为通过 Execute(StateIndex&, ...) 共享本定义时每个实例的字节数
+        MemoryReport MemoryUsage() const
+        {
+            MemoryReport report;
+            report.Add("object", sizeof(*this));
+            report.Add("state_index", indexer_.MemoryBytes());
+            report.Add("offsets", detail::VectorBytes(offsets_));
+            report.Add("keys", detail::VectorBytes(keys_) + detail::VectorBytes(targets_) + detail::VectorBytes(masks_));
+            report.Add("guards_actions", detail::VectorBytes(cold_));
+            report.Add("dispatch", detail::VectorBytes(dispatch_) + detail::VectorBytes(direct_));
+            report.instance_bytes = sizeof(StateIndex);
+            return report;
+        }
+
+    private:
+        struct ColdTrans
+        {
+            GuardFn guardfn;
+            ActionFn actionfn;
+        };
+
+        //每个状态的分派方式, span为0时使用SIMD扫描
+        struct StateDispatch
+        {
+            uint32_t offset;//在direct_中的起始下标
+            uint32_t span;//直接分派表的长度
+            Key min_key;//直接分派表第0项对应的触发器键
+        };
+
+        //直接分派表项: 触发器对应的候选组
+        struct DirectEntry
+        {
+            uint32_t first;//候选组的起始下标
+            uint32_t count;//候选个数, 最高位表示无条件组
+        };
+
+        //触发器键数组末尾的填充个数, 不小于一次SIMD比较的键个数
+        static const size_t kKeyPadding = 16;
+        static const uint32_t kUnconditional = 0x80000000u;
+        //直接分派表长度不超过 max(kDenseSpan, 候选数 * kDenseRatio)
+        static const uint64_t kDenseSpan = 64;
+        static const uint64_t kDenseRatio = 4;
+
+        //分析一个状态的候选转换(已按触发器键排序), 选择分派方式; 使用直接分派时向direct追加分派表
+        template <typename Trans>
+        static StateDispatch BuildDispatch(const std::vector<const Trans*>& candidates, uint32_t base,
+            std::vector<DirectEntry>& direct)
+        {
+            StateDispatch dispatch = { 0, 0, 0 };
+            if (candidates.empty())
+            {
+                return dispatch;
+            }
+
+            Key min_key = ToKey(candidates.front()->trigger);
+            uint64_t span = static_cast<uint64_t>(ToKey(candidates.back()->trigger)) - min_key + 1;
+            if (span > std::max(kDenseSpan, candidates.size() * kDenseRatio))
+            {
+                return dispatch;//触发器键过于稀疏
+            }
+
+            std::vector<DirectEntry> entries(span, DirectEntry{ 0, 0 });
+            for (size_t first = 0; first < candidates.size();)
+            {
+                size_t last = first + 1;
+                Key key = ToKey(candidates[first]->trigger);
+                while (last < candidates.size() && ToKey(candidates[last]->trigger) == key)
+                {
+                    ++last;
+                }
+
+                TriggerGroupKind kind = ClassifyTriggerGroup(candidates.begin() + static_cast<std::ptrdiff_t>(first),
+                    candidates.begin() + static_cast<std::ptrdiff_t>(last));
+                if (!IsDeterministic(kind))
+                {
+                    return dispatch;//结果依赖添加顺序, 使用与Fsm完全相同的顺序扫描
+                }
+
+                DirectEntry& entry = entries[static_cast<Key>(key - min_key)];
+                entry.first = base + static_cast<uint32_t>(first);
+                entry.count = (kind == FSM_GROUP_UNCONDITIONAL)
+                    ? (kUnconditional | 1u) : static_cast<uint32_t>(last - first);
+                first = last;
+            }
+
+            dispatch.offset = static_cast<uint32_t>(direct.size());
+            dispatch.span = static_cast<uint32_t>(span);
+            dispatch.min_key = min_key;
+            direct.insert(direct.end(), entries.begin(), entries.end());
+            return dispatch;
+        }
+
+        //执行第i个候选转换
+        void Fire(StateIndex& state, uint32_t i, Trigger trigger) const
+        {
+            const ColdTrans& cold = cold_[i];
+            if (cold.actionfn)
+            {
+                cold.actionfn();
+            }
+
+            StateIndex from = state;
+            state = targets_[i];
+            if (debug_fn_)
+            {
+                debug_fn_(indexer_.At(from), indexer_.At(state), trigger);
+            }
+        }
+
+        //对一组候选转换的位掩码guard无分支求值, 第i位对应masks[i]
+        static uint32_t PassMask(const MaskGuard* masks, GuardFlags flags)
+        {
+            using Block = detail::KeyBlock<sizeof(Key)>;
+            uint32_t pass = 0;
+            for (uint32_t k = 0; k < Block::kKeys; ++k)
+            {
+                GuardFlags fail = ((flags & masks[k].required) ^ masks[k].required) | (flags & masks[k].forbidden);
+                pass |= static_cast<uint32_t>(fail == 0) << k;
+            }
+            return pass;
+        }
+
+        GuardFlags CurrentFlags() const
+        {
+            return flags_ ? *flags_ : 0;
+        }
+
+        static Key ToKey(Trigger trigger)
+        {
+            return static_cast<Key>(TriggerOrdinal(trigger));
+        }
+
+        //返回状态编号, 定义中没有出现过的状态在此时编号, 其候选转换区间为空
+        StateIndex IndexOf(State s)
+        {
+            StateIndex idx = indexer_.Add(s);
+            while (offsets_.size() < indexer_.Size() + 1)
+            {
+                offsets_.push_back(offsets_.back());
+            }
+            dispatch_.resize(indexer_.Size(), StateDispatch{ 0, 0, 0 });
+            return idx;
+        }
+
+        StateIndexer<State> indexer_;
+        std::vector<uint32_t> offsets_;//状态编号 -> 候选区间起始下标, 共 状态数 + 1 项
+        std::vector<Key> keys_;//热数据: 触发器键
+        std::vector<StateIndex> targets_;//热数据: 目标状态编号
+        std::vector<MaskGuard> masks_;//位掩码guard, 与keys_一样带有填充
+        std::vector<ColdTrans> cold_;//冷数据: guard与action
+        std::vector<StateDispatch> dispatch_;//以状态编号为下标
+        std::vector<DirectEntry> direct_;//各直接分派状态的分派表
+        StateIndex current_state_;
+        DebugFn debug_fn_;
+        const GuardFlags* flags_;
+    };
+
+    template <typename State, State Initial, typename Trigger>
+    const size_t FrozenFsm<State, Initial, Trigger>::kKeyPadding;
+    template <typename State, State Initial, typename Trigger>
+    const uint32_t FrozenFsm<State, Initial, Trigger>::kUnconditional;
+    template <typename State, State Initial, typename Trigger>
+    const uint64_t FrozenFsm<State, Initial, Trigger>::kDenseSpan;
+    template <typename State, State Initial, typename Trigger>
+    const uint64_t FrozenFsm<State, Initial, Trigger>::kDenseRatio;
+}
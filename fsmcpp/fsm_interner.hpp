@@ -0,0 +1,323 @@
+#pragma once
+
+#include "fsmcpp.hpp"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+
+//字符串触发器的驻留(intern)工具
+//以 Fsm<State, Initial, std::string> 定义的命令式状态机, 每次Execute都要在候选转换中逐个比较字符串,
+//调用调试函数时还会复制一次触发器
+//TriggerInterner 在边界处把字符串触发器一次性映射为从0开始的稠密整数id,
+//StringFsm 内部以整数id驱动 Fsm, 使字符串触发的状态机与枚举触发的状态机性能一致
+
+namespace fsm
+{
+    //驻留后的触发器id类型
+    using TriggerId = uint32_t;
+    //查找失败时返回的id
+    const TriggerId kInvalidTriggerId = std::numeric_limits<TriggerId>::max();
+
+    //字符串到稠密整数id的映射表
+    //采用开放寻址 + 线性探测, 查找时只需要计算一次哈希, 不会分配内存
+    class TriggerInterner
+    {
+    public:
+        TriggerInterner()
+            : slots_()
+            , names_()
+        {
+        }
+
+        //FNV-1a 64位哈希, 调用方可以提前计算好哈希值, 通过Find的重载直接使用
+        static uint64_t Hash(const char* data, size_t len)
+        {
+            uint64_t h = 14695981039346656037ULL;
+            for (size_t i = 0; i < len; ++i)
+            {
+                h ^= static_cast<unsigned char>(data[i]);
+                h *= 1099511628211ULL;
+            }
+            return h;
+        }
+
+        //登记一个字符串, 返回其id; 字符串已登记时返回原有id
+        TriggerId Intern(const char* data, size_t len)
+        {
+            uint64_t hash = Hash(data, len);
+            TriggerId id = Find(data, len, hash);
+            if (id != kInvalidTriggerId)
+            {
+                return id;
+            }
+
+            //装载因子保持在1/2以下
+            if ((names_.size() + 1) * 2 > slots_.size())
+            {
+                Rehash(slots_.empty() ? 16 : slots_.size() * 2);
+            }
+
+            id = static_cast<TriggerId>(names_.size());
+            names_.emplace_back(data, len);
+            Insert(Slot{ hash, id });
+            return id;
+        }
+
+        TriggerId Intern(const std::string& s)
+        {
+            return Intern(s.data(), s.size());
+        }
+
+        //查找字符串对应的id, 未登记返回kInvalidTriggerId
+        TriggerId Find(const char* data, size_t len, uint64_t hash) const
+        {
+            if (slots_.empty())
+            {
+                return kInvalidTriggerId;
+            }
+
+            size_t mask = slots_.size() - 1;
+            for (size_t i = static_cast<size_t>(hash) & mask; ; i = (i + 1) & mask)
+            {
+                const Slot& slot = slots_[i];
+                if (slot.id == kInvalidTriggerId)
+                {
+                    return kInvalidTriggerId;//遇到空槽, 查找结束
+                }
+
+                const std::string& name = names_[slot.id];
+                if (slot.hash == hash && name.size() == len
+                    && (len == 0 || memcmp(name.data(), data, len) == 0))
+                {
+                    return slot.id;
+                }
+            }
+        }
+
+        TriggerId Find(const char* data, size_t len) const
+        {
+            return Find(data, len, Hash(data, len));
+        }
+
+        TriggerId Find(const std::string& s) const
+        {
+            return Find(s.data(), s.size());
+        }
+
+        //返回id对应的字符串, id必须由本对象分配
+        const std::string& Name(TriggerId id) const
+        {
+            return names_[id];
+        }
+
+        //返回已登记的字符串个数
+        size_t Size() const
+        {
+            return names_.size();
+        }
+
+        //按组件估算的内存占用
+        MemoryReport MemoryUsage() const
+        {
+            MemoryReport report;
+            report.Add("object", sizeof(*this));
+            report.Add("slots", detail::VectorBytes(slots_));
+            size_t names = detail::VectorBytes(names_);
+            for (const std::string& name : names_)
+            {
+                names += detail::StringBytes(name);
+            }
+            report.Add("names", names);
+            return report;
+        }
+
+    private:
+        struct Slot
+        {
+            uint64_t hash;//字符串哈希值
+            TriggerId id;//kInvalidTriggerId 表示空槽
+        };
+
+        void Insert(const Slot& slot)
+        {
+            size_t mask = slots_.size() - 1;
+            size_t i = static_cast<size_t>(slot.hash) & mask;
+            while (slots_[i].id != kInvalidTriggerId)
+            {
+                i = (i + 1) & mask;
+            }
+            slots_[i] = slot;
+        }
+
+        void Rehash(size_t capacity)
+        {
+            std::vector<Slot> old;
+            old.swap(slots_);
+            slots_.assign(capacity, Slot{ 0, kInvalidTriggerId });
+            for (const auto& slot : old)
+            {
+                if (slot.id != kInvalidTriggerId)
+                {
+                    Insert(slot);
+                }
+            }
+        }
+
+        std::vector<Slot> slots_;//哈希槽, 大小为2的幂
+        std::vector<std::string> names_;//按id存储的字符串
+    };
+
+    //以字符串为触发器的状态机
+    //转换定义沿用 Fsm<State, Initial, std::string>::Trans, 添加时把触发器驻留为整数id
+    //内部引擎为 Fsm<State, Initial, TriggerId>, 执行时只比较整数
+    template <typename State, State Initial>
+    class StringFsm
+    {
+    public:
+        using Engine = Fsm<State, Initial, TriggerId>;
+        using Trans = typename Fsm<State, Initial, std::string>::Trans;
+        using GuardFn = typename Engine::GuardFn;
+        using ActionFn = typename Engine::ActionFn;
+        // 定义调试函数类型
+        // 参数分别为: from_state, to_state, trigger, 触发器以引用形式传递, 不会复制
+        using DebugFn = std::function<void(State, State, const std::string&)>;
+
+        StringFsm()
+            : interner_()
+            , engine_()
+            , debug_fn_(nullptr)
+        {
+        }
+
+        //调试函数中引用了this, 不允许复制
+        StringFsm(const StringFsm&) = delete;
+        StringFsm& operator=(const StringFsm&) = delete;
+
+        void Reset(State s = Initial)
+        {
+            engine_.Reset(s);
+        }
+
+        //向状态机添加一组转换定义, 触发器在此处驻留
+        template <typename InputIt>
+        void AddTransitions(InputIt start, InputIt end)
+        {
+            std::vector<typename Engine::Trans> interned;
+            for (InputIt it = start; it != end; ++it)
+            {
+                interned.push_back({ (*it).from_state, (*it).to_state,
+                    interner_.Intern((*it).trigger), (*it).guardfn, (*it).actionfn, (*it).maskguard, (*it).priority });
+            }
+            engine_.AddTransitions(interned);
+        }
+
+        template <typename Coll>
+        void AddTransitions(Coll&& c)
+        {
+            AddTransitions(std::begin(c), std::end(c));
+        }
+
+        void AddTransitions(std::initializer_list<Trans>&& i)
+        {
+            AddTransitions(std::begin(i), std::end(i));
+        }
+
+        void AddDebugFn(DebugFn fn)
+        {
+            debug_fn_ = fn;
+            if (!debug_fn_)
+            {
+                engine_.AddDebugFn(nullptr);
+                return;
+            }
+
+            engine_.AddDebugFn([this](State from, State to, TriggerId id) {
+                debug_fn_(from, to, interner_.Name(id));
+            });
+        }
+
+        //绑定位掩码guard使用的标志字
+        void BindFlags(const GuardFlags* flags)
+        {
+            engine_.BindFlags(flags);
+        }
+
+        //提前解析触发器id, 热路径上可以直接以id调用Execute
+        TriggerId Resolve(const std::string& trigger) const
+        {
+            return interner_.Find(trigger);
+        }
+
+        //以触发器id执行, 不做任何字符串操作
+        FsmErrors Execute(TriggerId id)
+        {
+            return engine_.Execute(id);
+        }
+
+        //以字符串执行, 只计算一次哈希; 未登记的触发器必然没有匹配的转换
+        FsmErrors Execute(const char* data, size_t len)
+        {
+            TriggerId id = interner_.Find(data, len);
+            if (id == kInvalidTriggerId)
+            {
+                return FSM_NO_MATCHING_TRIGGER;
+            }
+            return engine_.Execute(id);
+        }
+
+        FsmErrors Execute(const char* trigger)
+        {
+            return Execute(trigger, strlen(trigger));
+        }
+
+        FsmErrors Execute(const std::string& trigger)
+        {
+            return Execute(trigger.data(), trigger.size());
+        }
+
+#if __cplusplus >= 201703L
+        FsmErrors Execute(std::string_view trigger)
+        {
+            return Execute(trigger.data(), trigger.size());
+        }
+#endif
+
+        State GetState() const
+        {
+            return engine_.GetState();
+        }
+
+        bool IsInitial() const
+        {
+            return engine_.IsInitial();
+        }
+
+        const TriggerInterner& Interner() const
+        {
+            return interner_;
+        }
+
+        //按组件估算的内存占用, 驻留表和内部的状态机各计为一个组件;
+        //状态保存在对象内, instance_bytes 为整个对象的占用
+        MemoryReport MemoryUsage() const
+        {
+            MemoryReport report;
+            report.Add("object", sizeof(*this) - sizeof(TriggerInterner) - sizeof(Engine));
+            report.Add("interner", interner_.MemoryUsage().Total());
+            report.Add("engine", engine_.MemoryUsage().Total());
+            report.instance_bytes = report.Total();
+            return report;
+        }
+
+    private:
+        TriggerInterner interner_;
+        Engine engine_;
+        DebugFn debug_fn_;
+    };
+}
@@ -0,0 +1,598 @@
+#pragma once
+
+#include "fsm_state_index.hpp"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <initializer_list>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+//按需构造的惰性DFA
+//把大型NFA完整地子集构造为DFA时状态数可能爆炸, LazyDfa 只在执行中第一次到达某个DFA状态(NFA状态集合)时才构造它,
+//构造结果连同各触发器的后继缓存在有上限的内存中:
+//- 命中缓存时每个触发器只需一次查表, 与普通DFA相同
+//- 缓存已满时按时钟(clock)策略淘汰最近没有使用过的状态; 指向被淘汰状态的表项通过代数(generation)失效, 不需要逐个清理
+//- 缓存抖动(平均每个新构造的状态被复用的次数过少), 或者上限连当前状态和后继都容纳不下时,
+//  回退为直接模拟NFA(每步合并活动集合中各状态的后继), 执行kFallbackSteps个触发器后再尝试回到DFA模式
+//语义与 BitNfa 相同: 标准NFA语义, 活动状态在触发器上没有转换时离开活动集合; 状态数没有上限
+//定义必须无guard, 触发器为整数或枚举类型; 转换上的action函数不会被调用
+
+namespace fsm
+{
+    //惰性DFA的运行统计
+    struct LazyDfaStats
+    {
+        uint64_t steps;//处理的触发器数
+        uint64_t misses;//未命中缓存而构造后继的次数
+        uint64_t evictions;//淘汰的缓存状态数
+        uint64_t fallback_steps;//以NFA模拟方式处理的触发器数
+        size_t cached_states;//当前缓存的DFA状态数
+        size_t memory_bytes;//缓存占用的内存估计
+    };
+
+    template <typename State, State Initial, typename Trigger>
+    class LazyDfa
+    {
+    public:
+        using SourceFsm = Fsm<State, Initial, Trigger>;
+
+        //默认的缓存内存上限
+        static const size_t kDefaultMemoryLimit = 4 << 20;
+        //支持的最大触发器序号
+        static const uint64_t kMaxOrdinal = 0xFFFF;
+        //回退到NFA模拟后至少处理的触发器数
+        static const uint64_t kFallbackSteps = 1 << 16;
+        //缓存周转一轮期间, 平均每个新构造的状态至少要对应的触发器数, 低于此值视为抖动
+        static const uint64_t kMinStepsPerMiss = 16;
+
+        explicit LazyDfa(size_t memory_limit = kDefaultMemoryLimit)
+            : memory_limit_(memory_limit)
+            , indexer_()
+            , symbols_()
+            , symbol_count_(1)
+            , edge_offsets_(2, 0)
+            , edges_()
+            , accepting_(1, 0)
+            , cache_()
+            , slots_()
+            , rows_()
+            , generations_()
+            , referenced_()
+            , flags_()
+            , free_slots_()
+            , memory_used_(0)
+            , generation_(0)
+            , hand_(0)
+            , current_(0)
+            , nfa_mode_(false)
+            , nfa_set_()
+            , fallback_left_(0)
+            , window_steps_(0)
+            , window_misses_(0)
+            , window_evictions_(0)
+            , mark_(1, 0)
+            , scratch_()
+            , stats_()
+        {
+            indexer_.Add(Initial);//构建之前只有没有任何转换的初始状态
+            Reset();
+        }
+
+        LazyDfa(const LazyDfa&) = delete;
+        LazyDfa& operator=(const LazyDfa&) = delete;
+
+        //由状态机定义构建NFA, 含有guard时返回FSM_GUARDED_TRANSITION
+        //definition可以是SourceFsm, 也可以是按传入状态分组好的FsmBuilder
+        template <typename Definition>
+        FsmErrors Build(const Definition& definition)
+        {
+            StateIndexer<State> indexer = IndexDefinitionStates<State, Initial>(definition);
+
+            //触发器序号映射为连续的符号编号, 符号0保留给没有任何转换的触发器
+            std::vector<uint32_t> symbols;
+            uint32_t symbol_count = 1;
+            std::vector<std::vector<std::pair<uint32_t, uint32_t>>> adjacency(indexer.Size());//(符号, 目标状态)
+            for (const auto& state_transitions : definition.GetTransitions())
+            {
+                StateIndex from = indexer.Find(state_transitions.first);
+                for (const auto& transition : state_transitions.second)
+                {
+                    if (transition.guardfn || !transition.maskguard.Empty())
+                    {
+                        return FSM_GUARDED_TRANSITION;
+                    }
+
+                    uint64_t ordinal = TriggerOrdinal(transition.trigger);
+                    if (ordinal > kMaxOrdinal)
+                    {
+                        return FSM_TRIGGER_OUT_OF_RANGE;
+                    }
+                    if (ordinal >= symbols.size())
+                    {
+                        symbols.resize(ordinal + 1, 0);
+                    }
+                    if (symbols[ordinal] == 0)
+                    {
+                        symbols[ordinal] = symbol_count++;
+                    }
+                    adjacency[from].emplace_back(symbols[ordinal], indexer.Find(transition.to_state));
+                }
+            }
+
+            //每个NFA状态的出边按符号排序后连续存放, 构造后继时二分查找
+            std::vector<uint32_t> offsets(1, 0);
+            std::vector<std::pair<uint32_t, uint32_t>> edges;
+            for (auto& state_edges : adjacency)
+            {
+                std::sort(state_edges.begin(), state_edges.end());
+                state_edges.erase(std::unique(state_edges.begin(), state_edges.end()), state_edges.end());
+                edges.insert(edges.end(), state_edges.begin(), state_edges.end());
+                offsets.push_back(static_cast<uint32_t>(edges.size()));
+            }
+
+            indexer_ = std::move(indexer);
+            symbols_.swap(symbols);
+            symbol_count_ = symbol_count;
+            edge_offsets_.swap(offsets);
+            edges_.swap(edges);
+            accepting_.assign(indexer_.Size(), 0);
+            mark_.assign(indexer_.Size(), 0);
+            Clear();
+            return FSM_SUCCESS;
+        }
+
+        //设置接受状态, 会清空缓存并重置到初始状态
+        template <typename InputIt>
+        void SetAccepting(InputIt first, InputIt last)
+        {
+            std::fill(accepting_.begin(), accepting_.end(), 0);
+            for (; first != last; ++first)
+            {
+                StateIndex idx = indexer_.Find(*first);
+                if (idx != kInvalidStateIndex)
+                {
+                    accepting_[idx] = 1;
+                }
+            }
+            Clear();
+        }
+
+        void SetAccepting(std::initializer_list<State> states)
+        {
+            SetAccepting(states.begin(), states.end());
+        }
+
+        //清空缓存, 重置到只有初始状态活动
+        void Clear()
+        {
+            cache_.clear();
+            slots_.clear();
+            rows_.clear();
+            generations_.clear();
+            referenced_.clear();
+            flags_.clear();
+            free_slots_.clear();
+            memory_used_ = 0;
+            hand_ = 0;
+            Reset();
+        }
+
+        //重置到只有初始状态活动, 缓存保留
+        void Reset()
+        {
+            nfa_set_.assign(1, 0);
+            nfa_mode_ = false;
+            fallback_left_ = 0;
+            EnterDfa();
+        }
+
+        //推进活动集合, 活动集合变为空时返回FSM_NO_MATCHING_TRIGGER
+        FsmErrors Execute(Trigger trigger)
+        {
+            Run(&trigger, 1);
+            return Empty() ? FSM_NO_MATCHING_TRIGGER : FSM_SUCCESS;
+        }
+
+        //处理整段输入
+        void Run(const Trigger* data, size_t len)
+        {
+            for (size_t i = 0; i < len; ++i)
+            {
+                uint32_t symbol = Symbol(data[i]);
+                if (nfa_mode_)
+                {
+                    FallbackStep(symbol);
+                    continue;
+                }
+
+                uint64_t entry = rows_[static_cast<size_t>(current_) * symbol_count_ + symbol];
+                uint32_t slot = static_cast<uint32_t>(entry);
+                if (generations_[slot] == static_cast<uint32_t>(entry >> 32))
+                {
+                    current_ = slot;
+                    referenced_[slot] = 1;
+                    ++window_steps_;
+                    continue;
+                }
+                Miss(symbol);
+            }
+        }
+
+        //当前活动集合中是否包含接受状态
+        bool IsAccepting() const
+        {
+            if (nfa_mode_)
+            {
+                return ContainsAccepting(nfa_set_);
+            }
+            return (flags_[current_] & kAcceptingFlag) != 0;
+        }
+
+        //活动集合为空时, 后续的触发器都不会再有效果
+        bool Empty() const
+        {
+            return CurrentSet().empty();
+        }
+
+        bool IsActive(State s) const
+        {
+            StateIndex idx = indexer_.Find(s);
+            const std::vector<uint32_t>& set = CurrentSet();
+            return idx != kInvalidStateIndex && std::binary_search(set.begin(), set.end(), idx);
+        }
+
+        //当前活动的所有状态
+        std::vector<State> ActiveStates() const
+        {
+            std::vector<State> states;
+            for (uint32_t idx : CurrentSet())
+            {
+                states.push_back(indexer_.At(idx));
+            }
+            return states;
+        }
+
+        //是否正处于NFA模拟的回退模式
+        bool InFallback() const
+        {
+            return nfa_mode_;
+        }
+
+        LazyDfaStats GetStats() const
+        {
+            LazyDfaStats stats = stats_;
+            stats.steps += window_steps_;
+            stats.cached_states = cache_.size();
+            stats.memory_bytes = memory_used_;
+            return stats;
+        }
+
+        size_t MemoryLimit() const
+        {
+            return memory_limit_;
+        }
+
+        //按组件估算的内存占用; 缓存随执行增长, 上限为MemoryLimit
+        //惰性DFA的缓存和执行状态不能在实例之间共享, instance_bytes 为整个对象的占用
+        MemoryReport MemoryUsage() const
+        {
+            MemoryReport report;
+            report.Add("object", sizeof(*this));
+            report.Add("state_index", indexer_.MemoryBytes());
+            report.Add("nfa", detail::VectorBytes(symbols_) + detail::VectorBytes(edge_offsets_)
+                + detail::VectorBytes(edges_) + detail::VectorBytes(accepting_));
+            size_t sets = 0;
+            for (const auto& entry : cache_)
+            {
+                sets += detail::VectorBytes(entry.first);
+            }
+            report.Add("cache", detail::HashBytes(cache_) + sets + detail::VectorBytes(slots_));
+            report.Add("rows", detail::VectorBytes(rows_) + detail::VectorBytes(generations_)
+                + detail::VectorBytes(referenced_) + detail::VectorBytes(flags_) + detail::VectorBytes(free_slots_));
+            report.Add("scratch", detail::VectorBytes(nfa_set_) + detail::VectorBytes(scratch_) + detail::VectorBytes(mark_));
+            report.instance_bytes = report.Total();
+            return report;
+        }
+
+    private:
+        using Set = std::vector<uint32_t>;
+
+        struct SetHash
+        {
+            size_t operator()(const Set& set) const
+            {
+                uint64_t hash = 14695981039346656037ull;
+                for (uint32_t s : set)
+                {
+                    hash = (hash ^ s) * 1099511628211ull;
+                }
+                return static_cast<size_t>(hash);
+            }
+        };
+
+        using Cache = std::unordered_map<Set, uint32_t, SetHash>;
+
+        static const uint8_t kAcceptingFlag = 1;
+        //空闲槽的代数, 有效代数从1开始
+        static const uint32_t kFreeGeneration = 0;
+        //不存在的槽
+        static const uint32_t kNoSlot = 0xFFFFFFFFu;
+        //未填写的表项, 代数部分不会与任何槽匹配
+        static const uint64_t kUnknownEntry = uint64_t(0xFFFFFFFFu) << 32;
+
+        uint32_t Symbol(Trigger trigger) const
+        {
+            uint64_t ordinal = TriggerOrdinal(trigger);
+            return ordinal < symbols_.size() ? symbols_[ordinal] : 0;
+        }
+
+        const Set& CurrentSet() const
+        {
+            return nfa_mode_ ? nfa_set_ : *slots_[current_];
+        }
+
+        bool ContainsAccepting(const Set& set) const
+        {
+            for (uint32_t s : set)
+            {
+                if (accepting_[s] != 0)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        //计算集合from在symbol上的后继集合, 结果有序
+        void NfaStep(const Set& from, uint32_t symbol, Set& to)
+        {
+            to.clear();
+            for (uint32_t s : from)
+            {
+                auto first = edges_.begin() + edge_offsets_[s];
+                auto last = edges_.begin() + edge_offsets_[s + 1];
+                auto range = std::equal_range(first, last, std::make_pair(symbol, uint32_t(0)),
+                    [](const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b) { return a.first < b.first; });
+                for (auto it = range.first; it != range.second; ++it)
+                {
+                    if (mark_[it->second] == 0)
+                    {
+                        mark_[it->second] = 1;
+                        to.push_back(it->second);
+                    }
+                }
+            }
+            for (uint32_t s : to)
+            {
+                mark_[s] = 0;
+            }
+            std::sort(to.begin(), to.end());
+        }
+
+        //缓存未命中: 构造后继并写入当前状态的表项
+        void Miss(uint32_t symbol)
+        {
+            ++window_steps_;
+            ++window_misses_;
+            ++stats_.misses;
+            NfaStep(*slots_[current_], symbol, scratch_);
+
+            uint32_t next = Intern(scratch_, current_);
+            if (next == kNoSlot)
+            {
+                //上限容纳不下新状态, 回退为NFA模拟
+                nfa_set_.swap(scratch_);
+                EnterFallback();
+                return;
+            }
+
+            rows_[static_cast<size_t>(current_) * symbol_count_ + symbol] =
+                (uint64_t(generations_[next]) << 32) | next;
+            current_ = next;
+            referenced_[next] = 1;
+
+            //缓存周转一轮后检查是否抖动
+            if (window_evictions_ > 0 && window_misses_ >= cache_.size())
+            {
+                bool thrashing = window_steps_ < window_misses_ * kMinStepsPerMiss;
+                ResetWindow();
+                if (thrashing)
+                {
+                    nfa_set_ = *slots_[current_];
+                    EnterFallback();
+                }
+            }
+        }
+
+        //查找或缓存集合, 返回槽号; 内存上限不足时返回kNoSlot; pinned为不能淘汰的槽
+        uint32_t Intern(const Set& set, uint32_t pinned)
+        {
+            auto found = cache_.find(set);
+            if (found != cache_.end())
+            {
+                return found->second;
+            }
+
+            size_t set_bytes = set.size() * sizeof(uint32_t) + kEntryOverhead;
+            size_t row_bytes = symbol_count_ * sizeof(uint64_t);
+            while (memory_used_ + set_bytes + (free_slots_.empty() ? row_bytes : 0) > memory_limit_)
+            {
+                if (!EvictOne(pinned))
+                {
+                    return kNoSlot;
+                }
+            }
+
+            uint32_t slot = 0;
+            if (free_slots_.empty())
+            {
+                slot = static_cast<uint32_t>(slots_.size());
+                slots_.push_back(nullptr);
+                rows_.resize(rows_.size() + symbol_count_, kUnknownEntry);
+                generations_.push_back(kFreeGeneration);
+                referenced_.push_back(0);
+                flags_.push_back(0);
+                memory_used_ += row_bytes;
+            }
+            else
+            {
+                slot = free_slots_.back();
+                free_slots_.pop_back();
+                std::fill_n(rows_.begin() + static_cast<std::ptrdiff_t>(static_cast<size_t>(slot) * symbol_count_),
+                    symbol_count_, kUnknownEntry);
+            }
+
+            if (++generation_ == static_cast<uint32_t>(kUnknownEntry >> 32))
+            {
+                //代数用尽, 清空所有表项并为仍在缓存中的状态重新分配代数, 它们会在下次到达时重新查找
+                std::fill(rows_.begin(), rows_.end(), kUnknownEntry);
+                generation_ = 0;
+                for (auto& generation : generations_)
+                {
+                    if (generation != kFreeGeneration)
+                    {
+                        generation = ++generation_;
+                    }
+                }
+                ++generation_;
+            }
+
+            auto inserted = cache_.emplace(set, slot);
+            slots_[slot] = &inserted.first->first;
+            generations_[slot] = generation_;
+            referenced_[slot] = 1;
+            flags_[slot] = ContainsAccepting(set) ? kAcceptingFlag : 0;
+            memory_used_ += set_bytes;
+            return slot;
+        }
+
+        //时钟淘汰: 指针扫过各槽, 最近使用过的槽清除标记后跳过, 遇到未使用的槽就淘汰
+        bool EvictOne(uint32_t pinned)
+        {
+            size_t slot_count = slots_.size();
+            for (size_t scanned = 0; scanned < 2 * slot_count; ++scanned)
+            {
+                uint32_t slot = hand_;
+                hand_ = (hand_ + 1 < slot_count) ? hand_ + 1 : 0;
+                if (generations_[slot] == kFreeGeneration || slot == pinned)
+                {
+                    continue;
+                }
+                if (referenced_[slot] != 0)
+                {
+                    referenced_[slot] = 0;
+                    continue;
+                }
+
+                memory_used_ -= slots_[slot]->size() * sizeof(uint32_t) + kEntryOverhead;
+                cache_.erase(*slots_[slot]);
+                slots_[slot] = nullptr;
+                generations_[slot] = kFreeGeneration;//指向该槽的表项随之失效
+                free_slots_.push_back(slot);
+                ++window_evictions_;
+                ++stats_.evictions;
+                return true;
+            }
+            return false;
+        }
+
+        void FallbackStep(uint32_t symbol)
+        {
+            NfaStep(nfa_set_, symbol, scratch_);
+            nfa_set_.swap(scratch_);
+            ++stats_.fallback_steps;
+            if (--fallback_left_ == 0)
+            {
+                EnterDfa();
+            }
+        }
+
+        void EnterFallback()
+        {
+            nfa_mode_ = true;
+            fallback_left_ = kFallbackSteps;
+            ResetWindow();
+        }
+
+        //以nfa_set_为当前状态回到DFA模式, 缓存容纳不下时继续回退
+        void EnterDfa()
+        {
+            uint32_t slot = Intern(nfa_set_, kNoSlot);
+            if (slot == kNoSlot)
+            {
+                EnterFallback();
+                return;
+            }
+            nfa_mode_ = false;
+            current_ = slot;
+        }
+
+        void ResetWindow()
+        {
+            stats_.steps += window_steps_;
+            window_steps_ = 0;
+            window_misses_ = 0;
+            window_evictions_ = 0;
+        }
+
+        //每个缓存状态在哈希表中的额外开销估计
+        static const size_t kEntryOverhead = sizeof(Set) + sizeof(uint32_t) + 4 * sizeof(void*);
+
+        size_t memory_limit_;
+
+        //NFA
+        StateIndexer<State> indexer_;
+        std::vector<uint32_t> symbols_;//触发器序号 -> 符号编号
+        uint32_t symbol_count_;
+        std::vector<uint32_t> edge_offsets_;
+        std::vector<std::pair<uint32_t, uint32_t>> edges_;//(符号, 目标状态)
+        std::vector<uint8_t> accepting_;
+
+        //缓存
+        Cache cache_;//NFA状态集合 -> 槽号
+        std::vector<const Set*> slots_;//槽号 -> 集合(哈希表中的键)
+        std::vector<uint64_t> rows_;//槽数 x 符号数, 高32位为目标槽的代数, 低32位为目标槽号
+        std::vector<uint32_t> generations_;
+        std::vector<uint8_t> referenced_;//时钟淘汰的使用标记
+        std::vector<uint8_t> flags_;
+        std::vector<uint32_t> free_slots_;
+        size_t memory_used_;
+        uint32_t generation_;
+        uint32_t hand_;
+
+        //执行状态
+        uint32_t current_;
+        bool nfa_mode_;
+        Set nfa_set_;//回退模式下的活动集合
+        uint64_t fallback_left_;
+        uint64_t window_steps_;
+        uint64_t window_misses_;
+        uint64_t window_evictions_;
+
+        std::vector<uint8_t> mark_;
+        Set scratch_;
+        LazyDfaStats stats_;
+    };
+
+    template <typename State, State Initial, typename Trigger>
+    const size_t LazyDfa<State, Initial, Trigger>::kDefaultMemoryLimit;
+    template <typename State, State Initial, typename Trigger>
+    const uint64_t LazyDfa<State, Initial, Trigger>::kMaxOrdinal;
+    template <typename State, State Initial, typename Trigger>
+    const uint64_t LazyDfa<State, Initial, Trigger>::kFallbackSteps;
+    template <typename State, State Initial, typename Trigger>
+    const uint64_t LazyDfa<State, Initial, Trigger>::kMinStepsPerMiss;
+    template <typename State, State Initial, typename Trigger>
+    const uint8_t LazyDfa<State, Initial, Trigger>::kAcceptingFlag;
+    template <typename State, State Initial, typename Trigger>
+    const uint32_t LazyDfa<State, Initial, Trigger>::kFreeGeneration;
+    template <typename State, State Initial, typename Trigger>
+    const uint32_t LazyDfa<State, Initial, Trigger>::kNoSlot;
+    template <typename State, State Initial, typename Trigger>
+    const uint64_t LazyDfa<State, Initial, Trigger>::kUnknownEntry;
+    template <typename State, State Initial, typename Trigger>
+    const size_t LazyDfa<State, Initial, Trigger>::kEntryOverhead;
+}
@@ -0,0 +1,500 @@
+#pragma once
+
+#include "fsm_state_index.hpp"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+//马尔可夫(概率转换)仿真
+//设备生命周期等模型做蒙特卡洛容量分析时, 同一(状态, 触发器)组合的多个转换按概率选取, 而不是按guard选取
+//MarkovSimulator 为每个组合的候选转换建立别名表(alias table), 每次采样O(1);
+//大量相互独立的实例以结构数组形式保存, 每一步对所有实例施加同一个触发器
+//随机数使用基于计数器的Philox4x32-10: 实例i在第t步使用的随机数只由(种子, i, t)决定,
+//因此结果与线程数、分块方式无关, 可以复现; 有AVX2时每次并行生成8个实例的随机数
+//每一步之后统计各状态的实例数(占用直方图)
+//转换的概率权重由构建时传入的函数给出, 同一组合内的权重会归一化; 没有任何转换的组合实例保持原状态
+//定义必须无guard, 触发器为整数或枚举类型; 转换上的action函数不会被调用
+
+namespace fsm
+{
+    namespace detail
+    {
+        const uint32_t kPhiloxM0 = 0xD2511F53u;
+        const uint32_t kPhiloxM1 = 0xCD9E8D57u;
+        const uint32_t kPhiloxW0 = 0x9E3779B9u;
+        const uint32_t kPhiloxW1 = 0xBB67AE85u;
+
+        //Philox4x32-10: 由128位计数器和64位密钥生成128位随机数
+        inline void Philox4x32(const uint32_t counter[4], uint32_t key0, uint32_t key1, uint32_t out[4])
+        {
+            uint32_t c0 = counter[0];
+            uint32_t c1 = counter[1];
+            uint32_t c2 = counter[2];
+            uint32_t c3 = counter[3];
+            for (int round = 0; round < 10; ++round)
+            {
+                uint64_t p0 = static_cast<uint64_t>(kPhiloxM0) * c0;
+                uint64_t p1 = static_cast<uint64_t>(kPhiloxM1) * c2;
+                uint32_t n0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ key0;
+                uint32_t n2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ key1;
+                c1 = static_cast<uint32_t>(p1);
+                c3 = static_cast<uint32_t>(p0);
+                c0 = n0;
+                c2 = n2;
+                key0 += kPhiloxW0;
+                key1 += kPhiloxW1;
+            }
+            out[0] = c0;
+            out[1] = c1;
+            out[2] = c2;
+            out[3] = c3;
+        }
+
+#if defined(__AVX2__)
+        //8个32位乘法的高低半部分
+        inline void MulHiLo8(__m256i a, __m256i m, __m256i& hi, __m256i& lo)
+        {
+            __m256i even = _mm256_mul_epu32(a, m);
+            __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), m);
+            lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+            hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+        }
+#endif
+
+        //为编号从first开始的count个实例生成第step步的随机数, 每个实例取Philox输出的前两个字
+        //计数器为(实例编号低32位, 实例编号高32位, 步数低32位, 步数高32位), 密钥为种子
+        inline void PhiloxBatch(uint64_t first, size_t count, uint64_t step, uint64_t seed, uint32_t* r0, uint32_t* r1)
+        {
+            uint32_t key0 = static_cast<uint32_t>(seed);
+            uint32_t key1 = static_cast<uint32_t>(seed >> 32);
+            size_t i = 0;
+#if defined(__AVX2__)
+            alignas(32) uint32_t ids_lo[8];
+            alignas(32) uint32_t ids_hi[8];
+            const __m256i m0 = _mm256_set1_epi32(static_cast<int>(kPhiloxM0));
+            const __m256i m1 = _mm256_set1_epi32(static_cast<int>(kPhiloxM1));
+            for (; i + 8 <= count; i += 8)
+            {
+                for (size_t k = 0; k < 8; ++k)
+                {
+                    ids_lo[k] = static_cast<uint32_t>(first + i + k);
+                    ids_hi[k] = static_cast<uint32_t>((first + i + k) >> 32);
+                }
+
+                __m256i c0 = _mm256_load_si256(reinterpret_cast<const __m256i*>(ids_lo));
+                __m256i c1 = _mm256_load_si256(reinterpret_cast<const __m256i*>(ids_hi));
+                __m256i c2 = _mm256_set1_epi32(static_cast<int>(static_cast<uint32_t>(step)));
+                __m256i c3 = _mm256_set1_epi32(static_cast<int>(static_cast<uint32_t>(step >> 32)));
+                uint32_t k0 = key0;
+                uint32_t k1 = key1;
+                for (int round = 0; round < 10; ++round)
+                {
+                    __m256i hi0, lo0, hi1, lo1;
+                    MulHiLo8(c0, m0, hi0, lo0);
+                    MulHiLo8(c2, m1, hi1, lo1);
+                    c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), _mm256_set1_epi32(static_cast<int>(k0)));
+                    c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), _mm256_set1_epi32(static_cast<int>(k1)));
+                    c1 = lo1;
+                    c3 = lo0;
+                    k0 += kPhiloxW0;
+                    k1 += kPhiloxW1;
+                }
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(r0 + i), c0);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(r1 + i), c1);
+            }
+#endif
+            for (; i < count; ++i)
+            {
+                uint32_t counter[4] = { static_cast<uint32_t>(first + i), static_cast<uint32_t>((first + i) >> 32),
+                    static_cast<uint32_t>(step), static_cast<uint32_t>(step >> 32) };
+                uint32_t out[4];
+                Philox4x32(counter, key0, key1, out);
+                r0[i] = out[0];
+                r1[i] = out[1];
+            }
+        }
+    }
+
+    template <typename State, State Initial, typename Trigger>
+    class MarkovSimulator
+    {
+    public:
+        using SourceFsm = Fsm<State, Initial, Trigger>;
+
+        //支持的最大触发器序号
+        static const uint64_t kMaxOrdinal = 0xFFFF;
+
+        explicit MarkovSimulator(uint64_t seed = 0)
+            : seed_(seed)
+            , indexer_()
+            , symbols_()
+            , symbol_count_(1)
+            , groups_(1, Group{ 0, 0 })
+            , entries_()
+            , states_()
+            , occupancy_(1, 0)
+            , step_(0)
+        {
+            indexer_.Add(Initial);
+        }
+
+        //由状态机定义构建别名表, weight(const Trans&)返回转换的相对权重(非负)
+        //含有guard时返回FSM_GUARDED_TRANSITION, 权重为负或同一组合权重之和为0时返回FSM_INVALID_PROBABILITY
+        //构建后所有实例回到初始状态
+        template <typename Definition, typename WeightFn>
+        FsmErrors Build(const Definition& definition, WeightFn&& weight)
+        {
+            StateIndexer<State> indexer = IndexDefinitionStates<State, Initial>(definition);
+
+            std::vector<uint32_t> symbols;
+            uint32_t symbol_count = 1;
+            for (const auto& state_transitions : definition.GetTransitions())
+            {
+                for (const auto& transition : state_transitions.second)
+                {
+                    if (transition.guardfn || !transition.maskguard.Empty())
+                    {
+                        return FSM_GUARDED_TRANSITION;
+                    }
+
+                    uint64_t ordinal = TriggerOrdinal(transition.trigger);
+                    if (ordinal > kMaxOrdinal)
+                    {
+                        return FSM_TRIGGER_OUT_OF_RANGE;
+                    }
+                    if (ordinal >= symbols.size())
+                    {
+                        symbols.resize(ordinal + 1, 0);
+                    }
+                    if (symbols[ordinal] == 0)
+                    {
+                        symbols[ordinal] = symbol_count++;
+                    }
+                }
+            }
+
+            //每个(状态, 符号)组合的候选转换: (目标状态, 权重)
+            std::vector<std::vector<std::pair<uint32_t, double>>> candidates(indexer.Size() * symbol_count);
+            for (const auto& state_transitions : definition.GetTransitions())
+            {
+                size_t row = indexer.Find(state_transitions.first) * symbol_count;
+                for (const auto& transition : state_transitions.second)
+                {
+                    double w = weight(transition);
+                    if (!(w >= 0.0))
+                    {
+                        return FSM_INVALID_PROBABILITY;
+                    }
+                    candidates[row + symbols[TriggerOrdinal(transition.trigger)]].emplace_back(
+                        indexer.Find(transition.to_state), w);
+                }
+            }
+
+            std::vector<Group> groups(candidates.size(), Group{ 0, 0 });
+            std::vector<AliasEntry> entries;
+            for (size_t g = 0; g < candidates.size(); ++g)
+            {
+                if (candidates[g].empty())
+                {
+                    continue;
+                }
+                groups[g] = Group{ static_cast<uint32_t>(entries.size()), static_cast<uint32_t>(candidates[g].size()) };
+                if (!BuildAliasTable(candidates[g], entries))
+                {
+                    return FSM_INVALID_PROBABILITY;
+                }
+            }
+
+            indexer_ = std::move(indexer);
+            symbols_.swap(symbols);
+            symbol_count_ = symbol_count;
+            groups_.swap(groups);
+            entries_.swap(entries);
+            Reset();
+            return FSM_SUCCESS;
+        }
+
+        //所有转换权重相同, 即同一组合的候选转换等概率
+        template <typename Definition>
+        FsmErrors Build(const Definition& definition)
+        {
+            using Trans = typename std::decay<decltype(*definition.GetTransitions().begin()->second.begin())>::type;
+            return Build(definition, [](const Trans&) { return 1.0; });
+        }
+
+        //设置实例数, 所有实例回到初始状态, 步数清零
+        void Resize(size_t instances)
+        {
+            states_.resize(instances);
+            Reset();
+        }
+
+        size_t Size() const
+        {
+            return states_.size();
+        }
+
+        //所有实例回到初始状态, 步数清零
+        void Reset()
+        {
+            std::fill(states_.begin(), states_.end(), 0);
+            occupancy_.assign(indexer_.Size(), 0);
+            occupancy_[0] = states_.size();
+            step_ = 0;
+        }
+
+        //更换种子, 之后的步骤使用新的随机数序列
+        void SetSeed(uint64_t seed)
+        {
+            seed_ = seed;
+        }
+
+        //对所有实例施加同一个触发器, threads为0时使用硬件线程数
+        //结果只由(种子, 实例编号, 步数)决定, 与线程数无关
+        void Step(Trigger trigger, size_t threads = 1)
+        {
+            uint64_t ordinal = TriggerOrdinal(trigger);
+            uint32_t symbol = ordinal < symbols_.size() ? symbols_[ordinal] : 0;
+            if (symbol == 0)
+            {
+                ++step_;
+                return;//没有任何转换, 所有实例保持原状态
+            }
+
+            if (threads == 0)
+            {
+                threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+            }
+            size_t chunk_count = std::max<size_t>(1, std::min(threads, states_.size() / kMinChunkSize));
+            size_t chunk_size = states_.size() / chunk_count;
+
+            std::vector<std::vector<uint64_t>> counts(chunk_count, std::vector<uint64_t>(indexer_.Size(), 0));
+            std::vector<std::thread> workers;
+            workers.reserve(chunk_count - 1);
+            bool spawn = true;
+            for (size_t c = 1; c < chunk_count; ++c)
+            {
+                size_t begin = c * chunk_size;
+                size_t end = (c + 1 == chunk_count) ? states_.size() : begin + chunk_size;
+                auto work = [this, &counts, begin, end, symbol, c] {
+                    Advance(begin, end, symbol, counts[c]);
+                };
+                if (spawn)
+                {
+                    try
+                    {
+                        workers.emplace_back(work);
+                        continue;
+                    }
+                    catch (const std::system_error&)
+                    {
+                        spawn = false;//无法再创建线程, 剩余的块由当前线程执行, 已启动的线程照常汇合
+                    }
+                }
+                work();
+            }
+            Advance(0, chunk_count == 1 ? states_.size() : chunk_size, symbol, counts[0]);
+            for (auto& worker : workers)
+            {
+                worker.join();
+            }
+
+            std::fill(occupancy_.begin(), occupancy_.end(), 0);
+            for (const auto& chunk_counts : counts)
+            {
+                for (size_t s = 0; s < occupancy_.size(); ++s)
+                {
+                    occupancy_[s] += chunk_counts[s];
+                }
+            }
+            ++step_;
+        }
+
+        //按schedule依次执行各步, 返回每一步之后的占用直方图
+        std::vector<std::vector<uint64_t>> Simulate(const std::vector<Trigger>& schedule, size_t threads = 1)
+        {
+            std::vector<std::vector<uint64_t>> histograms;
+            histograms.reserve(schedule.size());
+            for (Trigger trigger : schedule)
+            {
+                Step(trigger, threads);
+                histograms.push_back(occupancy_);
+            }
+            return histograms;
+        }
+
+        //最近一步之后各状态的实例数, 以状态编号为下标
+        const std::vector<uint64_t>& Occupancy() const
+        {
+            return occupancy_;
+        }
+
+        //处于状态s的实例数
+        uint64_t Count(State s) const
+        {
+            StateIndex idx = indexer_.Find(s);
+            return idx == kInvalidStateIndex ? 0 : occupancy_[idx];
+        }
+
+        State GetState(size_t instance) const
+        {
+            return indexer_.At(states_[instance]);
+        }
+
+        //已执行的步数
+        uint64_t StepCount() const
+        {
+            return step_;
+        }
+
+        size_t StateCount() const
+        {
+            return indexer_.Size();
+        }
+
+        //返回状态对应的编号, 初始状态编号为0
+        StateIndex FindState(State s) const
+        {
+            return indexer_.Find(s);
+        }
+
+        State StateAt(StateIndex idx) const
+        {
+            return indexer_.At(idx);
+        }
+
+        //按组件估算的内存占用; instance_bytes 为每个实例保存的状态编号
+        MemoryReport MemoryUsage() const
+        {
+            MemoryReport report;
+            report.Add("object", sizeof(*this));
+            report.Add("state_index", indexer_.MemoryBytes());
+            report.Add("symbols", detail::VectorBytes(symbols_));
+            report.Add("alias_tables", detail::VectorBytes(groups_) + detail::VectorBytes(entries_));
+            report.Add("instances", detail::VectorBytes(states_));
+            report.Add("occupancy", detail::VectorBytes(occupancy_));
+            report.instance_bytes = sizeof(uint32_t);
+            return report;
+        }
+
+    private:
+        //(状态, 符号)组合在entries_中的区间, count为0表示没有转换
+        struct Group
+        {
+            uint32_t offset;
+            uint32_t count;
+        };
+
+        //别名表的一列: 随机数低于threshold时取target, 否则取alias
+        struct AliasEntry
+        {
+            uint32_t threshold;
+            uint32_t target;
+            uint32_t alias;
+        };
+
+        //每个线程至少处理的实例数
+        static const size_t kMinChunkSize = 64 * 1024;
+        //每批生成随机数的实例数
+        static const size_t kBatchSize = 256;
+
+        //Vose方法构建别名表
+        static bool BuildAliasTable(const std::vector<std::pair<uint32_t, double>>& candidates,
+            std::vector<AliasEntry>& entries)
+        {
+            double total = 0.0;
+            for (const auto& candidate : candidates)
+            {
+                total += candidate.second;
+            }
+            if (!(total > 0.0))
+            {
+                return false;
+            }
+
+            size_t n = candidates.size();
+            size_t base = entries.size();
+            std::vector<double> scaled(n);
+            std::vector<size_t> small;
+            std::vector<size_t> large;
+            for (size_t i = 0; i < n; ++i)
+            {
+                scaled[i] = candidates[i].second * static_cast<double>(n) / total;
+                (scaled[i] < 1.0 ? small : large).push_back(i);
+                entries.push_back(AliasEntry{ 0xFFFFFFFFu, candidates[i].first, candidates[i].first });
+            }
+
+            while (!small.empty() && !large.empty())
+            {
+                size_t s = small.back();
+                small.pop_back();
+                size_t l = large.back();
+
+                entries[base + s].threshold = static_cast<uint32_t>(scaled[s] * 4294967296.0);
+                entries[base + s].alias = candidates[l].first;
+                scaled[l] -= 1.0 - scaled[s];
+                if (scaled[l] < 1.0)
+                {
+                    large.pop_back();
+                    small.push_back(l);
+                }
+            }
+            //剩余的列概率为1(浮点误差), 总是取自身
+            return true;
+        }
+
+        //推进[begin, end)中的实例并统计结束状态
+        void Advance(size_t begin, size_t end, uint32_t symbol, std::vector<uint64_t>& counts)
+        {
+            uint32_t r0[kBatchSize];
+            uint32_t r1[kBatchSize];
+            const Group* groups = groups_.data();
+            const AliasEntry* entries = entries_.data();
+            uint32_t* states = states_.data();
+            for (size_t first = begin; first < end; first += kBatchSize)
+            {
+                size_t count = std::min(kBatchSize, end - first);
+                detail::PhiloxBatch(first, count, step_, seed_, r0, r1);
+                for (size_t k = 0; k < count; ++k)
+                {
+                    uint32_t state = states[first + k];
+                    const Group& group = groups[state * symbol_count_ + symbol];
+                    if (group.count != 0)
+                    {
+                        const AliasEntry& entry = entries[group.offset
+                            + static_cast<uint32_t>((static_cast<uint64_t>(r0[k]) * group.count) >> 32)];
+                        state = r1[k] < entry.threshold ? entry.target : entry.alias;
+                        states[first + k] = state;
+                    }
+                    ++counts[state];
+                }
+            }
+        }
+
+        uint64_t seed_;
+        StateIndexer<State> indexer_;
+        std::vector<uint32_t> symbols_;//触发器序号 -> 符号编号, 0表示没有转换
+        uint32_t symbol_count_;
+        std::vector<Group> groups_;//状态数 x 符号数
+        std::vector<AliasEntry> entries_;
+        std::vector<uint32_t> states_;//每个实例的状态编号
+        std::vector<uint64_t> occupancy_;
+        uint64_t step_;
+    };
+
+    template <typename State, State Initial, typename Trigger>
+    const uint64_t MarkovSimulator<State, Initial, Trigger>::kMaxOrdinal;
+    template <typename State, State Initial, typename Trigger>
+    const size_t MarkovSimulator<State, Initial, Trigger>::kMinChunkSize;
+    template <typename State, State Initial, typename Trigger>
+    const size_t MarkovSimulator<State, Initial, Trigger>::kBatchSize;
+}
@@ -0,0 +1,283 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+//内存占用报告
+//各个引擎的 MemoryUsage() 按组件返回 MemoryReport: 组件名称 -> 字节数, 以及每增加一个实例需要的字节数
+//- 组件的字节数由容器的容量估算: vector按capacity计, 哈希表计桶数组和每个节点(键值、next指针、缓存的哈希值),
+//  不含malloc自身的开销; 哈希值是否缓存见 detail::CachesHash
+//- std::function 捕获的对象可能在堆上, 大小无法从外部得知, 报告中只计 std::function 对象本身;
+//  准确的字节数用下面的计数钩子测量
+//
+//计数钩子: 在程序的一个源文件中写 FSM_DEFINE_ACCOUNTING_OPERATOR_NEW 替换全局的operator new/delete,
+//之后在 ScopedAllocationAccount 作用域内的分配都记在指定的 AllocationAccount 上, 例如
+//  fsm::AllocationAccount account;
+//  { fsm::ScopedAllocationAccount scope(account); definition.AddTransitions(...); }
+//  account.Bytes() 为定义当前占用的堆内存, 包括 std::function 捕获的对象
+//每块内存前有16字节的头部记录所属账户和大小, 释放时(不论在哪个作用域)从所属账户中减去;
+//账户的生命周期需要覆盖记在它上面的内存
+
+//计数版本的operator new/delete在同一个源文件中定义, 内联后编译器会把头部的偏移误报为越界, 因此不内联
+#if defined(__GNUC__)
+#define FSM_MEMORY_NOINLINE __attribute__((noinline))
+#else
+#define FSM_MEMORY_NOINLINE
+#endif
+
+namespace fsm
+{
+    struct MemoryReport
+    {
+        std::vector<std::pair<const char*, size_t>> components;//组件名称 -> 字节数
+        size_t instance_bytes = 0;//每增加一个实例需要的字节数
+
+        //累加组件的字节数, 名称相同的组件合并
+        void Add(const char* component, size_t bytes)
+        {
+            for (std::pair<const char*, size_t>& entry : components)
+            {
+                if (std::strcmp(entry.first, component) == 0)
+                {
+                    entry.second += bytes;
+                    return;
+                }
+            }
+            components.emplace_back(component, bytes);
+        }
+
+        //组件的字节数, 没有该组件时为0
+        size_t Bytes(const char* component) const
+        {
+            for (const std::pair<const char*, size_t>& entry : components)
+            {
+                if (std::strcmp(entry.first, component) == 0)
+                {
+                    return entry.second;
+                }
+            }
+            return 0;
+        }
+
+        size_t Total() const
+        {
+            size_t total = 0;
+            for (const std::pair<const char*, size_t>& entry : components)
+            {
+                total += entry.second;
+            }
+            return total;
+        }
+    };
+
+    namespace detail
+    {
+        template <typename T, typename Alloc>
+        inline size_t VectorBytes(const std::vector<T, Alloc>& v)
+        {
+            return v.capacity() * sizeof(T);
+        }
+
+        template <typename Alloc>
+        inline size_t VectorBytes(const std::vector<bool, Alloc>& v)
+        {
+            return v.capacity() / 8;
+        }
+
+        //节点中是否保存哈希值: libstdc++只在哈希函数较慢(字符串等)或可能抛出异常时保存,
+        //整数和枚举键的std::hash不保存; 其他标准库按保存计, 结果是上界
+        //std::__is_fast_hash 是libstdc++的内部特征(GCC 4.7起存在), 可能随GCC版本改变;
+        //它不存在或含义改变时定义 FSM_NO_GLIBCXX_FAST_HASH, 按保存计
+        template <typename Map>
+        constexpr bool CachesHash()
+        {
+#if defined(__GLIBCXX__) && !defined(FSM_NO_GLIBCXX_FAST_HASH)
+            return !std::__is_fast_hash<typename Map::hasher>::value
+                || !noexcept(std::declval<const typename Map::hasher&>()(std::declval<const typename Map::key_type&>()));
+#else
+            return true;
+#endif
+        }
+
+        //桶数组加上每个节点: next指针、键值和(保存时)哈希值
+        template <typename Map>
+        inline size_t HashBytes(const Map& map)
+        {
+            return map.bucket_count() * sizeof(void*)
+                + map.size() * (sizeof(void*) + sizeof(typename Map::value_type) + (CachesHash<Map>() ? sizeof(size_t) : 0));
+        }
+
+        //新ABI: 超出短字符串优化的部分在堆上;
+        //旧ABI(写时复制): 非空字符串都在堆上, 数据前有长度、容量和引用计数组成的头部
+        inline size_t StringBytes(const std::string& s)
+        {
+#if defined(_GLIBCXX_USE_CXX11_ABI) && _GLIBCXX_USE_CXX11_ABI == 0
+            return s.empty() ? 0 : s.capacity() + 1 + 3 * sizeof(size_t);
+#else
+            return s.capacity() > std::string().capacity() ? s.capacity() + 1 : 0;
+#endif
+        }
+    }
+
+    class AllocationAccount
+    {
+    public:
+        AllocationAccount()
+            : bytes_(0)
+            , allocations_(0)
+        {
+        }
+
+        AllocationAccount(const AllocationAccount&) = delete;
+        AllocationAccount& operator=(const AllocationAccount&) = delete;
+
+        //记在本账户上且尚未释放的字节数
+        int64_t Bytes() const
+        {
+            return bytes_.load(std::memory_order_relaxed);
+        }
+
+        //记在本账户上且尚未释放的内存块数
+        int64_t Allocations() const
+        {
+            return allocations_.load(std::memory_order_relaxed);
+        }
+
+        void Record(int64_t bytes, int64_t allocations)
+        {
+            bytes_.fetch_add(bytes, std::memory_order_relaxed);
+            allocations_.fetch_add(allocations, std::memory_order_relaxed);
+        }
+
+    private:
+        std::atomic<int64_t> bytes_;
+        std::atomic<int64_t> allocations_;
+    };
+
+    namespace detail
+    {
+        inline AllocationAccount*& CurrentAccount()
+        {
+            static thread_local AllocationAccount* account = nullptr;
+            return account;
+        }
+
+        //头部: 所属账户和大小, 16字节保持malloc的对齐
+        struct AllocationHeader
+        {
+            AllocationAccount* account;
+            size_t size;
+        };
+        static_assert(sizeof(AllocationHeader) == 16, "allocation header must keep 16-byte alignment");
+
+        FSM_MEMORY_NOINLINE inline void* AccountedAlloc(size_t size)
+        {
+            void* block = std::malloc(sizeof(AllocationHeader) + size);
+            if (block == nullptr)
+            {
+                return nullptr;
+            }
+            AllocationHeader* header = static_cast<AllocationHeader*>(block);
+            header->account = CurrentAccount();
+            header->size = size;
+            if (header->account != nullptr)
+            {
+                header->account->Record(static_cast<int64_t>(size), 1);
+            }
+            return header + 1;
+        }
+
+        FSM_MEMORY_NOINLINE inline void AccountedFree(void* p)
+        {
+            if (p == nullptr)
+            {
+                return;
+            }
+            AllocationHeader* header = static_cast<AllocationHeader*>(p) - 1;
+            if (header->account != nullptr)
+            {
+                header->account->Record(-static_cast<int64_t>(header->size), -1);
+            }
+            std::free(header);
+        }
+    }
+
+    //作用域内本线程的分配记在account上, 可以嵌套
+    class ScopedAllocationAccount
+    {
+    public:
+        explicit ScopedAllocationAccount(AllocationAccount& account)
+            : previous_(detail::CurrentAccount())
+        {
+            detail::CurrentAccount() = &account;
+        }
+
+        ScopedAllocationAccount(const ScopedAllocationAccount&) = delete;
+        ScopedAllocationAccount& operator=(const ScopedAllocationAccount&) = delete;
+
+        ~ScopedAllocationAccount()
+        {
+            detail::CurrentAccount() = previous_;
+        }
+
+    private:
+        AllocationAccount* previous_;
+    };
+}
+
+//在程序的一个源文件中使用, 用计数版本替换全局的operator new/delete
+#define FSM_DEFINE_ACCOUNTING_OPERATOR_NEW \
+    void* operator new(size_t size) \
+    { \
+        void* p = ::fsm::detail::AccountedAlloc(size); \
+        if (p == nullptr) \
+        { \
+            throw std::bad_alloc(); \
+        } \
+        return p; \
+    } \
+    void* operator new[](size_t size) \
+    { \
+        return operator new(size); \
+    } \
+    void* operator new(size_t size, const std::nothrow_t&) noexcept \
+    { \
+        return ::fsm::detail::AccountedAlloc(size); \
+    } \
+    void* operator new[](size_t size, const std::nothrow_t&) noexcept \
+    { \
+        return ::fsm::detail::AccountedAlloc(size); \
+    } \
+    void operator delete(void* p) noexcept \
+    { \
+        ::fsm::detail::AccountedFree(p); \
+    } \
+    void operator delete[](void* p) noexcept \
+    { \
+        ::fsm::detail::AccountedFree(p); \
+    } \
+    void operator delete(void* p, size_t) noexcept \
+    { \
+        ::fsm::detail::AccountedFree(p); \
+    } \
+    void operator delete[](void* p, size_t) noexcept \
+    { \
+        ::fsm::detail::AccountedFree(p); \
+    } \
+    void operator delete(void* p, const std::nothrow_t&) noexcept \
+    { \
+        ::fsm::detail::AccountedFree(p); \
+    } \
+    void operator delete[](void* p, const std::nothrow_t&) noexcept \
+    { \
+        ::fsm::detail::AccountedFree(p); \
+    }
@@ -0,0 +1,379 @@
+#pragma once
+
+#include "fsmcpp.hpp"
+
+#include <stdint.h>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+//由SPSC环形队列连接的状态机流水线
+//分帧、会话、应用等多个状态机串成一条链, 上一级action产生的事件作为下一级的触发器
+//- SpscRing 是单生产者单消费者的环形队列: 读写位置分别放在独立的缓存行, 双方各自缓存对方的位置,
+//  只有缓存的位置不够用时才读取对方的原子变量; 支持一次放入或取出一批元素
+//- StageEmitter 供action向下一级发送触发器: 先写入固定大小的本地批次, 批次满或本级处理完一批输入后整批放入环形队列, 不分配内存
+//- Pipeline 为每一级启动一个线程(可以绑定到指定的CPU), 循环从输入队列取出一批触发器依次执行;
+//  所有线程都创建成功后各级才开始处理, 某个线程创建失败时已启动的线程直接退出, Start抛出std::system_error;
+//  输入队列关闭并取空后, 该级刷新并关闭自己的输出, 关闭沿流水线传递, Join等待所有级处理完毕
+//下游队列满时上游等待, 形成背压; 流水线不能有环
+
+namespace fsm
+{
+    template <typename T>
+    class SpscRing
+    {
+    public:
+        //容量向上取整为2的幂
+        explicit SpscRing(size_t capacity)
+            : buffer_(RoundUp(capacity))
+            , mask_(buffer_.size() - 1)
+            , head_(0)
+            , cached_tail_(0)
+            , tail_(0)
+            , cached_head_(0)
+            , closed_(false)
+        {
+        }
+
+        SpscRing(const SpscRing&) = delete;
+        SpscRing& operator=(const SpscRing&) = delete;
+
+        size_t Capacity() const
+        {
+            return buffer_.size();
+        }
+
+        //生产者: 放入最多count个元素, 返回放入的个数
+        size_t TryPush(const T* items, size_t count)
+        {
+            size_t tail = tail_.load(std::memory_order_relaxed);
+            size_t free = buffer_.size() - (tail - cached_head_);
+            if (free < count)
+            {
+                cached_head_ = head_.load(std::memory_order_acquire);
+                free = buffer_.size() - (tail - cached_head_);
+            }
+            count = std::min(count, free);
+            for (size_t i = 0; i < count; ++i)
+            {
+                buffer_[(tail + i) & mask_] = items[i];
+            }
+            tail_.store(tail + count, std::memory_order_release);
+            return count;
+        }
+
+        bool TryPush(const T& item)
+        {
+            return TryPush(&item, 1) == 1;
+        }
+
+        //消费者: 取出最多max个元素, 返回取出的个数
+        size_t TryPop(T* out, size_t max)
+        {
+            size_t head = head_.load(std::memory_order_relaxed);
+            size_t available = cached_tail_ - head;
+            if (available < max)
+            {
+                cached_tail_ = tail_.load(std::memory_order_acquire);
+                available = cached_tail_ - head;
+            }
+            size_t count = std::min(max, available);
+            for (size_t i = 0; i < count; ++i)
+            {
+                out[i] = buffer_[(head + i) & mask_];
+            }
+            head_.store(head + count, std::memory_order_release);
+            return count;
+        }
+
+        bool TryPop(T& item)
+        {
+            return TryPop(&item, 1) == 1;
+        }
+
+        //生产者: 不再放入元素
+        void Close()
+        {
+            closed_.store(true, std::memory_order_release);
+        }
+
+        //消费者: 生产者已经关闭并且队列已经取空
+        bool Drained() const
+        {
+            //先读关闭标志, 再读写位置: 关闭之前放入的元素一定可见
+            return closed_.load(std::memory_order_acquire)
+                && tail_.load(std::memory_order_acquire) == head_.load(std::memory_order_relaxed);
+        }
+
+    private:
+        static size_t RoundUp(size_t capacity)
+        {
+            size_t size = 1;
+            while (size < capacity)
+            {
+                size <<= 1;
+            }
+            return size;
+        }
+
+        //各组字段之间至少相隔一个缓存行, 生产者和消费者不会写同一个缓存行
+        std::vector<T> buffer_;
+        size_t mask_;
+        char pad0_[64];
+        std::atomic<size_t> head_;//消费者写
+        size_t cached_tail_;//消费者缓存的写位置
+        char pad1_[64];
+        std::atomic<size_t> tail_;//生产者写
+        size_t cached_head_;//生产者缓存的读位置
+        char pad2_[64];
+        std::atomic<bool> closed_;
+    };
+
+    //action向下一级发送触发器, 只能由所在级的线程使用
+    template <typename Trigger>
+    class StageEmitter
+    {
+    public:
+        explicit StageEmitter(SpscRing<Trigger>& ring)
+            : ring_(ring)
+            , count_(0)
+        {
+        }
+
+        StageEmitter(const StageEmitter&) = delete;
+        StageEmitter& operator=(const StageEmitter&) = delete;
+
+        void Emit(Trigger trigger)
+        {
+            if (count_ == kBatch)
+            {
+                Flush();
+            }
+            batch_[count_++] = trigger;
+        }
+
+        //把本地批次全部放入队列, 队列满时等待下游
+        void Flush()
+        {
+            size_t pushed = 0;
+            while (pushed < count_)
+            {
+                size_t n = ring_.TryPush(batch_ + pushed, count_ - pushed);
+                if (n == 0)
+                {
+                    std::this_thread::yield();
+                }
+                pushed += n;
+            }
+            count_ = 0;
+        }
+
+        //刷新并关闭下游队列
+        void Close()
+        {
+            Flush();
+            ring_.Close();
+        }
+
+    private:
+        static const size_t kBatch = 64;
+
+        SpscRing<Trigger>& ring_;
+        Trigger batch_[kBatch];
+        size_t count_;
+    };
+
+    template <typename Trigger>
+    const size_t StageEmitter<Trigger>::kBatch;
+
+    //每一级的统计, Join之后读取
+    struct PipelineStageStats
+    {
+        uint64_t events = 0;//执行的触发器数
+        uint64_t rejected = 0;//返回值不是FSM_SUCCESS的触发器数
+        uint64_t batches = 0;//取到输入的批次数
+        double busy_seconds = 0;//处理批次所用的时间, 不含等待输入
+    };
+
+    class Pipeline
+    {
+    public:
+        Pipeline()
+            : stages_()
+            , threads_()
+            , gate_(kGateClosed)
+        {
+        }
+
+        Pipeline(const Pipeline&) = delete;
+        Pipeline& operator=(const Pipeline&) = delete;
+
+        ~Pipeline()
+        {
+            Join();
+        }
+
+        //添加一级: 从input取触发器交给machine执行, machine的action通过output发送到下一级; cpu为负数或超出CPU_SETSIZE时不绑定
+        //machine, input和output的生命周期需要覆盖流水线的运行
+        template <typename Machine, typename In, typename Out>
+        void AddStage(Machine& machine, SpscRing<In>& input, StageEmitter<Out>& output, int32_t cpu = -1)
+        {
+            AddStage(machine, input, &output, cpu);
+        }
+
+        //添加最后一级, 没有下游
+        template <typename Machine, typename In>
+        void AddStage(Machine& machine, SpscRing<In>& input, int32_t cpu = -1)
+        {
+            AddStage(machine, input, static_cast<StageEmitter<In>*>(nullptr), cpu);
+        }
+
+        //为每一级启动线程; 线程创建失败时汇合已启动的线程后抛出std::system_error, 各级都没有处理输入
+        void Start()
+        {
+            gate_.store(kGateClosed, std::memory_order_relaxed);
+            try
+            {
+                for (std::unique_ptr<Stage>& stage : stages_)
+                {
+                    Stage* s = stage.get();
+                    threads_.emplace_back([this, s] {
+                        PinToCpu(s->cpu);
+                        int32_t gate;
+                        while ((gate = gate_.load(std::memory_order_acquire)) == kGateClosed)
+                        {
+                            std::this_thread::yield();
+                        }
+                        if (gate == kGateOpen)
+                        {
+                            s->run(s->stats);
+                        }
+                    });
+                }
+            }
+            catch (const std::system_error&)
+            {
+                gate_.store(kGateAborted, std::memory_order_release);
+                Join();
+                throw;
+            }
+            gate_.store(kGateOpen, std::memory_order_release);
+        }
+
+        //等待所有级处理完毕; 第一级的输入队列需要由生产者关闭
+        void Join()
+        {
+            for (std::thread& thread : threads_)
+            {
+                thread.join();
+            }
+            threads_.clear();
+        }
+
+        size_t StageCount() const
+        {
+            return stages_.size();
+        }
+
+        const PipelineStageStats& Stats(size_t stage) const
+        {
+            return stages_[stage]->stats;
+        }
+
+    private:
+        struct Stage
+        {
+            std::function<void(PipelineStageStats&)> run;
+            int32_t cpu;
+            PipelineStageStats stats;
+        };
+
+        //一次从输入队列取出的触发器个数
+        static const size_t kBatch = 64;
+        //连续多少次取不到输入后让出CPU
+        static const uint32_t kSpinsBeforeYield = 64;
+        //Start中各级线程等待的开关: 所有线程创建成功后打开, 有线程创建失败时放弃
+        static const int32_t kGateClosed = 0;
+        static const int32_t kGateOpen = 1;
+        static const int32_t kGateAborted = 2;
+
+        template <typename Machine, typename In, typename Out>
+        void AddStage(Machine& machine, SpscRing<In>& input, StageEmitter<Out>* output, int32_t cpu)
+        {
+            std::unique_ptr<Stage> stage(new Stage());
+            stage->cpu = cpu;
+            stage->run = [&machine, &input, output](PipelineStageStats& stats) {
+                using Clock = std::chrono::steady_clock;
+                In batch[kBatch];
+                Clock::duration busy = Clock::duration::zero();
+                uint32_t idle = 0;
+                for (;;)
+                {
+                    size_t count = input.TryPop(batch, kBatch);
+                    if (count == 0)
+                    {
+                        if (input.Drained())
+                        {
+                            break;
+                        }
+                        if (++idle >= kSpinsBeforeYield)
+                        {
+                            std::this_thread::yield();
+                        }
+                        continue;
+                    }
+                    idle = 0;
+
+                    Clock::time_point start = Clock::now();
+                    for (size_t i = 0; i < count; ++i)
+                    {
+                        if (machine.Execute(batch[i]) != FSM_SUCCESS)
+                        {
+                            ++stats.rejected;
+                        }
+                    }
+                    if (output != nullptr)
+                    {
+                        output->Flush();//本批的输出整批交给下游
+                    }
+                    busy += Clock::now() - start;
+                    stats.events += count;
+                    ++stats.batches;
+                }
+                if (output != nullptr)
+                {
+                    output->Close();
+                }
+                stats.busy_seconds = std::chrono::duration<double>(busy).count();
+            };
+            stages_.push_back(std::move(stage));
+        }
+
+        static void PinToCpu(int32_t cpu)
+        {
+#if defined(__linux__)
+            if (cpu >= 0 && cpu < CPU_SETSIZE)
+            {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(static_cast<size_t>(cpu), &set);
+                pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            }
+#endif
+        }
+
+        std::vector<std::unique_ptr<Stage>> stages_;
+        std::vector<std::thread> threads_;
+        std::atomic<int32_t> gate_;
+    };
+}
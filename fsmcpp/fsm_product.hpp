@@ -0,0 +1,346 @@
+#pragma once
+
+#include "fsm_state_index.hpp"
+
+#include <stdint.h>
+
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+//同步执行的多个状态机的乘积自动机
+//多个小状态机(例如协议状态、认证状态、限流状态)处理同一个触发器流时, 每个事件要在每个状态机中各查找一次
+//ProductFsm 从初始状态组合出发, 只构造可达的乘积状态, 得到一张 乘积状态数 x 触发器数 的稠密表,
+//执行时一次查表即可同时推进所有组成状态机, 再通过ComponentState<I>()取出第I个状态机的状态
+//语义与对每个组成状态机依次调用Execute相同: 没有匹配转换的状态机保持原状态,
+//至少一个状态机有匹配转换时返回FSM_SUCCESS
+//组成状态机必须无guard, 触发器类型相同且为整数或枚举类型; 乘积表只描述状态的变化, action不会被调用
+//乘积状态数可能随组成状态机的个数指数增长, 构建时超过给定上限会停止并返回FSM_STATE_LIMIT_EXCEEDED
+
+namespace fsm
+{
+    template <typename Trigger, typename... Machines>
+    class ProductFsm
+    {
+    public:
+        //组成状态机个数
+        static const size_t kComponents = sizeof...(Machines);
+        //默认的乘积状态数上限
+        static const size_t kDefaultMaxStates = 1 << 20;
+        //支持的最大触发器序号
+        static const uint64_t kMaxOrdinal = 0xFFFF;
+
+        ProductFsm()
+            : indexers_()
+            , symbols_()
+            , symbol_count_(0)
+            , table_()
+            , components_()
+            , current_state_(0)
+        {
+        }
+
+        //组成状态机各自状态数的乘积, 即乘积状态数的上界
+        static uint64_t UpperBound(const Machines&... machines)
+        {
+            uint64_t bound = 1;
+            uint64_t counts[] = { static_cast<uint64_t>(IndexStates(machines).Size())... };
+            for (uint64_t count : counts)
+            {
+                bound *= count;
+            }
+            return bound;
+        }
+
+        //构建可达的乘积自动机, 可达乘积状态数超过max_states时返回FSM_STATE_LIMIT_EXCEEDED
+        //先在局部对象中构建, 成功后才替换当前内容; 失败时当前内容不变
+        FsmErrors Build(size_t max_states, const Machines&... machines)
+        {
+            ProductFsm built;
+            built.indexers_ = Indexers(IndexStates(machines)...);
+
+            FsmErrors err_code = built.BuildSymbols(machines...);
+            if (err_code != FSM_SUCCESS)
+            {
+                return err_code;
+            }
+
+            std::vector<ComponentTable> tables;
+            err_code = built.BuildComponentTables(tables, std::index_sequence_for<Machines...>(), machines...);
+            if (err_code != FSM_SUCCESS)
+            {
+                return err_code;
+            }
+
+            err_code = built.Explore(tables, max_states);
+            if (err_code != FSM_SUCCESS)
+            {
+                return err_code;
+            }
+
+            std::swap(indexers_, built.indexers_);
+            symbols_.swap(built.symbols_);
+            symbol_count_ = built.symbol_count_;
+            table_.swap(built.table_);
+            components_.swap(built.components_);
+            current_state_ = 0;
+            return FSM_SUCCESS;
+        }
+
+        FsmErrors Build(const Machines&... machines)
+        {
+            return Build(kDefaultMaxStates, machines...);
+        }
+
+        //可达的乘积状态数
+        size_t StateCount() const
+        {
+            return components_.size() / kComponents;
+        }
+
+        //重置为所有组成状态机都处于初始状态
+        void Reset()
+        {
+            current_state_ = 0;
+        }
+
+        //所有组成状态机同时执行触发器, 一次查表
+        FsmErrors Execute(Trigger trigger)
+        {
+            return Execute(current_state_, trigger);
+        }
+
+        //以外部保存的乘积状态编号执行触发器
+        FsmErrors Execute(StateIndex& state, Trigger trigger) const
+        {
+            uint64_t ordinal = TriggerOrdinal(trigger);
+            if (ordinal >= symbols_.size() || symbols_[ordinal] == kNone)
+            {
+                return FSM_NO_MATCHING_TRIGGER;
+            }
+
+            uint32_t next = table_[state * symbol_count_ + symbols_[ordinal]];
+            if (next == kNone)
+            {
+                return FSM_NO_MATCHING_TRIGGER;
+            }
+            state = next;
+            return FSM_SUCCESS;
+        }
+
+        //当前乘积状态编号, 初始组合为0
+        StateIndex GetStateIndex() const
+        {
+            return current_state_;
+        }
+
+        //第I个组成状态机在当前乘积状态中的状态
+        template <size_t I>
+        auto ComponentState() const -> decltype(std::get<I>(std::declval<std::tuple<Machines...>>()).GetState())
+        {
+            return ComponentState<I>(current_state_);
+        }
+
+        //第I个组成状态机在乘积状态state中的状态
+        template <size_t I>
+        auto ComponentState(StateIndex state) const
+            -> decltype(std::get<I>(std::declval<std::tuple<Machines...>>()).GetState())
+        {
+            return std::get<I>(indexers_).At(components_[state * kComponents + I]);
+        }
+
+        //按组件估算的内存占用; instance_bytes 为通过 Execute(StateIndex&, ...) 共享本定义时每个实例的字节数
+        MemoryReport MemoryUsage() const
+        {
+            MemoryReport report;
+            report.Add("object", sizeof(*this));
+            report.Add("state_index", IndexerBytes(std::index_sequence_for<Machines...>()));
+            report.Add("symbols", detail::VectorBytes(symbols_));
+            report.Add("table", detail::VectorBytes(table_));
+            report.Add("components", detail::VectorBytes(components_));
+            report.instance_bytes = sizeof(StateIndex);
+            return report;
+        }
+
+    private:
+        using Indexers = std::tuple<StateIndexer<decltype(std::declval<Machines>().GetState())>...>;
+
+        //单个组成状态机的稠密转换表: 状态数 x 触发器数, kNone表示没有匹配的转换
+        struct ComponentTable
+        {
+            size_t state_count;
+            std::vector<uint32_t> next;
+        };
+
+        static const uint32_t kNone = 0xFFFFFFFFu;
+
+        template <size_t... I>
+        size_t IndexerBytes(std::index_sequence<I...>) const
+        {
+            size_t sizes[] = { 0, std::get<I>(indexers_).MemoryBytes()... };
+            size_t total = 0;
+            for (size_t size : sizes)
+            {
+                total += size;
+            }
+            return total;
+        }
+
+        //把所有组成状态机中出现的触发器序号映射为连续的符号编号
+        FsmErrors BuildSymbols(const Machines&... machines)
+        {
+            symbols_.clear();
+            symbol_count_ = 0;
+            FsmErrors errs[] = { CollectSymbols(machines)... };
+            for (FsmErrors err : errs)
+            {
+                if (err != FSM_SUCCESS)
+                {
+                    return err;
+                }
+            }
+            return FSM_SUCCESS;
+        }
+
+        template <typename Machine>
+        FsmErrors CollectSymbols(const Machine& machine)
+        {
+            for (const auto& state_transitions : machine.GetTransitions())
+            {
+                for (const auto& transition : state_transitions.second)
+                {
+                    if (transition.guardfn || !transition.maskguard.Empty())
+                    {
+                        return FSM_GUARDED_TRANSITION;
+                    }
+
+                    uint64_t ordinal = TriggerOrdinal(transition.trigger);
+                    if (ordinal > kMaxOrdinal)
+                    {
+                        return FSM_TRIGGER_OUT_OF_RANGE;
+                    }
+
+                    if (ordinal >= symbols_.size())
+                    {
+                        symbols_.resize(ordinal + 1, kNone);
+                    }
+                    if (symbols_[ordinal] == kNone)
+                    {
+                        symbols_[ordinal] = symbol_count_++;
+                    }
+                }
+            }
+            return FSM_SUCCESS;
+        }
+
+        template <size_t... Is>
+        FsmErrors BuildComponentTables(std::vector<ComponentTable>& tables, std::index_sequence<Is...>,
+            const Machines&... machines)
+        {
+            tables.resize(kComponents);
+            FsmErrors errs[] = { FillComponentTable(tables[Is], std::get<Is>(indexers_), machines)... };
+            for (FsmErrors err : errs)
+            {
+                if (err != FSM_SUCCESS)
+                {
+                    return err;
+                }
+            }
+            return FSM_SUCCESS;
+        }
+
+        template <typename Indexer, typename Machine>
+        FsmErrors FillComponentTable(ComponentTable& table, const Indexer& indexer, const Machine& machine) const
+        {
+            table.state_count = indexer.Size();
+            table.next.assign(table.state_count * symbol_count_, kNone);
+            for (const auto& state_transitions : machine.GetTransitions())
+            {
+                size_t row = indexer.Find(state_transitions.first) * symbol_count_;
+                for (const auto& transition : state_transitions.second)
+                {
+                    uint32_t& next = table.next[row + symbols_[TriggerOrdinal(transition.trigger)]];
+                    if (next == kNone)
+                    {
+                        next = indexer.Find(transition.to_state);//与Execute一致, 排在前面的转换优先
+                    }
+                }
+            }
+            return FSM_SUCCESS;
+        }
+
+        //从初始组合出发广度优先构造可达的乘积状态
+        FsmErrors Explore(const std::vector<ComponentTable>& tables, size_t max_states)
+        {
+            //以混合进制把组成状态编号编码为一个整数作为乘积状态的键
+            std::vector<uint64_t> radix(kComponents, 1);
+            for (size_t c = 1; c < kComponents; ++c)
+            {
+                radix[c] = radix[c - 1] * tables[c - 1].state_count;
+            }
+
+            std::unordered_map<uint64_t, uint32_t> seen;
+            std::vector<uint32_t> components(kComponents, 0);
+            std::vector<uint32_t> next_components(kComponents);
+            seen.emplace(0, 0);
+            components_.assign(components.begin(), components.end());
+            table_.clear();
+
+            for (size_t state = 0; state < components_.size() / kComponents; ++state)
+            {
+                components.assign(components_.begin() + static_cast<std::ptrdiff_t>(state * kComponents),
+                    components_.begin() + static_cast<std::ptrdiff_t>((state + 1) * kComponents));
+
+                for (uint32_t symbol = 0; symbol < symbol_count_; ++symbol)
+                {
+                    bool matched = false;
+                    uint64_t key = 0;
+                    for (size_t c = 0; c < kComponents; ++c)
+                    {
+                        uint32_t next = tables[c].next[components[c] * symbol_count_ + symbol];
+                        matched = matched || next != kNone;
+                        next_components[c] = (next == kNone) ? components[c] : next;
+                        key += next_components[c] * radix[c];
+                    }
+
+                    if (!matched)
+                    {
+                        table_.push_back(kNone);
+                        continue;
+                    }
+
+                    auto inserted = seen.emplace(key, static_cast<uint32_t>(seen.size()));
+                    if (inserted.second)
+                    {
+                        if (seen.size() > max_states)
+                        {
+                            return FSM_STATE_LIMIT_EXCEEDED;
+                        }
+                        components_.insert(components_.end(), next_components.begin(), next_components.end());
+                    }
+                    table_.push_back(inserted.first->second);
+                }
+            }
+
+            current_state_ = 0;
+            return FSM_SUCCESS;
+        }
+
+        Indexers indexers_;//各组成状态机的状态编号
+        std::vector<uint32_t> symbols_;//触发器序号 -> 符号编号
+        uint32_t symbol_count_;
+        std::vector<uint32_t> table_;//乘积状态数 x 符号数, kNone表示没有任何组成状态机匹配
+        std::vector<uint32_t> components_;//乘积状态数 x 组成状态机个数, 各组成状态机的状态编号
+        StateIndex current_state_;
+    };
+
+    template <typename Trigger, typename... Machines>
+    const size_t ProductFsm<Trigger, Machines...>::kComponents;
+    template <typename Trigger, typename... Machines>
+    const size_t ProductFsm<Trigger, Machines...>::kDefaultMaxStates;
+    template <typename Trigger, typename... Machines>
+    const uint64_t ProductFsm<Trigger, Machines...>::kMaxOrdinal;
+    template <typename Trigger, typename... Machines>
+    const uint32_t ProductFsm<Trigger, Machines...>::kNone;
+}
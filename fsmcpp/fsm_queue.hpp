@@ -0,0 +1,210 @@
+#pragma once
+
+#include "fsm_fleet.hpp"
+
+#include <stdint.h>
+
+#include <functional>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+//带合并的排队执行
+//触发器先按到达顺序放入队列, 再由RunOne/RunAll依次交给对应的状态机实例执行
+//突发负载下同一实例经常连续收到重复的触发器(例如多次"数据可读"), 逐个执行只是空转
+//可以用SetIdempotent把某个状态下的触发器标记为幂等: 实例处于该状态时, 如果队列中已经有该实例的同一触发器尚未执行,
+//新的一份直接被吸收, 不再入队. 每个实例用一个64位的位掩码记录已入队的触发器, 判断和吸收都是O(1)
+//- 是否吸收按入队时实例的状态判断; 被吸收的触发器与已排队的那一份合并, 在较早的位置执行
+//- 触发器出队时先清除对应的位, 再执行; action中再次发送同一触发器会重新入队
+//- 只有序号小于64的触发器参与合并, 其他触发器总是入队
+//- 同一触发器有多份在排队时(入队时不是幂等的), 任何一份出队都会清除位, 之后的一份不会被吸收, 只是少合并一次
+
+namespace fsm
+{
+    //Machine为提供 FsmErrors Execute(Trigger) 和 GetState() 的状态机类型, 例如 Fsm
+    template <typename Machine, typename Trigger>
+    class TriggerQueue
+    {
+    public:
+        using State = typename std::decay<decltype(std::declval<const Machine&>().GetState())>::type;
+        //执行结果不是FSM_SUCCESS时调用, 参数为实例、触发器和返回值
+        using RejectFn = std::function<void(InstanceId, Trigger, FsmErrors)>;
+
+        TriggerQueue()
+            : machines_()
+            , pending_()
+            , idempotent_()
+            , events_()
+            , head_(0)
+            , coalesced_(0)
+            , reject_fn_(nullptr)
+        {
+        }
+
+        //登记状态机实例, 队列不拥有它, 实例的生命周期需要覆盖队列的使用
+        InstanceId Attach(Machine& machine)
+        {
+            machines_.push_back(&machine);
+            pending_.push_back(0);
+            return static_cast<InstanceId>(machines_.size() - 1);
+        }
+
+        //标记或取消标记: 实例处于状态s时, 触发器trigger是幂等的
+        void SetIdempotent(State s, Trigger trigger, bool idempotent = true)
+        {
+            uint64_t ordinal = TriggerOrdinal(trigger);
+            if (ordinal >= kMaskBits)
+            {
+                return;
+            }
+            uint64_t& mask = idempotent_[s];
+            mask = idempotent ? (mask | Bit(ordinal)) : (mask & ~Bit(ordinal));
+        }
+
+        void SetRejectFn(RejectFn fn)
+        {
+            reject_fn_ = std::move(fn);
+        }
+
+        //向实例id发送触发器; 被已排队的同一触发器吸收时返回false
+        bool Post(InstanceId id, Trigger trigger)
+        {
+            uint64_t ordinal = TriggerOrdinal(trigger);
+            if (ordinal < kMaskBits)
+            {
+                uint64_t bit = Bit(ordinal);
+                if ((pending_[id] & bit) != 0 && (IdempotentMask(machines_[id]->GetState()) & bit) != 0)
+                {
+                    ++coalesced_;
+                    return false;
+                }
+                pending_[id] |= bit;
+            }
+            events_.push_back(Event{ id, trigger });
+            return true;
+        }
+
+        //实例id是否有尚未执行的触发器trigger(只记录序号小于64的触发器)
+        bool IsPending(InstanceId id, Trigger trigger) const
+        {
+            uint64_t ordinal = TriggerOrdinal(trigger);
+            return ordinal < kMaskBits && (pending_[id] & Bit(ordinal)) != 0;
+        }
+
+        //尚未执行的触发器数
+        size_t Pending() const
+        {
+            return events_.size() - head_;
+        }
+
+        //累计被吸收的触发器数
+        uint64_t Coalesced() const
+        {
+            return coalesced_;
+        }
+
+        void Reserve(size_t events)
+        {
+            events_.reserve(events);
+        }
+
+        //按组件估算的内存占用, 不含登记的状态机本身;
+        //instance_bytes 为每登记一个实例的字节数(位掩码和状态机指针), 每个排队的触发器另占一个Event
+        MemoryReport MemoryUsage() const
+        {
+            MemoryReport report;
+            report.Add("object", sizeof(*this));
+            report.Add("machines", detail::VectorBytes(machines_));
+            report.Add("pending", detail::VectorBytes(pending_));
+            report.Add("idempotent", detail::HashBytes(idempotent_));
+            report.Add("events", detail::VectorBytes(events_));
+            report.instance_bytes = sizeof(uint64_t) + sizeof(Machine*);
+            return report;
+        }
+
+        //执行队首的一个触发器, 队列为空时返回false
+        bool RunOne()
+        {
+            if (head_ == events_.size())
+            {
+                return false;
+            }
+
+            Event e = events_[head_++];
+            uint64_t ordinal = TriggerOrdinal(e.trigger);
+            if (ordinal < kMaskBits)
+            {
+                pending_[e.id] &= ~Bit(ordinal);
+            }
+            Compact();
+
+            FsmErrors err_code = machines_[e.id]->Execute(e.trigger);
+            if (err_code != FSM_SUCCESS && reject_fn_)
+            {
+                reject_fn_(e.id, e.trigger, err_code);
+            }
+            return true;
+        }
+
+        //执行所有触发器, 包括执行过程中新发送的触发器; 返回执行的个数
+        size_t RunAll()
+        {
+            size_t executed = 0;
+            while (RunOne())
+            {
+                ++executed;
+            }
+            return executed;
+        }
+
+    private:
+        struct Event
+        {
+            InstanceId id;
+            Trigger trigger;
+        };
+
+        static const uint64_t kMaskBits = 64;
+        //已执行的部分超过这个长度并且占到一半时整体前移
+        static const size_t kCompactThreshold = 1024;
+
+        static uint64_t Bit(uint64_t ordinal)
+        {
+            return uint64_t(1) << ordinal;
+        }
+
+        uint64_t IdempotentMask(const State& s) const
+        {
+            auto it = idempotent_.find(s);
+            return it == idempotent_.end() ? 0 : it->second;
+        }
+
+        void Compact()
+        {
+            if (head_ == events_.size())
+            {
+                events_.clear();
+                head_ = 0;
+            }
+            else if (head_ >= kCompactThreshold && head_ * 2 >= events_.size())
+            {
+                events_.erase(events_.begin(), events_.begin() + static_cast<std::ptrdiff_t>(head_));
+                head_ = 0;
+            }
+        }
+
+        std::vector<Machine*> machines_;
+        std::vector<uint64_t> pending_;//每个实例已入队的触发器位掩码
+        std::unordered_map<State, uint64_t> idempotent_;//每个状态下幂等的触发器位掩码
+        std::vector<Event> events_;//events_[head_]起为尚未执行的触发器
+        size_t head_;
+        uint64_t coalesced_;
+        RejectFn reject_fn_;
+    };
+
+    template <typename Machine, typename Trigger>
+    const uint64_t TriggerQueue<Machine, Trigger>::kMaskBits;
+    template <typename Machine, typename Trigger>
+    const size_t TriggerQueue<Machine, Trigger>::kCompactThreshold;
+}
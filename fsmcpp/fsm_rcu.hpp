@@ -0,0 +1,337 @@
+#pragma once
+
+#include "fsm_frozen.hpp"
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+//运行时热替换状态机定义(RCU)
+//RcuFsm 持有当前发布的冻结定义(FrozenFsm), Publish 原子地发布新定义, 不需要暂停执行:
+//- 读者通过 Reader 句柄执行, 句柄缓存定义的指针, Execute 与直接调用 FrozenFsm::Execute 完全相同, 读路径上没有原子操作和屏障;
+//  批量执行时可以在批开始时用 Get 取得定义的引用, 批内直接调用其Execute
+//- 读者在自己方便的时刻(例如处理完一批触发器之后)调用 Quiescent 宣告静止, 此时才切换到最新的定义;
+//  正在进行的 Execute 总是在旧定义上完成
+//- 写者每次发布使全局纪元加1, 被替换的定义记录在退休列表中; 所有在线读者宣告的纪元都不小于退休纪元后才释放
+//- 状态编号随定义变化, 读者在 Quiescent 时把自己持有的状态编号映射到新定义: 旧编号 -> 旧状态 -> MapFn -> 新编号,
+//  发布时可以给出MapFn处理状态改名; 读者跳过多个版本时依次经过每个版本的映射, 新定义中不存在的状态回到初始状态
+//读者长时间不执行时应调用 Offline, 否则会阻止旧定义的回收
+
+namespace fsm
+{
+    template <typename State, State Initial, typename Trigger>
+    class RcuFsm
+    {
+    public:
+        using Definition = FrozenFsm<State, Initial, Trigger>;
+        //把旧定义中的状态映射为新定义中的状态, 为nullptr时状态保持不变
+        using MapFn = std::function<State(State)>;
+
+        class Reader;
+
+        RcuFsm()
+            : current_(nullptr)
+            , epoch_(1)
+            , mutex_()
+            , slots_()
+            , retired_()
+        {
+            current_.store(new Version(), std::memory_order_release);
+        }
+
+        RcuFsm(const RcuFsm&) = delete;
+        RcuFsm& operator=(const RcuFsm&) = delete;
+
+        //销毁时所有Reader必须已经析构
+        ~RcuFsm()
+        {
+            for (Retired& retired : retired_)
+            {
+                delete retired.version;
+            }
+            delete current_.load(std::memory_order_relaxed);
+        }
+
+        //由状态机定义(Fsm或FsmBuilder)构建新定义并发布
+        template <typename Source>
+        FsmErrors Publish(const Source& source, MapFn map = nullptr)
+        {
+            std::unique_ptr<Definition> definition(new Definition());
+            FsmErrors err_code = definition->Build(source);
+            if (err_code != FSM_SUCCESS)
+            {
+                return err_code;
+            }
+            Publish(std::move(definition), std::move(map));
+            return FSM_SUCCESS;
+        }
+
+        //发布已经构建好的定义, 被替换的定义进入退休列表; 返回新定义的纪元
+        uint64_t Publish(std::unique_ptr<Definition> definition, MapFn map = nullptr)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Version* version = new Version();
+            version->definition = std::move(*definition);
+            version->map = std::move(map);
+
+            Version* old = current_.load(std::memory_order_relaxed);
+            old->next = version;//读者通过acquire读到新版本时也能看到这里的写入
+            current_.store(version, std::memory_order_seq_cst);
+            uint64_t epoch = epoch_.fetch_add(1, std::memory_order_acq_rel) + 1;
+            retired_.push_back(Retired{ epoch, old });
+            ReclaimLocked();
+            return epoch;
+        }
+
+        //释放所有在线读者都已经离开的旧定义, 返回释放的个数
+        size_t Reclaim()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return ReclaimLocked();
+        }
+
+        //等待所有旧定义都可以释放并释放它们; 需要每个在线读者之后调用Quiescent或Offline
+        void Synchronize()
+        {
+            while (Reclaim(), RetiredCount() != 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        //尚未释放的旧定义个数
+        size_t RetiredCount() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return retired_.size();
+        }
+
+        //当前的纪元, 每次发布加1
+        uint64_t Epoch() const
+        {
+            return epoch_.load(std::memory_order_acquire);
+        }
+
+        //当前发布的定义, 只在没有并发发布时使用, 例如发布之前检查
+        const Definition& Current() const
+        {
+            return current_.load(std::memory_order_acquire)->definition;
+        }
+
+        //按组件估算的内存占用: 当前定义、尚未释放的旧定义和读者登记;
+        //instance_bytes 为每个实例保存的状态编号
+        MemoryReport MemoryUsage() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            MemoryReport report;
+            report.Add("object", sizeof(*this));
+            report.Add("current", sizeof(Version) + current_.load(std::memory_order_acquire)->definition.MemoryUsage().Total());
+            size_t retired = detail::VectorBytes(retired_);
+            for (const Retired& r : retired_)
+            {
+                retired += sizeof(Version) + r.version->definition.MemoryUsage().Total();
+            }
+            report.Add("retired", retired);
+            report.Add("readers", detail::VectorBytes(slots_) + slots_.size() * sizeof(Slot));
+            report.instance_bytes = sizeof(StateIndex);
+            return report;
+        }
+
+    private:
+        struct Version
+        {
+            Definition definition;
+            MapFn map;//从上一版本到本版本的状态映射
+            Version* next = nullptr;//替换本版本的新版本
+        };
+
+        struct Retired
+        {
+            uint64_t epoch;//被替换时的纪元
+            Version* version;
+        };
+
+        //每个读者一个槽, 记录读者最近一次静止时看到的纪元; 填充到缓存行大小, 避免读者之间伪共享
+        struct Slot
+        {
+            std::atomic<uint64_t> epoch;
+            char padding[64 - sizeof(std::atomic<uint64_t>)];
+        };
+
+        static const uint64_t kOffline = std::numeric_limits<uint64_t>::max();
+
+        Slot* Register()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            slots_.emplace_back(new Slot());
+            Slot* slot = slots_.back().get();
+            slot->epoch.store(kOffline, std::memory_order_relaxed);
+            return slot;
+        }
+
+        void Unregister(Slot* slot)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (size_t i = 0; i < slots_.size(); ++i)
+            {
+                if (slots_[i].get() == slot)
+                {
+                    slots_[i] = std::move(slots_.back());
+                    slots_.pop_back();
+                    break;
+                }
+            }
+            ReclaimLocked();
+        }
+
+        size_t ReclaimLocked()
+        {
+            //与Reader::Online配对, 都使用seq_cst: 要么这里看到读者上线, 要么读者看到新发布的定义
+            uint64_t oldest = kOffline;
+            for (const std::unique_ptr<Slot>& slot : slots_)
+            {
+                oldest = std::min(oldest, slot->epoch.load(std::memory_order_seq_cst));
+            }
+
+            size_t freed = 0;
+            while (freed < retired_.size() && retired_[freed].epoch <= oldest)
+            {
+                delete retired_[freed].version;
+                ++freed;
+            }
+            retired_.erase(retired_.begin(), retired_.begin() + static_cast<std::ptrdiff_t>(freed));
+            return freed;
+        }
+
+        std::atomic<Version*> current_;
+        std::atomic<uint64_t> epoch_;
+        mutable std::mutex mutex_;//保护读者登记和退休列表, 也使发布串行化
+        std::vector<std::unique_ptr<Slot>> slots_;
+        std::vector<Retired> retired_;//按纪元递增
+    };
+
+    template <typename State, State Initial, typename Trigger>
+    const uint64_t RcuFsm<State, Initial, Trigger>::kOffline;
+
+    //读者句柄, 只能在一个线程中使用; 构造后处于在线状态并使用当前发布的定义
+    template <typename State, State Initial, typename Trigger>
+    class RcuFsm<State, Initial, Trigger>::Reader
+    {
+    public:
+        explicit Reader(RcuFsm& owner)
+            : owner_(owner)
+            , slot_(owner.Register())
+            , version_(nullptr)
+        {
+            Online();
+        }
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        ~Reader()
+        {
+            owner_.Unregister(slot_);
+        }
+
+        //读者当前使用的定义
+        const Definition& Get() const
+        {
+            return version_->definition;
+        }
+
+        //在当前使用的定义上执行触发器, state为该定义中的状态编号
+        FsmErrors Execute(StateIndex& state, Trigger trigger) const
+        {
+            return version_->definition.Execute(state, trigger);
+        }
+
+        FsmErrors Execute(StateIndex& state, Trigger trigger, GuardFlags flags) const
+        {
+            return version_->definition.Execute(state, trigger, flags);
+        }
+
+        //宣告静止并切换到最新的定义, 读者持有的状态编号[first, last)一并映射到新定义; 定义发生变化时返回true
+        //调用之后不能再使用之前通过Get取得的引用
+        template <typename It>
+        bool Quiescent(It first, It last)
+        {
+            uint64_t epoch = owner_.epoch_.load(std::memory_order_acquire);
+            const Version* latest = owner_.current_.load(std::memory_order_acquire);
+            bool changed = latest != version_;
+            if (changed)
+            {
+                for (It it = first; it != last; ++it)
+                {
+                    *it = MapState(*it, latest);
+                }
+                version_ = latest;
+            }
+            //此前对旧定义的访问都在这次release写之前完成
+            slot_->epoch.store(epoch, std::memory_order_release);
+            return changed;
+        }
+
+        //读者不持有状态编号时使用
+        bool Quiescent()
+        {
+            StateIndex* none = nullptr;
+            return Quiescent(none, none);
+        }
+
+        //映射单个状态编号的便捷形式
+        bool Quiescent(StateIndex& state)
+        {
+            return Quiescent(&state, &state + 1);
+        }
+
+        //离线期间不阻止旧定义的回收, 也不能执行
+        //离线后旧定义可能已被释放, 之前持有的状态编号无法映射, Online之后需要重新取得
+        void Offline()
+        {
+            slot_->epoch.store(kOffline, std::memory_order_release);
+        }
+
+        //重新上线并切换到最新的定义
+        void Online()
+        {
+            uint64_t epoch = owner_.epoch_.load(std::memory_order_acquire);
+            slot_->epoch.store(epoch, std::memory_order_seq_cst);
+            version_ = owner_.current_.load(std::memory_order_seq_cst);
+        }
+
+    private:
+        //沿版本链把旧版本中的状态编号映射到latest
+        StateIndex MapState(StateIndex state, const Version* latest) const
+        {
+            for (const Version* from = version_; from != latest; from = from->next)
+            {
+                const Version* to = from->next;
+                if (state >= from->definition.StateCount())
+                {
+                    state = 0;
+                    continue;
+                }
+                State s = from->definition.StateAt(state);
+                if (to->map)
+                {
+                    s = to->map(s);
+                }
+                StateIndex idx = to->definition.FindState(s);
+                state = (idx == kInvalidStateIndex) ? 0 : idx;
+            }
+            return state;
+        }
+
+        RcuFsm& owner_;
+        Slot* slot_;
+        const Version* version_;
+    };
+}
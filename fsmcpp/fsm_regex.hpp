@@ -0,0 +1,795 @@
+#pragma once
+
+#include "fsm_builder.hpp"
+
+#include <stdint.h>
+
+#include <bitset>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+//正则表达式编译器
+//把正则表达式编译为无guard的 Fsm<int, 0, char> 定义, 可以直接交给 ByteDfa 等冻结表示逐字节执行,
+//避免引入带回溯的完整正则库
+//编译过程: 递归下降解析为Thompson NFA -> 子集构造为DFA -> Moore划分细化最小化
+//支持的语法:
+//- 字面字符, 转义 \n \t \r \f \v \0 \xHH, 以及用反斜杠转义的标点符号
+//- . 匹配除'\n'外的任意字节
+//- 字符类 [abc] [a-z] [^0-9], 预定义类 \d \D \w \W \s \S (类内也可以使用)
+//- 分组 (), 选择 |, 重复 * + ?
+//- 锚点 ^ $, 只能出现在顶层每个选择分支的开头和结尾
+//匹配语义: 把整段输入送入状态机后, 结束状态为接受状态(IsAccepting)表示匹配
+//分支没有^时匹配可以从任意位置开始, 没有$时匹配之后可以有任意内容, 即 "abc" 表示包含abc, "^abc$" 表示恰好是abc
+//生成的DFA是完全的: 不可能再匹配的输入会显式转到死状态(DeadState), 死状态只有指向自身的转换;
+//由于冻结表示在没有匹配的转换时保持原状态, 指向自身的转换不会输出
+//  RegexDfa regex;
+//  regex.Compile("^(GET|POST) /");
+//  ByteDfa<int, 0> dfa;
+//  regex.Emit(dfa);
+//  bool ok = regex.IsAccepting(dfa.StateAt(dfa.Run(data, len)));
+
+namespace fsm
+{
+    namespace detail
+    {
+        //NFA中没有字节转换的状态, 以及最小化时尚未编号的块
+        const uint32_t kNoRegexState = 0xFFFFFFFFu;
+    }
+
+    class RegexDfa
+    {
+    public:
+        using Machine = Fsm<int, 0, char>;
+        using Trans = Machine::Trans;
+
+        //默认的DFA状态数上限, 子集构造的状态数可能随模式长度指数增长
+        static const size_t kDefaultMaxStates = 1 << 16;
+        //括号的最大嵌套层数
+        static const size_t kMaxNesting = 256;
+
+        RegexDfa()
+            : class_of_()
+            , class_count_(0)
+            , table_()
+            , accepting_()
+            , dead_state_(-1)
+            , error_offset_(0)
+        {
+        }
+
+        //编译正则表达式, 语法错误时返回FSM_INVALID_PATTERN, 出错位置由ErrorOffset给出;
+        //DFA状态数超过max_states时返回FSM_STATE_LIMIT_EXCEEDED
+        FsmErrors Compile(const char* pattern, size_t len, size_t max_states = kDefaultMaxStates)
+        {
+            Parser parser(pattern, len);
+            uint32_t start = 0;
+            uint32_t accept = 0;
+            if (!parser.Parse(start, accept))
+            {
+                error_offset_ = parser.Offset();
+                return FSM_INVALID_PATTERN;
+            }
+            error_offset_ = 0;
+
+            std::vector<uint32_t> dfa;
+            std::vector<bool> accepting;
+            FsmErrors err_code = Determinize(parser.States(), start, accept, max_states, dfa, accepting);
+            if (err_code != FSM_SUCCESS)
+            {
+                return err_code;
+            }
+
+            Minimize(dfa, accepting);
+            return FSM_SUCCESS;
+        }
+
+        FsmErrors Compile(const std::string& pattern, size_t max_states = kDefaultMaxStates)
+        {
+            return Compile(pattern.data(), pattern.size(), max_states);
+        }
+
+        //最近一次语法错误在模式中的位置
+        size_t ErrorOffset() const
+        {
+            return error_offset_;
+        }
+
+        //最小化后的状态数(包括死状态), 状态为[0, StateCount()), 初始状态为0
+        size_t StateCount() const
+        {
+            return accepting_.size();
+        }
+
+        bool IsAccepting(int state) const
+        {
+            return state >= 0 && static_cast<size_t>(state) < accepting_.size() && accepting_[static_cast<size_t>(state)];
+        }
+
+        //死状态, 不存在时返回-1(例如模式没有$时, 匹配之后的任意输入都保持接受)
+        int DeadState() const
+        {
+            return dead_state_;
+        }
+
+        //单步转换
+        int Step(int state, char byte) const
+        {
+            return static_cast<int>(table_[static_cast<size_t>(state) * class_count_ + class_of_[static_cast<unsigned char>(byte)]]);
+        }
+
+        //直接在编译结果上匹配, 进入死状态后提前结束
+        bool Match(const char* data, size_t len) const
+        {
+            int state = 0;
+            for (size_t i = 0; i < len && state != dead_state_; ++i)
+            {
+                state = Step(state, data[i]);
+            }
+            return IsAccepting(state);
+        }
+
+        bool Match(const std::string& data) const
+        {
+            return Match(data.data(), data.size());
+        }
+
+        //生成无guard, 无action的转换列表, 指向自身的转换被省略
+        std::vector<Trans> Transitions() const
+        {
+            std::vector<Trans> transitions;
+            for (size_t s = 0; s < StateCount(); ++s)
+            {
+                for (uint32_t byte = 0; byte < kAlphabetSize; ++byte)
+                {
+                    int to = Step(static_cast<int>(s), static_cast<char>(byte));
+                    if (to != static_cast<int>(s))
+                    {
+                        transitions.push_back({ static_cast<int>(s), to, static_cast<char>(byte), nullptr, nullptr });
+                    }
+                }
+            }
+            return transitions;
+        }
+
+        //把转换添加到状态机中
+        void Build(Machine& machine) const
+        {
+            FsmBuilder<int, 0, char> builder;
+            builder.AddTransitions(Transitions());
+            builder.Build(machine);
+        }
+
+        //直接构建冻结表示, 例如 ByteDfa<int, 0>
+        template <typename Frozen>
+        FsmErrors Emit(Frozen& frozen) const
+        {
+            FsmBuilder<int, 0, char> builder;
+            builder.AddTransitions(Transitions());
+            return builder.Emit(frozen);
+        }
+
+        //按组件估算的内存占用; instance_bytes 为每个匹配过程保存的状态
+        MemoryReport MemoryUsage() const
+        {
+            MemoryReport report;
+            report.Add("object", sizeof(*this));
+            report.Add("classes", detail::VectorBytes(class_of_));
+            report.Add("table", detail::VectorBytes(table_) + detail::VectorBytes(accepting_));
+            report.instance_bytes = sizeof(int);
+            return report;
+        }
+
+    private:
+        static const uint32_t kAlphabetSize = 256;
+
+        using ByteSet = std::bitset<kAlphabetSize>;
+
+        //Thompson NFA的状态: bytes中的字节转到out, eps为空转换
+        struct NfaState
+        {
+            ByteSet bytes;
+            uint32_t out;
+            std::vector<uint32_t> eps;
+        };
+
+        //NFA片段, 从start进入, 由end(只有空转换)离开
+        struct Fragment
+        {
+            uint32_t start;
+            uint32_t end;
+        };
+
+        class Parser
+        {
+        public:
+            Parser(const char* pattern, size_t len)
+                : pattern_(pattern)
+                , len_(len)
+                , pos_(0)
+                , depth_(0)
+                , states_()
+            {
+            }
+
+            //解析整个模式, 为每个顶层分支补上未锚定一侧的任意前缀或后缀
+            bool Parse(uint32_t& start, uint32_t& accept)
+            {
+                start = NewState();
+                accept = NewState();
+                for (;;)
+                {
+                    bool anchored_start = Consume('^');
+                    Fragment branch;
+                    if (!ParseConcat(branch))
+                    {
+                        return false;
+                    }
+                    bool anchored_end = Consume('$');
+
+                    if (!anchored_start)
+                    {
+                        branch = Concat(Star(Bytes(ByteSet().set())), branch);
+                    }
+                    if (!anchored_end)
+                    {
+                        branch = Concat(branch, Star(Bytes(ByteSet().set())));
+                    }
+                    states_[start].eps.push_back(branch.start);
+                    states_[branch.end].eps.push_back(accept);
+
+                    if (pos_ == len_)
+                    {
+                        return true;
+                    }
+                    if (!Consume('|'))
+                    {
+                        return false;//锚点不在分支边界, 或者多余的')'
+                    }
+                }
+            }
+
+            size_t Offset() const
+            {
+                return pos_;
+            }
+
+            const std::vector<NfaState>& States() const
+            {
+                return states_;
+            }
+
+        private:
+            bool ParseAlternation(Fragment& frag)
+            {
+                if (!ParseConcat(frag))
+                {
+                    return false;
+                }
+                while (Consume('|'))
+                {
+                    Fragment right;
+                    if (!ParseConcat(right))
+                    {
+                        return false;
+                    }
+                    frag = Alternate(frag, right);
+                }
+                return true;
+            }
+
+            bool ParseConcat(Fragment& frag)
+            {
+                uint32_t empty = NewState();
+                frag = { empty, empty };
+                while (pos_ < len_ && pattern_[pos_] != '|' && pattern_[pos_] != ')' && pattern_[pos_] != '$')
+                {
+                    Fragment item;
+                    if (!ParseRepeat(item))
+                    {
+                        return false;
+                    }
+                    frag = Concat(frag, item);
+                }
+                return true;
+            }
+
+            bool ParseRepeat(Fragment& frag)
+            {
+                if (!ParseAtom(frag))
+                {
+                    return false;
+                }
+                for (;;)
+                {
+                    if (Consume('*'))
+                    {
+                        frag = Star(frag);
+                    }
+                    else if (Consume('+'))
+                    {
+                        frag = Plus(frag);
+                    }
+                    else if (Consume('?'))
+                    {
+                        frag = Optional(frag);
+                    }
+                    else
+                    {
+                        return true;
+                    }
+                }
+            }
+
+            bool ParseAtom(Fragment& frag)
+            {
+                char c = pattern_[pos_];
+                switch (c)
+                {
+                case '(':
+                {
+                    ++pos_;
+                    if (++depth_ > kMaxNesting || !ParseAlternation(frag) || !Consume(')'))
+                    {
+                        return false;
+                    }
+                    --depth_;
+                    return true;
+                }
+                case '[':
+                {
+                    ++pos_;
+                    ByteSet set;
+                    if (!ParseClass(set))
+                    {
+                        return false;
+                    }
+                    frag = Bytes(set);
+                    return true;
+                }
+                case '.':
+                {
+                    ++pos_;
+                    frag = Bytes(ByteSet().set().reset('\n'));
+                    return true;
+                }
+                case '\\':
+                {
+                    ++pos_;
+                    ByteSet set;
+                    if (!ParseEscape(set))
+                    {
+                        return false;
+                    }
+                    frag = Bytes(set);
+                    return true;
+                }
+                case '*':
+                case '+':
+                case '?':
+                case '^':
+                    return false;//重复符前没有内容, 或者锚点不在分支开头
+                default:
+                {
+                    ++pos_;
+                    ByteSet set;
+                    set.set(static_cast<unsigned char>(c));
+                    frag = Bytes(set);
+                    return true;
+                }
+                }
+            }
+
+            //解析'['之后的字符类, 包括结尾的']'
+            bool ParseClass(ByteSet& set)
+            {
+                bool negate = Consume('^');
+                bool first = true;
+                while (pos_ < len_ && (first || pattern_[pos_] != ']'))
+                {
+                    first = false;
+                    ByteSet item;
+                    unsigned char low = 0;
+                    if (!ParseClassItem(item, low))
+                    {
+                        return false;
+                    }
+
+                    //范围 a-z, 结尾的'-'按字面字符处理
+                    if (item.count() == 1 && pos_ + 1 < len_ && pattern_[pos_] == '-' && pattern_[pos_ + 1] != ']')
+                    {
+                        ++pos_;
+                        ByteSet upper;
+                        unsigned char high = 0;
+                        if (!ParseClassItem(upper, high) || upper.count() != 1 || high < low)
+                        {
+                            return false;
+                        }
+                        for (uint32_t b = low; b <= high; ++b)
+                        {
+                            item.set(b);
+                        }
+                    }
+                    set |= item;
+                }
+
+                if (!Consume(']'))
+                {
+                    return false;
+                }
+                if (negate)
+                {
+                    set.flip();
+                }
+                return true;
+            }
+
+            //类中的一项: 单个字节(由byte返回)或预定义类
+            bool ParseClassItem(ByteSet& item, unsigned char& byte)
+            {
+                if (pattern_[pos_] == '\\')
+                {
+                    ++pos_;
+                    if (!ParseEscape(item))
+                    {
+                        return false;
+                    }
+                }
+                else
+                {
+                    item.set(static_cast<unsigned char>(pattern_[pos_++]));
+                }
+
+                if (item.count() == 1)
+                {
+                    for (uint32_t b = 0; b < kAlphabetSize; ++b)
+                    {
+                        if (item[b])
+                        {
+                            byte = static_cast<unsigned char>(b);
+                        }
+                    }
+                }
+                return true;
+            }
+
+            //解析'\'之后的转义
+            bool ParseEscape(ByteSet& set)
+            {
+                if (pos_ == len_)
+                {
+                    return false;
+                }
+
+                char c = pattern_[pos_++];
+                switch (c)
+                {
+                case 'n': set.set('\n'); return true;
+                case 't': set.set('\t'); return true;
+                case 'r': set.set('\r'); return true;
+                case 'f': set.set('\f'); return true;
+                case 'v': set.set('\v'); return true;
+                case '0': set.set(0); return true;
+                case 'd': case 'D':
+                    SetRange(set, '0', '9');
+                    break;
+                case 'w': case 'W':
+                    SetRange(set, '0', '9');
+                    SetRange(set, 'a', 'z');
+                    SetRange(set, 'A', 'Z');
+                    set.set('_');
+                    break;
+                case 's': case 'S':
+                    SetRange(set, '\t', '\r');//\t \n \v \f \r
+                    set.set(' ');
+                    break;
+                case 'x':
+                {
+                    int high = HexValue(pos_ < len_ ? pattern_[pos_] : 0);
+                    int low = HexValue(pos_ + 1 < len_ ? pattern_[pos_ + 1] : 0);
+                    if (high < 0 || low < 0)
+                    {
+                        return false;
+                    }
+                    pos_ += 2;
+                    set.set(static_cast<size_t>(high * 16 + low));
+                    return true;
+                }
+                default:
+                    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '1' && c <= '9'))
+                    {
+                        --pos_;
+                        return false;//未知的字母数字转义
+                    }
+                    set.set(static_cast<unsigned char>(c));
+                    return true;
+                }
+
+                if (c == 'D' || c == 'W' || c == 'S')
+                {
+                    set.flip();
+                }
+                return true;
+            }
+
+            static void SetRange(ByteSet& set, char low, char high)
+            {
+                for (int b = low; b <= high; ++b)
+                {
+                    set.set(static_cast<size_t>(b));
+                }
+            }
+
+            static int HexValue(char c)
+            {
+                if (c >= '0' && c <= '9')
+                {
+                    return c - '0';
+                }
+                if (c >= 'a' && c <= 'f')
+                {
+                    return c - 'a' + 10;
+                }
+                if (c >= 'A' && c <= 'F')
+                {
+                    return c - 'A' + 10;
+                }
+                return -1;
+            }
+
+            bool Consume(char c)
+            {
+                if (pos_ < len_ && pattern_[pos_] == c)
+                {
+                    ++pos_;
+                    return true;
+                }
+                return false;
+            }
+
+            uint32_t NewState()
+            {
+                states_.push_back({ ByteSet(), detail::kNoRegexState, {} });
+                return static_cast<uint32_t>(states_.size() - 1);
+            }
+
+            Fragment Bytes(const ByteSet& set)
+            {
+                uint32_t start = NewState();
+                uint32_t end = NewState();
+                states_[start].bytes = set;
+                states_[start].out = end;
+                return { start, end };
+            }
+
+            Fragment Concat(Fragment a, Fragment b)
+            {
+                states_[a.end].eps.push_back(b.start);
+                return { a.start, b.end };
+            }
+
+            Fragment Alternate(Fragment a, Fragment b)
+            {
+                uint32_t start = NewState();
+                uint32_t end = NewState();
+                states_[start].eps = { a.start, b.start };
+                states_[a.end].eps.push_back(end);
+                states_[b.end].eps.push_back(end);
+                return { start, end };
+            }
+
+            Fragment Star(Fragment a)
+            {
+                uint32_t start = NewState();
+                uint32_t end = NewState();
+                states_[start].eps = { a.start, end };
+                states_[a.end].eps.push_back(a.start);
+                states_[a.end].eps.push_back(end);
+                return { start, end };
+            }
+
+            Fragment Plus(Fragment a)
+            {
+                uint32_t end = NewState();
+                states_[a.end].eps.push_back(a.start);
+                states_[a.end].eps.push_back(end);
+                return { a.start, end };
+            }
+
+            Fragment Optional(Fragment a)
+            {
+                uint32_t start = NewState();
+                states_[start].eps = { a.start, a.end };
+                return { start, a.end };
+            }
+
+            const char* pattern_;
+            size_t len_;
+            size_t pos_;
+            size_t depth_;
+            std::vector<NfaState> states_;
+        };
+
+        //NFA状态集合的空转换闭包, 结果有序
+        static void Closure(const std::vector<NfaState>& nfa, std::vector<uint32_t>& set, std::vector<bool>& mark)
+        {
+            std::vector<uint32_t> stack(set);
+            for (uint32_t s : set)
+            {
+                mark[s] = true;
+            }
+            while (!stack.empty())
+            {
+                uint32_t s = stack.back();
+                stack.pop_back();
+                for (uint32_t next : nfa[s].eps)
+                {
+                    if (!mark[next])
+                    {
+                        mark[next] = true;
+                        set.push_back(next);
+                        stack.push_back(next);
+                    }
+                }
+            }
+            for (uint32_t s : set)
+            {
+                mark[s] = false;
+            }
+            std::sort(set.begin(), set.end());
+        }
+
+        //子集构造, 先把字节划分为等价类(对所有NFA字节集合不可区分的字节归为一类), 每类只计算一次
+        FsmErrors Determinize(const std::vector<NfaState>& nfa, uint32_t start, uint32_t accept, size_t max_states,
+            std::vector<uint32_t>& dfa, std::vector<bool>& accepting)
+        {
+            std::vector<uint32_t> class_of(kAlphabetSize, 0);
+            uint32_t class_count = 1;
+            for (const auto& state : nfa)
+            {
+                if (state.bytes.none())
+                {
+                    continue;
+                }
+                std::map<std::pair<uint32_t, bool>, uint32_t> refined;
+                for (uint32_t b = 0; b < kAlphabetSize; ++b)
+                {
+                    auto inserted = refined.emplace(std::make_pair(class_of[b], state.bytes[b]),
+                        static_cast<uint32_t>(refined.size()));
+                    class_of[b] = inserted.first->second;
+                }
+                class_count = static_cast<uint32_t>(refined.size());
+            }
+
+            std::vector<unsigned char> representative(class_count);
+            for (uint32_t b = kAlphabetSize; b-- > 0;)
+            {
+                representative[class_of[b]] = static_cast<unsigned char>(b);
+            }
+
+            std::vector<bool> mark(nfa.size(), false);
+            std::map<std::vector<uint32_t>, uint32_t> ids;
+            std::vector<std::vector<uint32_t>> sets;
+
+            std::vector<uint32_t> initial(1, start);
+            Closure(nfa, initial, mark);
+            ids.emplace(initial, 0);
+            sets.push_back(initial);
+
+            dfa.clear();
+            accepting.clear();
+            std::vector<uint32_t> target;
+            for (size_t i = 0; i < sets.size(); ++i)
+            {
+                accepting.push_back(std::binary_search(sets[i].begin(), sets[i].end(), accept));
+                for (uint32_t cls = 0; cls < class_count; ++cls)
+                {
+                    target.clear();
+                    for (uint32_t s : sets[i])
+                    {
+                        if (nfa[s].bytes[representative[cls]])
+                        {
+                            target.push_back(nfa[s].out);
+                        }
+                    }
+                    Closure(nfa, target, mark);
+                    target.erase(std::unique(target.begin(), target.end()), target.end());
+
+                    auto inserted = ids.emplace(target, static_cast<uint32_t>(sets.size()));
+                    if (inserted.second)
+                    {
+                        if (sets.size() >= max_states)
+                        {
+                            return FSM_STATE_LIMIT_EXCEEDED;
+                        }
+                        sets.push_back(target);
+                    }
+                    dfa.push_back(inserted.first->second);
+                }
+            }
+
+            class_of_.swap(class_of);
+            class_count_ = class_count;
+            return FSM_SUCCESS;
+        }
+
+        //Moore划分细化: 从接受/非接受两块出发, 按各字节类的目标块反复细分, 直到块数不再增加
+        void Minimize(const std::vector<uint32_t>& dfa, const std::vector<bool>& accepting)
+        {
+            size_t state_count = accepting.size();
+            std::vector<uint32_t> block(state_count);
+            for (size_t s = 0; s < state_count; ++s)
+            {
+                block[s] = accepting[s] ? 1 : 0;
+            }
+
+            size_t block_count = 0;
+            std::vector<uint32_t> signature(class_count_ + 1);
+            for (;;)
+            {
+                std::map<std::vector<uint32_t>, uint32_t> refined;
+                std::vector<uint32_t> next(state_count);
+                for (size_t s = 0; s < state_count; ++s)
+                {
+                    signature[0] = block[s];
+                    for (uint32_t cls = 0; cls < class_count_; ++cls)
+                    {
+                        signature[cls + 1] = block[dfa[s * class_count_ + cls]];
+                    }
+                    next[s] = refined.emplace(signature, static_cast<uint32_t>(refined.size())).first->second;
+                }
+                block.swap(next);
+                if (refined.size() == block_count)
+                {
+                    break;
+                }
+                block_count = refined.size();
+            }
+
+            //按从初始状态出发的广度优先顺序重新编号, 初始状态为0
+            std::vector<uint32_t> number(block_count, detail::kNoRegexState);
+            std::vector<uint32_t> order;
+            number[block[0]] = 0;
+            order.push_back(0);
+            for (size_t i = 0; i < order.size(); ++i)
+            {
+                for (uint32_t cls = 0; cls < class_count_; ++cls)
+                {
+                    uint32_t to = dfa[order[i] * class_count_ + cls];
+                    if (number[block[to]] == detail::kNoRegexState)
+                    {
+                        number[block[to]] = static_cast<uint32_t>(order.size());
+                        order.push_back(to);
+                    }
+                }
+            }
+
+            table_.assign(order.size() * class_count_, 0);
+            accepting_.assign(order.size(), false);
+            dead_state_ = -1;
+            for (size_t s = 0; s < order.size(); ++s)
+            {
+                bool absorbing = true;
+                for (uint32_t cls = 0; cls < class_count_; ++cls)
+                {
+                    uint32_t to = number[block[dfa[order[s] * class_count_ + cls]]];
+                    table_[s * class_count_ + cls] = to;
+                    absorbing = absorbing && to == s;
+                }
+                accepting_[s] = accepting[order[s]];
+                if (absorbing && !accepting_[s])
+                {
+                    dead_state_ = static_cast<int>(s);
+                }
+            }
+        }
+
+        std::vector<uint32_t> class_of_;//字节 -> 字节类
+        uint32_t class_count_;
+        std::vector<uint32_t> table_;//状态数 x 字节类数
+        std::vector<bool> accepting_;
+        int dead_state_;
+        size_t error_offset_;
+    };
+}
@@ -0,0 +1,401 @@
+#pragma once
+
+#include "fsm_fleet.hpp"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+//触发器的录制与回放
+//TriggerLog 把(实例, 触发器)序列编码为紧凑的字节流: 实例号和触发器序号分别与上一条记录做差,
+//差值经zigzag变换后以变长整数(每字节7位)写出, 相邻记录属于同一实例、触发器相近时每条只占2字节
+//TriggerRecorder 包装一个状态机或者实例集合, 在转发Execute之前把触发器追加到日志中, 录制只是一次编码和追加
+//ReplayTriggers 把日志解码到数组后以最快速度送给任意执行函数, 统计吞吐量, 并按间隔抽样单次执行的延迟给出分位数
+//
+//日志文件格式(主机字节序): 魔数"FSMT", 版本号(uint32), 记录数(uint64), 字节数(uint64), 编码后的字节流
+
+namespace fsm
+{
+    template <typename Trigger>
+    class TriggerLog
+    {
+    public:
+        TriggerLog()
+            : bytes_()
+            , count_(0)
+            , last_id_(0)
+            , last_trigger_(0)
+        {
+        }
+
+        //追加一条记录
+        void Append(InstanceId id, Trigger trigger)
+        {
+            uint64_t ordinal = TriggerOrdinal(trigger);
+            PutVarint(ZigZag(uint64_t(id) - last_id_));
+            PutVarint(ZigZag(ordinal - last_trigger_));
+            last_id_ = id;
+            last_trigger_ = ordinal;
+            ++count_;
+        }
+
+        //记录数
+        size_t Size() const
+        {
+            return count_;
+        }
+
+        bool Empty() const
+        {
+            return count_ == 0;
+        }
+
+        //编码后的字节数
+        size_t ByteSize() const
+        {
+            return bytes_.size();
+        }
+
+        void Clear()
+        {
+            bytes_.clear();
+            count_ = 0;
+            last_id_ = 0;
+            last_trigger_ = 0;
+        }
+
+        void Reserve(size_t bytes)
+        {
+            bytes_.reserve(bytes);
+        }
+
+        //按顺序对每条记录调用 fn(id, trigger)
+        template <typename Fn>
+        void ForEach(Fn&& fn) const
+        {
+            const uint8_t* p = bytes_.data();
+            uint64_t id = 0;
+            uint64_t ordinal = 0;
+            for (size_t i = 0; i < count_; ++i)
+            {
+                id += UnZigZag(GetVarint(p));
+                ordinal += UnZigZag(GetVarint(p));
+                fn(static_cast<InstanceId>(id), TriggerFromOrdinal<Trigger>(ordinal));
+            }
+        }
+
+        //解码全部记录
+        void Decode(std::vector<InstanceId>& ids, std::vector<Trigger>& triggers) const
+        {
+            ids.clear();
+            triggers.clear();
+            ids.reserve(count_);
+            triggers.reserve(count_);
+            ForEach([&](InstanceId id, Trigger trigger) {
+                ids.push_back(id);
+                triggers.push_back(trigger);
+            });
+        }
+
+        //写入日志文件, 失败时返回FSM_IO_ERROR
+        FsmErrors Save(const char* path) const
+        {
+            FilePtr file(fopen(path, "wb"));
+            if (!file)
+            {
+                return FSM_IO_ERROR;
+            }
+            uint32_t version = kVersion;
+            uint64_t count = count_;
+            uint64_t size = bytes_.size();
+            if (fwrite(kMagic, 1, sizeof(kMagic), file.get()) != sizeof(kMagic)
+                || fwrite(&version, sizeof(version), 1, file.get()) != 1
+                || fwrite(&count, sizeof(count), 1, file.get()) != 1
+                || fwrite(&size, sizeof(size), 1, file.get()) != 1
+                || fwrite(bytes_.data(), 1, bytes_.size(), file.get()) != bytes_.size())
+            {
+                return FSM_IO_ERROR;
+            }
+            return fclose(file.release()) == 0 ? FSM_SUCCESS : FSM_IO_ERROR;
+        }
+
+        //读取日志文件, 替换当前内容; 文件不存在、格式不符或被截断时返回FSM_IO_ERROR, 当前内容不变
+        FsmErrors Load(const char* path)
+        {
+            FilePtr file(fopen(path, "rb"));
+            if (!file)
+            {
+                return FSM_IO_ERROR;
+            }
+            char magic[sizeof(kMagic)];
+            uint32_t version = 0;
+            uint64_t count = 0;
+            uint64_t size = 0;
+            if (fread(magic, 1, sizeof(magic), file.get()) != sizeof(magic)
+                || memcmp(magic, kMagic, sizeof(kMagic)) != 0
+                || fread(&version, sizeof(version), 1, file.get()) != 1
+                || version != kVersion
+                || fread(&count, sizeof(count), 1, file.get()) != 1
+                || fread(&size, sizeof(size), 1, file.get()) != 1
+                || count > size)
+            {
+                return FSM_IO_ERROR;
+            }
+
+            //记录区的长度不能超过文件剩余的字节数, 避免按损坏的头部分配内存
+            long offset = ftell(file.get());
+            if (offset < 0 || fseek(file.get(), 0, SEEK_END) != 0)
+            {
+                return FSM_IO_ERROR;
+            }
+            long end = ftell(file.get());
+            if (end < offset || size > static_cast<uint64_t>(end - offset)
+                || fseek(file.get(), offset, SEEK_SET) != 0)
+            {
+                return FSM_IO_ERROR;
+            }
+
+            std::vector<uint8_t> bytes(static_cast<size_t>(size));
+            if (fread(bytes.data(), 1, bytes.size(), file.get()) != bytes.size()
+                || !Validate(bytes, count))
+            {
+                return FSM_IO_ERROR;
+            }
+
+            TriggerLog loaded;
+            loaded.bytes_ = std::move(bytes);
+            loaded.count_ = static_cast<size_t>(count);
+            //继续追加时从最后一条记录做差
+            loaded.ForEach([&](InstanceId id, Trigger trigger) {
+                loaded.last_id_ = id;
+                loaded.last_trigger_ = TriggerOrdinal(trigger);
+            });
+            *this = std::move(loaded);
+            return FSM_SUCCESS;
+        }
+
+    private:
+        struct FileCloser
+        {
+            void operator()(FILE* file) const
+            {
+                fclose(file);
+            }
+        };
+
+        using FilePtr = std::unique_ptr<FILE, FileCloser>;
+
+        static constexpr char kMagic[4] = { 'F', 'S', 'M', 'T' };
+        static const uint32_t kVersion = 1;
+
+        static uint64_t ZigZag(uint64_t delta)
+        {
+            return (delta << 1) ^ (0 - (delta >> 63));
+        }
+
+        static uint64_t UnZigZag(uint64_t value)
+        {
+            return (value >> 1) ^ (0 - (value & 1));
+        }
+
+        void PutVarint(uint64_t value)
+        {
+            while (value >= 0x80)
+            {
+                bytes_.push_back(static_cast<uint8_t>(value | 0x80));
+                value >>= 7;
+            }
+            bytes_.push_back(static_cast<uint8_t>(value));
+        }
+
+        static uint64_t GetVarint(const uint8_t*& p)
+        {
+            uint64_t value = 0;
+            for (uint32_t shift = 0;; shift += 7)
+            {
+                uint8_t byte = *p++;
+                value |= uint64_t(byte & 0x7F) << shift;
+                if (byte < 0x80)
+                {
+                    return value;
+                }
+            }
+        }
+
+        //检查字节流恰好包含count条完整的记录, 变长整数不超过10字节
+        static bool Validate(const std::vector<uint8_t>& bytes, uint64_t count)
+        {
+            size_t pos = 0;
+            for (uint64_t i = 0; i < 2 * count; ++i)
+            {
+                size_t start = pos;
+                while (pos < bytes.size() && bytes[pos] >= 0x80)
+                {
+                    ++pos;
+                }
+                if (pos >= bytes.size() || pos - start >= 10)
+                {
+                    return false;
+                }
+                ++pos;
+            }
+            return pos == bytes.size();
+        }
+
+        std::vector<uint8_t> bytes_;
+        size_t count_;
+        uint64_t last_id_;
+        uint64_t last_trigger_;
+    };
+
+    template <typename Trigger>
+    constexpr char TriggerLog<Trigger>::kMagic[4];
+    template <typename Trigger>
+    const uint32_t TriggerLog<Trigger>::kVersion;
+
+    //录制钩子: 把经过的触发器追加到日志, 再转发给被包装的状态机
+    //Machine 为 Fsm 等提供 Execute(Trigger) 的单实例状态机时, 记录的实例号为构造时给出的id;
+    //为 FsmFleet 等提供 Execute(InstanceId, Trigger) 的实例集合时, 记录调用传入的实例号
+    template <typename Machine, typename Trigger>
+    class TriggerRecorder
+    {
+    public:
+        TriggerRecorder(Machine& machine, TriggerLog<Trigger>& log, InstanceId id = 0)
+            : machine_(machine)
+            , log_(log)
+            , id_(id)
+            , enabled_(true)
+        {
+        }
+
+        FsmErrors Execute(Trigger trigger)
+        {
+            if (enabled_)
+            {
+                log_.Append(id_, trigger);
+            }
+            return machine_.Execute(trigger);
+        }
+
+        FsmErrors Execute(InstanceId id, Trigger trigger)
+        {
+            if (enabled_)
+            {
+                log_.Append(id, trigger);
+            }
+            return machine_.Execute(id, trigger);
+        }
+
+        //暂停或恢复录制
+        void Enable(bool enabled)
+        {
+            enabled_ = enabled;
+        }
+
+        Machine& GetMachine()
+        {
+            return machine_;
+        }
+
+    private:
+        Machine& machine_;
+        TriggerLog<Trigger>& log_;
+        InstanceId id_;
+        bool enabled_;
+    };
+
+    //回放参数
+    struct ReplayOptions
+    {
+        size_t repeat = 1;//整个日志回放的次数
+        size_t latency_stride = 64;//每隔多少条记录抽样一次单条执行的延迟, 0表示不统计延迟
+    };
+
+    //回放结果, 延迟单位为纳秒
+    struct ReplayStats
+    {
+        uint64_t events = 0;//送达的触发器数
+        uint64_t rejected = 0;//返回值不是FSM_SUCCESS的触发器数
+        double seconds = 0;
+        double events_per_second = 0;
+        uint64_t latency_samples = 0;
+        double p50 = 0;
+        double p90 = 0;
+        double p99 = 0;
+        double p999 = 0;
+        double max = 0;
+    };
+
+    //把日志中的触发器按顺序送给 fn(id, trigger), fn返回FsmErrors
+    //解码在计时之外完成; 被抽样的记录单独计时, 抽样的计时开销计入总耗时
+    template <typename Trigger, typename ExecuteFn>
+    ReplayStats ReplayTriggers(const TriggerLog<Trigger>& log, ExecuteFn&& fn, const ReplayOptions& options = ReplayOptions())
+    {
+        using Clock = std::chrono::steady_clock;
+
+        std::vector<InstanceId> ids;
+        std::vector<Trigger> triggers;
+        log.Decode(ids, triggers);
+
+        ReplayStats stats;
+        std::vector<double> latencies;
+        size_t stride = options.latency_stride;
+        if (stride != 0)
+        {
+            latencies.reserve(ids.size() / stride * options.repeat + options.repeat);
+        }
+
+        Clock::time_point start = Clock::now();
+        for (size_t round = 0; round < options.repeat; ++round)
+        {
+            size_t next_sample = 0;
+            for (size_t i = 0; i < ids.size(); ++i)
+            {
+                FsmErrors err_code;
+                if (stride != 0 && i == next_sample)
+                {
+                    Clock::time_point begin = Clock::now();
+                    err_code = fn(ids[i], triggers[i]);
+                    Clock::time_point end = Clock::now();
+                    latencies.push_back(std::chrono::duration<double, std::nano>(end - begin).count());
+                    next_sample += stride;
+                }
+                else
+                {
+                    err_code = fn(ids[i], triggers[i]);
+                }
+                if (err_code != FSM_SUCCESS)
+                {
+                    ++stats.rejected;
+                }
+            }
+        }
+        stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        stats.events = static_cast<uint64_t>(ids.size()) * options.repeat;
+        if (stats.seconds > 0)
+        {
+            stats.events_per_second = static_cast<double>(stats.events) / stats.seconds;
+        }
+
+        stats.latency_samples = latencies.size();
+        if (!latencies.empty())
+        {
+            std::sort(latencies.begin(), latencies.end());
+            auto percentile = [&](double q) {
+                size_t rank = static_cast<size_t>(q * static_cast<double>(latencies.size() - 1) + 0.5);
+                return latencies[rank];
+            };
+            stats.p50 = percentile(0.5);
+            stats.p90 = percentile(0.9);
+            stats.p99 = percentile(0.99);
+            stats.p999 = percentile(0.999);
+            stats.max = latencies.back();
+        }
+        return stats;
+    }
+}
@@ -0,0 +1,472 @@
+#pragma once
+
+#include "fsm_fleet.hpp"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+//离散事件调度
+//仿真和回放需要按全局时间顺序把带时间戳的触发器送给大量状态机实例
+//CalendarQueue 是日历队列(Brown 1988): 时间轴按宽度width划分为循环使用的桶, 每个桶是按时间排序的链表,
+//出队时从当前桶顺序向后扫描; 事件数变化时按2倍增减桶数并按队首事件的平均间隔重新估计宽度,
+//入队和出队的均摊代价为O(1). 事件节点保存在连续的节点池中, 以下标串成链表, 不为每个事件单独分配内存
+//时间相同的事件按入队顺序出队
+//
+//EventScheduler 在其上驱动多个状态机: 每次取出同一时刻的全部事件, 按实例稳定排序后依次送达,
+//同一实例的事件连续执行; action中可以通过Now()和CurrentInstance()调度之后的触发器,
+//调度到当前时刻的事件在本批之后、时间前进之前送达
+
+namespace fsm
+{
+    template <typename Payload>
+    class CalendarQueue
+    {
+    public:
+        //事件时间戳类型, 时间需要小于2^63
+        using Time = uint64_t;
+
+        CalendarQueue()
+            : nodes_()
+            , free_head_(kNil)
+            , buckets_(kMinBuckets, kNil)
+            , width_(1)
+            , size_(0)
+            , current_(0)
+            , bucket_top_(1)
+        {
+        }
+
+        size_t Size() const
+        {
+            return size_;
+        }
+
+        bool Empty() const
+        {
+            return size_ == 0;
+        }
+
+        //预留count个事件的节点
+        void Reserve(size_t count)
+        {
+            nodes_.reserve(count);
+        }
+
+        void Push(Time time, const Payload& payload)
+        {
+            uint32_t node = free_head_;
+            if (node != kNil)
+            {
+                free_head_ = nodes_[node].next;
+                nodes_[node] = Node{ time, kNil, payload };
+            }
+            else
+            {
+                node = static_cast<uint32_t>(nodes_.size());
+                nodes_.push_back(Node{ time, kNil, payload });
+            }
+
+            //早于当前桶的事件: 把扫描位置移到它所在的桶
+            if (time < bucket_top_ - width_)
+            {
+                current_ = BucketOf(time);
+                bucket_top_ = (time / width_ + 1) * width_;
+            }
+
+            Link(node);
+            if (++size_ > 2 * buckets_.size())
+            {
+                Resize(buckets_.size() * 2);
+            }
+        }
+
+        //取得最早事件的时间, 队列为空时返回false
+        bool PeekTime(Time& time)
+        {
+            if (!Locate())
+            {
+                return false;
+            }
+            time = nodes_[buckets_[current_]].time;
+            return true;
+        }
+
+        //取出最早的事件, 队列为空时返回false
+        bool Pop(Time& time, Payload& payload)
+        {
+            if (!Locate())
+            {
+                return false;
+            }
+
+            uint32_t node = buckets_[current_];
+            buckets_[current_] = nodes_[node].next;
+            time = nodes_[node].time;
+            payload = nodes_[node].payload;
+            nodes_[node].next = free_head_;
+            free_head_ = node;
+
+            if (--size_ < buckets_.size() / 2 && buckets_.size() > kMinBuckets)
+            {
+                Resize(buckets_.size() / 2);
+            }
+            return true;
+        }
+
+        //当前的桶数和桶宽度
+        size_t BucketCount() const
+        {
+            return buckets_.size();
+        }
+
+        Time BucketWidth() const
+        {
+            return width_;
+        }
+
+        //按组件估算的内存占用; instance_bytes 为每个事件的节点
+        MemoryReport MemoryUsage() const
+        {
+            MemoryReport report;
+            report.Add("object", sizeof(*this));
+            report.Add("nodes", detail::VectorBytes(nodes_));
+            report.Add("buckets", detail::VectorBytes(buckets_));
+            report.instance_bytes = sizeof(Node);
+            return report;
+        }
+
+    private:
+        struct Node
+        {
+            Time time;
+            uint32_t next;
+            Payload payload;
+        };
+
+        static const uint32_t kNil = 0xFFFFFFFFu;
+        static const size_t kMinBuckets = 16;
+        //估计桶宽度时采样的队首事件数
+        static const size_t kWidthSamples = 32;
+
+        size_t BucketOf(Time time) const
+        {
+            return static_cast<size_t>(time / width_) & (buckets_.size() - 1);
+        }
+
+        //按时间插入桶内链表, 排在时间相同的事件之后
+        void Link(uint32_t node)
+        {
+            Time time = nodes_[node].time;
+            uint32_t* link = &buckets_[BucketOf(time)];
+            while (*link != kNil && nodes_[*link].time <= time)
+            {
+                link = &nodes_[*link].next;
+            }
+            nodes_[node].next = *link;
+            *link = node;
+        }
+
+        //把current_移到最早事件所在的桶
+        bool Locate()
+        {
+            if (size_ == 0)
+            {
+                return false;
+            }
+
+            //一轮之内: 桶首事件落在当前桶的时间窗口内即为最早事件
+            for (size_t i = 0; i < buckets_.size(); ++i)
+            {
+                uint32_t head = buckets_[current_];
+                if (head != kNil && nodes_[head].time < bucket_top_)
+                {
+                    return true;
+                }
+                current_ = (current_ + 1) & (buckets_.size() - 1);
+                bucket_top_ += width_;
+            }
+
+            //事件都在一轮之后: 直接找出最早的桶首事件, 跳到它所在的窗口
+            uint32_t earliest = kNil;
+            for (uint32_t head : buckets_)
+            {
+                if (head != kNil && (earliest == kNil || nodes_[head].time < nodes_[earliest].time))
+                {
+                    earliest = head;
+                }
+            }
+            current_ = BucketOf(nodes_[earliest].time);
+            bucket_top_ = (nodes_[earliest].time / width_ + 1) * width_;
+            return true;
+        }
+
+        //改变桶数, 以最早若干事件的平均间隔的3倍作为新宽度, 然后重新链接所有事件
+        //按新桶号做稳定的计数排序后顺序建链, 避免逐个插入时对桶和节点的随机访问
+        void Resize(size_t bucket_count)
+        {
+            std::vector<uint32_t> nodes;
+            std::vector<Time> times;
+            nodes.reserve(size_);
+            times.reserve(size_);
+            for (uint32_t head : buckets_)
+            {
+                for (uint32_t node = head; node != kNil; node = nodes_[node].next)
+                {
+                    nodes.push_back(node);
+                    times.push_back(nodes_[node].time);
+                }
+            }
+
+            Time samples[kWidthSamples];
+            Time* samples_end = std::partial_sort_copy(times.begin(), times.end(), samples, samples + kWidthSamples);
+            size_t sample_count = static_cast<size_t>(samples_end - samples);
+            if (sample_count >= 2)
+            {
+                Time average = (samples[sample_count - 1] - samples[0]) / (sample_count - 1);
+                //去掉大于平均间隔2倍的离群间隔后重新平均
+                Time kept_span = 0;
+                Time kept = 0;
+                for (size_t i = 1; i < sample_count; ++i)
+                {
+                    Time gap = samples[i] - samples[i - 1];
+                    if (gap <= 2 * average)
+                    {
+                        kept_span += gap;
+                        ++kept;
+                    }
+                }
+                if (kept > 0 && kept_span > 0)
+                {
+                    width_ = std::max<Time>(1, 3 * kept_span / kept);
+                }
+            }
+            buckets_.assign(bucket_count, kNil);
+
+            std::vector<uint32_t> starts(bucket_count + 1, 0);
+            for (Time time : times)
+            {
+                ++starts[BucketOf(time) + 1];
+            }
+            for (size_t b = 0; b < bucket_count; ++b)
+            {
+                starts[b + 1] += starts[b];
+            }
+            std::vector<uint32_t> order(nodes.size());
+            {
+                std::vector<uint32_t> cursor(starts.begin(), starts.end() - 1);
+                for (size_t i = 0; i < nodes.size(); ++i)
+                {
+                    order[cursor[BucketOf(times[i])]++] = static_cast<uint32_t>(i);
+                }
+            }
+
+            //每个新桶由若干旧桶的有序片段组成, 桶内再按时间稳定插入排序; 时间相同的事件来自同一个旧桶, 保持原顺序
+            for (size_t b = 0; b < bucket_count; ++b)
+            {
+                uint32_t* first = order.data() + starts[b];
+                uint32_t* last = order.data() + starts[b + 1];
+                if (first == last)
+                {
+                    continue;
+                }
+                for (uint32_t* it = first + 1; it != last; ++it)
+                {
+                    uint32_t value = *it;
+                    uint32_t* hole = it;
+                    while (hole != first && times[*(hole - 1)] > times[value])
+                    {
+                        *hole = *(hole - 1);
+                        --hole;
+                    }
+                    *hole = value;
+                }
+                uint32_t next = kNil;
+                for (uint32_t* it = last; it != first; --it)
+                {
+                    uint32_t node = nodes[*(it - 1)];
+                    nodes_[node].next = next;
+                    next = node;
+                }
+                buckets_[b] = next;
+            }
+
+            current_ = 0;
+            bucket_top_ = width_;
+            if (sample_count > 0)
+            {
+                current_ = BucketOf(samples[0]);
+                bucket_top_ = (samples[0] / width_ + 1) * width_;
+            }
+        }
+
+        std::vector<Node> nodes_;//节点池, 空闲节点串成链表
+        uint32_t free_head_;
+        std::vector<uint32_t> buckets_;//桶首节点, 桶数为2的幂
+        Time width_;
+        size_t size_;
+        size_t current_;//当前扫描的桶
+        Time bucket_top_;//当前桶时间窗口的上界(不含)
+    };
+
+    template <typename Payload>
+    const uint32_t CalendarQueue<Payload>::kNil;
+    template <typename Payload>
+    const size_t CalendarQueue<Payload>::kMinBuckets;
+    template <typename Payload>
+    const size_t CalendarQueue<Payload>::kWidthSamples;
+
+    //Machine为提供 FsmErrors Execute(Trigger) 的状态机类型, 例如 Fsm, FrozenFsm
+    template <typename Machine, typename Trigger>
+    class EventScheduler
+    {
+    public:
+        using Time = uint64_t;
+        //送达的触发器没有成功执行时调用, 参数为时间、实例、触发器和返回值
+        using RejectFn = std::function<void(Time, InstanceId, Trigger, FsmErrors)>;
+
+        EventScheduler()
+            : machines_()
+            , queue_()
+            , batch_()
+            , now_(0)
+            , current_(kInvalidInstanceId)
+            , reject_fn_(nullptr)
+        {
+        }
+
+        //登记状态机实例, 调度器不拥有它, 实例的生命周期需要覆盖调度器的使用
+        InstanceId Attach(Machine& machine)
+        {
+            machines_.push_back(&machine);
+            return static_cast<InstanceId>(machines_.size() - 1);
+        }
+
+        void SetRejectFn(RejectFn fn)
+        {
+            reject_fn_ = std::move(fn);
+        }
+
+        //在time时刻向实例id发送触发器, 早于当前时刻的时间按当前时刻处理
+        void Schedule(Time time, InstanceId id, Trigger trigger)
+        {
+            queue_.Push(std::max(time, now_), Event{ id, trigger });
+        }
+
+        //在当前时刻之后delay个时间单位发送触发器
+        void ScheduleAfter(Time delay, InstanceId id, Trigger trigger)
+        {
+            Schedule(now_ + delay, id, trigger);
+        }
+
+        //当前时刻
+        Time Now() const
+        {
+            return now_;
+        }
+
+        //正在送达的事件所属的实例, 不在送达过程中时为kInvalidInstanceId
+        InstanceId CurrentInstance() const
+        {
+            return current_;
+        }
+
+        //尚未送达的事件数
+        size_t Pending() const
+        {
+            return queue_.Size();
+        }
+
+        void Reserve(size_t events)
+        {
+            queue_.Reserve(events);
+        }
+
+        //按组件估算的内存占用, 事件队列计入"queue"; instance_bytes 为每个登记的实例
+        MemoryReport MemoryUsage() const
+        {
+            MemoryReport report;
+            report.Add("object", sizeof(*this) - sizeof(queue_));
+            report.Add("machines", detail::VectorBytes(machines_));
+            report.Add("queue", queue_.MemoryUsage().Total());
+            report.Add("batch", detail::VectorBytes(batch_));
+            report.instance_bytes = sizeof(Machine*);
+            return report;
+        }
+
+        //送达最早时刻的一批事件, 没有事件时返回0
+        size_t Step()
+        {
+            Time time = 0;
+            if (!queue_.PeekTime(time))
+            {
+                return 0;
+            }
+            now_ = time;
+
+            batch_.clear();
+            Time event_time = 0;
+            Event event{};
+            while (queue_.PeekTime(event_time) && event_time == time)
+            {
+                queue_.Pop(event_time, event);
+                batch_.push_back(event);
+            }
+
+            //同一实例的事件连续送达, 并保持各自的调度顺序
+            std::stable_sort(batch_.begin(), batch_.end(),
+                [](const Event& a, const Event& b) { return a.id < b.id; });
+            for (const Event& e : batch_)
+            {
+                current_ = e.id;
+                FsmErrors err_code = machines_[e.id]->Execute(e.trigger);
+                if (err_code != FSM_SUCCESS && reject_fn_)
+                {
+                    reject_fn_(time, e.id, e.trigger, err_code);
+                }
+            }
+            current_ = kInvalidInstanceId;
+            return batch_.size();
+        }
+
+        //送达时间不晚于end的所有事件, 之后当前时刻前进到end; 返回送达的事件数
+        size_t RunUntil(Time end)
+        {
+            size_t delivered = 0;
+            Time time = 0;
+            while (queue_.PeekTime(time) && time <= end)
+            {
+                delivered += Step();
+            }
+            now_ = std::max(now_, end);
+            return delivered;
+        }
+
+        //送达所有事件, 包括送达过程中新调度的事件
+        size_t RunAll()
+        {
+            size_t delivered = 0;
+            for (size_t batch = Step(); batch != 0; batch = Step())
+            {
+                delivered += batch;
+            }
+            return delivered;
+        }
+
+    private:
+        struct Event
+        {
+            InstanceId id;
+            Trigger trigger;
+        };
+
+        std::vector<Machine*> machines_;
+        CalendarQueue<Event> queue_;
+        std::vector<Event> batch_;
+        Time now_;
+        InstanceId current_;
+        RejectFn reject_fn_;
+    };
+}
@@ -0,0 +1,636 @@
+#pragma once
+
+#include "fsm_fleet.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+//多进程共享的状态机实例表
+//ShmFsmTable 把冻结的状态机定义和实例表放在一块POSIX共享内存中, 预先fork的多个工作进程可以对同一组实例执行触发器:
+//- 段内只保存偏移量, 不保存指针, 各进程把段映射到不同的地址也能使用
+//- 定义按传入状态分组, 每个转换记录触发器序号、目标状态编号、位掩码guard以及guard和action的编号;
+//  guard和action在每个进程中通过SetGuard/SetAction按编号注册, 编号0表示没有
+//- 每个实例有一个64位原子状态字: 低32位是状态编号, 高32位是正在执行转换的进程号(0表示空闲)
+//  Execute先用CAS把自己的进程号写入状态字认领实例, 在认领期间求值guard、记录目标状态并执行action, 最后写回新状态释放实例;
+//  同一实例上的转换因此是串行的, 不同实例之间互不影响
+//- 工作进程在转换过程中崩溃时状态字中留下已经不存在的进程号; 等待该实例的进程或 Recover 发现后按恢复策略处理:
+//  回滚到转换前的状态, 或者前滚到已记录的目标状态. 进程号可能被复用, 检测只针对进程已经退出的情况
+//action中不能对同一实例执行触发器, 否则会等待自己释放实例
+
+namespace fsm
+{
+    //转换过程中崩溃的实例的处理方式
+    enum ShmRecoveryPolicy
+    {
+        SHM_RECOVER_ROLLBACK = 0,//回到转换前的状态, action的效果由使用者自行补偿
+        SHM_RECOVER_ROLL_FORWARD//进入已记录的目标状态, 视为action已经完成
+    };
+
+    namespace detail
+    {
+        inline uint32_t& CachedProcessId()
+        {
+            static uint32_t pid = 0;
+            return pid;
+        }
+
+        inline void RefreshProcessId()
+        {
+            CachedProcessId() = static_cast<uint32_t>(getpid());
+        }
+
+        //本进程的进程号, fork之后由pthread_atfork在子进程中更新, 避免每次执行都调用getpid
+        inline uint32_t CurrentProcessId()
+        {
+            static const bool registered = (RefreshProcessId(), pthread_atfork(nullptr, nullptr, &RefreshProcessId) == 0);
+            (void)registered;
+            return CachedProcessId();
+        }
+    }
+
+    template <typename State, State Initial, typename Trigger>
+    class ShmFsmTable
+    {
+        static_assert(std::is_trivially_copyable<State>::value, "state must be trivially copyable to live in shared memory");
+        static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared-memory state words need lock-free 64-bit atomics");
+
+    public:
+        //guard和action在各进程中注册, 参数为实例号
+        using GuardFn = std::function<bool(InstanceId)>;
+        using ActionFn = std::function<void(InstanceId)>;
+
+        //转换定义, guard和action以编号给出
+        struct Trans
+        {
+            State from_state;
+            State to_state;
+            Trigger trigger;
+            uint32_t guard_id;//0表示没有guard
+            uint32_t action_id;//0表示没有action
+            MaskGuard maskguard = MaskGuard{ 0, 0 };
+            int32_t priority = 0;
+        };
+
+        ShmFsmTable()
+            : base_(nullptr)
+            , mapped_size_(0)
+            , header_(nullptr)
+            , indexer_()
+            , guards_()
+            , actions_()
+            , policy_(SHM_RECOVER_ROLLBACK)
+        {
+        }
+
+        ShmFsmTable(const ShmFsmTable&) = delete;
+        ShmFsmTable& operator=(const ShmFsmTable&) = delete;
+
+        ~ShmFsmTable()
+        {
+            Close();
+        }
+
+        //创建名为name的共享内存段(名字以'/'开头)并写入定义, 段已存在或创建失败时返回FSM_IO_ERROR
+        FsmErrors Create(const char* name, const std::vector<Trans>& transitions, uint32_t capacity)
+        {
+            Close();
+            Layout layout = ComputeLayout(transitions, capacity);
+            int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+            if (fd < 0)
+            {
+                return FSM_IO_ERROR;
+            }
+            void* base = MAP_FAILED;
+            if (ftruncate(fd, static_cast<off_t>(layout.total_size)) == 0)
+            {
+                base = mmap(nullptr, layout.total_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            }
+            close(fd);
+            if (base == MAP_FAILED)
+            {
+                shm_unlink(name);
+                return FSM_IO_ERROR;
+            }
+            Initialize(base, layout, transitions, capacity);
+            return FSM_SUCCESS;
+        }
+
+        //创建匿名共享映射, 只能由之后fork出的子进程共享
+        FsmErrors CreateAnonymous(const std::vector<Trans>& transitions, uint32_t capacity)
+        {
+            Close();
+            Layout layout = ComputeLayout(transitions, capacity);
+            void* base = mmap(nullptr, layout.total_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+            if (base == MAP_FAILED)
+            {
+                return FSM_IO_ERROR;
+            }
+            Initialize(base, layout, transitions, capacity);
+            return FSM_SUCCESS;
+        }
+
+        //打开其他进程创建的共享内存段, 段不存在、尚未初始化完成或者与本类型不匹配时返回FSM_IO_ERROR
+        FsmErrors Open(const char* name)
+        {
+            Close();
+            int fd = shm_open(name, O_RDWR, 0600);
+            if (fd < 0)
+            {
+                return FSM_IO_ERROR;
+            }
+            struct stat st;
+            void* base = MAP_FAILED;
+            size_t size = 0;
+            if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(Header))
+            {
+                size = static_cast<size_t>(st.st_size);
+                base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            }
+            close(fd);
+            if (base == MAP_FAILED)
+            {
+                return FSM_IO_ERROR;
+            }
+
+            const Header* header = static_cast<const Header*>(base);
+            if (memcmp(header->magic, kMagic, sizeof(kMagic)) != 0
+                || header->state_size != sizeof(State)
+                || header->total_size != size
+                || header->ready.load(std::memory_order_acquire) == 0)
+            {
+                munmap(base, size);
+                return FSM_IO_ERROR;
+            }
+            Attach(base, size);
+            return FSM_SUCCESS;
+        }
+
+        //删除共享内存段的名字, 已经映射的进程不受影响
+        static FsmErrors Unlink(const char* name)
+        {
+            return shm_unlink(name) == 0 ? FSM_SUCCESS : FSM_IO_ERROR;
+        }
+
+        //解除本进程的映射
+        void Close()
+        {
+            if (base_ != nullptr)
+            {
+                munmap(base_, mapped_size_);
+                base_ = nullptr;
+                mapped_size_ = 0;
+                header_ = nullptr;
+                indexer_ = StateIndexer<State>();
+            }
+        }
+
+        bool IsOpen() const
+        {
+            return base_ != nullptr;
+        }
+
+        //在本进程中注册guard和action, 每个进程都需要注册定义中用到的编号; 没有注册的guard视为不通过, 没有注册的action不执行
+        void SetGuard(uint32_t id, GuardFn fn)
+        {
+            if (guards_.size() <= id)
+            {
+                guards_.resize(id + 1);
+            }
+            guards_[id] = std::move(fn);
+        }
+
+        void SetAction(uint32_t id, ActionFn fn)
+        {
+            if (actions_.size() <= id)
+            {
+                actions_.resize(id + 1);
+            }
+            actions_[id] = std::move(fn);
+        }
+
+        //设置等待实例时发现崩溃进程所用的恢复策略
+        void SetRecoveryPolicy(ShmRecoveryPolicy policy)
+        {
+            policy_ = policy;
+        }
+
+        //分配一个实例, 实例表已满时返回kInvalidInstanceId
+        InstanceId Add(State s = Initial)
+        {
+            StateIndex idx = indexer_.Find(s);
+            if (idx == kInvalidStateIndex)
+            {
+                return kInvalidInstanceId;
+            }
+            uint32_t id = header_->size.fetch_add(1, std::memory_order_acq_rel);
+            if (id >= header_->capacity)
+            {
+                header_->size.fetch_sub(1, std::memory_order_acq_rel);
+                return kInvalidInstanceId;
+            }
+            Instance& instance = InstanceAt(id);
+            instance.generation.store(0, std::memory_order_relaxed);
+            instance.target.store(idx, std::memory_order_relaxed);
+            instance.word.store(idx, std::memory_order_release);
+            return id;
+        }
+
+        //已分配的实例数
+        size_t Size() const
+        {
+            return std::min(header_->size.load(std::memory_order_acquire), header_->capacity);
+        }
+
+        size_t Capacity() const
+        {
+            return header_->capacity;
+        }
+
+        size_t StateCount() const
+        {
+            return header_->state_count;
+        }
+
+        //对实例执行触发器, 语义与 Fsm::Execute 相同; 实例正被其他进程转换时等待
+        //guard或action抛出异常时实例回到转换前的状态并被释放, 异常继续向外传递
+        FsmErrors Execute(InstanceId id, Trigger trigger, GuardFlags flags = 0)
+        {
+            Instance& instance = InstanceAt(id);
+            uint64_t word = Claim(instance);
+            StateIndex state = static_cast<StateIndex>(word);
+            StateIndex next = state;
+            ReleaseGuard release{ instance, next };
+
+            const uint64_t key = TriggerOrdinal(trigger);
+            const uint32_t* offsets = OffsetsData();
+            const Record* records = RecordsData();
+            FsmErrors err_code = FSM_NO_MATCHING_TRIGGER;
+            for (uint32_t i = offsets[state]; i < offsets[state + 1]; ++i)
+            {
+                const Record& record = records[i];
+                if (record.key != key)
+                {
+                    continue;
+                }
+                err_code = FSM_SUCCESS;
+                if (!record.maskguard.Pass(flags)
+                    || (record.guard_id != 0 && !CallGuard(record.guard_id, id)))
+                {
+                    continue;
+                }
+
+                //先记录目标状态, 崩溃后前滚时使用
+                instance.target.store(record.target, std::memory_order_release);
+                if (record.action_id != 0)
+                {
+                    CallAction(record.action_id, id);
+                }
+                next = record.target;
+                instance.generation.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+            return err_code;//release析构时释放实例
+        }
+
+        //返回实例的当前状态; 实例正在转换时返回转换前的状态
+        State GetState(InstanceId id) const
+        {
+            return indexer_.At(static_cast<StateIndex>(InstanceAt(id).word.load(std::memory_order_acquire)));
+        }
+
+        //实例完成的转换次数
+        uint32_t Generation(InstanceId id) const
+        {
+            return InstanceAt(id).generation.load(std::memory_order_acquire);
+        }
+
+        //重置实例的状态, 等待正在进行的转换结束
+        void Reset(InstanceId id, State s = Initial)
+        {
+            StateIndex idx = indexer_.Find(s);
+            if (idx == kInvalidStateIndex)
+            {
+                return;
+            }
+            Instance& instance = InstanceAt(id);
+            Claim(instance);
+            instance.target.store(idx, std::memory_order_relaxed);
+            instance.word.store(idx, std::memory_order_release);
+        }
+
+        //查找转换过程中崩溃的进程留下的实例并按policy恢复, 返回恢复的实例数
+        size_t Recover(ShmRecoveryPolicy policy)
+        {
+            size_t recovered = 0;
+            for (uint32_t id = 0; id < Size(); ++id)
+            {
+                Instance& instance = InstanceAt(id);
+                uint64_t word = instance.word.load(std::memory_order_acquire);
+                if (OwnerOf(word) != 0 && !IsAlive(OwnerOf(word)) && RecoverInstance(instance, word, policy))
+                {
+                    ++recovered;
+                }
+            }
+            return recovered;
+        }
+
+        //按组件估算的内存占用; 共享内存段按映射大小计入"segment", 由所有进程共用
+        //instance_bytes 为段中每个实例的字节数
+        MemoryReport MemoryUsage() const
+        {
+            MemoryReport report;
+            report.Add("object", sizeof(*this));
+            report.Add("segment", mapped_size_);
+            report.Add("state_index", indexer_.MemoryBytes());
+            report.Add("registries", detail::VectorBytes(guards_) + detail::VectorBytes(actions_));
+            report.instance_bytes = sizeof(Instance);
+            return report;
+        }
+
+    private:
+        //段头, 所有位置都是相对段起始地址的偏移
+        struct Header
+        {
+            char magic[8];
+            uint32_t state_size;
+            uint32_t state_count;
+            uint32_t transition_count;
+            uint32_t capacity;
+            uint64_t states_offset;//State[state_count]
+            uint64_t offsets_offset;//uint32_t[state_count + 1]
+            uint64_t records_offset;//Record[transition_count]
+            uint64_t instances_offset;//Instance[capacity]
+            uint64_t total_size;
+            std::atomic<uint32_t> size;//已分配的实例数
+            std::atomic<uint32_t> ready;//创建者写完定义后置1
+        };
+
+        struct Record
+        {
+            uint64_t key;//触发器序号
+            MaskGuard maskguard;
+            uint32_t target;
+            uint32_t guard_id;
+            uint32_t action_id;
+            uint32_t reserved;
+        };
+
+        struct Instance
+        {
+            std::atomic<uint64_t> word;//低32位状态编号, 高32位转换中的进程号
+            std::atomic<uint32_t> target;//正在进行的转换的目标状态, 空闲时等于当前状态
+            std::atomic<uint32_t> generation;
+        };
+
+        //析构时以state释放认领的实例, 先把target改为state; 异常离开Execute时state仍是转换前的状态
+        struct ReleaseGuard
+        {
+            Instance& instance;
+            const StateIndex& state;
+
+            ~ReleaseGuard()
+            {
+                instance.target.store(state, std::memory_order_relaxed);
+                instance.word.store(state, std::memory_order_release);
+            }
+        };
+
+        struct Layout
+        {
+            uint64_t states_offset;
+            uint64_t offsets_offset;
+            uint64_t records_offset;
+            uint64_t instances_offset;
+            uint64_t total_size;
+        };
+
+        static constexpr char kMagic[8] = { 'F', 'S', 'M', 'S', 'H', 'M', '1', '\0' };
+        //等待被认领的实例时, 每自旋这么多次检查一次认领进程是否还存在
+        static const uint32_t kLivenessInterval = 1024;
+
+        static uint64_t Align(uint64_t offset)
+        {
+            return (offset + 63) & ~uint64_t(63);
+        }
+
+        static uint32_t OwnerOf(uint64_t word)
+        {
+            return static_cast<uint32_t>(word >> 32);
+        }
+
+        static bool IsAlive(uint32_t pid)
+        {
+            return kill(static_cast<pid_t>(pid), 0) == 0 || errno != ESRCH;
+        }
+
+        //为定义中出现的状态编号, 初始状态为0
+        static StateIndexer<State> IndexStates(const std::vector<Trans>& transitions)
+        {
+            StateIndexer<State> indexer;
+            indexer.Add(Initial);
+            for (const Trans& transition : transitions)
+            {
+                indexer.Add(transition.from_state);
+                indexer.Add(transition.to_state);
+            }
+            return indexer;
+        }
+
+        static Layout ComputeLayout(const std::vector<Trans>& transitions, uint32_t capacity)
+        {
+            size_t state_count = IndexStates(transitions).Size();
+            Layout layout;
+            layout.states_offset = Align(sizeof(Header));
+            layout.offsets_offset = Align(layout.states_offset + sizeof(State) * state_count);
+            layout.records_offset = Align(layout.offsets_offset + sizeof(uint32_t) * (state_count + 1));
+            layout.instances_offset = Align(layout.records_offset + sizeof(Record) * transitions.size());
+            layout.total_size = Align(layout.instances_offset + sizeof(Instance) * capacity);
+            return layout;
+        }
+
+        void Initialize(void* base, const Layout& layout, const std::vector<Trans>& transitions, uint32_t capacity)
+        {
+            StateIndexer<State> indexer = IndexStates(transitions);
+            Header* header = new (base) Header();
+            memcpy(header->magic, kMagic, sizeof(kMagic));
+            header->state_size = sizeof(State);
+            header->state_count = static_cast<uint32_t>(indexer.Size());
+            header->transition_count = static_cast<uint32_t>(transitions.size());
+            header->capacity = capacity;
+            header->states_offset = layout.states_offset;
+            header->offsets_offset = layout.offsets_offset;
+            header->records_offset = layout.records_offset;
+            header->instances_offset = layout.instances_offset;
+            header->total_size = layout.total_size;
+            header->size.store(0, std::memory_order_relaxed);
+
+            char* bytes = static_cast<char*>(base);
+            State* states = reinterpret_cast<State*>(bytes + layout.states_offset);
+            for (size_t i = 0; i < indexer.Size(); ++i)
+            {
+                states[i] = indexer.At(static_cast<StateIndex>(i));
+            }
+
+            //按传入状态分组, 组内按优先级从高到低, 同优先级保持定义顺序
+            std::vector<const Trans*> sorted;
+            for (const Trans& transition : transitions)
+            {
+                sorted.push_back(&transition);
+            }
+            std::stable_sort(sorted.begin(), sorted.end(), [&](const Trans* a, const Trans* b) {
+                StateIndex fa = indexer.Find(a->from_state);
+                StateIndex fb = indexer.Find(b->from_state);
+                return fa != fb ? fa < fb : a->priority > b->priority;
+            });
+
+            uint32_t* offsets = reinterpret_cast<uint32_t*>(bytes + layout.offsets_offset);
+            Record* records = reinterpret_cast<Record*>(bytes + layout.records_offset);
+            size_t next = 0;
+            for (size_t s = 0; s < indexer.Size(); ++s)
+            {
+                offsets[s] = static_cast<uint32_t>(next);
+                while (next < sorted.size() && indexer.Find(sorted[next]->from_state) == s)
+                {
+                    const Trans& transition = *sorted[next];
+                    records[next] = Record{ TriggerOrdinal(transition.trigger), transition.maskguard,
+                        indexer.Find(transition.to_state), transition.guard_id, transition.action_id, 0 };
+                    ++next;
+                }
+            }
+            offsets[indexer.Size()] = static_cast<uint32_t>(next);
+
+            Instance* instances = reinterpret_cast<Instance*>(bytes + layout.instances_offset);
+            for (uint32_t i = 0; i < capacity; ++i)
+            {
+                new (&instances[i]) Instance();
+                instances[i].word.store(0, std::memory_order_relaxed);
+                instances[i].target.store(0, std::memory_order_relaxed);
+                instances[i].generation.store(0, std::memory_order_relaxed);
+            }
+
+            header->ready.store(1, std::memory_order_release);
+            Attach(base, static_cast<size_t>(layout.total_size));
+        }
+
+        //建立本进程的映射信息
+        void Attach(void* base, size_t size)
+        {
+            base_ = base;
+            mapped_size_ = size;
+            header_ = static_cast<Header*>(base);
+
+            const State* states = reinterpret_cast<const State*>(static_cast<char*>(base_) + header_->states_offset);
+            indexer_ = StateIndexer<State>();
+            for (uint32_t i = 0; i < header_->state_count; ++i)
+            {
+                indexer_.Add(states[i]);
+            }
+        }
+
+        Instance& InstanceAt(InstanceId id) const
+        {
+            return reinterpret_cast<Instance*>(static_cast<char*>(base_) + header_->instances_offset)[id];
+        }
+
+        const uint32_t* OffsetsData() const
+        {
+            return reinterpret_cast<const uint32_t*>(static_cast<char*>(base_) + header_->offsets_offset);
+        }
+
+        const Record* RecordsData() const
+        {
+            return reinterpret_cast<const Record*>(static_cast<char*>(base_) + header_->records_offset);
+        }
+
+        //认领实例: 把本进程号写入状态字, 返回认领前的状态字; 认领者已经退出时先按恢复策略恢复
+        uint64_t Claim(Instance& instance)
+        {
+            const uint64_t pid = detail::CurrentProcessId();
+            uint32_t spins = 0;
+            for (;;)
+            {
+                uint64_t word = instance.word.load(std::memory_order_acquire);
+                uint32_t owner = OwnerOf(word);
+                if (owner == 0)
+                {
+                    //空闲时target等于当前状态, 在记录真正的目标之前崩溃时前滚也不会改变状态
+                    if (instance.word.compare_exchange_weak(word, (pid << 32) | word,
+                        std::memory_order_acq_rel, std::memory_order_relaxed))
+                    {
+                        return word;
+                    }
+                    continue;
+                }
+
+                if (++spins % kLivenessInterval == 0 && !IsAlive(owner))
+                {
+                    RecoverInstance(instance, word, policy_);
+                    continue;
+                }
+                std::this_thread::yield();
+            }
+        }
+
+        //把崩溃进程留下的状态字恢复为空闲, 状态字已被其他进程恢复时返回false
+        //先以本进程的名义接管实例, 把target改为恢复后的状态再释放, 保持空闲时target等于当前状态
+        bool RecoverInstance(Instance& instance, uint64_t word, ShmRecoveryPolicy policy)
+        {
+            uint64_t state = static_cast<uint32_t>(word);
+            if (policy == SHM_RECOVER_ROLL_FORWARD)
+            {
+                state = instance.target.load(std::memory_order_acquire);
+            }
+            const uint64_t pid = detail::CurrentProcessId();
+            if (!instance.word.compare_exchange_strong(word, (pid << 32) | state,
+                std::memory_order_acq_rel, std::memory_order_relaxed))
+            {
+                return false;
+            }
+            instance.target.store(static_cast<uint32_t>(state), std::memory_order_relaxed);
+            instance.word.store(state, std::memory_order_release);
+            return true;
+        }
+
+        bool CallGuard(uint32_t id, InstanceId instance) const
+        {
+            return id < guards_.size() && guards_[id] && guards_[id](instance);
+        }
+
+        void CallAction(uint32_t id, InstanceId instance) const
+        {
+            if (id < actions_.size() && actions_[id])
+            {
+                actions_[id](instance);
+            }
+        }
+
+        void* base_;
+        size_t mapped_size_;
+        Header* header_;
+        StateIndexer<State> indexer_;//本进程中状态与编号的对应
+        std::vector<GuardFn> guards_;//本进程注册的guard, 以编号为下标
+        std::vector<ActionFn> actions_;
+        ShmRecoveryPolicy policy_;
+    };
+
+    template <typename State, State Initial, typename Trigger>
+    constexpr char ShmFsmTable<State, Initial, Trigger>::kMagic[8];
+    template <typename State, State Initial, typename Trigger>
+    const uint32_t ShmFsmTable<State, Initial, Trigger>::kLivenessInterval;
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "fsmcpp.hpp"
+
+#include <stdint.h>
+
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+//状态编号与触发器序号工具
+//冻结后的转换表以稠密整数下标访问状态, 用户定义的State需要先映射为[0, N)之间的编号
+//初始状态总是编号0, 其余状态按首次出现的顺序编号
+//整数和枚举类型的触发器可以直接换算为无符号序号, 用作位集或表格的下标
+
+namespace fsm
+{
+    //稠密状态编号类型
+    using StateIndex = uint32_t;
+    //未编号的状态
+    const StateIndex kInvalidStateIndex = std::numeric_limits<StateIndex>::max();
+
+    //取得整数或枚举类型的底层整数类型
+    template <typename T, bool IsEnum = std::is_enum<T>::value>
+    struct UnderlyingInteger
+    {
+        using type = T;
+    };
+
+    template <typename T>
+    struct UnderlyingInteger<T, true>
+    {
+        using type = typename std::underlying_type<T>::type;
+    };
+
+    //触发器序号, 按同宽度的无符号数解释, 例如 char(-1) 的序号为255
+    template <typename Trigger>
+    inline uint64_t TriggerOrdinal(Trigger trigger)
+    {
+        using Integer = typename UnderlyingInteger<Trigger>::type;
+        static_assert(std::is_integral<Integer>::value, "trigger must be an integral or enum type");
+        using Unsigned = typename std::make_unsigned<Integer>::type;
+        return static_cast<Unsigned>(static_cast<Integer>(trigger));
+    }
+
+    //由序号还原触发器
+    template <typename Trigger>
+    inline Trigger TriggerFromOrdinal(uint64_t ordinal)
+    {
+        using Integer = typename UnderlyingInteger<Trigger>::type;
+        return static_cast<Trigger>(static_cast<Integer>(ordinal));
+    }
+
+    template <typename State>
+    class StateIndexer
+    {
+    public:
+        StateIndexer()
+            : index_()
+            , states_()
+        {
+        }
+
+        //为状态分配编号, 已编号时返回原有编号
+        StateIndex Add(State s)
+        {
+            auto it = index_.find(s);
+            if (it != index_.end())
+            {
+                return it->second;
+            }
+
+            StateIndex idx = static_cast<StateIndex>(states_.size());
+            index_.emplace(s, idx);
+            states_.push_back(s);
+            return idx;
+        }
+
+        //返回状态编号, 未编号返回kInvalidStateIndex
+        StateIndex Find(State s) const
+        {
+            auto it = index_.find(s);
+            return it == index_.end() ? kInvalidStateIndex : it->second;
+        }
+
+        //返回编号对应的状态
+        State At(StateIndex idx) const
+        {
+            return states_[idx];
+        }
+
+        size_t Size() const
+        {
+            return states_.size();
+        }
+
+        //编号表占用的堆内存
+        size_t MemoryBytes() const
+        {
+            return detail::HashBytes(index_) + detail::VectorBytes(states_);
+        }
+
+    private:
+        std::unordered_map<State, StateIndex> index_;
+        std::vector<State> states_;
+    };
+
+    //为状态机定义中出现的所有状态编号, 初始状态编号为0
+    //definition可以是Fsm, 也可以是其他以GetTransitions()提供 (传入状态, 转换列表) 分组的定义, 例如FsmBuilder
+    template <typename State, State Initial, typename Definition>
+    StateIndexer<State> IndexDefinitionStates(const Definition& definition)
+    {
+        StateIndexer<State> indexer;
+        indexer.Add(Initial);
+        for (const auto& state_transitions : definition.GetTransitions())
+        {
+            indexer.Add(state_transitions.first);
+            for (const auto& transition : state_transitions.second)
+            {
+                indexer.Add(transition.to_state);
+            }
+        }
+        return indexer;
+    }
+
+    template <typename State, State Initial, typename Trigger>
+    StateIndexer<State> IndexStates(const Fsm<State, Initial, Trigger>& fsm)
+    {
+        return IndexDefinitionStates<State, Initial>(fsm);
+    }
+}
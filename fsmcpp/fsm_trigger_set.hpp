@@ -0,0 +1,243 @@
+#pragma once
+
+#include "fsm_state_index.hpp"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+//每个状态的有效触发器位集
+//协议校验时经常需要判断某个触发器在当前状态下是否可以接受, 直接调用Execute会执行guard和action
+//TriggerBitsets 从状态机定义冻结出每个状态的触发器位集: 至少有一个转换的触发器对应的位为1
+//查询不会调用guard, 也不会改变任何状态
+//只适用于整数或枚举类型的触发器, 字符串触发器可以先通过 StringFsm 驻留为整数id
+
+namespace fsm
+{
+    //某个状态下有效触发器集合的只读视图, 生命周期不超过产生它的 TriggerBitsets
+    template <typename Trigger>
+    class TriggerSetView
+    {
+    public:
+        TriggerSetView(const uint32_t* words, size_t word_count)
+            : words_(words)
+            , word_count_(word_count)
+        {
+        }
+
+        //触发器是否在集合中
+        bool Contains(Trigger trigger) const
+        {
+            uint64_t ordinal = TriggerOrdinal(trigger);
+            if ((ordinal >> 5) >= word_count_)
+            {
+                return false;
+            }
+            return ((words_[ordinal >> 5] >> (ordinal & 31)) & 1) != 0;
+        }
+
+        //集合中的触发器个数
+        size_t Count() const
+        {
+            size_t count = 0;
+            for (size_t w = 0; w < word_count_; ++w)
+            {
+                count += static_cast<size_t>(__builtin_popcount(words_[w]));
+            }
+            return count;
+        }
+
+        bool Empty() const
+        {
+            return Count() == 0;
+        }
+
+        //按序号从小到大对集合中的每个触发器调用fn(Trigger)
+        template <typename Fn>
+        void ForEach(Fn&& fn) const
+        {
+            for (size_t w = 0; w < word_count_; ++w)
+            {
+                for (uint32_t bits = words_[w]; bits != 0; bits &= bits - 1)
+                {
+                    uint64_t ordinal = w * 32 + static_cast<uint64_t>(__builtin_ctz(bits));
+                    fn(TriggerFromOrdinal<Trigger>(ordinal));
+                }
+            }
+        }
+
+        std::vector<Trigger> ToVector() const
+        {
+            std::vector<Trigger> triggers;
+            ForEach([&triggers](Trigger trigger) { triggers.push_back(trigger); });
+            return triggers;
+        }
+
+    private:
+        const uint32_t* words_;
+        size_t word_count_;
+    };
+
+    template <typename State, State Initial, typename Trigger>
+    class TriggerBitsets
+    {
+    public:
+        using SourceFsm = Fsm<State, Initial, Trigger>;
+
+        //支持的最大触发器序号
+        static const uint64_t kMaxOrdinal = 0xFFFF;
+
+        TriggerBitsets()
+            : indexer_()
+            , words_()
+            , words_per_state_(0)
+            , sentinel_(0)
+        {
+        }
+
+        //由状态机定义构建位集, 触发器序号超过kMaxOrdinal时返回FSM_TRIGGER_OUT_OF_RANGE
+        //definition可以是SourceFsm, 也可以是按传入状态分组好的FsmBuilder
+        template <typename Definition>
+        FsmErrors Build(const Definition& definition)
+        {
+            uint64_t max_ordinal = 0;
+            for (const auto& state_transitions : definition.GetTransitions())
+            {
+                for (const auto& transition : state_transitions.second)
+                {
+                    uint64_t ordinal = TriggerOrdinal(transition.trigger);
+                    if (ordinal > kMaxOrdinal)
+                    {
+                        return FSM_TRIGGER_OUT_OF_RANGE;
+                    }
+                    max_ordinal = std::max(max_ordinal, ordinal);
+                }
+            }
+
+            //多留出一位始终为0的哨兵位, 批量过滤时把越界的序号映射到这一位, 省去越界判断
+            uint32_t sentinel = static_cast<uint32_t>(max_ordinal + 1);
+            size_t words_per_state = sentinel / 32 + 1;
+
+            StateIndexer<State> indexer = IndexDefinitionStates<State, Initial>(definition);
+            std::vector<uint32_t> words(indexer.Size() * words_per_state, 0);
+            for (const auto& state_transitions : definition.GetTransitions())
+            {
+                uint32_t* row = &words[indexer.Find(state_transitions.first) * words_per_state];
+                for (const auto& transition : state_transitions.second)
+                {
+                    uint64_t ordinal = TriggerOrdinal(transition.trigger);
+                    row[ordinal >> 5] |= 1u << (ordinal & 31);
+                }
+            }
+
+            indexer_ = std::move(indexer);
+            words_.swap(words);
+            words_per_state_ = words_per_state;
+            sentinel_ = sentinel;
+            return FSM_SUCCESS;
+        }
+
+        //触发器在状态s下是否至少有一个转换, 不会调用guard
+        bool CanFire(State s, Trigger trigger) const
+        {
+            return AvailableTriggers(s).Contains(trigger);
+        }
+
+        //返回状态s下所有有效触发器的视图
+        TriggerSetView<Trigger> AvailableTriggers(State s) const
+        {
+            StateIndex idx = indexer_.Find(s);
+            if (idx == kInvalidStateIndex)
+            {
+                return TriggerSetView<Trigger>(nullptr, 0);
+            }
+            return TriggerSetView<Trigger>(&words_[idx * words_per_state_], words_per_state_);
+        }
+
+        //批量过滤: 把triggers中在状态s下有效的触发器按原顺序写入out, 返回写入个数
+        //out至少要能容纳count个元素, 可以与triggers相同
+        size_t FilterValid(State s, const Trigger* triggers, size_t count, Trigger* out) const
+        {
+            StateIndex idx = indexer_.Find(s);
+            if (idx == kInvalidStateIndex)
+            {
+                return 0;
+            }
+
+            const uint32_t* row = &words_[idx * words_per_state_];
+            size_t valid = 0;
+            size_t i = 0;
+#if defined(__AVX2__)
+            //每次用gather取出8个触发器所在的位集字, 再用可变移位一次测试8位
+            const __m256i one = _mm256_set1_epi32(1);
+            const __m256i low5 = _mm256_set1_epi32(31);
+            alignas(32) uint32_t ordinals[8];
+            for (; i + 8 <= count; i += 8)
+            {
+                for (size_t k = 0; k < 8; ++k)
+                {
+                    ordinals[k] = ClampOrdinal(triggers[i + k]);
+                }
+
+                __m256i ordinal = _mm256_load_si256(reinterpret_cast<const __m256i*>(ordinals));
+                __m256i word = _mm256_i32gather_epi32(reinterpret_cast<const int*>(row),
+                    _mm256_srli_epi32(ordinal, 5), 4);
+                __m256i bit = _mm256_and_si256(_mm256_srlv_epi32(word, _mm256_and_si256(ordinal, low5)), one);
+                uint32_t mask = static_cast<uint32_t>(
+                    _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(bit, one))));
+
+                //无分支压缩: 总是写入, 只有有效时才前移写指针
+                for (size_t k = 0; k < 8; ++k)
+                {
+                    out[valid] = triggers[i + k];
+                    valid += (mask >> k) & 1;
+                }
+            }
+#endif
+            for (; i < count; ++i)
+            {
+                uint32_t ordinal = ClampOrdinal(triggers[i]);
+                out[valid] = triggers[i];
+                valid += (row[ordinal >> 5] >> (ordinal & 31)) & 1;
+            }
+            return valid;
+        }
+
+        std::vector<Trigger> FilterValid(State s, const std::vector<Trigger>& triggers) const
+        {
+            std::vector<Trigger> valid(triggers.size());
+            valid.resize(FilterValid(s, triggers.data(), triggers.size(), valid.data()));
+            return valid;
+        }
+
+        //按组件估算的内存占用
+        MemoryReport MemoryUsage() const
+        {
+            MemoryReport report;
+            report.Add("object", sizeof(*this));
+            report.Add("state_index", indexer_.MemoryBytes());
+            report.Add("bitsets", detail::VectorBytes(words_));
+            return report;
+        }
+
+    private:
+        //越界的序号映射到哨兵位
+        uint32_t ClampOrdinal(Trigger trigger) const
+        {
+            uint64_t ordinal = TriggerOrdinal(trigger);
+            return ordinal < sentinel_ ? static_cast<uint32_t>(ordinal) : sentinel_;
+        }
+
+        StateIndexer<State> indexer_;
+        std::vector<uint32_t> words_;//状态数 x words_per_state_
+        size_t words_per_state_;
+        uint32_t sentinel_;//始终为0的哨兵位序号
+    };
+
+    template <typename State, State Initial, typename Trigger>
+    const uint64_t TriggerBitsets<State, Initial, Trigger>::kMaxOrdinal;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <type_traits>
+
+//用户态静态跟踪点(USDT)
+//Fsm::Execute 中的跟踪点可以在不重新编译的情况下用 perf 或 bpftrace 挂接, 例如
+//  bpftrace -e 'usdt:./server:fsm:transition { @[arg0, arg1] = count(); }'
+//没有挂接时每个跟踪点只是一条nop指令, 参数已经在寄存器中, 不需要判断分支
+//跟踪点以 sys/sdt.h 的格式写入ELF的 .note.stapsdt 段, 有 sys/sdt.h 时直接使用它, 否则使用这里的等价实现
+//provider为fsm, 跟踪点和参数(均为64位整数, 整数和枚举按值传递, 其他类型传递对象地址):
+//- execute(state, trigger)           进入Execute
+//- guard_reject(state, trigger)      触发器匹配但位掩码guard或guard函数不通过
+//- transition(from, to, trigger)     转换提交, 状态已经修改
+//- no_match(state, trigger)          当前状态下没有匹配的触发器
+//定义 FSM_DISABLE_USDT 可以去掉所有跟踪点; 不支持的平台上跟踪点为空
+
+namespace fsm
+{
+    namespace detail
+    {
+        template <typename T>
+        inline typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, int64_t>::type
+            ProbeArg(const T& value)
+        {
+            return static_cast<int64_t>(value);
+        }
+
+        template <typename T>
+        inline typename std::enable_if<!(std::is_integral<T>::value || std::is_enum<T>::value), int64_t>::type
+            ProbeArg(const T& value)
+        {
+            return static_cast<int64_t>(reinterpret_cast<intptr_t>(&value));
+        }
+    }
+}
+
+#if !defined(FSM_DISABLE_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define FSM_USDT_SYS_SDT 1
+#endif
+#endif
+
+#if defined(FSM_DISABLE_USDT)
+
+#define FSM_USDT_PROBE2(name, a1, a2) ((void)0)
+#define FSM_USDT_PROBE3(name, a1, a2, a3) ((void)0)
+
+#elif defined(FSM_USDT_SYS_SDT)
+
+#define FSM_USDT_PROBE2(name, a1, a2) \
+    DTRACE_PROBE2(fsm, name, ::fsm::detail::ProbeArg(a1), ::fsm::detail::ProbeArg(a2))
+#define FSM_USDT_PROBE3(name, a1, a2, a3) \
+    DTRACE_PROBE3(fsm, name, ::fsm::detail::ProbeArg(a1), ::fsm::detail::ProbeArg(a2), ::fsm::detail::ProbeArg(a3))
+
+#elif defined(__linux__) && defined(__GNUC__) && (defined(__x86_64__) || defined(__aarch64__))
+
+//与 sys/sdt.h 相同的布局: nop的地址、.stapsdt.base的地址、信号量(不使用, 为0)、provider、名字、参数格式
+//.note.stapsdt 段使用"?"标志与所在函数的段同组, 内联函数的副本被链接器丢弃时注释一起丢弃
+#define FSM_USDT_NOTE(name, args) \
+    "990: nop\n" \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n" \
+    ".balign 4\n" \
+    ".4byte 992f-991f, 994f-993f, 3\n" \
+    "991: .asciz \"stapsdt\"\n" \
+    "992: .balign 4\n" \
+    "993: .8byte 990b\n" \
+    ".8byte _.stapsdt.base\n" \
+    ".8byte 0\n" \
+    ".asciz \"fsm\"\n" \
+    ".asciz \"" #name "\"\n" \
+    ".asciz \"" args "\"\n" \
+    "994: .balign 4\n" \
+    ".popsection\n" \
+    ".ifndef _.stapsdt.base\n" \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+    ".weak _.stapsdt.base\n" \
+    ".hidden _.stapsdt.base\n" \
+    "_.stapsdt.base: .space 1\n" \
+    ".size _.stapsdt.base, 1\n" \
+    ".popsection\n" \
+    ".endif\n"
+
+#define FSM_USDT_PROBE2(name, a1, a2) \
+    __asm__ __volatile__(FSM_USDT_NOTE(name, "-8@%0 -8@%1") \
+        :: "nor"(::fsm::detail::ProbeArg(a1)), "nor"(::fsm::detail::ProbeArg(a2)))
+#define FSM_USDT_PROBE3(name, a1, a2, a3) \
+    __asm__ __volatile__(FSM_USDT_NOTE(name, "-8@%0 -8@%1 -8@%2") \
+        :: "nor"(::fsm::detail::ProbeArg(a1)), "nor"(::fsm::detail::ProbeArg(a2)), "nor"(::fsm::detail::ProbeArg(a3)))
+
+#else
+
+#define FSM_USDT_PROBE2(name, a1, a2) ((void)0)
+#define FSM_USDT_PROBE3(name, a1, a2, a3) ((void)0)
+
+#endif
@@ -1,6 +1,14 @@
+#pragma once
 
+#include "fsm_memory.hpp"
+#include "fsm_usdt.hpp"
 
+#include <stdint.h>
+
+#include <algorithm>
+#include <cassert>
 #include <functional>
+#include <iterator>
 #include <limits>
 #include <unordered_map>
 #include <vector>
@@ -10,7 +18,11 @@
 //可以通过触发器发起一次转换，将机器由一种状态转为另外一种状态
 //在转换过程中，有一个guard函数和转换动作相关联的action函数
 //guard函数是检查是否应该执行转换的函数, action函数是在执行有效转换时调用的函数
-//如果一个触发器发送到状态机后, 被关联到多个转换过程中，并且多个guard函数返回值为true, 则随机选取一个执行
+//常见的"某标志置位且另一标志清零"的检查可以声明为位掩码guard(MaskGuard), 对BindFlags绑定的标志字求值, 不需要函数调用
+//如果一个触发器发送到状态机后, 被关联到多个转换过程中，并且多个guard函数返回值为true,
+//则按转换的优先级(priority)从高到低选取, 优先级相同时选取最先添加的一个
+//fsm_analysis.hpp 中的 AnalyzeDeterminism 可以检查每个(状态, 触发器)组合是否需要依赖这一规则
+//Execute 总是按这一顺序逐个比较当前状态的转换; 按状态自动选择的直接分派只在冻结后的 FrozenFsm 中提供(见 fsm_frozen.hpp)
 //一个状态至少有一个传入和传出转换与之关联, 但有两种情况除外:
 //(1)伪初始化状态(没有传入状态, 有一个或多个传出状态)
 //(2)伪最终状态(一个或多个传入状态, 没有传出状态)
@@ -30,6 +42,7 @@
 //状态机和转换可以通过一个FSM::Trans结构体数组方便地定义。这使得FSM的结构非常清晰。
 //可以添加调试函数来跟踪状态的变化. 调试函数可以是' nullptr ', 也可以是'DebugFn'类型.
 //当定义了函数后, 当状态发生变化时, 就会使用 from_state, to_state和trigger 参数调用它
+//Execute中还有USDT跟踪点, 可以用perf或bpftrace在运行中挂接, 见 fsm_usdt.hpp
 
 //The following example implements this simple state machine.
 //
@@ -45,7 +58,35 @@ namespace fsm
     enum FsmErrors
     {
         FSM_SUCCESS = 0,
-        FSM_NO_MATCHING_TRIGGER
+        FSM_NO_MATCHING_TRIGGER,
+        FSM_GUARDED_TRANSITION,//定义中含有guard函数, 无法冻结为转换表
+        FSM_TRIGGER_OUT_OF_RANGE,//触发器序号超出冻结表支持的范围
+        FSM_STATE_LIMIT_EXCEEDED,//构建出的状态数超过给定的上限
+        FSM_INVALID_PATTERN,//正则表达式语法错误
+        FSM_INVALID_PROBABILITY,//转换的概率权重为负数, 或者同一组合的权重之和为0
+        FSM_IO_ERROR,//读写临时文件或日志文件失败
+        FSM_TRIGGER_QUEUED//状态机在等待异步action完成, 触发器已排队(见 fsm_coro.hpp)
+    };
+
+    //guard标志字类型, 由用户提供, 见 Fsm::BindFlags
+    using GuardFlags = uint64_t;
+
+    //声明式的位掩码guard, 对用户提供的标志字求值, 不需要函数调用
+    //标志字中required的位全部置位且forbidden的位全部清零时通过; 两者都为0时总是通过
+    struct MaskGuard
+    {
+        GuardFlags required;//必须置位的标志
+        GuardFlags forbidden;//必须清零的标志
+
+        bool Pass(GuardFlags flags) const
+        {
+            return (((flags & required) ^ required) | (flags & forbidden)) == 0;
+        }
+
+        bool Empty() const
+        {
+            return (required | forbidden) == 0;
+        }
     };
 
     //一个通用的有限状态机(FSM)实现。
@@ -67,13 +108,19 @@ namespace fsm
             Trigger trigger;//触发器
             GuardFn guardfn;//保护函数
             ActionFn actionfn;//操作函数
+            MaskGuard maskguard = MaskGuard{ 0, 0 };//位掩码保护, 与guardfn同时存在时两者都要通过
+            int32_t priority = 0;//优先级, 多个转换同时满足时优先级高的先执行
         };
 
+        using TransitionElemVec = std::vector<Trans>;
+        using TransitionsMap = std::unordered_map<State, TransitionElemVec>;
+
     public:
         Fsm()
             : transitions_()
             , current_states_(Initial)
             , debug_fn_(nullptr)
+            , flags_(nullptr)
         {
         }
 
@@ -90,8 +137,36 @@ namespace fsm
             InputIt it = start;
             for (; it != end; ++it)
             {
-                transitions_[(*it).from_state].push_back(*it);
+                TransitionElemVec& state_transitions = transitions_[(*it).from_state];
+                //保持转换列表按优先级从高到低排列, 同优先级按添加顺序
+                auto pos = std::upper_bound(state_transitions.begin(), state_transitions.end(), *it, HigherPriority);
+                state_transitions.insert(pos, *it);
+            }
+        }
+
+        //向状态机添加一组传入状态均为from的转换, 每个元素的from_state必须等于from(调试构建中断言)
+        //只查找一次转换列表, 前向迭代器时一次性预留空间; 传入move_iterator时转换会被移动而不是复制
+        template <typename InputIt>
+        void AddTransitions(State from, InputIt start, InputIt end)
+        {
+            TransitionElemVec& state_transitions = transitions_[from];
+            ReserveFor(state_transitions, start, end, typename std::iterator_traits<InputIt>::iterator_category());
+            size_t first = state_transitions.size();
+            state_transitions.insert(state_transitions.end(), start, end);
+            for (size_t i = first; i < state_transitions.size(); ++i)
+            {
+                assert(state_transitions[i].from_state == from);
             }
+            if (!std::is_sorted(state_transitions.begin(), state_transitions.end(), HigherPriority))
+            {
+                std::stable_sort(state_transitions.begin(), state_transitions.end(), HigherPriority);
+            }
+        }
+
+        //预留可容纳count个传入状态的空间
+        void ReserveStates(size_t count)
+        {
+            transitions_.reserve(count);
         }
 
         //将转换添加到状态机的重载方法
@@ -126,14 +201,35 @@ namespace fsm
             debug_fn_ = fn;
         }
 
+        //绑定位掩码guard使用的标志字, 执行时读取*flags的当前值; 传入nullptr时标志字视为0
+        void BindFlags(const GuardFlags* flags)
+        {
+            flags_ = flags;
+        }
+
         //根据该状态机定义的语义执行给定的触发器, 返回执行操作的状态
         FsmErrors Execute(Trigger trigger)
         {
+            return Execute(current_states_, trigger, CurrentFlags());
+        }
+
+        //以外部保存的状态执行触发器, 转换成功时修改state
+        //多个实例可以共享同一份状态机定义, 每个实例只需保存自己的状态
+        FsmErrors Execute(State& state, Trigger trigger) const
+        {
+            return Execute(state, trigger, CurrentFlags());
+        }
+
+        //以外部保存的状态和标志字执行触发器
+        FsmErrors Execute(State& state, Trigger trigger, GuardFlags flags) const
+        {
+            FSM_USDT_PROBE2(execute, state, trigger);
             FsmErrors err_code = FSM_NO_MATCHING_TRIGGER;
 
-            const auto& state_transitions = transitions_.find(current_states_);
+            const auto& state_transitions = transitions_.find(state);
             if (state_transitions == transitions_.end())
             {
+                FSM_USDT_PROBE2(no_match, state, trigger);
                 return err_code;//没有从当前状态找到合适的转换
             }
 
@@ -147,9 +243,16 @@ namespace fsm
                 }
                 err_code = FSM_SUCCESS;
 
-                //检查是否执行保护函数, 若执行且执行成功
+                //先检查位掩码保护, 再检查是否执行保护函数, 若执行且执行成功
+                if (!transition.maskguard.Pass(flags))
+                {
+                    FSM_USDT_PROBE2(guard_reject, state, trigger);
+                    continue;
+                }
+
                 if (transition.guardfn && !transition.guardfn())
                 {
+                    FSM_USDT_PROBE2(guard_reject, state, trigger);
                     continue;
                 }
 
@@ -158,7 +261,8 @@ namespace fsm
                 {
                     transition.actionfn();
                 }
-                current_states_ = transition.to_state;//修改状态
+                state = transition.to_state;//修改状态
+                FSM_USDT_PROBE3(transition, transition.from_state, transition.to_state, trigger);
 
                 if (debug_fn_)
                 {
@@ -168,6 +272,10 @@ namespace fsm
                 break;
             }
 
+            if (err_code == FSM_NO_MATCHING_TRIGGER)
+            {
+                FSM_USDT_PROBE2(no_match, state, trigger);
+            }
             return err_code;
         }
 
@@ -183,12 +291,57 @@ namespace fsm
             return current_states_ == Initial;
         }
 
+        //转换的排列顺序: 优先级高的在前
+        static bool HigherPriority(const Trans& a, const Trans& b)
+        {
+            return a.priority > b.priority;
+        }
+
+        //返回按传入状态分组的转换定义, 供冻结、分析等工具读取
+        //同一传入状态的转换按执行时的尝试顺序排列
+        const TransitionsMap& GetTransitions() const
+        {
+            return transitions_;
+        }
+
+        //按组件估算的内存占用, 不含std::function捕获的对象(见 fsm_memory.hpp);
+        //instance_bytes 为通过 Execute(State&, ...) 共享本定义时每个实例的字节数
+        MemoryReport MemoryUsage() const
+        {
+            MemoryReport report;
+            report.Add("object", sizeof(*this));
+            report.Add("state_map", detail::HashBytes(transitions_));
+            size_t transitions = 0;
+            for (const auto& state_transitions : transitions_)
+            {
+                transitions += detail::VectorBytes(state_transitions.second);
+            }
+            report.Add("transitions", transitions);
+            report.instance_bytes = sizeof(State);
+            return report;
+        }
+
     private:
-        using TransitionElemVec = std::vector<Trans>;
-        using TransitionsMap = std::unordered_map<State, TransitionElemVec>;
+        //单遍的输入迭代器不能先求距离, 只在前向迭代器时预留
+        template <typename InputIt>
+        static void ReserveFor(TransitionElemVec& v, InputIt start, InputIt end, std::forward_iterator_tag)
+        {
+            v.reserve(v.size() + static_cast<size_t>(std::distance(start, end)));
+        }
+
+        template <typename InputIt>
+        static void ReserveFor(TransitionElemVec&, InputIt, InputIt, std::input_iterator_tag)
+        {
+        }
+
+        GuardFlags CurrentFlags() const
+        {
+            return flags_ ? *flags_ : 0;
+        }
 
         TransitionsMap transitions_;//存储转换结构体
         State current_states_;//当前状态
         DebugFn debug_fn_;
+        const GuardFlags* flags_;//位掩码guard的标志字
     };
 }
\ No newline at end of file
@@ -0,0 +1,115 @@
+
+#include <googletest-1.10.0/include/gtest/gtest.h>
+#include <fsm_analysis.hpp>
+#include <fsm_builder.hpp>
+
+namespace
+{
+    class FsmAnalysisTest : public testing::Test
+    {
+    protected:
+
+        enum Flags : fsm::GuardFlags
+        {
+            READY = 1 << 0,
+            BUSY = 1 << 1
+        };
+
+        void SetUp() override
+        {
+            test_fsm_.AddTransitions({
+                { 0, 1, 'a', nullptr, nullptr },
+                { 0, 2, 'a', [] { return true; }, nullptr },
+                { 0, 1, 'b', nullptr, nullptr, { READY, 0 } },
+                { 0, 2, 'b', nullptr, nullptr, { 0, READY } },
+                { 0, 1, 'c', nullptr, nullptr, { READY, 0 } },
+                { 0, 2, 'c', nullptr, nullptr, { BUSY, 0 } },
+                { 0, 1, 'd', [] { return true; }, nullptr, { 0, 0 }, 1 },
+                { 0, 2, 'd', [] { return true; }, nullptr, { 0, 0 }, 2 },
+                { 0, 1, 'e', [] { return true; }, nullptr },
+            });
+        }
+
+        fsm::TriggerGroupKind KindOf(char trigger) const
+        {
+            for (const auto& report : fsm::AnalyzeDeterminism(test_fsm_))
+            {
+                if (report.state == 0 && report.trigger == trigger)
+                {
+                    return report.kind;
+                }
+            }
+            ADD_FAILURE() << "trigger not found: " << trigger;
+            return fsm::FSM_GROUP_AMBIGUOUS;
+        }
+
+        using F = fsm::Fsm<int32_t, 0, char>;
+        F test_fsm_;
+    };
+
+    TEST_F(FsmAnalysisTest, Classify)
+    {
+        EXPECT_EQ(fsm::AnalyzeDeterminism(test_fsm_).size(), 5u);
+        EXPECT_EQ(KindOf('a'), fsm::FSM_GROUP_UNCONDITIONAL);
+        EXPECT_EQ(KindOf('b'), fsm::FSM_GROUP_GUARDED_EXCLUSIVE);
+        //READY与BUSY可能同时置位, 优先级相同
+        EXPECT_EQ(KindOf('c'), fsm::FSM_GROUP_AMBIGUOUS);
+        EXPECT_EQ(KindOf('d'), fsm::FSM_GROUP_PRIORITIZED);
+        EXPECT_EQ(KindOf('e'), fsm::FSM_GROUP_GUARDED_EXCLUSIVE);
+        EXPECT_FALSE(fsm::IsDeterministic(KindOf('c')));
+        EXPECT_TRUE(fsm::IsDeterministic(KindOf('d')));
+    }
+
+    TEST(FsmAnalysisBuilderTest, AnalyzeBuilder)
+    {
+        fsm::FsmBuilder<int32_t, 0, char> builder;
+        builder.Add({ 0, 1, 'a', [] { return true; }, nullptr });
+        builder.Add({ 1, 0, 'a', nullptr, nullptr });
+        builder.Add({ 0, 2, 'a', [] { return true; }, nullptr });
+        builder.Group();
+
+        auto reports = fsm::AnalyzeDeterminism(builder);
+        ASSERT_EQ(reports.size(), 2u);
+        for (const auto& report : reports)
+        {
+            if (report.state == 0)
+            {
+                EXPECT_EQ(report.kind, fsm::FSM_GROUP_AMBIGUOUS);
+                EXPECT_EQ(report.candidates, 2u);
+            }
+            else
+            {
+                EXPECT_EQ(report.kind, fsm::FSM_GROUP_UNCONDITIONAL);
+            }
+        }
+    }
+
+    //一个状态有大量触发器时按首次出现的顺序逐个给出, 每个触发器的候选都被收集到
+    TEST(FsmAnalysisBuilderTest, ManyTriggersInOneState)
+    {
+        fsm::Fsm<int32_t, 0, int32_t> wide;
+        const int32_t kTriggers = 20000;
+        for (int32_t t = 0; t < kTriggers; ++t)
+        {
+            wide.AddTransitions({ { 0, 1, t, nullptr, nullptr } });
+        }
+        wide.AddTransitions({ { 0, 2, 7, nullptr, nullptr, { 1, 0 } } });
+
+        auto reports = fsm::AnalyzeDeterminism(wide);
+        ASSERT_EQ(reports.size(), static_cast<size_t>(kTriggers));
+        for (int32_t t = 0; t < kTriggers; ++t)
+        {
+            ASSERT_EQ(reports[t].trigger, t);
+            ASSERT_EQ(reports[t].candidates, t == 7 ? 2u : 1u);
+            ASSERT_EQ(reports[t].kind, fsm::FSM_GROUP_UNCONDITIONAL);
+        }
+    }
+
+    TEST(FsmAnalysisMaskTest, MaskGuardsExclusive)
+    {
+        EXPECT_TRUE(fsm::MaskGuardsExclusive({ 1, 0 }, { 0, 1 }));
+        EXPECT_FALSE(fsm::MaskGuardsExclusive({ 1, 0 }, { 2, 0 }));
+        //自身矛盾的掩码永远不会通过
+        EXPECT_TRUE(fsm::MaskGuardsExclusive({ 1, 1 }, { 0, 0 }));
+    }
+}
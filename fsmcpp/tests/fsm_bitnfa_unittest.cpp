@@ -0,0 +1,134 @@
+
+#include <googletest-1.10.0/include/gtest/gtest.h>
+#include <fsm_bitnfa.hpp>
+
+#include <random>
+#include <set>
+#include <string>
+
+namespace
+{
+    class FsmBitNfaTest : public testing::Test
+    {
+    protected:
+
+        using F = fsm::Fsm<int32_t, 0, char>;
+
+        //用std::set逐个状态模拟NFA, 与位并行结果比较
+        template <size_t Words>
+        void CompareWithSetSimulation(int32_t state_count, size_t transition_count, uint32_t seed)
+        {
+            std::mt19937 rng(seed);
+            F machine;
+            for (size_t i = 0; i < transition_count; ++i)
+            {
+                int32_t from = static_cast<int32_t>(rng() % static_cast<uint32_t>(state_count));
+                int32_t to = static_cast<int32_t>(rng() % static_cast<uint32_t>(state_count));
+                char trigger = static_cast<char>('a' + rng() % 4);
+                machine.AddTransitions({ { from, to, trigger, nullptr, nullptr } });
+            }
+
+            fsm::BitNfa<int32_t, 0, char, Words> nfa;
+            ASSERT_EQ(nfa.Build(machine), fsm::FSM_SUCCESS);
+
+            std::set<int32_t> expected = { 0 };
+            for (int i = 0; i < 300 && !expected.empty(); ++i)
+            {
+                char trigger = static_cast<char>('a' + rng() % 4);
+                std::set<int32_t> next;
+                for (const auto& state_transitions : machine.GetTransitions())
+                {
+                    if (expected.count(state_transitions.first) == 0)
+                    {
+                        continue;
+                    }
+                    for (const auto& transition : state_transitions.second)
+                    {
+                        if (transition.trigger == trigger)
+                        {
+                            next.insert(transition.to_state);
+                        }
+                    }
+                }
+                expected.swap(next);
+
+                EXPECT_EQ(nfa.Execute(trigger), expected.empty() ? fsm::FSM_NO_MATCHING_TRIGGER : fsm::FSM_SUCCESS);
+                ASSERT_EQ(nfa.Active().Count(), expected.size());
+                for (int32_t s : expected)
+                {
+                    ASSERT_TRUE(nfa.IsActive(s));
+                }
+            }
+
+            //没有任何转换的触发器使活动集合变为空
+            EXPECT_EQ(nfa.Execute('z'), fsm::FSM_NO_MATCHING_TRIGGER);
+            EXPECT_TRUE(nfa.Empty());
+        }
+    };
+
+    TEST_F(FsmBitNfaTest, RandomDefinitions)
+    {
+        for (uint32_t seed = 1; seed <= 20; ++seed)
+        {
+            CompareWithSetSimulation<1>(64, 300, seed);
+            CompareWithSetSimulation<2>(128, 600, seed);
+        }
+    }
+
+    TEST_F(FsmBitNfaTest, MultiPattern)
+    {
+        //初始状态对所有字节自环, 每个模式是一条链
+        F machine;
+        for (int c = 0; c < 256; ++c)
+        {
+            machine.AddTransitions({ { 0, 0, static_cast<char>(c), nullptr, nullptr } });
+        }
+        const char* patterns[] = { "he", "she", "his", "hers" };
+        int32_t next = 1;
+        std::vector<int32_t> finals;
+        for (const char* pattern : patterns)
+        {
+            int32_t from = 0;
+            for (const char* p = pattern; *p != 0; ++p, ++next)
+            {
+                machine.AddTransitions({ { from, next, *p, nullptr, nullptr } });
+                from = next;
+            }
+            finals.push_back(from);
+        }
+
+        fsm::BitNfa<int32_t, 0, char> nfa;
+        ASSERT_EQ(nfa.Build(machine), fsm::FSM_SUCCESS);
+        auto accept = nfa.MaskOf({ finals[0], finals[1], finals[2], finals[3] });
+
+        std::string text = "ushers his";
+        std::vector<size_t> positions;
+        size_t hits = nfa.Scan(text.data(), text.size(), accept,
+            [&positions](size_t pos, const fsm::BitNfa<int32_t, 0, char>::Mask&) { positions.push_back(pos); });
+        EXPECT_EQ(hits, 3u);
+        //she与he同时在3处结束, hers在5处, his在9处
+        EXPECT_EQ(positions, (std::vector<size_t>{ 3, 5, 9 }));
+        EXPECT_TRUE(nfa.IsActive(0));
+    }
+
+    TEST_F(FsmBitNfaTest, Limits)
+    {
+        F machine;
+        for (int32_t s = 0; s < 64; ++s)
+        {
+            machine.AddTransitions({ { s, s + 1, 'a', nullptr, nullptr } });
+        }
+        fsm::BitNfa<int32_t, 0, char> narrow;
+        EXPECT_EQ(narrow.Execute('a'), fsm::FSM_NO_MATCHING_TRIGGER);//没有构建时没有任何转换
+        narrow.Reset();
+        EXPECT_EQ(narrow.Build(machine), fsm::FSM_STATE_LIMIT_EXCEEDED);
+        EXPECT_EQ(narrow.Execute('a'), fsm::FSM_NO_MATCHING_TRIGGER);
+        fsm::BitNfa<int32_t, 0, char, 2> wide;
+        ASSERT_EQ(wide.Build(machine), fsm::FSM_SUCCESS);
+        std::string input(64, 'a');
+        EXPECT_TRUE(wide.Run(input.data(), input.size()).Test(wide.FindState(64)));
+
+        machine.AddTransitions({ { 0, 1, 'b', [] { return true; }, nullptr } });
+        EXPECT_EQ(wide.Build(machine), fsm::FSM_GUARDED_TRANSITION);
+    }
+}
@@ -0,0 +1,119 @@
+
+#include <googletest-1.10.0/include/gtest/gtest.h>
+#include <fsm_builder.hpp>
+#include <fsm_bytedfa.hpp>
+#include <fsm_trigger_set.hpp>
+#include <memory>
+
+namespace
+{
+    class FsmBuilderTest : public testing::Test
+    {
+    protected:
+
+        using F = fsm::Fsm<int32_t, 0, char>;
+        using Builder = fsm::FsmBuilder<int32_t, 0, char>;
+
+        //生成一个环形的大规模状态机: 状态i遇到'a'到达i+1, 遇到'b'回到0
+        static void Generate(Builder& builder, int32_t state_count)
+        {
+            builder.Reserve(static_cast<size_t>(state_count) * 2);
+            //交错添加不同状态的转换, 验证分组
+            for (int32_t i = 0; i < state_count; ++i)
+            {
+                builder.Add({ i, (i + 1) % state_count, 'a', nullptr, nullptr });
+            }
+            for (int32_t i = 0; i < state_count; ++i)
+            {
+                builder.Add({ i, 0, 'b', nullptr, nullptr });
+            }
+        }
+    };
+
+    TEST_F(FsmBuilderTest, Group)
+    {
+        Builder builder;
+        builder.Add({ 1, 2, 'x', nullptr, nullptr });
+        builder.Add({ 0, 1, 'a', nullptr, nullptr });
+        builder.Add({ 1, 0, 'y', nullptr, nullptr });
+        builder.Add({ 0, 2, 'b', nullptr, nullptr });
+        builder.Group();
+
+        const auto& groups = builder.GetTransitions();
+        ASSERT_EQ(groups.size(), 2u);
+        EXPECT_EQ(groups[0].first, 1);
+        ASSERT_EQ(groups[0].second.size(), 2u);
+        //同一状态内保持添加顺序
+        EXPECT_EQ(groups[0].second.begin()[0].trigger, 'x');
+        EXPECT_EQ(groups[0].second.begin()[1].trigger, 'y');
+        EXPECT_EQ(groups[1].first, 0);
+        EXPECT_EQ(groups[1].second.begin()[1].trigger, 'b');
+
+        //分组后继续添加, 重新分组之前不能读取区间
+        builder.Add({ 0, 0, 'c', nullptr, nullptr });
+        EXPECT_DEBUG_DEATH(builder.GetTransitions(), "GetTransitions before Group");
+        builder.Group();
+        ASSERT_EQ(builder.GetTransitions().size(), 2u);
+        EXPECT_EQ(builder.Size(), 5u);
+    }
+
+    TEST_F(FsmBuilderTest, BuildLarge)
+    {
+        const int32_t state_count = 100000;
+        Builder builder;
+        Generate(builder, state_count);
+
+        F test_fsm;
+        builder.Build(test_fsm);
+        EXPECT_EQ(builder.Size(), 0u);
+        EXPECT_EQ(test_fsm.GetTransitions().size(), static_cast<size_t>(state_count));
+
+        for (int32_t i = 0; i < 10; ++i)
+        {
+            EXPECT_EQ(test_fsm.Execute('a'), fsm::FSM_SUCCESS);
+        }
+        EXPECT_EQ(test_fsm.GetState(), 10);
+        EXPECT_EQ(test_fsm.Execute('b'), fsm::FSM_SUCCESS);
+        EXPECT_TRUE(test_fsm.IsInitial());
+    }
+
+    //转换被移动而不是复制
+    TEST_F(FsmBuilderTest, MoveFunctions)
+    {
+        auto counter = std::make_shared<int32_t>(0);
+        Builder builder;
+        std::vector<F::Trans> trans_vec;
+        trans_vec.push_back({ 0, 1, 'a', nullptr, [counter] { ++*counter; } });
+        builder.AddTransitions(std::move(trans_vec));
+        EXPECT_EQ(counter.use_count(), 2);
+
+        F test_fsm;
+        builder.Build(test_fsm);
+        EXPECT_EQ(counter.use_count(), 2);
+        test_fsm.Execute('a');
+        EXPECT_EQ(*counter, 1);
+    }
+
+    //直接从构建器生成冻结表示
+    TEST_F(FsmBuilderTest, Emit)
+    {
+        Builder builder;
+        Generate(builder, 1000);
+
+        fsm::ByteDfa<int32_t, 0> dfa;
+        ASSERT_EQ(builder.Emit(dfa), fsm::FSM_SUCCESS);
+        EXPECT_EQ(dfa.StateCount(), 1000u);
+        std::string input(1500, 'a');
+        EXPECT_EQ(dfa.StateAt(dfa.Run(input.data(), input.size())), 500);
+
+        fsm::TriggerBitsets<int32_t, 0, char> bitsets;
+        ASSERT_EQ(builder.Emit(bitsets), fsm::FSM_SUCCESS);
+        EXPECT_TRUE(bitsets.CanFire(999, 'b'));
+        EXPECT_FALSE(bitsets.CanFire(999, 'c'));
+
+        //生成冻结表示不会消耗构建器中的转换
+        F test_fsm;
+        builder.Build(test_fsm);
+        EXPECT_EQ(test_fsm.GetTransitions().size(), 1000u);
+    }
+}
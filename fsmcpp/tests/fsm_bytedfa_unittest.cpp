@@ -0,0 +1,159 @@
+
+#include <googletest-1.10.0/include/gtest/gtest.h>
+#include <fsm_bytedfa.hpp>
+#include "fsm_thread_limit.hpp"
+#include <random>
+#include <string>
+
+namespace
+{
+    class ByteDfaTest : public testing::Test
+    {
+    protected:
+
+        //识别日志中的"ERR"关键字, 识别后停留在FOUND状态
+        enum class States
+        {
+            INITIAL,
+            E,
+            ER,
+            FOUND
+        };
+
+        void SetUp() override
+        {
+            std::vector<F::Trans> trans_vec;
+            for (int32_t c = 0; c < 256; ++c)
+            {
+                char ch = static_cast<char>(c);
+                States after_other = (ch == 'E') ? States::E : States::INITIAL;
+                trans_vec.push_back({ States::INITIAL, after_other, ch, nullptr, nullptr });
+                trans_vec.push_back({ States::E, (ch == 'R') ? States::ER : after_other, ch, nullptr, nullptr });
+                trans_vec.push_back({ States::ER, (ch == 'R') ? States::FOUND : after_other, ch, nullptr, nullptr });
+            }
+            test_fsm_.AddTransitions(trans_vec);
+            ASSERT_EQ(dfa_.Build(test_fsm_), fsm::FSM_SUCCESS);
+        }
+
+        static std::string RandomLog(size_t len, uint32_t seed)
+        {
+            std::mt19937 gen(seed);
+            std::uniform_int_distribution<int32_t> dist(0, 3);
+            const char alphabet[] = { 'E', 'R', 'x', '\n' };
+            std::string log(len, ' ');
+            for (auto& ch : log)
+            {
+                ch = alphabet[dist(gen)];
+            }
+            return log;
+        }
+
+        using F = fsm::Fsm<States, States::INITIAL, char>;
+        F test_fsm_;
+        fsm::ByteDfa<States, States::INITIAL> dfa_;
+    };
+
+    //冻结表与逐字节执行Fsm的结果一致
+    TEST_F(ByteDfaTest, MatchesFsmExecute)
+    {
+        std::string log = RandomLog(4096, 1);
+        for (char ch : log)
+        {
+            test_fsm_.Execute(ch);
+        }
+
+        fsm::StateIndex end = dfa_.Run(log.data(), log.size());
+        EXPECT_EQ(dfa_.StateAt(end), test_fsm_.GetState());
+        EXPECT_EQ(dfa_.FindState(States::INITIAL), 0u);
+        EXPECT_EQ(dfa_.StateCount(), 4u);
+    }
+
+    //没有匹配的转换时保持原状态
+    TEST(ByteDfaMissTest, MissKeepsState)
+    {
+        enum class States
+        {
+            INITIAL,
+            A
+        };
+        fsm::Fsm<States, States::INITIAL, char> test_fsm;
+        test_fsm.AddTransitions({
+            { States::INITIAL, States::A, 'a', nullptr, nullptr },
+            { States::INITIAL, States::INITIAL, 'a', nullptr, nullptr },
+        });
+        fsm::ByteDfa<States, States::INITIAL> dfa;
+        ASSERT_EQ(dfa.Build(test_fsm), fsm::FSM_SUCCESS);
+
+        fsm::StateIndex a = dfa.FindState(States::A);
+        EXPECT_EQ(dfa.Step(0, 'b'), 0u);
+        //先添加的转换优先
+        EXPECT_EQ(dfa.Step(0, 'a'), a);
+        EXPECT_EQ(dfa.Step(a, 'a'), a);
+    }
+
+    TEST(ByteDfaGuardTest, RejectGuard)
+    {
+        enum class States
+        {
+            INITIAL,
+            A
+        };
+        fsm::Fsm<States, States::INITIAL, char> test_fsm;
+        test_fsm.AddTransitions({
+            { States::INITIAL, States::A, 'a', [] { return true; }, nullptr },
+        });
+        fsm::ByteDfa<States, States::INITIAL> dfa;
+        EXPECT_EQ(dfa.Build(test_fsm), fsm::FSM_GUARDED_TRANSITION);
+    }
+
+    //推测执行的状态映射与逐个状态顺序执行一致
+    TEST_F(ByteDfaTest, RunFromAllStates)
+    {
+        std::string log = RandomLog(3000, 2);
+        std::vector<fsm::StateIndex> mapping = dfa_.RunFromAllStates(log.data(), log.size());
+        ASSERT_EQ(mapping.size(), dfa_.StateCount());
+        for (fsm::StateIndex s = 0; s < mapping.size(); ++s)
+        {
+            EXPECT_EQ(mapping[s], dfa_.Run(log.data(), log.size(), s));
+        }
+    }
+
+    //并行执行结果与顺序执行一致
+    TEST_F(ByteDfaTest, RunParallel)
+    {
+        //不含"ERR"的长日志, 保证结束状态不总是FOUND
+        std::string log = RandomLog(1 << 20, 3);
+        for (size_t i = 2; i < log.size(); ++i)
+        {
+            if (log[i] == 'R' && log[i - 1] == 'R' && log[i - 2] == 'E')
+            {
+                log[i] = 'x';
+            }
+        }
+
+        for (fsm::StateIndex start = 0; start < dfa_.StateCount(); ++start)
+        {
+            fsm::StateIndex expected = dfa_.Run(log.data(), log.size(), start);
+            for (size_t threads = 1; threads <= 8; ++threads)
+            {
+                EXPECT_EQ(dfa_.RunParallel(log.data(), log.size(), start, threads), expected);
+            }
+            EXPECT_EQ(dfa_.RunParallel(log.data(), log.size(), start), expected);
+        }
+
+        std::string found = log + "ERR" + RandomLog(100000, 4);
+        EXPECT_EQ(dfa_.StateAt(dfa_.RunParallel(found.data(), found.size(), 0, 4)), States::FOUND);
+    }
+
+    //线程创建失败时剩余的块在当前线程上执行, 结果不变
+    TEST_F(ByteDfaTest, ThreadCreationFailure)
+    {
+        std::string log = RandomLog(1 << 20, 5) + "ERR" + RandomLog(1 << 20, 6);
+        fsm::StateIndex expected = dfa_.Run(log.data(), log.size(), 0);
+        for (int32_t started = 0; started < 3; ++started)
+        {
+            fsm_test::ThreadLimit limit(started);
+            EXPECT_EQ(dfa_.RunParallel(log.data(), log.size(), 0, 4), expected);
+        }
+    }
+}
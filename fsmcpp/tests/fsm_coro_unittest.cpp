@@ -0,0 +1,342 @@
+
+#include <googletest-1.10.0/include/gtest/gtest.h>
+#include <fsm_coro.hpp>
+
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace
+{
+    enum class States
+    {
+        IDLE,
+        CONNECTED,
+        CLOSED
+    };
+
+    enum class Triggers
+    {
+        CONNECT,
+        SEND,
+        CLOSE
+    };
+
+    using F = fsm::AsyncFsm<States, States::IDLE, Triggers>;
+
+    //模拟的事件循环: co_await Wait() 挂起协程, RunOne() 在本线程上恢复最早挂起的一个
+    class Loop
+    {
+    public:
+        struct Awaiter
+        {
+            Loop& loop;
+            int32_t value;
+
+            bool await_ready() noexcept
+            {
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<> h)
+            {
+                loop.waiting_.push_back(h);
+            }
+
+            int32_t await_resume() noexcept
+            {
+                return value;
+            }
+        };
+
+        Awaiter Wait(int32_t value = 0)
+        {
+            return Awaiter{ *this, value };
+        }
+
+        bool RunOne()
+        {
+            if (waiting_.empty())
+            {
+                return false;
+            }
+            std::coroutine_handle<> h = waiting_.front();
+            waiting_.pop_front();
+            h.resume();
+            return true;
+        }
+
+        size_t Waiting() const
+        {
+            return waiting_.size();
+        }
+
+    private:
+        std::deque<std::coroutine_handle<>> waiting_;
+    };
+
+    class AsyncFsmTest : public testing::Test
+    {
+    protected:
+        void SetUp() override
+        {
+            machine_.AddTransitions({
+                { States::IDLE, States::CONNECTED, Triggers::CONNECT, nullptr, [this]() -> fsm::FsmTask
+                {
+                    log_.push_back("connect begin");
+                    int32_t fd = co_await loop_.Wait(3);
+                    log_.push_back("connect done " + std::to_string(fd));
+                } },
+                { States::CONNECTED, States::CONNECTED, Triggers::SEND, nullptr, [this]() -> fsm::FsmTask
+                {
+                    log_.push_back("send");
+                    co_return;
+                } },
+                { States::CONNECTED, States::CLOSED, Triggers::CLOSE, nullptr, [this]() -> fsm::FsmTask
+                {
+                    co_await loop_.Wait();
+                    co_await loop_.Wait();
+                    log_.push_back("closed");
+                } },
+            });
+            machine_.AddDebugFn([this](States from, States to, Triggers trigger)
+            {
+                commits_.emplace_back(from, to, trigger);
+            });
+        }
+
+        Loop loop_;
+        F machine_;
+        std::vector<std::string> log_;
+        std::vector<std::tuple<States, States, Triggers>> commits_;
+    };
+
+    //action挂起时状态机处于传入状态, 恢复完成后才提交转换
+    TEST_F(AsyncFsmTest, SuspendsUntilCompletion)
+    {
+        EXPECT_EQ(machine_.Execute(Triggers::CONNECT), fsm::FSM_SUCCESS);
+        EXPECT_TRUE(machine_.IsSuspended());
+        EXPECT_EQ(machine_.GetState(), States::IDLE);
+        EXPECT_EQ(machine_.GetTarget(), States::CONNECTED);
+        EXPECT_TRUE(commits_.empty());
+        EXPECT_EQ(log_, (std::vector<std::string>{ "connect begin" }));
+
+        EXPECT_TRUE(loop_.RunOne());
+        EXPECT_FALSE(machine_.IsSuspended());
+        EXPECT_EQ(machine_.GetState(), States::CONNECTED);
+        EXPECT_EQ(machine_.GetTarget(), States::CONNECTED);
+        EXPECT_EQ(log_.back(), "connect done 3");
+        ASSERT_EQ(commits_.size(), 1u);
+        EXPECT_EQ(commits_[0], std::make_tuple(States::IDLE, States::CONNECTED, Triggers::CONNECT));
+    }
+
+    //没有挂起的action与同步action相同
+    TEST_F(AsyncFsmTest, SynchronousCompletion)
+    {
+        machine_.Reset(States::CONNECTED);
+        EXPECT_EQ(machine_.Execute(Triggers::SEND), fsm::FSM_SUCCESS);
+        EXPECT_FALSE(machine_.IsSuspended());
+        EXPECT_EQ(commits_.size(), 1u);
+        EXPECT_EQ(loop_.Waiting(), 0u);
+    }
+
+    //挂起期间的触发器排队, 完成后按顺序执行, 可以再次挂起
+    TEST_F(AsyncFsmTest, QueuesTriggersWhileSuspended)
+    {
+        std::vector<std::pair<Triggers, fsm::FsmErrors>> rejected;
+        machine_.SetRejectFn([&](Triggers trigger, fsm::FsmErrors err_code) { rejected.emplace_back(trigger, err_code); });
+
+        EXPECT_EQ(machine_.Execute(Triggers::CONNECT), fsm::FSM_SUCCESS);
+        EXPECT_EQ(machine_.Execute(Triggers::SEND), fsm::FSM_TRIGGER_QUEUED);
+        EXPECT_EQ(machine_.Execute(Triggers::CONNECT), fsm::FSM_TRIGGER_QUEUED);
+        EXPECT_EQ(machine_.Execute(Triggers::CLOSE), fsm::FSM_TRIGGER_QUEUED);
+        EXPECT_EQ(machine_.Execute(Triggers::SEND), fsm::FSM_TRIGGER_QUEUED);
+        EXPECT_EQ(machine_.Pending(), 4u);
+
+        //CONNECT完成: SEND执行, CONNECT被拒绝, CLOSE挂起, 最后的SEND继续排队
+        EXPECT_TRUE(loop_.RunOne());
+        EXPECT_EQ(log_, (std::vector<std::string>{ "connect begin", "connect done 3", "send" }));
+        EXPECT_TRUE(machine_.IsSuspended());
+        EXPECT_EQ(machine_.GetState(), States::CONNECTED);
+        EXPECT_EQ(machine_.GetTarget(), States::CLOSED);
+        EXPECT_EQ(machine_.Pending(), 1u);
+        ASSERT_EQ(rejected.size(), 1u);
+        EXPECT_EQ(rejected[0].first, Triggers::CONNECT);
+        EXPECT_EQ(rejected[0].second, fsm::FSM_NO_MATCHING_TRIGGER);
+
+        //CLOSE有两次等待
+        EXPECT_TRUE(loop_.RunOne());
+        EXPECT_TRUE(machine_.IsSuspended());
+        EXPECT_TRUE(loop_.RunOne());
+        EXPECT_FALSE(machine_.IsSuspended());
+        EXPECT_EQ(machine_.GetState(), States::CLOSED);
+        EXPECT_EQ(machine_.Pending(), 0u);
+        ASSERT_EQ(rejected.size(), 2u);
+        EXPECT_EQ(rejected[1].first, Triggers::SEND);
+        EXPECT_EQ(commits_.size(), 3u);
+        EXPECT_FALSE(loop_.RunOne());
+    }
+
+    //guard和位掩码guard与Fsm相同, 拒绝时不启动action
+    TEST(AsyncFsmGuardTest, GuardsBeforeAction)
+    {
+        bool allow = false;
+        int32_t started = 0;
+        fsm::GuardFlags flags = 0;
+        F machine;
+        machine.BindFlags(&flags);
+        machine.AddTransitions({
+            { States::IDLE, States::CONNECTED, Triggers::CONNECT, [&] { return allow; }, [&]() -> fsm::FsmTask
+            {
+                ++started;
+                co_return;
+            } },
+            { States::CONNECTED, States::CLOSED, Triggers::CLOSE, nullptr, nullptr, fsm::MaskGuard{ 1, 0 } },
+        });
+        EXPECT_EQ(machine.Execute(Triggers::SEND), fsm::FSM_NO_MATCHING_TRIGGER);
+        EXPECT_EQ(machine.Execute(Triggers::CONNECT), fsm::FSM_SUCCESS);
+        EXPECT_EQ(started, 0);
+        EXPECT_EQ(machine.GetState(), States::IDLE);
+        allow = true;
+        EXPECT_EQ(machine.Execute(Triggers::CONNECT), fsm::FSM_SUCCESS);
+        EXPECT_EQ(started, 1);
+        EXPECT_EQ(machine.GetState(), States::CONNECTED);
+
+        //没有action的转换立即提交
+        machine.Execute(Triggers::CLOSE);
+        EXPECT_EQ(machine.GetState(), States::CONNECTED);
+        flags = 1;
+        machine.Execute(Triggers::CLOSE);
+        EXPECT_EQ(machine.GetState(), States::CLOSED);
+    }
+
+    //action内部发送的触发器在提交之后执行
+    TEST(AsyncFsmReentryTest, ExecuteFromAction)
+    {
+        Loop loop;
+        F machine;
+        machine.AddTransitions({
+            { States::IDLE, States::CONNECTED, Triggers::CONNECT, nullptr, [&]() -> fsm::FsmTask
+            {
+                EXPECT_EQ(machine.Execute(Triggers::SEND), fsm::FSM_TRIGGER_QUEUED);
+                co_await loop.Wait();
+                EXPECT_EQ(machine.Execute(Triggers::CLOSE), fsm::FSM_TRIGGER_QUEUED);
+            } },
+            { States::CONNECTED, States::CONNECTED, Triggers::SEND, nullptr, nullptr },
+            { States::CONNECTED, States::CLOSED, Triggers::CLOSE, nullptr, nullptr },
+        });
+        std::vector<Triggers> order;
+        machine.AddDebugFn([&](States, States, Triggers trigger) { order.push_back(trigger); });
+
+        machine.Execute(Triggers::CONNECT);
+        EXPECT_EQ(machine.Pending(), 1u);
+        loop.RunOne();
+        EXPECT_EQ(order, (std::vector<Triggers>{ Triggers::CONNECT, Triggers::SEND, Triggers::CLOSE }));
+        EXPECT_EQ(machine.GetState(), States::CLOSED);
+    }
+
+    //guard或action工厂抛出异常后状态机仍然可用, 不会把之后的触发器都排队
+    TEST(AsyncFsmExceptionTest, RecoversAfterThrow)
+    {
+        bool throw_guard = true;
+        bool throw_factory = true;
+        F machine;
+        machine.AddTransitions({
+            { States::IDLE, States::CONNECTED, Triggers::CONNECT, [&] {
+                if (throw_guard)
+                {
+                    throw std::runtime_error("guard");
+                }
+                return true;
+            }, nullptr },
+            { States::CONNECTED, States::CLOSED, Triggers::CLOSE, nullptr, [&]() -> fsm::FsmTask {
+                if (throw_factory)
+                {
+                    throw std::runtime_error("factory");
+                }
+                return fsm::FsmTask();
+            } },
+        });
+
+        EXPECT_THROW(machine.Execute(Triggers::CONNECT), std::runtime_error);
+        EXPECT_EQ(machine.GetState(), States::IDLE);
+        throw_guard = false;
+        EXPECT_EQ(machine.Execute(Triggers::CONNECT), fsm::FSM_SUCCESS);
+        EXPECT_EQ(machine.GetState(), States::CONNECTED);
+
+        EXPECT_THROW(machine.Execute(Triggers::CLOSE), std::runtime_error);
+        EXPECT_EQ(machine.GetState(), States::CONNECTED);
+        EXPECT_FALSE(machine.IsSuspended());
+        throw_factory = false;
+        EXPECT_EQ(machine.Execute(Triggers::CLOSE), fsm::FSM_SUCCESS);
+        EXPECT_EQ(machine.GetState(), States::CLOSED);
+        EXPECT_EQ(machine.Pending(), 0u);
+    }
+
+    //挂起时不能重置状态
+    TEST_F(AsyncFsmTest, ResetWhileSuspended)
+    {
+        machine_.Execute(Triggers::CONNECT);
+        ASSERT_TRUE(machine_.IsSuspended());
+        EXPECT_DEBUG_DEATH(machine_.Reset(States::CLOSED), "Reset while suspended");
+        EXPECT_EQ(machine_.GetState(), States::IDLE);
+        loop_.RunOne();
+        EXPECT_EQ(machine_.GetState(), States::CONNECTED);
+    }
+
+    //挂起时可以添加转换, 挂起的协程恢复后仍能访问自己的捕获
+    TEST_F(AsyncFsmTest, AddTransitionsWhileSuspended)
+    {
+        int32_t tag = 7;
+        machine_.AddTransitions({
+            { States::CLOSED, States::IDLE, Triggers::CONNECT, nullptr, [this, tag]() -> fsm::FsmTask
+            {
+                co_await loop_.Wait();
+                log_.push_back("reopen " + std::to_string(tag));
+            } },
+        });
+        machine_.Reset(States::CLOSED);
+        machine_.Execute(Triggers::CONNECT);
+        ASSERT_TRUE(machine_.IsSuspended());
+
+        for (int32_t i = 0; i < 100; ++i)
+        {
+            machine_.AddTransitions({ { States::CLOSED, States::CLOSED, Triggers::SEND, nullptr, nullptr } });
+        }
+        EXPECT_TRUE(loop_.RunOne());
+        EXPECT_EQ(machine_.GetState(), States::IDLE);
+        EXPECT_EQ(log_.back(), "reopen 7");
+    }
+
+    //析构时销毁挂起的action协程, 协程中的局部对象被析构
+    TEST(AsyncFsmLifetimeTest, DestroysSuspendedAction)
+    {
+        struct Probe
+        {
+            int32_t& destroyed;
+            ~Probe()
+            {
+                ++destroyed;
+            }
+        };
+
+        Loop loop;
+        int32_t destroyed = 0;
+        {
+            F machine;
+            machine.AddTransitions({
+                { States::IDLE, States::CONNECTED, Triggers::CONNECT, nullptr, [&]() -> fsm::FsmTask
+                {
+                    Probe probe{ destroyed };
+                    co_await loop.Wait();
+                } },
+            });
+            machine.Execute(Triggers::CONNECT);
+            EXPECT_TRUE(machine.IsSuspended());
+            EXPECT_EQ(destroyed, 0);
+        }
+        EXPECT_EQ(destroyed, 1);
+    }
+}
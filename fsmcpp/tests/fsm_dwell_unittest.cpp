@@ -0,0 +1,174 @@
+
+#include <googletest-1.10.0/include/gtest/gtest.h>
+#include <fsm_dwell.hpp>
+
+#include <chrono>
+#include <random>
+#include <thread>
+
+namespace
+{
+    enum class States
+    {
+        IDLE,
+        HANDSHAKE,
+        OPEN,
+        CLOSED
+    };
+
+    enum class Triggers
+    {
+        CONNECT,
+        ACCEPT,
+        PING,
+        CLOSE
+    };
+
+    using F = fsm::Fsm<States, States::IDLE, Triggers>;
+    using Tracker = fsm::DwellTracker<States, States::IDLE, Triggers>;
+
+    F MakeDefinition()
+    {
+        F definition;
+        definition.AddTransitions({
+            { States::IDLE, States::HANDSHAKE, Triggers::CONNECT, nullptr, nullptr },
+            { States::HANDSHAKE, States::OPEN, Triggers::ACCEPT, nullptr, nullptr },
+            { States::OPEN, States::OPEN, Triggers::PING, nullptr, nullptr },
+            { States::OPEN, States::CLOSED, Triggers::CLOSE, nullptr, nullptr },
+        });
+        return definition;
+    }
+
+    //每个值都落在所在格的上下界之间, 格宽不超过下界的1/32
+    TEST(DwellHistogramTest, BucketBounds)
+    {
+        std::mt19937_64 rng(3);
+        for (int32_t i = 0; i < 100000; ++i)
+        {
+            uint64_t value = rng() >> (rng() % 64);
+            uint32_t bucket = fsm::DwellHistogram::BucketOf(value);
+            ASSERT_LT(bucket, fsm::DwellHistogram::BucketCount());
+            ASSERT_LE(fsm::DwellHistogram::LowerBound(bucket), value);
+            ASSERT_GE(fsm::DwellHistogram::UpperBound(bucket), value);
+            uint64_t width = fsm::DwellHistogram::UpperBound(bucket) - fsm::DwellHistogram::LowerBound(bucket);
+            ASSERT_LE(width, fsm::DwellHistogram::LowerBound(bucket) / 32);
+        }
+        EXPECT_EQ(fsm::DwellHistogram::BucketOf(UINT64_MAX), fsm::DwellHistogram::BucketCount() - 1);
+        EXPECT_EQ(fsm::DwellHistogram::UpperBound(fsm::DwellHistogram::BucketCount() - 1), UINT64_MAX);
+    }
+
+    TEST(DwellHistogramTest, QuantilesAndMerge)
+    {
+        fsm::DwellHistogram a;
+        fsm::DwellHistogram b;
+        EXPECT_EQ(a.ValueAtQuantile(0.5), 0u);
+        for (uint64_t v = 1; v <= 1000; ++v)
+        {
+            (v % 2 == 0 ? a : b).Record(v * 1000);
+        }
+        a.Merge(b);
+        EXPECT_EQ(a.Count(), 1000u);
+        EXPECT_EQ(a.Min(), 1000u);
+        EXPECT_EQ(a.Max(), 1000000u);
+        EXPECT_DOUBLE_EQ(a.Mean(), 500500.0);
+        EXPECT_NEAR(static_cast<double>(a.ValueAtQuantile(0.5)), 500000.0, 500000.0 / 32);
+        EXPECT_NEAR(static_cast<double>(a.ValueAtQuantile(0.99)), 990000.0, 990000.0 / 32);
+        EXPECT_EQ(a.ValueAtQuantile(1.0), 1000000u);
+
+        uint64_t total = 0;
+        uint64_t last = 0;
+        a.ForEach([&](uint64_t lower, uint64_t upper, uint64_t count)
+        {
+            EXPECT_GE(lower, last);
+            EXPECT_LE(lower, upper);
+            last = upper;
+            total += count;
+        });
+        EXPECT_EQ(total, 1000u);
+    }
+
+    //只在状态变化时记录离开的状态, 自转换和没有匹配的触发器不算离开
+    TEST(DwellTrackerTest, RecordsOnStateChange)
+    {
+        Tracker tracker(MakeDefinition());
+        Tracker::Recorder recorder(tracker);
+
+        States state = States::IDLE;
+        Tracker::Stamp stamp = recorder.Enter();
+        EXPECT_EQ(recorder.Execute(state, stamp, Triggers::CONNECT), fsm::FSM_SUCCESS);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        EXPECT_EQ(recorder.Execute(state, stamp, Triggers::PING), fsm::FSM_NO_MATCHING_TRIGGER);
+        EXPECT_EQ(recorder.Execute(state, stamp, Triggers::ACCEPT), fsm::FSM_SUCCESS);
+        EXPECT_EQ(recorder.Execute(state, stamp, Triggers::PING), fsm::FSM_SUCCESS);
+        EXPECT_EQ(recorder.Execute(state, stamp, Triggers::PING), fsm::FSM_SUCCESS);
+        EXPECT_EQ(recorder.Execute(state, stamp, Triggers::CLOSE), fsm::FSM_SUCCESS);
+        EXPECT_EQ(state, States::CLOSED);
+
+        EXPECT_EQ(tracker.Snapshot(States::IDLE).Count(), 1u);
+        EXPECT_EQ(tracker.Snapshot(States::OPEN).Count(), 1u);
+        EXPECT_EQ(tracker.Snapshot(States::CLOSED).Count(), 0u);
+        fsm::DwellHistogram handshake = tracker.Snapshot(States::HANDSHAKE);
+        ASSERT_EQ(handshake.Count(), 1u);
+        double ms = fsm::TscClock::ToNanoseconds(handshake.Max()) / 1e6;
+        EXPECT_GE(ms, 15.0);
+        EXPECT_LT(ms, 2000.0);
+
+        std::vector<std::pair<States, fsm::DwellHistogram>> all = tracker.SnapshotAll();
+        EXPECT_EQ(all.size(), 4u);
+    }
+
+    //多个线程各自记录, 记录过程中可以合并; 句柄析构后计数保留
+    TEST(DwellTrackerTest, MergesAcrossThreads)
+    {
+        const int32_t kThreads = 4;
+        const int32_t kInstances = 64;
+        const int32_t kRounds = 2000;
+        Tracker tracker(MakeDefinition());
+        std::atomic<bool> done(false);
+
+        std::thread reader([&]
+        {
+            uint64_t last = 0;
+            while (!done.load())
+            {
+                uint64_t count = tracker.Snapshot(States::HANDSHAKE).Count();
+                EXPECT_GE(count, last);
+                last = count;
+                std::this_thread::yield();
+            }
+        });
+
+        std::vector<std::thread> workers;
+        for (int32_t t = 0; t < kThreads; ++t)
+        {
+            workers.emplace_back([&]
+            {
+                Tracker::Recorder recorder(tracker);
+                std::vector<States> states(kInstances, States::IDLE);
+                std::vector<Tracker::Stamp> stamps(kInstances, recorder.Enter());
+                for (int32_t round = 0; round < kRounds; ++round)
+                {
+                    for (int32_t i = 0; i < kInstances; ++i)
+                    {
+                        recorder.Execute(states[i], stamps[i], Triggers::CONNECT);
+                        recorder.Execute(states[i], stamps[i], Triggers::ACCEPT);
+                        recorder.Execute(states[i], stamps[i], Triggers::CLOSE);
+                        states[i] = States::IDLE;
+                        stamps[i] = recorder.Enter();
+                    }
+                }
+            });
+        }
+        for (std::thread& worker : workers)
+        {
+            worker.join();
+        }
+        done = true;
+        reader.join();
+
+        const uint64_t expected = static_cast<uint64_t>(kThreads) * kInstances * kRounds;
+        EXPECT_EQ(tracker.Snapshot(States::IDLE).Count(), expected);
+        EXPECT_EQ(tracker.Snapshot(States::HANDSHAKE).Count(), expected);
+        EXPECT_EQ(tracker.Snapshot(States::OPEN).Count(), expected);
+    }
+}
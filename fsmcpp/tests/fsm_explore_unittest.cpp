@@ -0,0 +1,241 @@
+
+#include <googletest-1.10.0/include/gtest/gtest.h>
+#include <fsm_explore.hpp>
+#include <fsm_bytedfa.hpp>
+#include "fsm_thread_limit.hpp"
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <queue>
+
+namespace
+{
+    class FsmExploreTest : public testing::Test
+    {
+    protected:
+
+        using F = fsm::Fsm<int32_t, 0, char>;
+
+        //0 -> 1 -> 2 -> 1, 1 -> 3(陷阱), 4 -> 5 与 4 -> 0 不可达
+        void SetUp() override
+        {
+            test_fsm_.AddTransitions({
+                { 0, 1, 'a', nullptr, nullptr },
+                { 1, 2, 'b', [] { return false; }, nullptr },
+                { 2, 1, 'c', nullptr, nullptr },
+                { 1, 3, 'd', nullptr, nullptr },
+                { 3, 3, 'e', nullptr, nullptr },
+                { 4, 5, 'f', nullptr, nullptr },
+                { 4, 0, 'g', nullptr, nullptr },
+            });
+        }
+
+        F test_fsm_;
+    };
+
+    //s -> (s * 5 + 1) % n, s -> (s + 7) % n, 以及只在s为3的倍数时才有的 s -> s / 3
+    struct Successors
+    {
+        template <typename Emit>
+        void operator()(uint64_t s, Emit&& emit) const
+        {
+            emit((s * 5 + 1) % n);
+            emit((s + 7) % n);
+            if (s % 3 == 0)
+            {
+                emit(s / 3);
+            }
+        }
+
+        uint64_t n;
+    };
+
+    //单线程的参考实现
+    std::vector<bool> ReferenceBfs(uint64_t n, uint64_t root)
+    {
+        std::vector<bool> seen(n, false);
+        std::queue<uint64_t> queue;
+        seen[root] = true;
+        queue.push(root);
+        Successors successors{ n };
+        while (!queue.empty())
+        {
+            uint64_t s = queue.front();
+            queue.pop();
+            successors(s, [&](uint64_t next) {
+                if (!seen[next])
+                {
+                    seen[next] = true;
+                    queue.push(next);
+                }
+            });
+        }
+        return seen;
+    }
+
+    TEST_F(FsmExploreTest, Report)
+    {
+        auto report = fsm::AnalyzeReachability(test_fsm_);
+        EXPECT_EQ(report.reachable.front(), 0);
+        std::sort(report.reachable.begin(), report.reachable.end());
+        std::sort(report.unreachable.begin(), report.unreachable.end());
+        EXPECT_EQ(report.reachable, (std::vector<int32_t>{ 0, 1, 2, 3 }));
+        EXPECT_EQ(report.unreachable, (std::vector<int32_t>{ 4, 5 }));
+        //guard被视为可能通过, 2可达; 5虽然没有传出转换但不可达
+        EXPECT_EQ(report.traps, (std::vector<int32_t>{ 3 }));
+        EXPECT_EQ(report.unreachable_transitions, 2u);
+        EXPECT_EQ(report.error, fsm::FSM_SUCCESS);
+    }
+
+    TEST_F(FsmExploreTest, PruneBeforeFreezing)
+    {
+        fsm::FsmBuilder<int32_t, 0, char> builder;
+        size_t count = 0;
+        EXPECT_EQ(fsm::PruneUnreachable(test_fsm_, builder, count), fsm::FSM_SUCCESS);
+        EXPECT_EQ(count, 2u);
+        EXPECT_EQ(builder.Size(), 5u);
+
+        //剔除不可达转换后冻结表变小; 含guard的转换需要先去掉才能冻结为ByteDfa
+        F unguarded;
+        unguarded.AddTransitions({
+            { 0, 1, 'a', nullptr, nullptr },
+            { 1, 0, 'b', nullptr, nullptr },
+            { 5, 6, 'c', nullptr, nullptr },
+            { 6, 7, 'c', nullptr, nullptr },
+        });
+        fsm::FsmBuilder<int32_t, 0, char> pruned;
+        EXPECT_EQ(fsm::PruneUnreachable(unguarded, pruned, count), fsm::FSM_SUCCESS);
+        EXPECT_EQ(count, 2u);
+        fsm::ByteDfa<int32_t, 0> dfa;
+        ASSERT_EQ(pruned.Emit(dfa), fsm::FSM_SUCCESS);
+        EXPECT_EQ(dfa.StateCount(), 2u);
+    }
+
+    //临时文件无法创建时报告错误, 不把未探索到的状态当作不可达
+    TEST(FsmExploreErrorTest, SpillFailure)
+    {
+        fsm::Fsm<int32_t, 0, char> star;
+        for (int32_t s = 1; s <= 16; ++s)
+        {
+            star.AddTransitions({ { 0, s, static_cast<char>('a' + s), nullptr, nullptr } });
+        }
+        fsm::ExploreOptions options;
+        options.spill_threshold = 1;
+
+        //把文件描述符上限降到下一个可用的描述符, 使tmpfile失败
+        int next = open("/dev/null", O_RDONLY);
+        ASSERT_GE(next, 0);
+        close(next);
+        rlimit saved;
+        ASSERT_EQ(getrlimit(RLIMIT_NOFILE, &saved), 0);
+        rlimit limited = saved;
+        limited.rlim_cur = static_cast<rlim_t>(next);
+        ASSERT_EQ(setrlimit(RLIMIT_NOFILE, &limited), 0);
+
+        auto report = fsm::AnalyzeReachability(star, options);
+        fsm::FsmBuilder<int32_t, 0, char> builder;
+        size_t count = 99;
+        fsm::FsmErrors err_code = fsm::PruneUnreachable(star, builder, count, options);
+        ASSERT_EQ(setrlimit(RLIMIT_NOFILE, &saved), 0);
+
+        EXPECT_EQ(report.error, fsm::FSM_IO_ERROR);
+        EXPECT_TRUE(report.unreachable.empty());
+        EXPECT_EQ(err_code, fsm::FSM_IO_ERROR);
+        EXPECT_EQ(count, 99u);
+        EXPECT_EQ(builder.Size(), 0u);
+
+        //恢复后探索成功, 所有状态可达
+        report = fsm::AnalyzeReachability(star, options);
+        EXPECT_EQ(report.error, fsm::FSM_SUCCESS);
+        EXPECT_EQ(report.reachable.size(), 17u);
+        EXPECT_TRUE(report.unreachable.empty());
+    }
+
+    //每个线程每层只有一个临时文件, 阈值再小也不会耗尽文件描述符
+    TEST(FsmExploreErrorTest, SpillFilesPerThread)
+    {
+        fsm::Fsm<int32_t, 0, char> star;
+        for (int32_t s = 1; s <= 64; ++s)
+        {
+            star.AddTransitions({ { 0, s, static_cast<char>(s), nullptr, nullptr } });
+        }
+        fsm::ExploreOptions options;
+        options.spill_threshold = 1;
+
+        //只留出两层各一个临时文件的余量
+        int next = open("/dev/null", O_RDONLY);
+        ASSERT_GE(next, 0);
+        close(next);
+        rlimit saved;
+        ASSERT_EQ(getrlimit(RLIMIT_NOFILE, &saved), 0);
+        rlimit limited = saved;
+        limited.rlim_cur = static_cast<rlim_t>(next + 2);
+        ASSERT_EQ(setrlimit(RLIMIT_NOFILE, &limited), 0);
+
+        auto report = fsm::AnalyzeReachability(star, options);
+        ASSERT_EQ(setrlimit(RLIMIT_NOFILE, &saved), 0);
+
+        EXPECT_EQ(report.error, fsm::FSM_SUCCESS);
+        EXPECT_EQ(report.reachable.size(), 65u);
+    }
+
+    TEST_F(FsmExploreTest, ImplicitStateSpace)
+    {
+        const uint64_t n = 1 << 20;
+        std::vector<bool> expected = ReferenceBfs(n, 2);
+        uint64_t expected_count = static_cast<uint64_t>(std::count(expected.begin(), expected.end(), true));
+
+        fsm::ExploreOptions options;
+        for (size_t threads : { 1, 4 })
+        {
+            options.threads = threads;
+            for (size_t spill : { 0, 1000 })
+            {
+                options.spill_threshold = spill;
+                fsm::ReachabilityExplorer explorer(options);
+                ASSERT_EQ(explorer.Explore(n, { 2 }, Successors{ n }), fsm::FSM_SUCCESS);
+                EXPECT_EQ(explorer.ReachableCount(), expected_count);
+                for (uint64_t s = 0; s < n; s += 101)
+                {
+                    ASSERT_EQ(explorer.IsReachable(s), expected[s]);
+                }
+
+                uint64_t total = 0;
+                for (uint64_t level : explorer.LevelSizes())
+                {
+                    total += level;
+                }
+                EXPECT_EQ(total, expected_count);
+                EXPECT_EQ(explorer.SpilledStates() > 0, spill != 0);
+            }
+        }
+    }
+
+    //线程创建失败时没有启动的工作在当前线程上执行, 结果不变
+    TEST(FsmExploreErrorTest, ThreadCreationFailure)
+    {
+        const uint64_t n = 1 << 16;
+        std::vector<bool> expected = ReferenceBfs(n, 2);
+        uint64_t expected_count = static_cast<uint64_t>(std::count(expected.begin(), expected.end(), true));
+
+        fsm::ExploreOptions options;
+        options.threads = 4;
+        for (int32_t started = 0; started < 3; ++started)
+        {
+            fsm::ReachabilityExplorer explorer(options);
+            fsm_test::ThreadLimit limit(started);
+            ASSERT_EQ(explorer.Explore(n, { 2 }, Successors{ n }), fsm::FSM_SUCCESS);
+            EXPECT_EQ(explorer.ReachableCount(), expected_count);
+        }
+    }
+
+    TEST_F(FsmExploreTest, OutOfRange)
+    {
+        fsm::ReachabilityExplorer explorer;
+        EXPECT_EQ(explorer.Explore(10, { 1 }, [](uint64_t s, auto&& emit) { emit(s + 5); }), fsm::FSM_STATE_LIMIT_EXCEEDED);
+        EXPECT_EQ(explorer.Explore(10, { 10 }, [](uint64_t, auto&&) {}), fsm::FSM_STATE_LIMIT_EXCEEDED);
+    }
+}
@@ -0,0 +1,117 @@
+
+#include <googletest-1.10.0/include/gtest/gtest.h>
+#include <fsm_fleet.hpp>
+
+namespace
+{
+    class FsmFleetTest : public testing::Test
+    {
+    protected:
+
+        enum class States
+        {
+            INITIAL,
+            CONNECTED,
+            CLOSED
+        };
+
+        enum class Triggers
+        {
+            CONNECT,
+            CLOSE,
+            PING
+        };
+
+        void SetUp() override
+        {
+            definition_.AddTransitions({
+                { States::INITIAL, States::CONNECTED, Triggers::CONNECT, nullptr, [this] { connects_++; } },
+                { States::CONNECTED, States::CLOSED, Triggers::CLOSE, nullptr, nullptr },
+                { States::CONNECTED, States::CONNECTED, Triggers::PING, nullptr, nullptr },
+            });
+        }
+
+        using F = fsm::Fsm<States, States::INITIAL, Triggers>;
+        using Fleet = fsm::FsmFleet<States, States::INITIAL, Triggers>;
+        F definition_;
+        int32_t connects_ = 0;
+    };
+
+    //共享定义时以外部状态执行
+    TEST_F(FsmFleetTest, ExecuteExternalState)
+    {
+        States state = States::INITIAL;
+        EXPECT_EQ(definition_.Execute(state, Triggers::CONNECT), fsm::FSM_SUCCESS);
+        EXPECT_EQ(state, States::CONNECTED);
+        EXPECT_EQ(definition_.GetState(), States::INITIAL);
+    }
+
+    TEST_F(FsmFleetTest, Counts)
+    {
+        Fleet fleet(definition_);
+        std::vector<fsm::InstanceId> ids;
+        for (int32_t i = 0; i < 10; ++i)
+        {
+            ids.push_back(fleet.Add());
+        }
+        EXPECT_EQ(fleet.Size(), 10u);
+        EXPECT_EQ(fleet.Count(States::INITIAL), 10u);
+
+        EXPECT_EQ(fleet.Execute(ids[0], Triggers::CONNECT), fsm::FSM_SUCCESS);
+        EXPECT_EQ(fleet.Execute(ids[1], Triggers::CONNECT), fsm::FSM_SUCCESS);
+        EXPECT_EQ(fleet.Execute(ids[1], Triggers::PING), fsm::FSM_SUCCESS);
+        EXPECT_EQ(fleet.Execute(ids[2], Triggers::CLOSE), fsm::FSM_NO_MATCHING_TRIGGER);
+        EXPECT_EQ(fleet.GetState(ids[1]), States::CONNECTED);
+        EXPECT_EQ(fleet.Count(States::INITIAL), 8u);
+        EXPECT_EQ(fleet.Count(States::CONNECTED), 2u);
+        EXPECT_EQ(fleet.Count(States::CLOSED), 0u);
+
+        size_t total = 0;
+        for (const auto& entry : fleet.Histogram())
+        {
+            EXPECT_EQ(entry.second, fleet.Count(entry.first));
+            total += entry.second;
+        }
+        EXPECT_EQ(total, 10u);
+
+        fleet.Remove(ids[0]);
+        EXPECT_EQ(fleet.Count(States::CONNECTED), 1u);
+        EXPECT_EQ(fleet.Size(), 9u);
+        //复用已删除的编号
+        EXPECT_EQ(fleet.Add(States::CLOSED), ids[0]);
+        EXPECT_EQ(fleet.Count(States::CLOSED), 1u);
+
+        fleet.Reset(ids[0]);
+        EXPECT_EQ(fleet.Count(States::CLOSED), 0u);
+        EXPECT_EQ(fleet.Count(States::INITIAL), 9u);
+    }
+
+    TEST_F(FsmFleetTest, Broadcast)
+    {
+        Fleet fleet(definition_);
+        for (int32_t i = 0; i < 100; ++i)
+        {
+            fleet.Add();
+        }
+
+        EXPECT_EQ(fleet.Broadcast(States::INITIAL, Triggers::CONNECT), 100u);
+        EXPECT_EQ(connects_, 100);
+        EXPECT_EQ(fleet.Count(States::INITIAL), 0u);
+        EXPECT_EQ(fleet.Count(States::CONNECTED), 100u);
+
+        //广播只影响目标状态中的实例
+        EXPECT_EQ(fleet.Broadcast(States::INITIAL, Triggers::CONNECT), 0u);
+        EXPECT_EQ(connects_, 100);
+
+        size_t visited = 0;
+        fleet.ForEachIn(States::CONNECTED, [&](fsm::InstanceId id) {
+            EXPECT_EQ(fleet.GetState(id), States::CONNECTED);
+            visited++;
+        });
+        EXPECT_EQ(visited, 100u);
+
+        EXPECT_EQ(fleet.Broadcast(States::CONNECTED, Triggers::CLOSE), 100u);
+        EXPECT_EQ(fleet.Count(States::CLOSED), 100u);
+        EXPECT_EQ(fleet.Count(States::CONNECTED), 0u);
+    }
+}
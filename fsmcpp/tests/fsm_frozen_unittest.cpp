@@ -0,0 +1,206 @@
+
+#include <googletest-1.10.0/include/gtest/gtest.h>
+#include <fsm_builder.hpp>
+#include <fsm_frozen.hpp>
+#include <random>
+
+namespace
+{
+    //随机生成带guard和action的状态机, 比较Fsm与FrozenFsm逐步执行的结果
+    template <typename Trigger>
+    void CompareWithFsm(uint32_t seed, int32_t trigger_range, int32_t transitions_per_state)
+    {
+        const int32_t state_count = 20;
+        std::mt19937 gen(seed);
+        std::uniform_int_distribution<int32_t> state_dist(0, state_count - 1);
+        std::uniform_int_distribution<int32_t> trigger_dist(0, trigger_range - 1);
+        std::bernoulli_distribution guard_dist(0.3);
+        std::uniform_int_distribution<uint64_t> flag_dist(0, 15);
+        std::uniform_int_distribution<int32_t> priority_dist(0, 2);
+
+        int32_t fsm_actions = 0;
+        int32_t frozen_actions = 0;
+        bool guard_value = true;
+        int32_t* action_counter = &fsm_actions;
+
+        using F = fsm::Fsm<int32_t, 0, Trigger>;
+        F test_fsm;
+        std::vector<typename F::Trans> trans_vec;
+        for (int32_t from = 0; from < state_count; ++from)
+        {
+            for (int32_t t = 0; t < transitions_per_state; ++t)
+            {
+                typename F::GuardFn guard = nullptr;
+                if (guard_dist(gen))
+                {
+                    guard = [&guard_value] { return guard_value; };
+                }
+                //部分转换带有位掩码guard, required与forbidden不相交
+                fsm::MaskGuard mask = { 0, 0 };
+                if (guard_dist(gen))
+                {
+                    mask.required = flag_dist(gen);
+                    mask.forbidden = flag_dist(gen) & ~mask.required;
+                }
+                trans_vec.push_back({ from, state_dist(gen), static_cast<Trigger>(trigger_dist(gen)), guard,
+                    [&action_counter] { ++*action_counter; }, mask, priority_dist(gen) });
+            }
+        }
+        test_fsm.AddTransitions(trans_vec);
+
+        fsm::FrozenFsm<int32_t, 0, Trigger> frozen;
+        ASSERT_EQ(frozen.Build(test_fsm), fsm::FSM_SUCCESS);
+
+        fsm::GuardFlags flags = 0;
+        test_fsm.BindFlags(&flags);
+        frozen.BindFlags(&flags);
+
+        for (int32_t step = 0; step < 5000; ++step)
+        {
+            Trigger trigger = static_cast<Trigger>(trigger_dist(gen));
+            guard_value = (step % 3) != 0;
+            flags = flag_dist(gen);
+            action_counter = &fsm_actions;
+            fsm::FsmErrors expected = test_fsm.Execute(trigger);
+            action_counter = &frozen_actions;
+            ASSERT_EQ(frozen.Execute(trigger), expected);
+            ASSERT_EQ(frozen.GetState(), test_fsm.GetState());
+        }
+        EXPECT_EQ(fsm_actions, frozen_actions);
+    }
+
+    TEST(FrozenFsmTest, MatchesFsmChar)
+    {
+        CompareWithFsm<char>(1, 8, 12);
+        //候选数超过一次SIMD比较的宽度
+        CompareWithFsm<char>(2, 4, 40);
+    }
+
+    TEST(FrozenFsmTest, MatchesFsmUint16)
+    {
+        CompareWithFsm<uint16_t>(3, 8, 20);
+    }
+
+    TEST(FrozenFsmTest, MatchesFsmInt32)
+    {
+        CompareWithFsm<int32_t>(4, 6, 9);
+    }
+
+    TEST(FrozenFsmTest, MatchesFsmInt64)
+    {
+        CompareWithFsm<int64_t>(5, 6, 9);
+    }
+
+    class FrozenFsmEnumTest : public testing::Test
+    {
+    protected:
+
+        enum class States
+        {
+            INITIAL,
+            A,
+            FINAL
+        };
+
+        enum class Triggers : uint8_t
+        {
+            A,
+            B
+        };
+
+        using F = fsm::Fsm<States, States::INITIAL, Triggers>;
+        fsm::FrozenFsm<States, States::INITIAL, Triggers> frozen_;
+    };
+
+    TEST_F(FrozenFsmEnumTest, ResetAndDebug)
+    {
+        //未构建时没有任何转换
+        EXPECT_TRUE(frozen_.IsInitial());
+        EXPECT_EQ(frozen_.Execute(Triggers::A), fsm::FSM_NO_MATCHING_TRIGGER);
+
+        fsm::FsmBuilder<States, States::INITIAL, Triggers> builder;
+        builder.Add({ States::INITIAL, States::A, Triggers::A, nullptr, nullptr });
+        builder.Add({ States::A, States::FINAL, Triggers::B, nullptr, nullptr });
+        ASSERT_EQ(builder.Emit(frozen_), fsm::FSM_SUCCESS);
+
+        States dbg_from = States::FINAL;
+        States dbg_to = States::FINAL;
+        frozen_.AddDebugFn([&](States from, States to, Triggers) {
+            dbg_from = from;
+            dbg_to = to;
+        });
+        EXPECT_EQ(frozen_.Execute(Triggers::A), fsm::FSM_SUCCESS);
+        EXPECT_EQ(dbg_from, States::INITIAL);
+        EXPECT_EQ(dbg_to, States::A);
+        EXPECT_EQ(frozen_.Execute(Triggers::B), fsm::FSM_SUCCESS);
+        EXPECT_EQ(frozen_.GetState(), States::FINAL);
+        EXPECT_EQ(frozen_.Execute(Triggers::B), fsm::FSM_NO_MATCHING_TRIGGER);
+
+        frozen_.Reset();
+        EXPECT_TRUE(frozen_.IsInitial());
+        frozen_.Reset(States::A);
+        EXPECT_EQ(frozen_.GetState(), States::A);
+
+        //共享冻结定义, 以外部状态编号执行
+        fsm::StateIndex state = 0;
+        EXPECT_EQ(frozen_.Execute(state, Triggers::A), fsm::FSM_SUCCESS);
+        EXPECT_EQ(frozen_.StateAt(state), States::A);
+        EXPECT_EQ(frozen_.GetState(), States::A);
+    }
+
+    //确定性状态使用直接分派, 其余状态使用扫描
+    TEST(FrozenFsmDispatchTest, DirectDispatch)
+    {
+        enum Flags : fsm::GuardFlags
+        {
+            READY = 1 << 0
+        };
+        using F = fsm::Fsm<int32_t, 0, char>;
+        F test_fsm;
+        bool guard_value = true;
+        test_fsm.AddTransitions({
+            //状态0: 全部无条件
+            { 0, 1, 'a', nullptr, nullptr },
+            { 0, 2, 'b', nullptr, nullptr },
+            { 0, 3, 'a', nullptr, nullptr },
+            //状态1: 位掩码guard互斥
+            { 1, 2, 'a', nullptr, nullptr, { READY, 0 } },
+            { 1, 3, 'a', nullptr, nullptr, { 0, READY } },
+            //状态2: guard函数可能同时通过, 但优先级不同
+            { 2, 0, 'a', [&guard_value] { return guard_value; }, nullptr, { 0, 0 }, 1 },
+            { 2, 1, 'a', [&guard_value] { return !guard_value; }, nullptr, { 0, 0 }, 2 },
+            //状态3: 有歧义
+            { 3, 0, 'a', [&guard_value] { return guard_value; }, nullptr },
+            { 3, 1, 'a', [&guard_value] { return guard_value; }, nullptr },
+            //状态4: 触发器键过于稀疏
+            { 4, 0, 0, nullptr, nullptr },
+            { 4, 0, 127, nullptr, nullptr },
+        });
+
+        fsm::FrozenFsm<int32_t, 0, char> frozen;
+        ASSERT_EQ(frozen.Build(test_fsm), fsm::FSM_SUCCESS);
+        EXPECT_TRUE(frozen.IsDirectDispatch(0));
+        EXPECT_TRUE(frozen.IsDirectDispatch(1));
+        EXPECT_TRUE(frozen.IsDirectDispatch(2));
+        EXPECT_FALSE(frozen.IsDirectDispatch(3));
+        EXPECT_FALSE(frozen.IsDirectDispatch(4));
+
+        fsm::GuardFlags flags = 0;
+        frozen.BindFlags(&flags);
+        EXPECT_EQ(frozen.Execute('c'), fsm::FSM_NO_MATCHING_TRIGGER);
+        EXPECT_EQ(frozen.Execute('a'), fsm::FSM_SUCCESS);
+        EXPECT_EQ(frozen.GetState(), 1);
+        EXPECT_EQ(frozen.Execute('a'), fsm::FSM_SUCCESS);
+        EXPECT_EQ(frozen.GetState(), 3);
+
+        frozen.Reset(1);
+        flags = READY;
+        EXPECT_EQ(frozen.Execute('a'), fsm::FSM_SUCCESS);
+        EXPECT_EQ(frozen.GetState(), 2);
+
+        //优先级高的候选先尝试
+        guard_value = false;
+        EXPECT_EQ(frozen.Execute('a'), fsm::FSM_SUCCESS);
+        EXPECT_EQ(frozen.GetState(), 1);
+    }
+}
@@ -0,0 +1,257 @@
+
+#include <googletest-1.10.0/include/gtest/gtest.h>
+#include <fsmcpp.hpp>
+#include <fsm_dwell.hpp>
+#include <fsm_fleet.hpp>
+#include <fsm_frozen.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+//热路径回归测试: 稳定状态下的Execute不能分配内存, 每次调用的周期数不能超过预算
+//本程序替换全局的operator new/delete为计数版本, 因此单独编译为一个可执行文件
+//周期预算(TscClock的计数)默认为kDefaultCycleBudget, 可以用环境变量 FSM_EXECUTE_CYCLE_BUDGET 修改,
+//例如在sanitizer或-O0构建中放宽; 设为0时只打印测量值不检查
+//测量值总是用RecordProperty记录, 可以从 --gtest_output=xml 的结果中读取
+
+namespace
+{
+    std::atomic<uint64_t> g_allocations(0);
+
+    void* CountedAlloc(size_t size)
+    {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+        void* p = std::malloc(size == 0 ? 1 : size);
+        if (p == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+}
+
+void* operator new(size_t size)
+{
+    return CountedAlloc(size);
+}
+
+void* operator new[](size_t size)
+{
+    return CountedAlloc(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+    const double kDefaultCycleBudget = 1000;
+    const size_t kWarmup = 1 << 12;
+    const size_t kIterations = 1 << 16;
+    const int32_t kRounds = 7;
+
+    double CycleBudget()
+    {
+        const char* value = std::getenv("FSM_EXECUTE_CYCLE_BUDGET");
+        return value != nullptr ? std::atof(value) : kDefaultCycleBudget;
+    }
+
+    //预热后运行kRounds轮, 每轮kIterations次; 返回期间的分配次数, cycles为各轮平均每次周期数的最小值
+    template <typename Fn>
+    uint64_t Measure(const char* name, Fn&& fn, double& cycles)
+    {
+        for (size_t i = 0; i < kWarmup; ++i)
+        {
+            fn(i);
+        }
+
+        uint64_t before = g_allocations.load();
+        cycles = 1e18;
+        for (int32_t round = 0; round < kRounds; ++round)
+        {
+            uint64_t start = fsm::TscClock::Now();
+            for (size_t i = 0; i < kIterations; ++i)
+            {
+                fn(i);
+            }
+            uint64_t ticks = fsm::TscClock::Now() - start;
+            cycles = std::min(cycles, static_cast<double>(ticks) / static_cast<double>(kIterations));
+        }
+        uint64_t allocations = g_allocations.load() - before;
+        testing::Test::RecordProperty(std::string(name) + " cycles", static_cast<int>(cycles + 0.5));
+        if (CycleBudget() == 0)
+        {
+            std::printf("%-24s %8.1f cycles/op, %llu allocations\n", name, cycles,
+                static_cast<unsigned long long>(allocations));
+        }
+        return allocations;
+    }
+
+    void CheckBudget(double cycles)
+    {
+        double budget = CycleBudget();
+        if (budget > 0)
+        {
+            EXPECT_LE(cycles, budget);
+        }
+    }
+
+    enum class States
+    {
+        IDLE,
+        CONNECTING,
+        OPEN,
+        CLOSING
+    };
+
+    enum class Triggers
+    {
+        CONNECT,
+        ACCEPT,
+        DATA,
+        CLOSE,
+        DONE,
+        UNKNOWN
+    };
+
+    using F = fsm::Fsm<States, States::IDLE, Triggers>;
+
+    //带guard、action、位掩码guard和自转换的连接状态机, 触发器序列循环经过所有状态
+    class HotPathTest : public testing::Test
+    {
+    protected:
+        void SetUp() override
+        {
+            definition_.AddTransitions({
+                { States::IDLE, States::CONNECTING, Triggers::CONNECT, [this] { return allow_; }, nullptr },
+                { States::CONNECTING, States::OPEN, Triggers::ACCEPT, nullptr, [this] { ++actions_; } },
+                { States::OPEN, States::OPEN, Triggers::DATA, nullptr, [this] { ++actions_; }, fsm::MaskGuard{ 1, 0 } },
+                { States::OPEN, States::CLOSING, Triggers::CLOSE, nullptr, nullptr },
+                { States::CLOSING, States::IDLE, Triggers::DONE, nullptr, nullptr },
+            });
+            flags_ = 1;
+            definition_.BindFlags(&flags_);
+            //包含一个没有匹配的触发器; Execute(State&)的标志字随序号变化, 其中一半的DATA被位掩码guard拒绝
+            cycle_ = { Triggers::CONNECT, Triggers::ACCEPT, Triggers::DATA, Triggers::UNKNOWN, Triggers::DATA,
+                Triggers::CLOSE, Triggers::DONE };
+        }
+
+        Triggers At(size_t i) const
+        {
+            return cycle_[i % cycle_.size()];
+        }
+
+        F definition_;
+        fsm::GuardFlags flags_ = 0;
+        bool allow_ = true;
+        uint64_t actions_ = 0;
+        std::vector<Triggers> cycle_;
+    };
+
+    TEST_F(HotPathTest, FsmExecute)
+    {
+        double cycles = 0;
+        EXPECT_EQ(Measure("Fsm::Execute", [&](size_t i) { definition_.Execute(At(i)); }, cycles), 0u);
+        CheckBudget(cycles);
+        EXPECT_GT(actions_, 0u);
+    }
+
+    TEST_F(HotPathTest, FsmExecuteExternalState)
+    {
+        std::vector<States> states(64, States::IDLE);
+        double cycles = 0;
+        EXPECT_EQ(Measure("Fsm::Execute(State&)", [&](size_t i)
+        {
+            definition_.Execute(states[i & 63], At(i >> 6), static_cast<fsm::GuardFlags>(i & 1));
+        }, cycles), 0u);
+        CheckBudget(cycles);
+    }
+
+    TEST_F(HotPathTest, FsmExecuteWithDebugFn)
+    {
+        uint64_t traced = 0;
+        definition_.AddDebugFn([&](States, States, Triggers) { ++traced; });
+        double cycles = 0;
+        EXPECT_EQ(Measure("Fsm::Execute+DebugFn", [&](size_t i) { definition_.Execute(At(i)); }, cycles), 0u);
+        CheckBudget(cycles);
+        EXPECT_GT(traced, 0u);
+    }
+
+    TEST_F(HotPathTest, FrozenExecute)
+    {
+        fsm::FrozenFsm<States, States::IDLE, Triggers> frozen;
+        ASSERT_EQ(frozen.Build(definition_), fsm::FSM_SUCCESS);
+        double cycles = 0;
+        EXPECT_EQ(Measure("FrozenFsm::Execute", [&](size_t i) { frozen.Execute(At(i)); }, cycles), 0u);
+        CheckBudget(cycles);
+    }
+
+    TEST_F(HotPathTest, FleetExecute)
+    {
+        fsm::FsmFleet<States, States::IDLE, Triggers> fleet(definition_);
+        for (int32_t i = 0; i < 64; ++i)
+        {
+            fleet.Add();
+        }
+        double cycles = 0;
+        EXPECT_EQ(Measure("FsmFleet::Execute", [&](size_t i)
+        {
+            fleet.Execute(static_cast<fsm::InstanceId>(i & 63), At(i >> 6));
+        }, cycles), 0u);
+        CheckBudget(cycles);
+    }
+
+    TEST_F(HotPathTest, DwellRecorderExecute)
+    {
+        fsm::DwellTracker<States, States::IDLE, Triggers> tracker(definition_);
+        fsm::DwellTracker<States, States::IDLE, Triggers>::Recorder recorder(tracker);
+        States state = States::IDLE;
+        uint64_t stamp = recorder.Enter();
+        double cycles = 0;
+        EXPECT_EQ(Measure("DwellRecorder::Execute", [&](size_t i) { recorder.Execute(state, stamp, At(i)); }, cycles), 0u);
+        CheckBudget(cycles);
+    }
+
+    //计数版本的operator new确实生效
+    TEST(HotPathHarnessTest, CountsAllocations)
+    {
+        uint64_t before = g_allocations.load();
+        std::vector<int32_t>* v = new std::vector<int32_t>(16);
+        delete v;
+        EXPECT_EQ(g_allocations.load() - before, 2u);
+    }
+}
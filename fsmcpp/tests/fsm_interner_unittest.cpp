@@ -0,0 +1,121 @@
+
+#include <googletest-1.10.0/include/gtest/gtest.h>
+#include <fsm_interner.hpp>
+#include <string>
+
+namespace
+{
+    //测试字符串驻留的id分配与查找
+    TEST(TriggerInternerTest, InternAndFind)
+    {
+        fsm::TriggerInterner interner;
+        EXPECT_EQ(interner.Find("open"), fsm::kInvalidTriggerId);
+
+        fsm::TriggerId open_id = interner.Intern("open");
+        fsm::TriggerId close_id = interner.Intern("close");
+        EXPECT_EQ(open_id, 0u);
+        EXPECT_EQ(close_id, 1u);
+        //重复登记返回原有id
+        EXPECT_EQ(interner.Intern(std::string("open")), open_id);
+        EXPECT_EQ(interner.Size(), 2u);
+
+        EXPECT_EQ(interner.Find("close", 5), close_id);
+        EXPECT_EQ(interner.Find("clos", 4), fsm::kInvalidTriggerId);
+        EXPECT_EQ(interner.Name(open_id), "open");
+
+        //预先计算的哈希值
+        uint64_t hash = fsm::TriggerInterner::Hash("close", 5);
+        EXPECT_EQ(interner.Find("close", 5, hash), close_id);
+    }
+
+    //测试扩容后id保持不变
+    TEST(TriggerInternerTest, Rehash)
+    {
+        fsm::TriggerInterner interner;
+        for (int32_t i = 0; i < 1000; ++i)
+        {
+            EXPECT_EQ(interner.Intern(std::to_string(i)), static_cast<fsm::TriggerId>(i));
+        }
+        for (int32_t i = 0; i < 1000; ++i)
+        {
+            EXPECT_EQ(interner.Find(std::to_string(i)), static_cast<fsm::TriggerId>(i));
+        }
+        EXPECT_EQ(interner.Find(""), fsm::kInvalidTriggerId);
+        EXPECT_EQ(interner.Intern(""), 1000u);
+        EXPECT_EQ(interner.Find(""), 1000u);
+    }
+
+    class StringFsmTest : public testing::Test
+    {
+    protected:
+
+        enum class States
+        {
+            INITIAL,
+            OPENED,
+            CLOSED
+        };
+
+        void SetUp() override
+        {
+            test_fsm_.AddTransitions({
+                { States::INITIAL, States::OPENED, "open", nullptr, [this] { opened_++; } },
+                { States::OPENED, States::CLOSED, "close", [this] { return allow_close_; }, nullptr },
+            });
+        }
+
+        using F = fsm::StringFsm<States, States::INITIAL>;
+        F test_fsm_;
+        int32_t opened_ = 0;
+        bool allow_close_ = true;
+    };
+
+    TEST_F(StringFsmTest, ExecuteByString)
+    {
+        EXPECT_EQ(test_fsm_.Execute("close"), fsm::FSM_NO_MATCHING_TRIGGER);
+        EXPECT_EQ(test_fsm_.Execute("unknown"), fsm::FSM_NO_MATCHING_TRIGGER);
+        EXPECT_TRUE(test_fsm_.IsInitial());
+
+        EXPECT_EQ(test_fsm_.Execute(std::string("open")), fsm::FSM_SUCCESS);
+        EXPECT_EQ(test_fsm_.GetState(), States::OPENED);
+        EXPECT_EQ(opened_, 1);
+
+        allow_close_ = false;
+        EXPECT_EQ(test_fsm_.Execute("close", 5), fsm::FSM_SUCCESS);
+        EXPECT_EQ(test_fsm_.GetState(), States::OPENED);
+
+        allow_close_ = true;
+        EXPECT_EQ(test_fsm_.Execute("close"), fsm::FSM_SUCCESS);
+        EXPECT_EQ(test_fsm_.GetState(), States::CLOSED);
+    }
+
+    TEST_F(StringFsmTest, ExecuteById)
+    {
+        fsm::TriggerId open_id = test_fsm_.Resolve("open");
+        EXPECT_NE(open_id, fsm::kInvalidTriggerId);
+        EXPECT_EQ(test_fsm_.Resolve("missing"), fsm::kInvalidTriggerId);
+
+        EXPECT_EQ(test_fsm_.Execute(open_id), fsm::FSM_SUCCESS);
+        EXPECT_EQ(test_fsm_.GetState(), States::OPENED);
+        test_fsm_.Reset();
+        EXPECT_TRUE(test_fsm_.IsInitial());
+    }
+
+    TEST_F(StringFsmTest, DebugFunc)
+    {
+        std::string dbg_tr;
+        States dbg_to = States::INITIAL;
+        test_fsm_.AddDebugFn([&](States from, States to, const std::string& tr) {
+            dbg_to = to;
+            dbg_tr = tr;
+        });
+
+        test_fsm_.Execute("open");
+        EXPECT_EQ(dbg_to, States::OPENED);
+        EXPECT_EQ(dbg_tr, "open");
+
+        test_fsm_.AddDebugFn(nullptr);
+        test_fsm_.Execute("close");
+        EXPECT_EQ(dbg_to, States::OPENED);
+    }
+}
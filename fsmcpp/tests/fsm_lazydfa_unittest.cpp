@@ -0,0 +1,110 @@
+
+#include <googletest-1.10.0/include/gtest/gtest.h>
+#include <fsm_lazydfa.hpp>
+#include <fsm_bitnfa.hpp>
+
+#include <random>
+#include <string>
+
+namespace
+{
+    class FsmLazyDfaTest : public testing::Test
+    {
+    protected:
+
+        using F = fsm::Fsm<int32_t, 0, char>;
+
+        //(a|b)*a(a|b){n}: NFA只有n+2个状态, 完整DFA需要2^(n+1)个状态
+        void SetUp() override
+        {
+            test_fsm_.AddTransitions({
+                { 0, 0, 'a', nullptr, nullptr },
+                { 0, 0, 'b', nullptr, nullptr },
+                { 0, 1, 'a', nullptr, nullptr },
+            });
+            for (int32_t s = 1; s <= kN; ++s)
+            {
+                test_fsm_.AddTransitions({
+                    { s, s + 1, 'a', nullptr, nullptr },
+                    { s, s + 1, 'b', nullptr, nullptr },
+                });
+            }
+            ASSERT_EQ(reference_.Build(test_fsm_), fsm::FSM_SUCCESS);
+            accept_ = reference_.MaskOf({ kN + 1 });
+        }
+
+        //与 BitNfa 逐步比较接受结果与活动集合大小
+        void CompareWithBitNfa(fsm::LazyDfa<int32_t, 0, char>& lazy, size_t steps, uint32_t seed)
+        {
+            ASSERT_EQ(lazy.Build(test_fsm_), fsm::FSM_SUCCESS);
+            lazy.SetAccepting({ kN + 1 });
+            reference_.Reset();
+
+            std::mt19937 rng(seed);
+            for (size_t i = 0; i < steps; ++i)
+            {
+                char trigger = (rng() % 2 == 0) ? 'a' : 'b';
+                ASSERT_EQ(lazy.Execute(trigger), reference_.Execute(trigger));
+                ASSERT_EQ(lazy.IsAccepting(), (reference_.Active() & accept_).Any());
+                ASSERT_EQ(lazy.ActiveStates().size(), reference_.Active().Count());
+            }
+        }
+
+        static const int32_t kN = 14;
+        F test_fsm_;
+        fsm::BitNfa<int32_t, 0, char> reference_;
+        fsm::BitNfa<int32_t, 0, char>::Mask accept_;
+    };
+
+    const int32_t FsmLazyDfaTest::kN;
+
+    TEST_F(FsmLazyDfaTest, Unbounded)
+    {
+        fsm::LazyDfa<int32_t, 0, char> lazy(64 << 20);
+        CompareWithBitNfa(lazy, 100000, 1);
+        fsm::LazyDfaStats stats = lazy.GetStats();
+        EXPECT_EQ(stats.evictions, 0u);
+        EXPECT_EQ(stats.fallback_steps, 0u);
+        EXPECT_LE(stats.cached_states, size_t(1) << (kN + 1));
+        EXPECT_GT(stats.steps, stats.misses);
+    }
+
+    TEST_F(FsmLazyDfaTest, BoundedCache)
+    {
+        const size_t limit = 64 << 10;
+        fsm::LazyDfa<int32_t, 0, char> lazy(limit);
+        CompareWithBitNfa(lazy, 300000, 2);
+        fsm::LazyDfaStats stats = lazy.GetStats();
+        EXPECT_GT(stats.evictions, 0u);
+        EXPECT_LE(stats.memory_bytes, limit);
+        //随机输入下2^15个状态轮流出现, 缓存抖动后回退为NFA模拟
+        EXPECT_GT(stats.fallback_steps, 0u);
+    }
+
+    TEST_F(FsmLazyDfaTest, TinyLimit)
+    {
+        //上限连一个状态都容纳不下, 始终以NFA模拟执行
+        fsm::LazyDfa<int32_t, 0, char> lazy(16);
+        CompareWithBitNfa(lazy, 10000, 3);
+        EXPECT_TRUE(lazy.InFallback());
+        EXPECT_EQ(lazy.GetStats().cached_states, 0u);
+    }
+
+    TEST_F(FsmLazyDfaTest, RunAndReset)
+    {
+        fsm::LazyDfa<int32_t, 0, char> lazy;
+        ASSERT_EQ(lazy.Build(test_fsm_), fsm::FSM_SUCCESS);
+        lazy.SetAccepting({ kN + 1 });
+        std::string input = "a" + std::string(kN, 'b');
+        lazy.Run(input.data(), input.size());
+        EXPECT_TRUE(lazy.IsAccepting());
+        EXPECT_TRUE(lazy.IsActive(0));
+        EXPECT_EQ(lazy.Execute('z'), fsm::FSM_NO_MATCHING_TRIGGER);
+        EXPECT_TRUE(lazy.Empty());
+        lazy.Reset();
+        EXPECT_EQ(lazy.ActiveStates(), std::vector<int32_t>{ 0 });
+
+        test_fsm_.AddTransitions({ { 0, 1, 'c', [] { return true; }, nullptr } });
+        EXPECT_EQ(lazy.Build(test_fsm_), fsm::FSM_GUARDED_TRANSITION);
+    }
+}
@@ -0,0 +1,169 @@
+
+#include <googletest-1.10.0/include/gtest/gtest.h>
+#include <fsm_markov.hpp>
+#include "fsm_thread_limit.hpp"
+
+#include <cmath>
+
+namespace
+{
+    enum class Device
+    {
+        NEW,
+        ACTIVE,
+        FAILED,
+        RETIRED
+    };
+
+    class FsmMarkovTest : public testing::Test
+    {
+    protected:
+
+        using F = fsm::Fsm<Device, Device::NEW, char>;
+        using Simulator = fsm::MarkovSimulator<Device, Device::NEW, char>;
+
+        //每个tick: 新设备必定投入使用; 使用中的设备以10%概率故障, 2%概率退役; 故障设备以50%概率修复
+        void SetUp() override
+        {
+            test_fsm_.AddTransitions({
+                { Device::NEW, Device::ACTIVE, 't', nullptr, nullptr },
+                { Device::ACTIVE, Device::ACTIVE, 't', nullptr, nullptr, { 0, 0 }, 88 },
+                { Device::ACTIVE, Device::FAILED, 't', nullptr, nullptr, { 0, 0 }, 10 },
+                { Device::ACTIVE, Device::RETIRED, 't', nullptr, nullptr, { 0, 0 }, 2 },
+                { Device::FAILED, Device::ACTIVE, 't', nullptr, nullptr },
+                { Device::FAILED, Device::FAILED, 't', nullptr, nullptr },
+            });
+        }
+
+        //以优先级字段作为权重, 未设置时为1
+        static double Weight(const F::Trans& transition)
+        {
+            return transition.priority == 0 ? 1.0 : transition.priority;
+        }
+
+        F test_fsm_;
+    };
+
+    TEST(PhiloxTest, KnownAnswer)
+    {
+        //Random123 的 Philox4x32-10 已知答案
+        uint32_t zero[4] = { 0, 0, 0, 0 };
+        uint32_t out[4];
+        fsm::detail::Philox4x32(zero, 0, 0, out);
+        EXPECT_EQ(out[0], 0x6627e8d5u);
+        EXPECT_EQ(out[1], 0xe169c58du);
+        EXPECT_EQ(out[2], 0xbc57ac4cu);
+        EXPECT_EQ(out[3], 0x9b00dbd8u);
+
+        uint32_t ones[4] = { 0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu };
+        fsm::detail::Philox4x32(ones, 0xffffffffu, 0xffffffffu, out);
+        EXPECT_EQ(out[0], 0x408f276du);
+        EXPECT_EQ(out[1], 0x41c83b0eu);
+        EXPECT_EQ(out[2], 0xa20bc7c6u);
+        EXPECT_EQ(out[3], 0x6d5451fdu);
+    }
+
+    TEST(PhiloxTest, BatchMatchesScalar)
+    {
+        const uint64_t first = 0xFFFFFFF0ull;//跨越实例编号低32位的进位
+        uint32_t r0[37];
+        uint32_t r1[37];
+        fsm::detail::PhiloxBatch(first, 37, 5, 42, r0, r1);
+        for (uint32_t i = 0; i < 37; ++i)
+        {
+            uint64_t id = first + i;
+            uint32_t counter[4] = { static_cast<uint32_t>(id), static_cast<uint32_t>(id >> 32), 5, 0 };
+            uint32_t out[4];
+            fsm::detail::Philox4x32(counter, 42, 0, out);
+            EXPECT_EQ(r0[i], out[0]);
+            EXPECT_EQ(r1[i], out[1]);
+        }
+    }
+
+    TEST_F(FsmMarkovTest, Distribution)
+    {
+        Simulator sim(7);
+        ASSERT_EQ(sim.Build(test_fsm_, Weight), fsm::FSM_SUCCESS);
+        sim.Resize(200000);
+        EXPECT_EQ(sim.Count(Device::NEW), 200000u);
+
+        sim.Step('t');
+        EXPECT_EQ(sim.Count(Device::ACTIVE), 200000u);
+
+        sim.Step('t');
+        double n = 200000.0;
+        //与期望值的偏差在5个标准差以内
+        auto near = [n](uint64_t count, double p) {
+            return std::fabs(static_cast<double>(count) - n * p) < 5.0 * std::sqrt(n * p * (1.0 - p));
+        };
+        EXPECT_TRUE(near(sim.Count(Device::ACTIVE), 0.88));
+        EXPECT_TRUE(near(sim.Count(Device::FAILED), 0.10));
+        EXPECT_TRUE(near(sim.Count(Device::RETIRED), 0.02));
+
+        //没有转换的触发器: 所有实例保持原状态
+        std::vector<uint64_t> before = sim.Occupancy();
+        sim.Step('x');
+        EXPECT_EQ(sim.Occupancy(), before);
+        EXPECT_EQ(sim.StepCount(), 3u);
+    }
+
+    TEST_F(FsmMarkovTest, ReproducibleAcrossThreads)
+    {
+        std::vector<char> schedule(20, 't');
+        Simulator single(11);
+        ASSERT_EQ(single.Build(test_fsm_, Weight), fsm::FSM_SUCCESS);
+        single.Resize(300000);
+        auto expected = single.Simulate(schedule, 1);
+
+        Simulator parallel(11);
+        ASSERT_EQ(parallel.Build(test_fsm_, Weight), fsm::FSM_SUCCESS);
+        parallel.Resize(300000);
+        EXPECT_EQ(parallel.Simulate(schedule, 4), expected);
+        for (size_t i = 0; i < single.Size(); i += 997)
+        {
+            ASSERT_EQ(single.GetState(i), parallel.GetState(i));
+        }
+
+        //直方图每一步的总数不变
+        for (const auto& histogram : expected)
+        {
+            uint64_t total = 0;
+            for (uint64_t count : histogram)
+            {
+                total += count;
+            }
+            EXPECT_EQ(total, 300000u);
+        }
+    }
+
+    //线程创建失败时剩余的块在当前线程上执行, 结果不变
+    TEST_F(FsmMarkovTest, ThreadCreationFailure)
+    {
+        std::vector<char> schedule(5, 't');
+        Simulator single(11);
+        ASSERT_EQ(single.Build(test_fsm_, Weight), fsm::FSM_SUCCESS);
+        single.Resize(300000);
+        auto expected = single.Simulate(schedule, 1);
+
+        Simulator parallel(11);
+        ASSERT_EQ(parallel.Build(test_fsm_, Weight), fsm::FSM_SUCCESS);
+        parallel.Resize(300000);
+        std::vector<std::vector<uint64_t>> histograms;
+        {
+            fsm_test::ThreadLimit limit(1);
+            histograms = parallel.Simulate(schedule, 4);
+        }
+        EXPECT_EQ(histograms, expected);
+    }
+
+    TEST_F(FsmMarkovTest, InvalidWeights)
+    {
+        Simulator sim;
+        EXPECT_EQ(sim.Build(test_fsm_, [](const F::Trans&) { return -1.0; }), fsm::FSM_INVALID_PROBABILITY);
+        EXPECT_EQ(sim.Build(test_fsm_, [](const F::Trans&) { return 0.0; }), fsm::FSM_INVALID_PROBABILITY);
+        EXPECT_EQ(sim.Build(test_fsm_), fsm::FSM_SUCCESS);
+
+        test_fsm_.AddTransitions({ { Device::RETIRED, Device::NEW, 't', [] { return true; }, nullptr } });
+        EXPECT_EQ(sim.Build(test_fsm_), fsm::FSM_GUARDED_TRANSITION);
+    }
+}
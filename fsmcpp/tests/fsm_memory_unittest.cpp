@@ -0,0 +1,294 @@
+
+#include <googletest-1.10.0/include/gtest/gtest.h>
+#include <fsm_bitnfa.hpp>
+#include <fsm_bytedfa.hpp>
+#include <fsm_dwell.hpp>
+#include <fsm_fleet.hpp>
+#include <fsm_frozen.hpp>
+#include <fsm_interner.hpp>
+#include <fsm_lazydfa.hpp>
+#include <fsm_markov.hpp>
+#include <fsm_memory.hpp>
+#include <fsm_product.hpp>
+#include <fsm_queue.hpp>
+#include <fsm_rcu.hpp>
+#include <fsm_regex.hpp>
+#include <fsm_scheduler.hpp>
+#include <fsm_shm.hpp>
+#include <fsm_trigger_set.hpp>
+
+#include <array>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+FSM_DEFINE_ACCOUNTING_OPERATOR_NEW
+
+namespace
+{
+    using F = fsm::Fsm<int32_t, 0, char>;
+
+    //n个状态的环, 每个状态有三个转换
+    F MakeRing(int32_t n)
+    {
+        F machine;
+        for (int32_t s = 0; s < n; ++s)
+        {
+            machine.AddTransitions({
+                { s, (s + 1) % n, 'a', nullptr, nullptr },
+                { s, (s + 2) % n, 'b', nullptr, nullptr },
+                { s, s, 'c', nullptr, nullptr },
+            });
+        }
+        return machine;
+    }
+
+    TEST(MemoryReportTest, MergesComponents)
+    {
+        fsm::MemoryReport report;
+        report.Add("a", 10);
+        report.Add("b", 5);
+        report.Add("a", 1);
+        EXPECT_EQ(report.components.size(), 2u);
+        EXPECT_EQ(report.Bytes("a"), 11u);
+        EXPECT_EQ(report.Bytes("missing"), 0u);
+        EXPECT_EQ(report.Total(), 16u);
+    }
+
+    //估算随定义规模增长, 与计数钩子测得的堆内存在同一数量级
+    TEST(MemoryUsageTest, FsmEstimateTracksAccount)
+    {
+        fsm::AllocationAccount small_account;
+        fsm::AllocationAccount large_account;
+        F small;
+        F large;
+        {
+            fsm::ScopedAllocationAccount scope(small_account);
+            small = MakeRing(4);
+        }
+        {
+            fsm::ScopedAllocationAccount scope(large_account);
+            large = MakeRing(400);
+        }
+        fsm::MemoryReport report = large.MemoryUsage();
+        EXPECT_GT(report.Bytes("state_map"), 0u);
+        EXPECT_GT(report.Bytes("transitions"), 400 * 3 * sizeof(F::Trans) - 1);
+        EXPECT_EQ(report.instance_bytes, sizeof(int32_t));
+        EXPECT_GT(report.Total(), small.MemoryUsage().Total() * 50);
+
+        double heap = static_cast<double>(report.Total() - report.Bytes("object"));
+        EXPECT_GT(static_cast<double>(large_account.Bytes()), heap * 0.5);
+        EXPECT_LT(static_cast<double>(large_account.Bytes()), heap * 2.0);
+        EXPECT_LT(small_account.Bytes(), large_account.Bytes());
+    }
+
+#if defined(__GLIBCXX__) && !defined(FSM_NO_GLIBCXX_FAST_HASH)
+    //哈希表的估算与实际分配一致: 整数键的节点不保存哈希值, 字符串键的节点保存
+    TEST(MemoryUsageTest, HashBytesMatchesAllocations)
+    {
+        fsm::AllocationAccount int_account;
+        fsm::AllocationAccount string_account;
+        std::unordered_map<int32_t, int32_t> ints;
+        std::unordered_map<std::string, int32_t> strings;
+        {
+            fsm::ScopedAllocationAccount scope(int_account);
+            for (int32_t i = 0; i < 1000; ++i)
+            {
+                ints.emplace(i, i);
+            }
+        }
+        {
+            fsm::ScopedAllocationAccount scope(string_account);
+            for (int32_t i = 0; i < 1000; ++i)
+            {
+                strings.emplace(std::to_string(i), i);
+            }
+        }
+        EXPECT_FALSE(fsm::detail::CachesHash<decltype(ints)>());
+        EXPECT_TRUE(fsm::detail::CachesHash<decltype(strings)>());
+        EXPECT_EQ(static_cast<size_t>(int_account.Bytes()), fsm::detail::HashBytes(ints));
+        size_t key_bytes = 0;
+        for (const auto& entry : strings)
+        {
+            key_bytes += fsm::detail::StringBytes(entry.first);
+        }
+        EXPECT_EQ(static_cast<size_t>(string_account.Bytes()), fsm::detail::HashBytes(strings) + key_bytes);
+    }
+#endif
+
+    //std::function捕获的大对象在堆上, 只能由计数钩子测得
+    TEST(MemoryUsageTest, AccountSeesFunctionCaptures)
+    {
+        fsm::AllocationAccount plain_account;
+        fsm::AllocationAccount capture_account;
+        std::array<char, 256> payload{};
+        F plain;
+        F capturing;
+        {
+            fsm::ScopedAllocationAccount scope(plain_account);
+            for (int32_t s = 0; s < 32; ++s)
+            {
+                plain.AddTransitions({ { s, s + 1, 'a', nullptr, [] {} } });
+            }
+        }
+        {
+            fsm::ScopedAllocationAccount scope(capture_account);
+            for (int32_t s = 0; s < 32; ++s)
+            {
+                capturing.AddTransitions({ { s, s + 1, 'a', nullptr, [payload] { (void)payload; } } });
+            }
+        }
+        EXPECT_EQ(plain.MemoryUsage().Total(), capturing.MemoryUsage().Total());
+        EXPECT_GE(capture_account.Bytes() - plain_account.Bytes(), 32 * 256);
+    }
+
+    //释放时从所属账户减去, 不论当前作用域; 其他线程的分配不计入
+    TEST(AllocationAccountTest, AttributesFrees)
+    {
+        fsm::AllocationAccount outer;
+        fsm::AllocationAccount inner;
+        std::vector<char>* kept = nullptr;
+        {
+            fsm::ScopedAllocationAccount outer_scope(outer);
+            std::vector<char> temporary(1000);
+            {
+                fsm::ScopedAllocationAccount inner_scope(inner);
+                kept = new std::vector<char>(100);
+                std::thread other([] { std::vector<char> elsewhere(5000); });
+                other.join();
+            }
+            EXPECT_EQ(outer.Bytes(), 1000);
+        }
+        EXPECT_EQ(outer.Bytes(), 0);
+        EXPECT_EQ(outer.Allocations(), 0);
+        EXPECT_EQ(inner.Bytes(), static_cast<int64_t>(sizeof(std::vector<char>) + 100));
+        EXPECT_EQ(inner.Allocations(), 2);
+        delete kept;
+        EXPECT_EQ(inner.Bytes(), 0);
+    }
+
+    void ExpectReport(const fsm::MemoryReport& report, const char* component)
+    {
+        EXPECT_GT(report.Bytes("object"), 0u);
+        EXPECT_GT(report.Bytes(component), 0u) << component;
+        EXPECT_GE(report.Total(), report.Bytes("object") + report.Bytes(component));
+    }
+
+    //每种引擎都给出按组件的报告
+    TEST(MemoryUsageTest, EveryEngine)
+    {
+        F definition = MakeRing(16);
+
+        fsm::FrozenFsm<int32_t, 0, char> frozen;
+        ASSERT_EQ(frozen.Build(definition), fsm::FSM_SUCCESS);
+        ExpectReport(frozen.MemoryUsage(), "keys");
+        EXPECT_EQ(frozen.MemoryUsage().instance_bytes, sizeof(fsm::StateIndex));
+
+        fsm::ByteDfa<int32_t, 0> bytedfa;
+        ASSERT_EQ(bytedfa.Build(definition), fsm::FSM_SUCCESS);
+        ExpectReport(bytedfa.MemoryUsage(), "table");
+        EXPECT_GE(bytedfa.MemoryUsage().Bytes("table"), 16u * 256 * sizeof(uint32_t));
+
+        fsm::BitNfa<int32_t, 0, char> bitnfa;
+        ASSERT_EQ(bitnfa.Build(definition), fsm::FSM_SUCCESS);
+        ExpectReport(bitnfa.MemoryUsage(), "steps");
+
+        fsm::LazyDfa<int32_t, 0, char> lazy;
+        ASSERT_EQ(lazy.Build(definition), fsm::FSM_SUCCESS);
+        size_t before = lazy.MemoryUsage().Bytes("cache");
+        for (int32_t i = 0; i < 100; ++i)
+        {
+            lazy.Execute("abc"[i % 3]);
+        }
+        ExpectReport(lazy.MemoryUsage(), "nfa");
+        EXPECT_GT(lazy.MemoryUsage().Bytes("cache"), before);
+        EXPECT_EQ(lazy.MemoryUsage().instance_bytes, lazy.MemoryUsage().Total());
+
+        fsm::MarkovSimulator<int32_t, 0, char> markov;
+        ASSERT_EQ(markov.Build(definition), fsm::FSM_SUCCESS);
+        markov.Resize(1000);
+        ExpectReport(markov.MemoryUsage(), "instances");
+        EXPECT_GE(markov.MemoryUsage().Bytes("instances"), 1000 * sizeof(uint32_t));
+
+        F other = MakeRing(3);
+        fsm::ProductFsm<char, F, F> product;
+        ASSERT_EQ(product.Build(definition, other), fsm::FSM_SUCCESS);
+        ExpectReport(product.MemoryUsage(), "table");
+        ExpectReport(product.MemoryUsage(), "state_index");
+
+        fsm::RegexDfa regex;
+        ASSERT_EQ(regex.Compile("a(b|c)*d"), fsm::FSM_SUCCESS);
+        ExpectReport(regex.MemoryUsage(), "table");
+
+        fsm::TriggerBitsets<int32_t, 0, char> bitsets;
+        ASSERT_EQ(bitsets.Build(definition), fsm::FSM_SUCCESS);
+        ExpectReport(bitsets.MemoryUsage(), "bitsets");
+
+        fsm::FsmFleet<int32_t, 0, char> fleet(definition);
+        for (int32_t i = 0; i < 100; ++i)
+        {
+            fleet.Add();
+        }
+        ExpectReport(fleet.MemoryUsage(), "instances");
+        EXPECT_EQ(fleet.MemoryUsage().Bytes("definition"), fleet.GetDefinition().MemoryUsage().Total());
+
+        fsm::StringFsm<int32_t, 0> strings;
+        strings.AddTransitions({ { 0, 1, "a rather long trigger name", nullptr, nullptr } });
+        ExpectReport(strings.MemoryUsage(), "interner");
+        EXPECT_GT(strings.Interner().MemoryUsage().Bytes("names"), 0u);
+
+        fsm::RcuFsm<int32_t, 0, char> rcu;
+        ASSERT_EQ(rcu.Publish(definition), fsm::FSM_SUCCESS);
+        size_t current = rcu.MemoryUsage().Bytes("current");
+        EXPECT_GT(current, frozen.MemoryUsage().Total() / 2);
+        {
+            fsm::RcuFsm<int32_t, 0, char>::Reader reader(rcu);
+            ASSERT_EQ(rcu.Publish(other), fsm::FSM_SUCCESS);
+            ExpectReport(rcu.MemoryUsage(), "retired");
+            ExpectReport(rcu.MemoryUsage(), "readers");
+        }
+
+        fsm::DwellTracker<int32_t, 0, char> tracker(definition);
+        size_t idle = tracker.MemoryUsage().Bytes("recorders");
+        {
+            fsm::DwellTracker<int32_t, 0, char>::Recorder recorder(tracker);
+            EXPECT_GT(tracker.MemoryUsage().Bytes("recorders"), idle + 16 * fsm::DwellHistogram::BucketCount());
+        }
+        ExpectReport(tracker.MemoryUsage(), "retired");
+
+        fsm::TriggerQueue<F, char> queue;
+        std::vector<F> machines(10, definition);
+        for (F& machine : machines)
+        {
+            queue.Attach(machine);
+        }
+        queue.SetIdempotent(0, 'a');
+        for (int32_t i = 0; i < 100; ++i)
+        {
+            queue.Post(static_cast<fsm::InstanceId>(i % 10), "abc"[i % 3]);
+        }
+        ExpectReport(queue.MemoryUsage(), "events");
+        ExpectReport(queue.MemoryUsage(), "pending");
+        EXPECT_EQ(queue.MemoryUsage().instance_bytes, sizeof(uint64_t) + sizeof(F*));
+
+        fsm::EventScheduler<F, char> scheduler;
+        for (F& machine : machines)
+        {
+            scheduler.Attach(machine);
+        }
+        size_t idle_queue = scheduler.MemoryUsage().Bytes("queue");
+        for (int32_t i = 0; i < 1000; ++i)
+        {
+            scheduler.Schedule(static_cast<uint64_t>(i), static_cast<fsm::InstanceId>(i % 10), 'a');
+        }
+        ExpectReport(scheduler.MemoryUsage(), "machines");
+        EXPECT_GE(scheduler.MemoryUsage().Bytes("queue"), idle_queue + 1000 * (sizeof(uint64_t) + sizeof(fsm::InstanceId)));
+        EXPECT_EQ(scheduler.MemoryUsage().instance_bytes, sizeof(F*));
+
+        using Table = fsm::ShmFsmTable<int32_t, 0, char>;
+        Table table;
+        ASSERT_EQ(table.CreateAnonymous({ { 0, 1, 'a', 0, 0 } }, 1000), fsm::FSM_SUCCESS);
+        ExpectReport(table.MemoryUsage(), "segment");
+        EXPECT_GE(table.MemoryUsage().Bytes("segment"), 1000 * table.MemoryUsage().instance_bytes);
+    }
+}
@@ -0,0 +1,302 @@
+
+#include <googletest-1.10.0/include/gtest/gtest.h>
+#include <fsm_pipeline.hpp>
+#include "fsm_thread_limit.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+namespace
+{
+    TEST(SpscRingTest, BatchPushPop)
+    {
+        fsm::SpscRing<int32_t> ring(6);
+        EXPECT_EQ(ring.Capacity(), 8u);
+
+        int32_t items[10] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+        EXPECT_EQ(ring.TryPush(items, 10), 8u);
+        EXPECT_FALSE(ring.TryPush(items[8]));
+
+        int32_t out[10] = {};
+        EXPECT_EQ(ring.TryPop(out, 5), 5u);
+        EXPECT_EQ(out[4], 4);
+        //回绕
+        EXPECT_EQ(ring.TryPush(items + 8, 2), 2u);
+        EXPECT_EQ(ring.TryPop(out, 10), 5u);
+        EXPECT_EQ(out[0], 5);
+        EXPECT_EQ(out[4], 9);
+
+        EXPECT_FALSE(ring.Drained());
+        ring.Close();
+        EXPECT_TRUE(ring.Drained());
+    }
+
+    //两个线程之间顺序传递
+    TEST(SpscRingTest, CrossThreadOrder)
+    {
+        const uint32_t kCount = 1 << 20;
+        fsm::SpscRing<uint32_t> ring(1024);
+        std::thread producer([&]
+        {
+            uint32_t batch[37];
+            for (uint32_t next = 0; next < kCount;)
+            {
+                uint32_t n = std::min<uint32_t>(37, kCount - next);
+                for (uint32_t i = 0; i < n; ++i)
+                {
+                    batch[i] = next + i;
+                }
+                uint32_t pushed = 0;
+                while (pushed < n)
+                {
+                    size_t k = ring.TryPush(batch + pushed, n - pushed);
+                    if (k == 0)
+                    {
+                        std::this_thread::yield();
+                    }
+                    pushed += static_cast<uint32_t>(k);
+                }
+                next += n;
+            }
+            ring.Close();
+        });
+
+        uint32_t expected = 0;
+        bool in_order = true;
+        uint32_t out[64];
+        while (!ring.Drained())
+        {
+            size_t n = ring.TryPop(out, 64);
+            if (n == 0)
+            {
+                std::this_thread::yield();
+            }
+            for (size_t i = 0; i < n; ++i)
+            {
+                in_order = in_order && out[i] == expected;
+                ++expected;
+            }
+        }
+        producer.join();
+        EXPECT_TRUE(in_order);
+        EXPECT_EQ(expected, kCount);
+    }
+
+    enum class Bytes
+    {
+        DATA,
+        DELIM
+    };
+
+    enum class FrameStates
+    {
+        IDLE,
+        IN_FRAME
+    };
+
+    enum class Frames
+    {
+        FRAME
+    };
+
+    enum class SessionStates
+    {
+        OPEN
+    };
+
+    enum class Messages
+    {
+        MESSAGE
+    };
+
+    enum class AppStates
+    {
+        READY
+    };
+
+    using Framing = fsm::Fsm<FrameStates, FrameStates::IDLE, Bytes>;
+    using Session = fsm::Fsm<SessionStates, SessionStates::OPEN, Frames>;
+    using App = fsm::Fsm<AppStates, AppStates::READY, Messages>;
+
+    //分帧 -> 会话 -> 应用, 每个以DELIM结束的非空帧产生一条消息
+    TEST(PipelineTest, ThreeStages)
+    {
+        fsm::SpscRing<Bytes> bytes(256);
+        fsm::SpscRing<Frames> frames(256);
+        fsm::SpscRing<Messages> messages(256);
+        fsm::StageEmitter<Frames> to_session(frames);
+        fsm::StageEmitter<Messages> to_app(messages);
+
+        Framing framing;
+        framing.AddTransitions({
+            { FrameStates::IDLE, FrameStates::IN_FRAME, Bytes::DATA, nullptr, nullptr },
+            { FrameStates::IN_FRAME, FrameStates::IN_FRAME, Bytes::DATA, nullptr, nullptr },
+            { FrameStates::IN_FRAME, FrameStates::IDLE, Bytes::DELIM, nullptr, [&] { to_session.Emit(Frames::FRAME); } },
+        });
+        Session session;
+        session.AddTransitions({
+            { SessionStates::OPEN, SessionStates::OPEN, Frames::FRAME, nullptr, [&] { to_app.Emit(Messages::MESSAGE); } },
+        });
+        uint64_t received = 0;
+        App app;
+        app.AddTransitions({
+            { AppStates::READY, AppStates::READY, Messages::MESSAGE, nullptr, [&] { ++received; } },
+        });
+
+        fsm::Pipeline pipeline;
+        pipeline.AddStage(framing, bytes, to_session);
+        pipeline.AddStage(session, frames, to_app);
+        pipeline.AddStage(app, messages);
+        EXPECT_EQ(pipeline.StageCount(), 3u);
+        pipeline.Start();
+
+        //帧长度1~5, 其中穿插空帧(连续的DELIM)
+        uint64_t expected = 0;
+        uint64_t empty = 0;
+        uint64_t sent = 0;
+        for (uint32_t frame = 0; frame < 100000; ++frame)
+        {
+            uint32_t length = frame % 6;
+            for (uint32_t i = 0; i <= length; ++i)
+            {
+                Bytes byte = i == length ? Bytes::DELIM : Bytes::DATA;
+                while (!bytes.TryPush(byte))
+                {
+                    std::this_thread::yield();
+                }
+                ++sent;
+            }
+            expected += length > 0 ? 1 : 0;
+            empty += length > 0 ? 0 : 1;
+        }
+        bytes.Close();
+        pipeline.Join();
+
+        EXPECT_EQ(received, expected);
+        EXPECT_EQ(pipeline.Stats(0).events, sent);
+        EXPECT_EQ(pipeline.Stats(0).rejected, empty);//空帧的DELIM在IDLE中没有转换
+        EXPECT_EQ(pipeline.Stats(1).events, expected);
+        EXPECT_EQ(pipeline.Stats(2).events, expected);
+    }
+
+    //有一级的线程创建失败时Start抛出异常, 已启动的各级没有处理输入就退出
+    TEST(PipelineTest, ThreadCreationFailure)
+    {
+        fsm::SpscRing<Frames> frames(256);
+        fsm::SpscRing<Messages> messages(256);
+        fsm::StageEmitter<Messages> to_app(messages);
+        Session session;
+        session.AddTransitions({
+            { SessionStates::OPEN, SessionStates::OPEN, Frames::FRAME, nullptr, [&] { to_app.Emit(Messages::MESSAGE); } },
+        });
+        uint64_t received = 0;
+        App app;
+        app.AddTransitions({
+            { AppStates::READY, AppStates::READY, Messages::MESSAGE, nullptr, [&] { ++received; } },
+        });
+        ASSERT_TRUE(frames.TryPush(Frames::FRAME));
+
+        {
+            //析构时不需要关闭输入队列
+            fsm::Pipeline failed;
+            failed.AddStage(session, frames, to_app);
+            failed.AddStage(app, messages);
+            fsm_test::ThreadLimit limit(1);
+            EXPECT_THROW(failed.Start(), std::system_error);
+        }
+        EXPECT_EQ(received, 0u);
+
+        fsm::Pipeline pipeline;
+        pipeline.AddStage(session, frames, to_app, CPU_SETSIZE);
+        pipeline.AddStage(app, messages);
+        pipeline.Start();
+        frames.Close();
+        pipeline.Join();
+        EXPECT_EQ(received, 1u);
+        EXPECT_EQ(pipeline.Stats(1).events, 1u);
+    }
+
+    enum class Hops
+    {
+        HOP
+    };
+
+    enum class HopStates
+    {
+        ON
+    };
+
+    using Relay = fsm::Fsm<HopStates, HopStates::ON, Hops>;
+
+    //吞吐量和端到端延迟: 三级一对一转发, 第k个输出对应第k个输入
+    TEST(PipelineTest, Benchmark)
+    {
+        using Clock = std::chrono::steady_clock;
+        const size_t kEvents = 1 << 20;
+        fsm::SpscRing<Hops> r0(4096);
+        fsm::SpscRing<Hops> r1(4096);
+        fsm::SpscRing<Hops> r2(4096);
+        fsm::StageEmitter<Hops> e1(r1);
+        fsm::StageEmitter<Hops> e2(r2);
+
+        std::vector<Clock::time_point> sent(kEvents);
+        std::vector<Clock::time_point> done(kEvents);
+        size_t completed = 0;
+
+        Relay first;
+        first.AddTransitions({ { HopStates::ON, HopStates::ON, Hops::HOP, nullptr, [&] { e1.Emit(Hops::HOP); } } });
+        Relay second;
+        second.AddTransitions({ { HopStates::ON, HopStates::ON, Hops::HOP, nullptr, [&] { e2.Emit(Hops::HOP); } } });
+        Relay last;
+        last.AddTransitions({ { HopStates::ON, HopStates::ON, Hops::HOP, nullptr, [&] { done[completed++] = Clock::now(); } } });
+
+        fsm::Pipeline pipeline;
+        uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+        pipeline.AddStage(first, r0, e1, cores >= 4 ? 1 : -1);
+        pipeline.AddStage(second, r1, e2, cores >= 4 ? 2 : -1);
+        pipeline.AddStage(last, r2, cores >= 4 ? 3 : -1);
+        pipeline.Start();
+
+        Clock::time_point start = Clock::now();
+        Hops batch[32];
+        std::fill(batch, batch + 32, Hops::HOP);
+        for (size_t next = 0; next < kEvents;)
+        {
+            size_t n = std::min<size_t>(32, kEvents - next);
+            Clock::time_point now = Clock::now();
+            size_t pushed = r0.TryPush(batch, n);
+            for (size_t i = 0; i < pushed; ++i)
+            {
+                sent[next + i] = now;
+            }
+            if (pushed == 0)
+            {
+                std::this_thread::yield();
+            }
+            next += pushed;
+        }
+        r0.Close();
+        pipeline.Join();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        ASSERT_EQ(completed, kEvents);
+        std::vector<double> latency(kEvents);
+        for (size_t i = 0; i < kEvents; ++i)
+        {
+            latency[i] = std::chrono::duration<double, std::micro>(done[i] - sent[i]).count();
+        }
+        std::sort(latency.begin(), latency.end());
+        std::printf("pipeline: %.2f Mevents/s end-to-end, latency p50 %.1f us p99 %.1f us\n",
+            static_cast<double>(kEvents) / seconds / 1e6, latency[kEvents / 2], latency[kEvents * 99 / 100]);
+        for (size_t s = 0; s < pipeline.StageCount(); ++s)
+        {
+            const fsm::PipelineStageStats& stats = pipeline.Stats(s);
+            EXPECT_EQ(stats.events, kEvents);
+            std::printf("  stage %zu: %.2f Mevents/s busy, %.1f events/batch\n", s,
+                static_cast<double>(stats.events) / std::max(stats.busy_seconds, 1e-9) / 1e6,
+                static_cast<double>(stats.events) / static_cast<double>(stats.batches));
+        }
+    }
+}
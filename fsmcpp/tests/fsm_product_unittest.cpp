@@ -0,0 +1,92 @@
+
+#include <googletest-1.10.0/include/gtest/gtest.h>
+#include <fsm_product.hpp>
+
+#include <random>
+
+namespace
+{
+    enum class Link
+    {
+        DOWN,
+        UP
+    };
+
+    class FsmProductTest : public testing::Test
+    {
+    protected:
+
+        using Protocol = fsm::Fsm<int32_t, 0, char>;
+        using Session = fsm::Fsm<Link, Link::DOWN, char>;
+        using Product = fsm::ProductFsm<char, Protocol, Session>;
+
+        void SetUp() override
+        {
+            protocol_.AddTransitions({
+                { 0, 1, 'h', nullptr, nullptr },
+                { 1, 2, 'd', nullptr, nullptr },
+                { 2, 2, 'd', nullptr, nullptr },
+                { 2, 0, 'x', nullptr, nullptr },
+                { 1, 0, 'x', nullptr, nullptr },
+            });
+            session_.AddTransitions({
+                { Link::DOWN, Link::UP, 'u', nullptr, nullptr },
+                { Link::UP, Link::DOWN, 'x', nullptr, nullptr },
+                { Link::UP, Link::DOWN, 'q', nullptr, nullptr },
+            });
+        }
+
+        Protocol protocol_;
+        Session session_;
+    };
+
+    TEST_F(FsmProductTest, Lockstep)
+    {
+        Product product;
+        ASSERT_EQ(product.Build(protocol_, session_), fsm::FSM_SUCCESS);
+        EXPECT_LE(product.StateCount(), Product::UpperBound(protocol_, session_));
+        EXPECT_EQ(product.ComponentState<0>(), 0);
+        EXPECT_EQ(product.ComponentState<1>(), Link::DOWN);
+
+        const char alphabet[] = { 'h', 'd', 'x', 'u', 'q', 'z' };
+        std::mt19937 rng(7);
+        for (int i = 0; i < 2000; ++i)
+        {
+            char trigger = alphabet[rng() % sizeof(alphabet)];
+            bool matched = protocol_.Execute(trigger) == fsm::FSM_SUCCESS;
+            matched = session_.Execute(trigger) == fsm::FSM_SUCCESS || matched;
+
+            EXPECT_EQ(product.Execute(trigger), matched ? fsm::FSM_SUCCESS : fsm::FSM_NO_MATCHING_TRIGGER);
+            ASSERT_EQ(product.ComponentState<0>(), protocol_.GetState());
+            ASSERT_EQ(product.ComponentState<1>(), session_.GetState());
+        }
+
+        product.Reset();
+        EXPECT_EQ(product.GetStateIndex(), 0u);
+    }
+
+    TEST_F(FsmProductTest, StateLimit)
+    {
+        Product product;
+        EXPECT_EQ(Product::UpperBound(protocol_, session_), 6u);
+        EXPECT_EQ(product.Build(2, protocol_, session_), fsm::FSM_STATE_LIMIT_EXCEEDED);
+        EXPECT_EQ(product.StateCount(), 0u);
+        EXPECT_EQ(product.Build(6, protocol_, session_), fsm::FSM_SUCCESS);
+
+        //构建失败时保留之前构建好的内容和当前状态
+        size_t states = product.StateCount();
+        ASSERT_EQ(product.Execute('h'), fsm::FSM_SUCCESS);
+        EXPECT_EQ(product.Build(2, protocol_, session_), fsm::FSM_STATE_LIMIT_EXCEEDED);
+        EXPECT_EQ(product.StateCount(), states);
+        EXPECT_EQ(product.ComponentState<0>(), 1);
+        EXPECT_EQ(product.Execute('d'), fsm::FSM_SUCCESS);
+        EXPECT_EQ(product.ComponentState<0>(), 2);
+    }
+
+    TEST_F(FsmProductTest, RejectGuards)
+    {
+        protocol_.AddTransitions({ { 0, 2, 'g', [] { return true; }, nullptr } });
+        Product product;
+        EXPECT_EQ(product.Build(protocol_, session_), fsm::FSM_GUARDED_TRANSITION);
+    }
+}
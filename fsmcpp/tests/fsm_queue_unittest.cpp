@@ -0,0 +1,188 @@
+
+#include <googletest-1.10.0/include/gtest/gtest.h>
+#include <fsm_queue.hpp>
+
+#include <vector>
+
+namespace
+{
+    enum class States
+    {
+        IDLE,
+        READING,
+        CLOSED
+    };
+
+    enum class Triggers
+    {
+        DATA_AVAILABLE,
+        OPEN,
+        CLOSE
+    };
+
+    using F = fsm::Fsm<States, States::IDLE, Triggers>;
+    using Queue = fsm::TriggerQueue<F, Triggers>;
+
+    //OPEN: IDLE -> READING; READING下DATA_AVAILABLE自转换并计数; CLOSE: READING -> CLOSED
+    void Define(F& machine, int32_t& reads)
+    {
+        machine.AddTransitions({
+            { States::IDLE, States::READING, Triggers::OPEN, nullptr, nullptr },
+            { States::READING, States::READING, Triggers::DATA_AVAILABLE, nullptr, [&reads] { ++reads; } },
+            { States::READING, States::CLOSED, Triggers::CLOSE, nullptr, nullptr },
+        });
+    }
+
+    //没有标记幂等时按顺序逐个执行
+    TEST(TriggerQueueTest, FifoWithoutCoalescing)
+    {
+        int32_t reads = 0;
+        F machine;
+        Define(machine, reads);
+        Queue queue;
+        fsm::InstanceId id = queue.Attach(machine);
+
+        EXPECT_TRUE(queue.Post(id, Triggers::OPEN));
+        for (int32_t i = 0; i < 10; ++i)
+        {
+            EXPECT_TRUE(queue.Post(id, Triggers::DATA_AVAILABLE));
+        }
+        EXPECT_EQ(queue.Pending(), 11u);
+        EXPECT_EQ(queue.RunAll(), 11u);
+        EXPECT_EQ(reads, 10);
+        EXPECT_EQ(queue.Coalesced(), 0u);
+    }
+
+    //幂等的触发器在排队期间只保留一份
+    TEST(TriggerQueueTest, AbsorbsIdempotentCopies)
+    {
+        int32_t reads_a = 0;
+        int32_t reads_b = 0;
+        F a;
+        F b;
+        Define(a, reads_a);
+        Define(b, reads_b);
+        a.Reset(States::READING);
+        b.Reset(States::READING);
+
+        Queue queue;
+        queue.SetIdempotent(States::READING, Triggers::DATA_AVAILABLE);
+        fsm::InstanceId ia = queue.Attach(a);
+        fsm::InstanceId ib = queue.Attach(b);
+
+        EXPECT_TRUE(queue.Post(ia, Triggers::DATA_AVAILABLE));
+        EXPECT_TRUE(queue.Post(ib, Triggers::DATA_AVAILABLE));
+        for (int32_t i = 0; i < 100; ++i)
+        {
+            EXPECT_FALSE(queue.Post(ia, Triggers::DATA_AVAILABLE));
+        }
+        EXPECT_TRUE(queue.IsPending(ia, Triggers::DATA_AVAILABLE));
+        EXPECT_FALSE(queue.IsPending(ia, Triggers::CLOSE));
+        EXPECT_EQ(queue.Pending(), 2u);
+        EXPECT_EQ(queue.Coalesced(), 100u);
+
+        EXPECT_EQ(queue.RunAll(), 2u);
+        EXPECT_EQ(reads_a, 1);
+        EXPECT_EQ(reads_b, 1);
+        EXPECT_FALSE(queue.IsPending(ia, Triggers::DATA_AVAILABLE));
+
+        //已经执行过的触发器不再吸收新的一份
+        EXPECT_TRUE(queue.Post(ia, Triggers::DATA_AVAILABLE));
+        EXPECT_EQ(queue.RunAll(), 1u);
+        EXPECT_EQ(reads_a, 2);
+    }
+
+    //是否幂等由入队时实例所处的状态决定, 非幂等的触发器和其他触发器照常入队
+    TEST(TriggerQueueTest, IdempotencyIsPerState)
+    {
+        int32_t reads = 0;
+        F machine;
+        Define(machine, reads);
+        Queue queue;
+        queue.SetIdempotent(States::READING, Triggers::DATA_AVAILABLE);
+        fsm::InstanceId id = queue.Attach(machine);
+
+        //IDLE下DATA_AVAILABLE不是幂等的
+        EXPECT_TRUE(queue.Post(id, Triggers::DATA_AVAILABLE));
+        EXPECT_TRUE(queue.Post(id, Triggers::DATA_AVAILABLE));
+        EXPECT_TRUE(queue.Post(id, Triggers::OPEN));
+        EXPECT_TRUE(queue.Post(id, Triggers::OPEN));
+
+        std::vector<fsm::FsmErrors> rejected;
+        queue.SetRejectFn([&](fsm::InstanceId, Triggers, fsm::FsmErrors err_code) { rejected.push_back(err_code); });
+        EXPECT_EQ(queue.RunAll(), 4u);
+        EXPECT_EQ(rejected.size(), 3u);
+        EXPECT_EQ(machine.GetState(), States::READING);
+
+        EXPECT_TRUE(queue.Post(id, Triggers::DATA_AVAILABLE));
+        EXPECT_FALSE(queue.Post(id, Triggers::DATA_AVAILABLE));
+        queue.SetIdempotent(States::READING, Triggers::DATA_AVAILABLE, false);
+        EXPECT_TRUE(queue.Post(id, Triggers::DATA_AVAILABLE));
+        EXPECT_EQ(queue.RunAll(), 2u);
+        EXPECT_EQ(reads, 2);
+    }
+
+    //action中再次发送正在执行的触发器会重新入队
+    TEST(TriggerQueueTest, RepostFromAction)
+    {
+        Queue queue;
+        int32_t reads = 0;
+        F machine;
+        fsm::InstanceId id = 0;
+        machine.AddTransitions({
+            { States::READING, States::READING, Triggers::DATA_AVAILABLE, nullptr, [&]
+                {
+                    if (++reads < 5)
+                    {
+                        EXPECT_TRUE(queue.Post(id, Triggers::DATA_AVAILABLE));
+                        EXPECT_FALSE(queue.Post(id, Triggers::DATA_AVAILABLE));
+                    }
+                } },
+        });
+        machine.Reset(States::READING);
+        queue.SetIdempotent(States::READING, Triggers::DATA_AVAILABLE);
+        id = queue.Attach(machine);
+
+        queue.Post(id, Triggers::DATA_AVAILABLE);
+        EXPECT_EQ(queue.RunAll(), 5u);
+        EXPECT_EQ(reads, 5);
+        EXPECT_EQ(queue.Coalesced(), 4u);
+    }
+
+    //突发负载: 大量实例各收到一串重复触发器, 执行次数只与实例数成正比
+    TEST(TriggerQueueTest, BurstAndCompaction)
+    {
+        const int32_t kInstances = 500;
+        const int32_t kBurst = 20;
+        int32_t reads = 0;
+        std::vector<F> machines(kInstances);
+        Queue queue;
+        queue.SetIdempotent(States::READING, Triggers::DATA_AVAILABLE);
+        for (F& machine : machines)
+        {
+            Define(machine, reads);
+            machine.Reset(States::READING);
+            queue.Attach(machine);
+        }
+
+        for (int32_t round = 0; round < 4; ++round)
+        {
+            for (int32_t i = 0; i < kBurst; ++i)
+            {
+                for (fsm::InstanceId id = 0; id < kInstances; ++id)
+                {
+                    queue.Post(id, Triggers::DATA_AVAILABLE);
+                }
+            }
+            //只执行一半, 让后一轮的触发器排在未执行的触发器之后
+            for (int32_t i = 0; i < kInstances / 2; ++i)
+            {
+                EXPECT_TRUE(queue.RunOne());
+            }
+        }
+        queue.RunAll();
+        EXPECT_EQ(reads + static_cast<int32_t>(queue.Coalesced()), 4 * kBurst * kInstances);
+        EXPECT_LE(reads, 4 * kInstances);
+        EXPECT_EQ(queue.Pending(), 0u);
+    }
+}
@@ -0,0 +1,264 @@
+
+#include <googletest-1.10.0/include/gtest/gtest.h>
+#include <fsm_rcu.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+
+namespace
+{
+    enum class States
+    {
+        IDLE,
+        RUNNING,
+        PAUSED,
+        SUSPENDED,
+        DONE
+    };
+
+    enum class Triggers
+    {
+        START,
+        PAUSE,
+        RESUME,
+        STOP
+    };
+
+    using F = fsm::Fsm<States, States::IDLE, Triggers>;
+    using Rcu = fsm::RcuFsm<States, States::IDLE, Triggers>;
+
+    //版本1: 暂停状态为PAUSED
+    F MakeV1()
+    {
+        F definition;
+        definition.AddTransitions({
+            { States::IDLE, States::RUNNING, Triggers::START, nullptr, nullptr },
+            { States::RUNNING, States::PAUSED, Triggers::PAUSE, nullptr, nullptr },
+            { States::PAUSED, States::RUNNING, Triggers::RESUME, nullptr, nullptr },
+            { States::RUNNING, States::DONE, Triggers::STOP, nullptr, nullptr },
+        });
+        return definition;
+    }
+
+    //版本2: PAUSED改名为SUSPENDED, 并且可以从暂停直接结束
+    F MakeV2()
+    {
+        F definition;
+        definition.AddTransitions({
+            { States::IDLE, States::RUNNING, Triggers::START, nullptr, nullptr },
+            { States::RUNNING, States::SUSPENDED, Triggers::PAUSE, nullptr, nullptr },
+            { States::SUSPENDED, States::RUNNING, Triggers::RESUME, nullptr, nullptr },
+            { States::SUSPENDED, States::DONE, Triggers::STOP, nullptr, nullptr },
+            { States::RUNNING, States::DONE, Triggers::STOP, nullptr, nullptr },
+        });
+        return definition;
+    }
+
+    States RenamePaused(States s)
+    {
+        return s == States::PAUSED ? States::SUSPENDED : s;
+    }
+
+    //读者在静止之前一直使用旧定义, 静止时映射状态并切换
+    TEST(RcuFsmTest, SwapAtQuiescentPoint)
+    {
+        Rcu rcu;
+        ASSERT_EQ(rcu.Publish(MakeV1()), fsm::FSM_SUCCESS);
+
+        Rcu::Reader reader(rcu);
+        fsm::StateIndex state = 0;
+        EXPECT_FALSE(reader.Quiescent(state));
+        EXPECT_EQ(reader.Execute(state, Triggers::START), fsm::FSM_SUCCESS);
+        EXPECT_EQ(reader.Execute(state, Triggers::PAUSE), fsm::FSM_SUCCESS);
+        EXPECT_EQ(reader.Get().StateAt(state), States::PAUSED);
+
+        ASSERT_EQ(rcu.Publish(MakeV2(), RenamePaused), fsm::FSM_SUCCESS);
+        //旧定义仍被读者使用
+        EXPECT_EQ(rcu.RetiredCount(), 1u);
+        EXPECT_EQ(reader.Execute(state, Triggers::STOP), fsm::FSM_NO_MATCHING_TRIGGER);
+        EXPECT_EQ(reader.Get().StateAt(state), States::PAUSED);
+
+        EXPECT_TRUE(reader.Quiescent(state));
+        EXPECT_EQ(reader.Get().StateAt(state), States::SUSPENDED);
+        EXPECT_EQ(rcu.Reclaim(), 1u);
+        EXPECT_EQ(rcu.RetiredCount(), 0u);
+
+        EXPECT_EQ(reader.Execute(state, Triggers::STOP), fsm::FSM_SUCCESS);
+        EXPECT_EQ(reader.Get().StateAt(state), States::DONE);
+        EXPECT_FALSE(reader.Quiescent(state));
+    }
+
+    //跳过多个版本时依次映射, 新定义中不存在的状态回到初始状态
+    TEST(RcuFsmTest, SkipVersions)
+    {
+        Rcu rcu;
+        rcu.Publish(MakeV1());
+        Rcu::Reader reader(rcu);
+
+        std::vector<fsm::StateIndex> states(3, 0);
+        reader.Execute(states[1], Triggers::START);
+        reader.Execute(states[2], Triggers::START);
+        reader.Execute(states[2], Triggers::PAUSE);
+
+        rcu.Publish(MakeV2(), RenamePaused);
+        //版本3只有IDLE和SUSPENDED, 没有RUNNING
+        F v3;
+        v3.AddTransitions({
+            { States::IDLE, States::SUSPENDED, Triggers::PAUSE, nullptr, nullptr },
+        });
+        rcu.Publish(v3);
+        EXPECT_EQ(rcu.RetiredCount(), 2u);
+
+        EXPECT_TRUE(reader.Quiescent(states.begin(), states.end()));
+        EXPECT_EQ(reader.Get().StateAt(states[0]), States::IDLE);
+        EXPECT_EQ(reader.Get().StateAt(states[1]), States::IDLE);
+        EXPECT_EQ(reader.Get().StateAt(states[2]), States::SUSPENDED);
+        EXPECT_EQ(rcu.Reclaim(), 2u);
+    }
+
+    //离线读者不阻止回收, 多个读者都静止后才回收
+    TEST(RcuFsmTest, ReclaimWaitsForOnlineReaders)
+    {
+        Rcu rcu;
+        Rcu::Reader a(rcu);
+        Rcu::Reader b(rcu);
+        Rcu::Reader c(rcu);
+        c.Offline();
+
+        rcu.Publish(MakeV1());
+        rcu.Publish(MakeV2());
+        EXPECT_EQ(rcu.RetiredCount(), 2u);
+        a.Quiescent();
+        EXPECT_EQ(rcu.Reclaim(), 0u);
+        b.Quiescent();
+        EXPECT_EQ(rcu.Reclaim(), 2u);
+
+        c.Online();
+        EXPECT_EQ(c.Get().StateCount(), rcu.Current().StateCount());
+        rcu.Publish(MakeV1());
+        EXPECT_EQ(rcu.RetiredCount(), 1u);
+        a.Quiescent();
+        b.Quiescent();
+        {
+            Rcu::Reader d(rcu);
+            EXPECT_EQ(rcu.Reclaim(), 0u);
+        }
+        c.Offline();
+        EXPECT_EQ(rcu.Reclaim(), 1u);
+    }
+
+    //多个读者线程持续执行, 写者不断发布新定义
+    TEST(RcuFsmTest, ConcurrentPublish)
+    {
+        Rcu rcu;
+        rcu.Publish(MakeV1());
+        std::atomic<bool> stop(false);
+        std::atomic<uint64_t> executed(0);
+
+        std::vector<std::thread> readers;
+        for (int32_t t = 0; t < 4; ++t)
+        {
+            readers.emplace_back([&, t]
+            {
+                Rcu::Reader reader(rcu);
+                std::vector<fsm::StateIndex> states(16, 0);
+                std::mt19937 rng(static_cast<uint32_t>(t));
+                uint64_t count = 0;
+                while (!stop.load(std::memory_order_relaxed))
+                {
+                    for (int32_t i = 0; i < 256; ++i)
+                    {
+                        fsm::StateIndex& state = states[rng() % states.size()];
+                        reader.Execute(state, static_cast<Triggers>(rng() % 4));
+                        if (reader.Get().StateAt(state) == States::DONE)
+                        {
+                            state = 0;
+                        }
+                        ++count;
+                    }
+                    reader.Quiescent(states.begin(), states.end());
+                    for (fsm::StateIndex state : states)
+                    {
+                        ASSERT_LT(state, reader.Get().StateCount());
+                    }
+                }
+                executed += count;
+            });
+        }
+
+        for (int32_t i = 0; i < 200; ++i)
+        {
+            if (i % 2 == 0)
+            {
+                rcu.Publish(MakeV2(), RenamePaused);
+            }
+            else
+            {
+                rcu.Publish(MakeV1(), [](States s) { return s == States::SUSPENDED ? States::PAUSED : s; });
+            }
+            std::this_thread::yield();
+        }
+        stop = true;
+        for (std::thread& thread : readers)
+        {
+            thread.join();
+        }
+        rcu.Synchronize();
+        EXPECT_EQ(rcu.RetiredCount(), 0u);
+        EXPECT_GT(executed.load(), 0u);
+    }
+
+    //读路径的开销: 通过读者句柄执行与直接执行冻结定义对比
+    TEST(RcuFsmTest, ReadPathBenchmark)
+    {
+        F definition = MakeV1();
+        Rcu::Definition frozen;
+        frozen.Build(definition);
+        Rcu rcu;
+        rcu.Publish(definition);
+        Rcu::Reader reader(rcu);
+
+        const size_t kEvents = 1 << 22;
+        std::vector<Triggers> triggers;
+        std::mt19937 rng(1);
+        for (size_t i = 0; i < kEvents; ++i)
+        {
+            triggers.push_back(static_cast<Triggers>(rng() % 4));
+        }
+
+        //每批1024个触发器; 读者在批内使用Get()取得的定义, 批之间宣告一次静止
+        auto run = [&](bool use_reader)
+        {
+            fsm::StateIndex state = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < kEvents; i += 1024)
+            {
+                const Rcu::Definition& current = use_reader ? reader.Get() : frozen;
+                for (size_t k = i; k < i + 1024; ++k)
+                {
+                    current.Execute(state, triggers[k]);
+                }
+                if (use_reader)
+                {
+                    reader.Quiescent(state);
+                }
+            }
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(kEvents);
+        };
+
+        //交替运行, 各取最好的一次
+        double direct = 1e9;
+        double rcu_read = 1e9;
+        for (int32_t round = 0; round < 5; ++round)
+        {
+            direct = std::min(direct, run(false));
+            rcu_read = std::min(rcu_read, run(true));
+        }
+        std::printf("direct %.2f ns/op, rcu reader %.2f ns/op\n", direct, rcu_read);
+        //计时受机器负载影响, 只检查没有数量级上的差别
+        EXPECT_LT(rcu_read, direct * 2 + 1);
+    }
+}
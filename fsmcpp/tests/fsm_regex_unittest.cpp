@@ -0,0 +1,121 @@
+
+#include <googletest-1.10.0/include/gtest/gtest.h>
+#include <fsm_regex.hpp>
+#include <fsm_bytedfa.hpp>
+
+#include <random>
+#include <regex>
+
+namespace
+{
+    class FsmRegexTest : public testing::Test
+    {
+    protected:
+
+        //与std::regex_search逐一比较随机输入的匹配结果, 同时检查 Fsm 和 ByteDfa 的执行结果
+        void CompareWithStdRegex(const std::string& pattern)
+        {
+            fsm::RegexDfa regex;
+            ASSERT_EQ(regex.Compile(pattern), fsm::FSM_SUCCESS) << pattern;
+
+            fsm::Fsm<int, 0, char> machine;
+            regex.Build(machine);
+            fsm::ByteDfa<int, 0> dfa;
+            ASSERT_EQ(regex.Emit(dfa), fsm::FSM_SUCCESS);
+
+            std::regex expected(pattern);
+            const char alphabet[] = "abc0 _\n";
+            std::mt19937 rng(11);
+            for (int i = 0; i < 500; ++i)
+            {
+                std::string input;
+                size_t len = rng() % 9;
+                for (size_t k = 0; k < len; ++k)
+                {
+                    input.push_back(alphabet[rng() % (sizeof(alphabet) - 1)]);
+                }
+
+                bool matched = std::regex_search(input, expected);
+                ASSERT_EQ(regex.Match(input), matched) << pattern << " / " << input;
+
+                int state = 0;
+                for (char c : input)
+                {
+                    machine.Execute(state, c);
+                }
+                ASSERT_EQ(regex.IsAccepting(state), matched) << pattern << " / " << input;
+                ASSERT_EQ(regex.IsAccepting(dfa.StateAt(dfa.Run(input.data(), input.size()))), matched);
+            }
+        }
+    };
+
+    TEST_F(FsmRegexTest, MatchesStdRegex)
+    {
+        const char* patterns[] = {
+            "abc", "^abc$", "a|b", "^a|b$", "^(ab|c)*$", "a+b?c", "^[a-c]+0$", "[^ab]", "^.*$",
+            "^\\d\\s\\w$", "^[\\d_]+$", "(a|ab)(c|bcd)", "^(a*)*$", "^$", "", "^a\\|b", "^[a-]$",
+        };
+        for (const char* pattern : patterns)
+        {
+            CompareWithStdRegex(pattern);
+        }
+    }
+
+    TEST_F(FsmRegexTest, MinimalAndDeadState)
+    {
+        fsm::RegexDfa regex;
+        ASSERT_EQ(regex.Compile("^(a|b)*abb$"), fsm::FSM_SUCCESS);
+        EXPECT_EQ(regex.StateCount(), 5u);//教科书例子的4个状态, 加上a和b以外字节进入的死状态
+        EXPECT_NE(regex.DeadState(), -1);
+
+        ASSERT_EQ(regex.Compile("^ab$"), fsm::FSM_SUCCESS);
+        EXPECT_EQ(regex.StateCount(), 4u);//初始, a, ab, 死状态
+        ASSERT_NE(regex.DeadState(), -1);
+        EXPECT_EQ(regex.Step(0, 'x'), regex.DeadState());
+        EXPECT_TRUE(regex.Match("ab"));
+        EXPECT_FALSE(regex.Match("abx"));
+
+        //没有$时匹配后保持接受, 吸收状态没有任何输出转换
+        ASSERT_EQ(regex.Compile("ab"), fsm::FSM_SUCCESS);
+        EXPECT_TRUE(regex.Match("xxabyy"));
+        for (const auto& transition : regex.Transitions())
+        {
+            EXPECT_FALSE(regex.IsAccepting(transition.from_state));
+        }
+    }
+
+    TEST_F(FsmRegexTest, SyntaxErrors)
+    {
+        fsm::RegexDfa regex;
+        EXPECT_EQ(regex.Compile("a(b"), fsm::FSM_INVALID_PATTERN);
+        EXPECT_EQ(regex.Compile("ab)"), fsm::FSM_INVALID_PATTERN);
+        EXPECT_EQ(regex.ErrorOffset(), 2u);
+        EXPECT_EQ(regex.Compile("*a"), fsm::FSM_INVALID_PATTERN);
+        EXPECT_EQ(regex.Compile("a$b"), fsm::FSM_INVALID_PATTERN);
+        EXPECT_EQ(regex.Compile("(^a)"), fsm::FSM_INVALID_PATTERN);
+        EXPECT_EQ(regex.Compile("[z-a]"), fsm::FSM_INVALID_PATTERN);
+        EXPECT_EQ(regex.Compile("\\q"), fsm::FSM_INVALID_PATTERN);
+        EXPECT_EQ(regex.Compile("\\x4"), fsm::FSM_INVALID_PATTERN);
+        EXPECT_EQ(regex.Compile("\\x41$"), fsm::FSM_SUCCESS);
+        EXPECT_TRUE(regex.Match("zA"));
+
+        //类开头的']'按字面字符处理
+        ASSERT_EQ(regex.Compile("^[]a]+$"), fsm::FSM_SUCCESS);
+        EXPECT_TRUE(regex.Match("]a]"));
+        EXPECT_FALSE(regex.Match("]b"));
+    }
+
+    TEST_F(FsmRegexTest, StateLimit)
+    {
+        //(a|b)*a(a|b){n} 的DFA需要2^n个状态
+        std::string pattern = "a";
+        for (int i = 0; i < 12; ++i)
+        {
+            pattern += "[ab]";
+        }
+        pattern += "$";
+        fsm::RegexDfa regex;
+        EXPECT_EQ(regex.Compile(pattern, 1000), fsm::FSM_STATE_LIMIT_EXCEEDED);
+        EXPECT_EQ(regex.Compile(pattern), fsm::FSM_SUCCESS);
+    }
+}
@@ -0,0 +1,243 @@
+
+#include <googletest-1.10.0/include/gtest/gtest.h>
+#include <fsm_replay.hpp>
+
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+
+namespace
+{
+    class FsmReplayTest : public testing::Test
+    {
+    protected:
+
+        enum class States
+        {
+            INITIAL,
+            CONNECTED,
+            CLOSED
+        };
+
+        enum class Triggers
+        {
+            CONNECT,
+            CLOSE,
+            PING
+        };
+
+        void SetUp() override
+        {
+            definition_.AddTransitions({
+                { States::INITIAL, States::CONNECTED, Triggers::CONNECT, nullptr, nullptr },
+                { States::CONNECTED, States::CLOSED, Triggers::CLOSE, nullptr, nullptr },
+                { States::CONNECTED, States::CONNECTED, Triggers::PING, nullptr, nullptr },
+                { States::CLOSED, States::CONNECTED, Triggers::CONNECT, nullptr, nullptr },
+            });
+        }
+
+        std::string TempPath(const char* name) const
+        {
+            return testing::TempDir() + name;
+        }
+
+        using F = fsm::Fsm<States, States::INITIAL, Triggers>;
+        using Fleet = fsm::FsmFleet<States, States::INITIAL, Triggers>;
+        using Log = fsm::TriggerLog<Triggers>;
+        F definition_;
+    };
+
+    //录制单个状态机, 相邻记录差值很小时每条2字节
+    TEST_F(FsmReplayTest, RecordSingleMachine)
+    {
+        Log log;
+        F machine(definition_);
+        fsm::TriggerRecorder<F, Triggers> recorder(machine, log, 7);
+        EXPECT_EQ(recorder.Execute(Triggers::CONNECT), fsm::FSM_SUCCESS);
+        EXPECT_EQ(recorder.Execute(Triggers::PING), fsm::FSM_SUCCESS);
+        EXPECT_EQ(recorder.Execute(Triggers::CONNECT), fsm::FSM_NO_MATCHING_TRIGGER);
+        recorder.Enable(false);
+        EXPECT_EQ(recorder.Execute(Triggers::CLOSE), fsm::FSM_SUCCESS);
+        EXPECT_EQ(machine.GetState(), States::CLOSED);
+
+        ASSERT_EQ(log.Size(), 3u);
+        EXPECT_EQ(log.ByteSize(), 6u);
+        std::vector<fsm::InstanceId> ids;
+        std::vector<Triggers> triggers;
+        log.Decode(ids, triggers);
+        EXPECT_EQ(ids, std::vector<fsm::InstanceId>({ 7, 7, 7 }));
+        EXPECT_EQ(triggers, std::vector<Triggers>({ Triggers::CONNECT, Triggers::PING, Triggers::CONNECT }));
+    }
+
+    //差值为负数或很大的实例号、触发器序号都能还原
+    TEST_F(FsmReplayTest, DeltaEncodingRoundTrip)
+    {
+        fsm::TriggerLog<int64_t> log;
+        std::vector<fsm::InstanceId> ids = { 0, 1000000, 3, 0xFFFFFFFFu, 0, 42 };
+        std::vector<int64_t> triggers = { -1, std::numeric_limits<int64_t>::max(), std::numeric_limits<int64_t>::min(), 0, 5, -5 };
+        for (size_t i = 0; i < ids.size(); ++i)
+        {
+            log.Append(ids[i], triggers[i]);
+        }
+
+        std::vector<fsm::InstanceId> decoded_ids;
+        std::vector<int64_t> decoded_triggers;
+        log.Decode(decoded_ids, decoded_triggers);
+        EXPECT_EQ(decoded_ids, ids);
+        EXPECT_EQ(decoded_triggers, triggers);
+    }
+
+    //写入文件再读回, 读回后可以继续追加
+    TEST_F(FsmReplayTest, SaveLoad)
+    {
+        Log log;
+        std::mt19937 rng(5);
+        for (int32_t i = 0; i < 10000; ++i)
+        {
+            log.Append(static_cast<fsm::InstanceId>(rng() % 100), static_cast<Triggers>(rng() % 3));
+        }
+        std::string path = TempPath("fsm_replay_saveload.log");
+        ASSERT_EQ(log.Save(path.c_str()), fsm::FSM_SUCCESS);
+
+        Log loaded;
+        ASSERT_EQ(loaded.Load(path.c_str()), fsm::FSM_SUCCESS);
+        EXPECT_EQ(loaded.Size(), log.Size());
+        EXPECT_EQ(loaded.ByteSize(), log.ByteSize());
+
+        log.Append(3, Triggers::PING);
+        loaded.Append(3, Triggers::PING);
+        std::vector<fsm::InstanceId> ids_a, ids_b;
+        std::vector<Triggers> triggers_a, triggers_b;
+        log.Decode(ids_a, triggers_a);
+        loaded.Decode(ids_b, triggers_b);
+        EXPECT_EQ(ids_a, ids_b);
+        EXPECT_EQ(triggers_a, triggers_b);
+        remove(path.c_str());
+    }
+
+    TEST_F(FsmReplayTest, LoadErrors)
+    {
+        Log log;
+        EXPECT_EQ(log.Load(TempPath("fsm_replay_missing.log").c_str()), fsm::FSM_IO_ERROR);
+
+        Log source;
+        for (uint32_t i = 0; i < 100; ++i)
+        {
+            source.Append(i * 1000, Triggers::PING);
+        }
+        std::string path = TempPath("fsm_replay_truncated.log");
+        ASSERT_EQ(source.Save(path.c_str()), fsm::FSM_SUCCESS);
+
+        //截断最后一个字节
+        FILE* file = fopen(path.c_str(), "rb");
+        ASSERT_NE(file, nullptr);
+        std::vector<char> content(1 << 16);
+        size_t size = fread(content.data(), 1, content.size(), file);
+        fclose(file);
+        file = fopen(path.c_str(), "wb");
+        ASSERT_NE(file, nullptr);
+        fwrite(content.data(), 1, size - 1, file);
+        fclose(file);
+
+        log.Append(1, Triggers::CLOSE);
+        EXPECT_EQ(log.Load(path.c_str()), fsm::FSM_IO_ERROR);
+        EXPECT_EQ(log.Size(), 1u);
+
+        //头部记录的长度远大于文件: 不按它分配内存, 直接报告错误
+        size_t header = 0;
+        for (size_t h = 8; h < 64 && header == 0; ++h)
+        {
+            uint64_t recorded = 0;
+            memcpy(&recorded, content.data() + h - 8, sizeof(recorded));
+            header = recorded == size - h ? h : 0;
+        }
+        ASSERT_NE(header, 0u);
+        std::vector<char> corrupt(content.begin(), content.begin() + static_cast<std::ptrdiff_t>(size));
+        uint64_t huge = uint64_t(1) << 40;
+        memcpy(corrupt.data() + header - 8, &huge, sizeof(huge));
+        file = fopen(path.c_str(), "wb");
+        ASSERT_NE(file, nullptr);
+        fwrite(corrupt.data(), 1, corrupt.size(), file);
+        fclose(file);
+        EXPECT_EQ(log.Load(path.c_str()), fsm::FSM_IO_ERROR);
+        EXPECT_EQ(log.Size(), 1u);
+
+        //破坏魔数
+        content[0] = 'X';
+        file = fopen(path.c_str(), "wb");
+        ASSERT_NE(file, nullptr);
+        fwrite(content.data(), 1, size, file);
+        fclose(file);
+        EXPECT_EQ(log.Load(path.c_str()), fsm::FSM_IO_ERROR);
+        remove(path.c_str());
+    }
+
+    //录制实例集合的流量, 回放到另一个实例集合得到相同的状态分布
+    TEST_F(FsmReplayTest, RecordFleetAndReplay)
+    {
+        Fleet fleet(definition_);
+        Log log;
+        fsm::TriggerRecorder<Fleet, Triggers> recorder(fleet, log);
+        std::vector<fsm::InstanceId> ids;
+        for (int32_t i = 0; i < 64; ++i)
+        {
+            ids.push_back(fleet.Add());
+        }
+        std::mt19937 rng(11);
+        size_t rejected = 0;
+        for (int32_t i = 0; i < 5000; ++i)
+        {
+            if (recorder.Execute(ids[rng() % ids.size()], static_cast<Triggers>(rng() % 3)) != fsm::FSM_SUCCESS)
+            {
+                ++rejected;
+            }
+        }
+        ASSERT_EQ(log.Size(), 5000u);
+
+        Fleet replica(definition_);
+        for (size_t i = 0; i < ids.size(); ++i)
+        {
+            replica.Add();
+        }
+        fsm::ReplayOptions options;
+        options.latency_stride = 10;
+        fsm::ReplayStats stats = fsm::ReplayTriggers(log, [&](fsm::InstanceId id, Triggers trigger)
+        {
+            return replica.Execute(id, trigger);
+        }, options);
+
+        EXPECT_EQ(stats.events, 5000u);
+        EXPECT_EQ(stats.rejected, rejected);
+        EXPECT_EQ(stats.latency_samples, 500u);
+        EXPECT_LE(stats.p50, stats.p99);
+        EXPECT_LE(stats.p99, stats.max);
+        for (States state : { States::INITIAL, States::CONNECTED, States::CLOSED })
+        {
+            EXPECT_EQ(replica.Count(state), fleet.Count(state));
+        }
+    }
+
+    //重复回放, 不统计延迟
+    TEST_F(FsmReplayTest, ReplayRepeat)
+    {
+        Log log;
+        log.Append(0, Triggers::CONNECT);
+        log.Append(0, Triggers::PING);
+        log.Append(0, Triggers::CLOSE);
+
+        F machine(definition_);
+        fsm::ReplayOptions options;
+        options.repeat = 4;
+        options.latency_stride = 0;
+        fsm::ReplayStats stats = fsm::ReplayTriggers(log, [&](fsm::InstanceId, Triggers trigger)
+        {
+            return machine.Execute(trigger);
+        }, options);
+
+        EXPECT_EQ(stats.events, 12u);
+        EXPECT_EQ(stats.rejected, 0u);
+        EXPECT_EQ(stats.latency_samples, 0u);
+        EXPECT_EQ(machine.GetState(), States::CLOSED);
+    }
+}
@@ -0,0 +1,227 @@
+
+#include <googletest-1.10.0/include/gtest/gtest.h>
+#include <fsm_scheduler.hpp>
+
+#include <queue>
+#include <random>
+#include <tuple>
+
+namespace
+{
+    enum class States
+    {
+        IDLE,
+        RUNNING,
+        DONE
+    };
+
+    enum class Triggers
+    {
+        START,
+        TICK,
+        STOP
+    };
+
+    using F = fsm::Fsm<States, States::IDLE, Triggers>;
+
+    //与按(时间, 入队序号)排序的优先队列对比, 覆盖扩容、缩容和时间跨度很大的事件
+    TEST(CalendarQueueTest, MatchesPriorityQueue)
+    {
+        using Entry = std::tuple<uint64_t, uint64_t, uint32_t>;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> reference;
+        fsm::CalendarQueue<uint32_t> queue;
+        std::mt19937_64 rng(7);
+
+        uint64_t now = 0;
+        uint64_t sequence = 0;
+        uint32_t payload = 0;
+        for (int32_t round = 0; round < 40; ++round)
+        {
+            //交替进行大量入队和大量出队
+            size_t pushes = static_cast<size_t>(rng() % 3000);
+            uint64_t spread = (round % 5 == 0) ? 1000000u : 64u;
+            for (size_t i = 0; i < pushes; ++i)
+            {
+                uint64_t time = now + rng() % spread;
+                queue.Push(time, payload);
+                reference.emplace(time, sequence++, payload);
+                ++payload;
+            }
+            size_t pops = static_cast<size_t>(rng() % 3000);
+            for (size_t i = 0; i < pops && !reference.empty(); ++i)
+            {
+                uint64_t time = 0;
+                uint32_t value = 0;
+                ASSERT_TRUE(queue.Pop(time, value));
+                ASSERT_EQ(time, std::get<0>(reference.top()));
+                ASSERT_EQ(value, std::get<2>(reference.top()));
+                reference.pop();
+                now = time;
+            }
+            ASSERT_EQ(queue.Size(), reference.size());
+        }
+
+        while (!reference.empty())
+        {
+            uint64_t time = 0;
+            uint32_t value = 0;
+            ASSERT_TRUE(queue.Pop(time, value));
+            ASSERT_EQ(value, std::get<2>(reference.top()));
+            reference.pop();
+        }
+        uint64_t time = 0;
+        uint32_t value = 0;
+        EXPECT_FALSE(queue.Pop(time, value));
+        EXPECT_TRUE(queue.Empty());
+    }
+
+    //早于当前扫描位置的事件仍然先出队
+    TEST(CalendarQueueTest, PushBeforeCurrent)
+    {
+        fsm::CalendarQueue<int32_t> queue;
+        queue.Push(1000, 1);
+        queue.Push(2000, 2);
+
+        uint64_t time = 0;
+        int32_t value = 0;
+        ASSERT_TRUE(queue.PeekTime(time));
+        EXPECT_EQ(time, 1000u);
+        queue.Push(10, 0);
+        ASSERT_TRUE(queue.Pop(time, value));
+        EXPECT_EQ(time, 10u);
+        EXPECT_EQ(value, 0);
+        ASSERT_TRUE(queue.Pop(time, value));
+        EXPECT_EQ(value, 1);
+        ASSERT_TRUE(queue.Pop(time, value));
+        EXPECT_EQ(value, 2);
+    }
+
+    class EventSchedulerTest : public testing::Test
+    {
+    protected:
+        void SetUp() override
+        {
+            definition_.AddTransitions({
+                { States::IDLE, States::RUNNING, Triggers::START, nullptr, nullptr },
+                { States::RUNNING, States::RUNNING, Triggers::TICK, nullptr, nullptr },
+                { States::RUNNING, States::DONE, Triggers::STOP, nullptr, nullptr },
+            });
+        }
+
+        F definition_;
+    };
+
+    //同一时刻的事件按实例分组送达, 实例内保持调度顺序
+    TEST_F(EventSchedulerTest, BatchPerInstance)
+    {
+        std::vector<std::pair<uint64_t, int32_t>> log;
+        F a;
+        F b;
+        a.AddTransitions({
+            { States::IDLE, States::RUNNING, Triggers::START, nullptr, [&] { log.emplace_back(0, 0); } },
+            { States::RUNNING, States::DONE, Triggers::STOP, nullptr, [&] { log.emplace_back(0, 1); } },
+        });
+        b.AddTransitions({
+            { States::IDLE, States::RUNNING, Triggers::START, nullptr, [&] { log.emplace_back(1, 0); } },
+            { States::RUNNING, States::DONE, Triggers::STOP, nullptr, [&] { log.emplace_back(1, 1); } },
+        });
+
+        fsm::EventScheduler<F, Triggers> scheduler;
+        fsm::InstanceId ia = scheduler.Attach(a);
+        fsm::InstanceId ib = scheduler.Attach(b);
+        scheduler.Schedule(5, ib, Triggers::START);
+        scheduler.Schedule(5, ia, Triggers::START);
+        scheduler.Schedule(5, ib, Triggers::STOP);
+        scheduler.Schedule(5, ia, Triggers::STOP);
+
+        EXPECT_EQ(scheduler.Step(), 4u);
+        EXPECT_EQ(scheduler.Now(), 5u);
+        std::vector<std::pair<uint64_t, int32_t>> expected = { { 0, 0 }, { 0, 1 }, { 1, 0 }, { 1, 1 } };
+        EXPECT_EQ(log, expected);
+        EXPECT_EQ(a.GetState(), States::DONE);
+        EXPECT_EQ(b.GetState(), States::DONE);
+        EXPECT_EQ(scheduler.Step(), 0u);
+    }
+
+    //action中调度之后的触发器
+    TEST_F(EventSchedulerTest, ActionsScheduleFutureTriggers)
+    {
+        fsm::EventScheduler<F, Triggers> scheduler;
+        std::vector<uint64_t> ticks;
+        F machine;
+        machine.AddTransitions({
+            { States::IDLE, States::RUNNING, Triggers::START, nullptr, [&] {
+                scheduler.ScheduleAfter(10, scheduler.CurrentInstance(), Triggers::TICK);
+            } },
+            { States::RUNNING, States::RUNNING, Triggers::TICK, nullptr, [&] {
+                ticks.push_back(scheduler.Now());
+                scheduler.ScheduleAfter(10, scheduler.CurrentInstance(), ticks.size() < 3 ? Triggers::TICK : Triggers::STOP);
+            } },
+            { States::RUNNING, States::DONE, Triggers::STOP, nullptr, nullptr },
+        });
+        fsm::InstanceId id = scheduler.Attach(machine);
+        scheduler.Schedule(100, id, Triggers::START);
+
+        EXPECT_EQ(scheduler.RunUntil(125), 3u);
+        EXPECT_EQ(scheduler.Now(), 125u);
+        EXPECT_EQ(machine.GetState(), States::RUNNING);
+        EXPECT_EQ(scheduler.Pending(), 1u);
+
+        EXPECT_EQ(scheduler.RunAll(), 2u);
+        EXPECT_EQ(machine.GetState(), States::DONE);
+        std::vector<uint64_t> expected = { 110, 120, 130 };
+        EXPECT_EQ(ticks, expected);
+        EXPECT_EQ(scheduler.Now(), 140u);
+        EXPECT_EQ(scheduler.CurrentInstance(), fsm::kInvalidInstanceId);
+    }
+
+    //调度到过去的事件按当前时刻送达, 失败的触发器交给RejectFn
+    TEST_F(EventSchedulerTest, PastEventsAndRejects)
+    {
+        fsm::EventScheduler<F, Triggers> scheduler;
+        std::vector<fsm::FsmErrors> rejects;
+        scheduler.SetRejectFn([&](uint64_t time, fsm::InstanceId, Triggers trigger, fsm::FsmErrors err_code) {
+            EXPECT_EQ(time, 50u);
+            EXPECT_EQ(trigger, Triggers::STOP);
+            rejects.push_back(err_code);
+        });
+
+        F machine(definition_);
+        fsm::InstanceId id = scheduler.Attach(machine);
+        scheduler.RunUntil(50);
+        scheduler.Schedule(10, id, Triggers::STOP);
+        EXPECT_EQ(scheduler.RunAll(), 1u);
+        ASSERT_EQ(rejects.size(), 1u);
+        EXPECT_EQ(rejects[0], fsm::FSM_NO_MATCHING_TRIGGER);
+    }
+
+    //大量实例、大量事件
+    TEST_F(EventSchedulerTest, ManyInstances)
+    {
+        const size_t kInstances = 1000;
+        std::vector<F> machines(kInstances, definition_);
+        fsm::EventScheduler<F, Triggers> scheduler;
+        std::mt19937 rng(3);
+        for (F& machine : machines)
+        {
+            fsm::InstanceId id = scheduler.Attach(machine);
+            uint64_t start = rng() % 1000;
+            scheduler.Schedule(start, id, Triggers::START);
+            for (uint64_t i = 1; i <= 50; ++i)
+            {
+                scheduler.Schedule(start + i * (1 + rng() % 7), id, Triggers::TICK);
+            }
+            scheduler.Schedule(start + 1000, id, Triggers::STOP);
+        }
+        EXPECT_EQ(scheduler.Pending(), kInstances * 52);
+
+        size_t rejected = 0;
+        scheduler.SetRejectFn([&](uint64_t, fsm::InstanceId, Triggers, fsm::FsmErrors) { ++rejected; });
+        EXPECT_EQ(scheduler.RunAll(), kInstances * 52);
+        EXPECT_EQ(rejected, 0u);
+        for (const F& machine : machines)
+        {
+            EXPECT_EQ(machine.GetState(), States::DONE);
+        }
+    }
+}
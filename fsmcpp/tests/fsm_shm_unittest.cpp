@@ -0,0 +1,276 @@
+
+#include <googletest-1.10.0/include/gtest/gtest.h>
+#include <fsm_shm.hpp>
+
+#include <sys/wait.h>
+
+#include <random>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    enum class States
+    {
+        IDLE,
+        A,
+        B,
+        C
+    };
+
+    enum class Triggers
+    {
+        NEXT,
+        JUMP,
+        CRASH
+    };
+
+    using Table = fsm::ShmFsmTable<States, States::IDLE, Triggers>;
+
+    const uint32_t kGuardAllowJump = 1;
+    const uint32_t kActionCount = 1;
+    const uint32_t kActionCrash = 2;
+
+    //IDLE -> A -> B -> C -> A 循环; JUMP由guard控制; CRASH的action使进程退出
+    std::vector<Table::Trans> Definition()
+    {
+        return {
+            { States::IDLE, States::A, Triggers::NEXT, 0, kActionCount },
+            { States::A, States::B, Triggers::NEXT, 0, kActionCount },
+            { States::B, States::C, Triggers::NEXT, 0, kActionCount },
+            { States::C, States::A, Triggers::NEXT, 0, kActionCount },
+            { States::A, States::C, Triggers::JUMP, kGuardAllowJump, 0 },
+            { States::A, States::B, Triggers::JUMP, 0, 0, fsm::MaskGuard{ 1, 0 }, -1 },
+            { States::A, States::C, Triggers::CRASH, 0, kActionCrash },
+        };
+    }
+
+    //子进程中运行fn, 返回退出码
+    template <typename Fn>
+    int32_t RunChild(Fn&& fn)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            _exit(fn());
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    }
+
+    TEST(ShmFsmTableTest, ExecuteWithRegistries)
+    {
+        Table table;
+        ASSERT_EQ(table.CreateAnonymous(Definition(), 4), fsm::FSM_SUCCESS);
+        int32_t count = 0;
+        bool allow = false;
+        table.SetAction(kActionCount, [&](fsm::InstanceId) { ++count; });
+        table.SetGuard(kGuardAllowJump, [&](fsm::InstanceId) { return allow; });
+
+        fsm::InstanceId id = table.Add();
+        ASSERT_NE(id, fsm::kInvalidInstanceId);
+        EXPECT_EQ(table.GetState(id), States::IDLE);
+        EXPECT_EQ(table.Execute(id, Triggers::NEXT), fsm::FSM_SUCCESS);
+        EXPECT_EQ(table.GetState(id), States::A);
+        EXPECT_EQ(count, 1);
+        EXPECT_EQ(table.Generation(id), 1u);
+
+        //guard不通过, 位掩码guard也不通过: 触发器匹配但状态不变
+        EXPECT_EQ(table.Execute(id, Triggers::JUMP), fsm::FSM_SUCCESS);
+        EXPECT_EQ(table.GetState(id), States::A);
+        EXPECT_EQ(table.Generation(id), 1u);
+        //位掩码guard通过, 选取优先级较低的转换
+        EXPECT_EQ(table.Execute(id, Triggers::JUMP, 1), fsm::FSM_SUCCESS);
+        EXPECT_EQ(table.GetState(id), States::B);
+
+        table.Reset(id, States::A);
+        allow = true;
+        EXPECT_EQ(table.Execute(id, Triggers::JUMP, 1), fsm::FSM_SUCCESS);
+        EXPECT_EQ(table.GetState(id), States::C);
+        EXPECT_EQ(table.Execute(id, Triggers::JUMP), fsm::FSM_NO_MATCHING_TRIGGER);
+
+        EXPECT_NE(table.Add(States::B), fsm::kInvalidInstanceId);
+        EXPECT_NE(table.Add(), fsm::kInvalidInstanceId);
+        EXPECT_NE(table.Add(), fsm::kInvalidInstanceId);
+        EXPECT_EQ(table.Add(), fsm::kInvalidInstanceId);
+        EXPECT_EQ(table.Size(), 4u);
+        EXPECT_EQ(table.GetState(1), States::B);
+    }
+
+    //没有在本进程注册的guard视为不通过
+    TEST(ShmFsmTableTest, UnregisteredGuard)
+    {
+        Table table;
+        ASSERT_EQ(table.CreateAnonymous(Definition(), 1), fsm::FSM_SUCCESS);
+        fsm::InstanceId id = table.Add(States::A);
+        EXPECT_EQ(table.Execute(id, Triggers::JUMP), fsm::FSM_SUCCESS);
+        EXPECT_EQ(table.GetState(id), States::A);
+    }
+
+    //命名段: 同一进程中的两次映射地址不同, 看到同一份实例
+    TEST(ShmFsmTableTest, NamedSegment)
+    {
+        std::string name = "/fsm_shm_test_" + std::to_string(getpid());
+        Table::Unlink(name.c_str());
+
+        Table missing;
+        EXPECT_EQ(missing.Open(name.c_str()), fsm::FSM_IO_ERROR);
+
+        Table creator;
+        ASSERT_EQ(creator.Create(name.c_str(), Definition(), 16), fsm::FSM_SUCCESS);
+        Table duplicate;
+        EXPECT_EQ(duplicate.Create(name.c_str(), Definition(), 16), fsm::FSM_IO_ERROR);
+
+        Table opener;
+        ASSERT_EQ(opener.Open(name.c_str()), fsm::FSM_SUCCESS);
+        EXPECT_EQ(opener.StateCount(), 4u);
+        EXPECT_EQ(opener.Capacity(), 16u);
+
+        fsm::InstanceId id = creator.Add();
+        EXPECT_EQ(opener.Size(), 1u);
+        EXPECT_EQ(opener.Execute(id, Triggers::NEXT), fsm::FSM_SUCCESS);
+        EXPECT_EQ(creator.GetState(id), States::A);
+
+        //其他进程打开同一个段
+        EXPECT_EQ(RunChild([&]
+        {
+            Table child;
+            if (child.Open(name.c_str()) != fsm::FSM_SUCCESS)
+            {
+                return 1;
+            }
+            return child.Execute(id, Triggers::NEXT) == fsm::FSM_SUCCESS ? 0 : 2;
+        }), 0);
+        EXPECT_EQ(opener.GetState(id), States::B);
+
+        EXPECT_EQ(Table::Unlink(name.c_str()), fsm::FSM_SUCCESS);
+        EXPECT_EQ(creator.GetState(id), States::B);
+    }
+
+    //多个进程并发执行, 同一实例上的转换串行
+    TEST(ShmFsmTableTest, ConcurrentProcesses)
+    {
+        const uint32_t kInstances = 8;
+        const int32_t kProcesses = 4;
+        const int32_t kSteps = 5000;
+        Table table;
+        ASSERT_EQ(table.CreateAnonymous(Definition(), kInstances), fsm::FSM_SUCCESS);
+        for (uint32_t i = 0; i < kInstances; ++i)
+        {
+            table.Add(States::A);
+        }
+
+        std::vector<pid_t> children;
+        for (int32_t p = 0; p < kProcesses; ++p)
+        {
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                std::mt19937 rng(static_cast<uint32_t>(p));
+                for (int32_t i = 0; i < kSteps; ++i)
+                {
+                    if (table.Execute(static_cast<fsm::InstanceId>(rng() % kInstances), Triggers::NEXT) != fsm::FSM_SUCCESS)
+                    {
+                        _exit(1);
+                    }
+                }
+                _exit(0);
+            }
+            children.push_back(pid);
+        }
+        for (pid_t pid : children)
+        {
+            int status = 0;
+            waitpid(pid, &status, 0);
+            EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        }
+
+        uint64_t total = 0;
+        const States cycle[] = { States::A, States::B, States::C };
+        for (uint32_t i = 0; i < kInstances; ++i)
+        {
+            total += table.Generation(i);
+            EXPECT_EQ(table.GetState(i), cycle[table.Generation(i) % 3]);
+        }
+        EXPECT_EQ(total, static_cast<uint64_t>(kProcesses * kSteps));
+    }
+
+    //action抛出异常时实例回到转换前的状态并被释放
+    TEST(ShmFsmTableTest, ThrowingActionReleasesInstance)
+    {
+        Table table;
+        ASSERT_EQ(table.CreateAnonymous(Definition(), 1), fsm::FSM_SUCCESS);
+        bool fail = true;
+        table.SetAction(kActionCount, [&](fsm::InstanceId) {
+            if (fail)
+            {
+                throw std::runtime_error("action failed");
+            }
+        });
+        fsm::InstanceId id = table.Add();
+        EXPECT_THROW(table.Execute(id, Triggers::NEXT), std::runtime_error);
+        EXPECT_EQ(table.GetState(id), States::IDLE);
+        EXPECT_EQ(table.Generation(id), 0u);
+
+        //实例已经释放, 其他进程可以继续执行, 前滚恢复也不会进入异常转换的目标状态
+        fail = false;
+        EXPECT_EQ(RunChild([&] { return table.Execute(id, Triggers::NEXT) == fsm::FSM_SUCCESS ? 0 : 1; }), 0);
+        EXPECT_EQ(table.GetState(id), States::A);
+        EXPECT_EQ(table.Recover(fsm::SHM_RECOVER_ROLL_FORWARD), 0u);
+    }
+
+    //子进程在action中退出, 实例停留在转换中
+    class ShmCrashTest : public testing::Test
+    {
+    protected:
+        void SetUp() override
+        {
+            ASSERT_EQ(table_.CreateAnonymous(Definition(), 2), fsm::FSM_SUCCESS);
+            table_.SetAction(kActionCrash, [](fsm::InstanceId) { _exit(0); });
+            id_ = table_.Add(States::A);
+            ASSERT_EQ(RunChild([&] { table_.Execute(id_, Triggers::CRASH); return 1; }), 0);
+            EXPECT_EQ(table_.GetState(id_), States::A);
+        }
+
+        Table table_;
+        fsm::InstanceId id_ = fsm::kInvalidInstanceId;
+    };
+
+    TEST_F(ShmCrashTest, RecoverRollback)
+    {
+        EXPECT_EQ(table_.Recover(fsm::SHM_RECOVER_ROLLBACK), 1u);
+        EXPECT_EQ(table_.GetState(id_), States::A);
+        EXPECT_EQ(table_.Recover(fsm::SHM_RECOVER_ROLLBACK), 0u);
+        EXPECT_EQ(table_.Execute(id_, Triggers::NEXT), fsm::FSM_SUCCESS);
+        EXPECT_EQ(table_.GetState(id_), States::B);
+    }
+
+    TEST_F(ShmCrashTest, RecoverRollForward)
+    {
+        EXPECT_EQ(table_.Recover(fsm::SHM_RECOVER_ROLL_FORWARD), 1u);
+        EXPECT_EQ(table_.GetState(id_), States::C);
+    }
+
+    //回滚后target等于当前状态: 之后在guard中崩溃(尚未记录目标)时前滚也停留在原状态
+    TEST_F(ShmCrashTest, RollForwardAfterRollback)
+    {
+        EXPECT_EQ(table_.Recover(fsm::SHM_RECOVER_ROLLBACK), 1u);
+        ASSERT_EQ(RunChild([&] {
+            table_.SetGuard(kGuardAllowJump, [](fsm::InstanceId) -> bool { _exit(0); });
+            table_.Execute(id_, Triggers::JUMP);
+            return 1;
+        }), 0);
+        EXPECT_EQ(table_.Recover(fsm::SHM_RECOVER_ROLL_FORWARD), 1u);
+        EXPECT_EQ(table_.GetState(id_), States::A);
+    }
+
+    //等待实例的进程发现认领者已经退出, 按设置的策略恢复后继续执行
+    TEST_F(ShmCrashTest, ExecuteRecoversInline)
+    {
+        table_.SetRecoveryPolicy(fsm::SHM_RECOVER_ROLL_FORWARD);
+        EXPECT_EQ(table_.Execute(id_, Triggers::NEXT), fsm::FSM_SUCCESS);
+        EXPECT_EQ(table_.GetState(id_), States::A);
+        EXPECT_EQ(table_.Recover(fsm::SHM_RECOVER_ROLLBACK), 0u);
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <atomic>
+
+//测试用的线程创建失败注入
+//测试程序自己定义pthread_create, 覆盖C库中的版本; ThreadLimit存在期间只允许再创建limit个线程,
+//之后的pthread_create返回EAGAIN, std::thread的构造函数随之抛出std::system_error
+//每个测试程序只能有一个源文件包含本文件
+
+namespace fsm_test
+{
+    //剩余可以创建的线程数, 负数表示不限制
+    inline std::atomic<int>& ThreadBudget()
+    {
+        static std::atomic<int> budget(-1);
+        return budget;
+    }
+
+    class ThreadLimit
+    {
+    public:
+        explicit ThreadLimit(int limit)
+        {
+            ThreadBudget().store(limit);
+        }
+
+        ThreadLimit(const ThreadLimit&) = delete;
+        ThreadLimit& operator=(const ThreadLimit&) = delete;
+
+        ~ThreadLimit()
+        {
+            ThreadBudget().store(-1);
+        }
+    };
+}
+
+extern "C" int pthread_create(pthread_t* thread, const pthread_attr_t* attr, void* (*start)(void*), void* arg)
+{
+    using CreateFn = int (*)(pthread_t*, const pthread_attr_t*, void* (*)(void*), void*);
+    static CreateFn real = reinterpret_cast<CreateFn>(dlsym(RTLD_NEXT, "pthread_create"));
+
+    std::atomic<int>& budget = fsm_test::ThreadBudget();
+    for (int left = budget.load(); left >= 0;)
+    {
+        if (left == 0)
+        {
+            return EAGAIN;
+        }
+        if (budget.compare_exchange_weak(left, left - 1))
+        {
+            break;
+        }
+    }
+    return real(thread, attr, start, arg);
+}
@@ -0,0 +1,116 @@
+
+#include <googletest-1.10.0/include/gtest/gtest.h>
+#include <fsm_trigger_set.hpp>
+
+namespace
+{
+    class TriggerBitsetsTest : public testing::Test
+    {
+    protected:
+
+        enum class States
+        {
+            INITIAL,
+            OPENED,
+            CLOSED
+        };
+
+        enum class Triggers : uint8_t
+        {
+            OPEN = 1,
+            DATA = 7,
+            CLOSE = 40,
+            RESET = 200
+        };
+
+        void SetUp() override
+        {
+            test_fsm_.AddTransitions({
+                { States::INITIAL, States::OPENED, Triggers::OPEN, [this] { guard_calls_++; return true; }, nullptr },
+                { States::OPENED, States::OPENED, Triggers::DATA, nullptr, nullptr },
+                { States::OPENED, States::CLOSED, Triggers::CLOSE, nullptr, nullptr },
+                { States::OPENED, States::INITIAL, Triggers::RESET, nullptr, nullptr },
+            });
+            ASSERT_EQ(bitsets_.Build(test_fsm_), fsm::FSM_SUCCESS);
+        }
+
+        using F = fsm::Fsm<States, States::INITIAL, Triggers>;
+        F test_fsm_;
+        fsm::TriggerBitsets<States, States::INITIAL, Triggers> bitsets_;
+        int32_t guard_calls_ = 0;
+    };
+
+    //查询不调用guard, 也不改变状态
+    TEST_F(TriggerBitsetsTest, CanFire)
+    {
+        EXPECT_TRUE(bitsets_.CanFire(States::INITIAL, Triggers::OPEN));
+        EXPECT_FALSE(bitsets_.CanFire(States::INITIAL, Triggers::DATA));
+        EXPECT_TRUE(bitsets_.CanFire(States::OPENED, Triggers::RESET));
+        EXPECT_FALSE(bitsets_.CanFire(States::OPENED, Triggers::OPEN));
+        //伪最终状态没有有效触发器
+        EXPECT_FALSE(bitsets_.CanFire(States::CLOSED, Triggers::OPEN));
+        EXPECT_EQ(guard_calls_, 0);
+        EXPECT_TRUE(test_fsm_.IsInitial());
+    }
+
+    TEST_F(TriggerBitsetsTest, AvailableTriggers)
+    {
+        auto opened = bitsets_.AvailableTriggers(States::OPENED);
+        EXPECT_EQ(opened.Count(), 3u);
+        std::vector<Triggers> expected = { Triggers::DATA, Triggers::CLOSE, Triggers::RESET };
+        EXPECT_EQ(opened.ToVector(), expected);
+
+        EXPECT_TRUE(bitsets_.AvailableTriggers(States::CLOSED).Empty());
+    }
+
+    //批量过滤, 覆盖SIMD主循环与标量尾部
+    TEST_F(TriggerBitsetsTest, FilterValid)
+    {
+        std::vector<Triggers> input;
+        std::vector<Triggers> expected;
+        for (int32_t i = 0; i < 1000; ++i)
+        {
+            //包含定义中没有出现过的序号, 包括超出位集范围的序号
+            Triggers trigger = static_cast<Triggers>((i * 37) % 256);
+            input.push_back(trigger);
+            if (trigger == Triggers::DATA || trigger == Triggers::CLOSE || trigger == Triggers::RESET)
+            {
+                expected.push_back(trigger);
+            }
+        }
+        EXPECT_EQ(bitsets_.FilterValid(States::OPENED, input), expected);
+
+        //原地过滤
+        size_t valid = bitsets_.FilterValid(States::OPENED, input.data(), input.size(), input.data());
+        input.resize(valid);
+        EXPECT_EQ(input, expected);
+
+        EXPECT_TRUE(bitsets_.FilterValid(States::CLOSED, expected).empty());
+    }
+
+    TEST(TriggerBitsetsRangeTest, OutOfRange)
+    {
+        enum class States
+        {
+            INITIAL,
+            FINAL
+        };
+        fsm::Fsm<States, States::INITIAL, int32_t> test_fsm;
+        test_fsm.AddTransitions({
+            { States::INITIAL, States::FINAL, 1 << 20, nullptr, nullptr },
+        });
+        fsm::TriggerBitsets<States, States::INITIAL, int32_t> bitsets;
+        EXPECT_EQ(bitsets.Build(test_fsm), fsm::FSM_TRIGGER_OUT_OF_RANGE);
+
+        //负数按无符号序号解释, 超出范围的查询结果为false
+        fsm::Fsm<States, States::INITIAL, int32_t> negative_fsm;
+        negative_fsm.AddTransitions({
+            { States::INITIAL, States::FINAL, 3, nullptr, nullptr },
+        });
+        ASSERT_EQ(bitsets.Build(negative_fsm), fsm::FSM_SUCCESS);
+        EXPECT_FALSE(bitsets.CanFire(States::INITIAL, -1));
+        std::vector<int32_t> input = { -1, 3, 1 << 30, 3, 2 };
+        std::vector<int32_t> expected = { 3, 3 };
+        EXPECT_EQ(bitsets.FilterValid(States::INITIAL, input), expected);
+    }
+}
@@ -2,6 +2,8 @@
 #include <googletest-1.10.0/include/gtest/gtest.h>
 #include <fsmcpp.hpp>
 #include <array>
+#include <iterator>
+#include <vector>
 
 namespace
 {
@@ -283,4 +285,158 @@ namespace
         test_fsm.Execute(Triggers::A);
         EXPECT_EQ(res, 43);
     }
-}
\ No newline at end of file
+
+    //测试位掩码guard
+    TEST(FsmTest, MaskGuards)
+    {
+        enum class States
+        {
+            INITIAL,
+            A,
+            B
+        };
+        enum Flags : fsm::GuardFlags
+        {
+            CONNECTED = 1 << 0,
+            THROTTLED = 1 << 1
+        };
+        using F = fsm::Fsm<States, States::INITIAL, char>;
+        F test_fsm;
+        int32_t guard_calls = 0;
+        //CONNECTED置位且THROTTLED清零时进入A, 否则在guard函数通过时进入B
+        test_fsm.AddTransitions({
+            { States::INITIAL, States::A, 'a', nullptr, nullptr, { CONNECTED, THROTTLED } },
+            { States::INITIAL, States::B, 'a', [&guard_calls] { guard_calls++; return true; }, nullptr, { 0, CONNECTED } },
+        });
+
+        //未绑定标志字时视为0
+        EXPECT_EQ(test_fsm.Execute('a'), fsm::FSM_SUCCESS);
+        EXPECT_EQ(test_fsm.GetState(), States::B);
+        EXPECT_EQ(guard_calls, 1);
+
+        fsm::GuardFlags flags = CONNECTED | THROTTLED;
+        test_fsm.BindFlags(&flags);
+        test_fsm.Reset();
+        //两个转换的位掩码guard都不通过, guard函数不会被调用
+        EXPECT_EQ(test_fsm.Execute('a'), fsm::FSM_SUCCESS);
+        EXPECT_TRUE(test_fsm.IsInitial());
+        EXPECT_EQ(guard_calls, 1);
+
+        flags = CONNECTED;
+        EXPECT_EQ(test_fsm.Execute('a'), fsm::FSM_SUCCESS);
+        EXPECT_EQ(test_fsm.GetState(), States::A);
+
+        //以外部状态和标志字执行
+        States state = States::INITIAL;
+        EXPECT_EQ(test_fsm.Execute(state, 'a', 0), fsm::FSM_SUCCESS);
+        EXPECT_EQ(state, States::B);
+    }
+
+    //测试转换优先级
+    TEST(FsmTest, Priority)
+    {
+        enum class States
+        {
+            INITIAL,
+            A,
+            B,
+            C
+        };
+        using F = fsm::Fsm<States, States::INITIAL, char>;
+        F test_fsm;
+        //优先级高的先执行, 优先级相同时先添加的先执行
+        test_fsm.AddTransitions({
+            { States::INITIAL, States::A, 'a', nullptr, nullptr, { 0, 0 }, 0 },
+            { States::INITIAL, States::B, 'a', nullptr, nullptr, { 0, 0 }, 5 },
+            { States::INITIAL, States::C, 'a', nullptr, nullptr, { 0, 0 }, 5 },
+        });
+        EXPECT_EQ(test_fsm.Execute('a'), fsm::FSM_SUCCESS);
+        EXPECT_EQ(test_fsm.GetState(), States::B);
+
+        //批量添加同一状态的转换时同样按优先级排列
+        F bulk_fsm;
+        std::vector<F::Trans> trans_vec = {
+            { States::INITIAL, States::A, 'a', nullptr, nullptr, { 0, 0 }, -1 },
+            { States::INITIAL, States::C, 'a', nullptr, nullptr },
+        };
+        bulk_fsm.AddTransitions(States::INITIAL, trans_vec.begin(), trans_vec.end());
+        EXPECT_EQ(bulk_fsm.Execute('a'), fsm::FSM_SUCCESS);
+        EXPECT_EQ(bulk_fsm.GetState(), States::C);
+    }
+
+    //只能单遍读取的迭代器, 用于检查批量添加不会先求距离
+    template <typename It>
+    class SinglePass
+    {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = typename std::iterator_traits<It>::value_type;
+        using difference_type = typename std::iterator_traits<It>::difference_type;
+        using pointer = typename std::iterator_traits<It>::pointer;
+        using reference = typename std::iterator_traits<It>::reference;
+
+        explicit SinglePass(It it)
+            : it_(it)
+        {
+        }
+
+        reference operator*() const
+        {
+            return *it_;
+        }
+
+        SinglePass& operator++()
+        {
+            ++it_;
+            return *this;
+        }
+
+        SinglePass operator++(int)
+        {
+            SinglePass old = *this;
+            ++it_;
+            return old;
+        }
+
+        bool operator==(const SinglePass& other) const
+        {
+            return it_ == other.it_;
+        }
+
+        bool operator!=(const SinglePass& other) const
+        {
+            return it_ != other.it_;
+        }
+
+    private:
+        It it_;
+    };
+
+    //批量添加同一状态的转换: 输入迭代器, 以及from_state与from不一致时的断言
+    TEST(FsmTest, BulkAddTransitions)
+    {
+        enum class States
+        {
+            INITIAL,
+            A,
+            B
+        };
+        using F = fsm::Fsm<States, States::INITIAL, char>;
+        std::vector<F::Trans> trans_vec = {
+            { States::INITIAL, States::A, 'a', nullptr, nullptr },
+            { States::INITIAL, States::B, 'b', nullptr, nullptr },
+        };
+        F test_fsm;
+        using It = SinglePass<std::vector<F::Trans>::iterator>;
+        test_fsm.AddTransitions(States::INITIAL, It(trans_vec.begin()), It(trans_vec.end()));
+        EXPECT_EQ(test_fsm.GetTransitions().at(States::INITIAL).size(), 2u);
+        EXPECT_EQ(test_fsm.Execute('b'), fsm::FSM_SUCCESS);
+        EXPECT_EQ(test_fsm.GetState(), States::B);
+
+        std::vector<F::Trans> wrong = {
+            { States::A, States::B, 'a', nullptr, nullptr },
+        };
+        F wrong_fsm;
+        EXPECT_DEBUG_DEATH(wrong_fsm.AddTransitions(States::INITIAL, wrong.begin(), wrong.end()), "from_state == from");
+    }
+}
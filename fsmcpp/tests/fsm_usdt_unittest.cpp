@@ -0,0 +1,91 @@
+
+#include <googletest-1.10.0/include/gtest/gtest.h>
+#include <fsmcpp.hpp>
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <string>
+
+namespace
+{
+    enum class States
+    {
+        IDLE,
+        RUNNING
+    };
+
+    enum class Triggers
+    {
+        START = 7,
+        STOP
+    };
+
+    using F = fsm::Fsm<States, States::IDLE, Triggers>;
+
+    TEST(UsdtTest, ProbeArguments)
+    {
+        EXPECT_EQ(fsm::detail::ProbeArg(Triggers::START), 7);
+        EXPECT_EQ(fsm::detail::ProbeArg(int8_t(-3)), -3);
+        std::string text = "abc";
+        EXPECT_EQ(fsm::detail::ProbeArg(text), static_cast<int64_t>(reinterpret_cast<intptr_t>(&text)));
+    }
+
+    //跟踪点不改变Execute的行为
+    TEST(UsdtTest, ExecuteUnchanged)
+    {
+        bool allow = false;
+        F machine;
+        machine.AddTransitions({
+            { States::IDLE, States::RUNNING, Triggers::START, [&] { return allow; }, nullptr },
+            { States::RUNNING, States::IDLE, Triggers::STOP, nullptr, nullptr },
+        });
+        EXPECT_EQ(machine.Execute(Triggers::STOP), fsm::FSM_NO_MATCHING_TRIGGER);
+        EXPECT_EQ(machine.Execute(Triggers::START), fsm::FSM_SUCCESS);
+        EXPECT_EQ(machine.GetState(), States::IDLE);
+        allow = true;
+        EXPECT_EQ(machine.Execute(Triggers::START), fsm::FSM_SUCCESS);
+        EXPECT_EQ(machine.GetState(), States::RUNNING);
+
+        States unknown = static_cast<States>(5);
+        EXPECT_EQ(machine.Execute(unknown, Triggers::STOP), fsm::FSM_NO_MATCHING_TRIGGER);
+    }
+
+#if defined(__linux__) && !defined(FSM_DISABLE_USDT) && (defined(__x86_64__) || defined(__aarch64__))
+    //可执行文件的 .note.stapsdt 中有fsm的四个跟踪点
+    TEST(UsdtTest, NotesInExecutable)
+    {
+        std::ifstream file("/proc/self/exe", std::ios::binary);
+        ASSERT_TRUE(file.good());
+        std::string image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        //注释格式: namesz(4) descsz(4) type(4) "stapsdt\0" 地址(3*8) provider\0 name\0 args\0
+        std::set<std::string> probes;
+        const std::string owner("stapsdt\0", 8);
+        for (size_t pos = image.find(owner); pos != std::string::npos; pos = image.find(owner, pos + 1))
+        {
+            uint32_t header[3];
+            if (pos < sizeof(header))
+            {
+                continue;
+            }
+            std::memcpy(header, image.data() + pos - sizeof(header), sizeof(header));
+            if (header[0] != 8 || header[2] != 3 || pos + 8 + header[1] > image.size())
+            {
+                continue;
+            }
+            const char* desc = image.data() + pos + 8 + 24;
+            std::string provider(desc);
+            std::string name(desc + provider.size() + 1);
+            std::string args(desc + provider.size() + name.size() + 2);
+            if (provider == "fsm")
+            {
+                probes.insert(name);
+                EXPECT_EQ(args.compare(0, 3, "-8@"), 0) << args;
+            }
+        }
+        EXPECT_EQ(probes, (std::set<std::string>{ "execute", "guard_reject", "no_match", "transition" }));
+    }
+#endif
+}